@@ -38,6 +38,8 @@
   A3 - Current measurement
   A4 - SDA - I2C connection to RTC
   A5 - SCK - I2C connection to RTC
+  A6 - Thermistor (thermistor to 3.3V, 10k to ground). Was A0 with the vane before 19/10/26:
+       older boards need the thermistor divider moved to A6 to read temperature
   
   Counts pulses from a sensor (such as a anemometer or flow sensor)
   These are pulses are averaged into a wind speed.
@@ -63,7 +65,7 @@
   This will change the date to DDMMYY
   "S?????E"
   This will change the sample period to ????? seconds. Set to 00001 for 1 second data, set to 03600 for 1 hour data.
-  The minimum is 1 second data. The maximum is 99999 seconds
+  The minimum is 1 second data. The maximum is 65535 seconds
   "R??E"
   This will change the reference to ??. 
   "OE"
@@ -75,6 +77,8 @@
   R1 is the top resistor, R2 is the lower resistor.
   "I???E"
   This sets the current gain value, in mV/A
+  "P?????E"
+  This sets battery threshold ? (1 to 4) to ???? mV. See power.cpp.
  
   
   // Addedd Interrupt code from here:
@@ -104,6 +108,51 @@
   20/3/15  More work on V and I code. SMD design - Matt Little
   15/4/15  Re-doing code for new hardware - Matt Little
   21/4/15  Adding voltage and current calibration factors in serial - Matt Little
+  19/10/26 Interrupts post events to a queue, main loop sleeps until the queue is non-empty
+  19/10/26 Split data path into acquisition, aggregation, formatting and storage stages
+  19/10/26 LED patterns run from the watchdog interrupt instead of delay()
+  19/10/26 Normal/conserve/survival power states driven by battery voltage
+  19/10/26 Analog channels read by an interrupt driven ADC scan in ADC noise reduction sleep
+  19/10/26 Per-channel oversampling to 13 bits, integer maths for the analog conversions
+  19/10/26 Energy (Wh), charge (Ah), mean and peak power integrated every second
+  19/10/26 Daily power curve (0.5m/s bins) written to CYYMMDD.csv, readable over serial
+  19/10/26 Irradiance integrated every second: insolation, mean, min and max per period
+  19/10/26 Thermistor lookup table instead of log(), thermistor moved to A6 (was shared with the vane on A0)
+  19/10/26 Common period statistics for the analog channels, optional mean/sd/min/max columns (WRITE_CHANNEL_STATS)
+  19/10/26 Serial commands parsed as they arrive from a command table, with "?" queries and optional CRC
+  19/10/26 Data files listed and downloaded over serial in CRC checked, resumable blocks
+  19/10/26 Live binary telemetry at up to 10Hz in calibrate mode, for commissioning
+  19/10/26 Record echo can be turned off (U0E), sent from the TX interrupt in idle sleep instead of flush()
+  19/10/26 Settings kept in one versioned, CRC checked EEPROM block, defaults if it is corrupt
+  19/10/26 Energy totals, boot and record counts checkpointed to a wear-leveled EEPROM ring
+  19/10/26 All fields built in, the ones written chosen over serial (F command) and kept in EEPROM
+  19/10/26 Fields listed once (FIELD_LIST) for the ids, headers, writers and the host schema, column counts checked at compile time
+  19/10/26 Host build (host/) with a deterministic simulator
+  19/10/26 GPIOR0 section markers (BENCH_MARKERS) and a cycle benchmark under simavr (bench/)
+  19/10/26 Host build: FAT32 card image with sector, erase and latency counts (--card-image)
+  19/10/26 Host build: firmware stack high-water, and a year-long soak through power losses, card swaps and serial sessions (tools/soak.py)
+  19/10/26 RAM painted at reset, free and least free RAM with the H command and in the data file daily (RAM_MONITOR)
+  19/10/26 Trace ring of Timer1 stamped loop phases and interrupts, sent with the X command (TRACE_ENABLED, tools/trace_view.py)
+  19/10/26 Card detect interrupt held off until the change is handled, events lost to a full queue written to the data file
+  19/10/26 Nothing written to the card when all 10 of the day's files have other headers, shown by the error LED
+  19/10/26 Sum of squares and sd only kept with WRITE_CHANNEL_STATS, PStringToRAM buffer cut to 32 (headers are printed from flash)
+  19/10/26 A command ending in place of its index is answered at once, so the next command is read
+  19/10/26 10-bit current offset from older firmware scaled to the 13-bit result
+  19/10/26 Sample period in progress kept in the checkpoints and carried on after a reset
+  19/10/26 Temperature and external volts and amps left out of the default build again (READ_xxx can be set when compiling)
+  19/10/26 RAM_MONITOR off by default
+  19/10/26 Anemometer counter wraps counted in the pulse interrupts and latched with the period
+  19/10/26 ADC scans only started from idle, "OE" answers "ERR busy" rather than store a reading it didn't take
+  19/10/26 Board rework for temperature: thermistor divider moved from A0 (the vane) to A6, see the pin list
+  19/10/26 Statistics compile against the core's min()/max() macros, sd capped at 32767 at the int16_t extremes
+  19/10/26 Dates checked against the month length, "S?E" gives the sample time in use
+  19/10/26 Energy totals start from zero on the first checkpoint (no import from locations the original firmware never used)
+  19/10/26 Only the original firmware's EEPROM locations (0-12) are taken over into the settings block
+  19/10/26 Waiting for an ADC scan in calibrate mode uses idle sleep, so serial commands at the end of a period aren't lost
+  19/10/26 File listing and download left out of the default build (TRANSFER_ENABLED), as it didn't fit the flash
+  19/10/26 Live telemetry left out of the default build (TELEMETRY_ENABLED), as it didn't fit the flash
+  19/10/26 Checkpoints only built in with energy (CHECKPOINT_ENABLED), period data only kept for the channels built in,
+           event rows written straight into the data string, to fit the ATmega328P
   
   TO DO
   Sort out Voltage conversion (via serial) - implemented - TEST
@@ -131,31 +180,51 @@
 #include <Rtc_Pcf8563.h>   // RTC library
 #include <SdFat.h>            // SD card library
 #include <avr/pgmspace.h>  // Library for putting data into program memory
+#include <avr/sleep.h>     // For the sleep mode definitions
 #include <EEPROM.h>        // For writing values to the EEPROM
 
 /************ Application Libraries*****************************/
 
 #include "app.h"
+#include "events.h"
 #include "utility.h"
+#include "stats.h"
 #include "sleep.h"
+#include "led.h"
 #include "eeprom_storage.h"
 #include "battery.h"
+#include "power.h"
 #include "external_volts_amps.h"
 #include "serial_handler.h"
 #include "wind.h"
 #include "temperature.h"
 #include "rtc.h"
+#include "analog.h"
+#include "energy.h"
+#include "irradiance.h"
+#include "pipeline.h"
+#include "fields.h"
+#include "power_curve.h"
 #include "sd.h"
+#include "transfer.h"
+#include "telemetry.h"
+#include "checkpoint.h"
+#include "ram.h"
+#include "bench.h"
+#include "trace.h"
 
 /********* I/O Pins *************/
-#define RED_LED_PIN 4      // The output led is on pin 4
 #define CALIBRATE_PIN 6   // This controls if we are in serial calibrate mode or not
 
 #define FLASH_PERIOD (10)
-static int s_aliveFlashCounter = 0;  // This is used to count to give flash every 10 seconds
+static int s_aliveFlashCounter = 0;  // This is used to count to give flash every 10 seconds (counted on EVT_TICK)
 static bool s_debugFlag = false;    // Set this if you want to be in debugging mode.
 static bool s_error = false;
 static bool s_calibrate_mode = false;
+static uint8_t s_droppedEvents = 0;  // Events lost to a full queue, as last written to the data file
+#if RAM_MONITOR == 1
+static uint8_t s_diagnosticsDay = 0;  // Day of the month the diagnostics were last written (0 writes them after a reset)
+#endif
 
 //**********STRINGS TO USE****************************
 
@@ -163,29 +232,8 @@ static bool s_calibrate_mode = false;
 // These are a mixutre of error messages and serial printed information
 const char error[] PROGMEM = "ERROR";
 const char dateerror[] PROGMEM = "Date ERR";
-
-/***************************************************
- *  Name:        ledOn, ledOff
- *
- *  Returns:     Nothing.
- *
- *  Parameters:  None
- *
- *  Description: Turns status LED on or off            
- *
- ***************************************************/
-static void ledOn()
-{
-  pinMode(RED_LED_PIN,OUTPUT);
-  digitalWrite(RED_LED_PIN, HIGH);
-}
-
-static void ledOff()
-{
-  digitalWrite(RED_LED_PIN, LOW);
-  // Set LED to be an INPUT - saves power 
-  pinMode(RED_LED_PIN,INPUT);
-}
+const char eventsdropped[] PROGMEM = "Events dropped ";
+const char calibrate[] PROGMEM = "Calibrate";
 
 /***************************************************
  *  Name:        flashLED
@@ -194,36 +242,26 @@ static void ledOff()
  *
  *  Parameters:  None
  *
- *  Description: Per-second LED flash            
+ *  Description: Per-second LED flash.
+ *               Only starts the pattern, the LED module runs it
+ *               from the watchdog while the CPU sleeps.
  *
  ***************************************************/
 static void flashLED()
 {
-  pinMode(RED_LED_PIN,OUTPUT);
-    
-  if (s_error)
+  if (s_error || !SD_HasDataFile())
   {
-    for(int x=0;x<=5;x++)
-    {
-      digitalWrite(RED_LED_PIN, HIGH);
-      delay(5);
-      digitalWrite(RED_LED_PIN, LOW);
-      delay(50);     
-    }
+    LED_Signal(LED_PATTERN_ERROR);
   }
   else
   {
     // Flash the LED every FLASH_PERIOD seconds to show alive
     if(s_aliveFlashCounter >= FLASH_PERIOD)
     {
-      digitalWrite(RED_LED_PIN, HIGH);
-      delay(5);
-      digitalWrite(RED_LED_PIN, LOW); 
+      LED_Signal(LED_PATTERN_ALIVE);
       s_aliveFlashCounter=0;
     }
   }
-
-  pinMode(RED_LED_PIN,INPUT);
 }
 
 /***************************************************
@@ -233,16 +271,18 @@ static void flashLED()
  *
  *  Parameters:  None
  *
- *  Description: Per-second LED flash            
+ *  Description: Per-second calibration data output            
  *
  ***************************************************/
 static void handleCalibration()
 {
-  Serial.println("Calibrate");    
+  // Nothing else on the serial port in the middle of a file transfer,
+  // and the live telemetry frames replace the text output
+  if (XFER_IsActive() || TLM_IsActive()) { return; }
+
+  Serial.println(PStringToRAM(calibrate));
   SERIAL_HandleCalibrationData();
-  delay(500);  // Some time to read data
   SD_PrintDataToSerial(); 
-  Serial.flush();    // Force out the end of the serial data
 }
 
 /***************************************************
@@ -252,13 +292,222 @@ static void handleCalibration()
  *
  *  Parameters:  None.
  *
- *  Description: Read the SD card present and calibrate inputs.           
+ *  Description: Read the calibrate input.
+ *               Serial RX events are only wanted in calibrate mode.
  *
  ***************************************************/
 void readInputs()
 {
-  s_error = !SD_CardIsPresent();
-  s_calibrate_mode = (digitalRead(CALIBRATE_PIN)== HIGH);
+  bool calibrate_mode = (digitalRead(CALIBRATE_PIN)== HIGH);
+
+  if (calibrate_mode && !s_calibrate_mode)
+  {
+    SERIAL_EnableRxEvent();
+    // Keep the trace of the logger as it was running for the first X command
+    TRACE_Hold();
+  }
+  else if (!calibrate_mode && s_calibrate_mode)
+  {
+    SERIAL_DisableRxEvent();
+    XFER_Abort();
+    TLM_SetRate(0);
+  }
+
+  s_calibrate_mode = calibrate_mode;
+}
+
+/***************************************************
+ *  Name:        handleSecondTick
+ *
+ *  Returns:     Nothing.
+ *
+ *  Parameters:  None.
+ *
+ *  Description: Per-second work, run on EVT_TICK.
+ *
+ ***************************************************/
+static void handleSecondTick()
+{
+  BENCH_BEGIN(BENCH_TICK);
+  TRACE_BEGIN(TRACE_TICK);
+
+  s_aliveFlashCounter++;
+
+  readInputs();
+
+  // Acquisition stage - the readings are collected on EVT_ANALOG_SCAN_COMPLETE.
+  // The wind direction is measured every second to give good direction analysis
+  PIPE_StartAcquisition();
+
+  // The period in progress and the counters, every CHECKPOINT_INTERVAL
+  CHECKPOINT_SecondTick();
+  
+  flashLED();
+
+  WIND_Debug();
+
+  if(s_calibrate_mode)
+  {    
+    handleCalibration();
+  }
+
+  TRACE_END(TRACE_TICK);
+  BENCH_END(BENCH_TICK);
+}
+
+/***************************************************
+ *  Name:        updatePowerCurve
+ *
+ *  Returns:     Nothing.
+ *
+ *  Parameters:  The record just completed.
+ *
+ *  Description: Adds the period to the power curve bins,
+ *               writing out and clearing the bins at the end of each day.
+ *
+ ***************************************************/
+static void updatePowerCurve(const struct record * rec)
+{
+#if PCURVE_ENABLED
+  if (!FIELDS_IsEnabled(FIELD_WINDSPEED) || !FIELDS_IsEnabled(FIELD_ENERGY)) { return; }
+
+  if (PCURVE_DayHasEnded(&rec->time))
+  {
+    SD_WritePowerCurveFile(PCURVE_GetDate());
+    PCURVE_Reset();
+  }
+
+  PCURVE_AddPeriod(&rec->time, WIND_PulsesToSpeed(rec->pulses[0], rec->ticks), rec->energy.meanMilliwatts);
+#else
+  (void)rec;
+#endif
+}
+
+/***************************************************
+ *  Name:        writeDailyDiagnostics
+ *
+ *  Returns:     Nothing.
+ *
+ *  Parameters:  The day of the month of the period just completed.
+ *
+ *  Description: Writes the free RAM to the data file at the first
+ *               period after a reset and of each day.
+ *
+ ***************************************************/
+static void writeDailyDiagnostics(uint8_t day)
+{
+#if RAM_MONITOR == 1
+  if (day == s_diagnosticsDay) { return; }
+  s_diagnosticsDay = day;
+
+  // Anything still queued first, so the rows stay in order
+  SD_StoreRecords();
+  RAM_WriteDiagnostics();
+#else
+  (void)day;
+#endif
+}
+
+/***************************************************
+ *  Name:        writeDroppedEvents
+ *
+ *  Returns:     Nothing.
+ *
+ *  Parameters:  None.
+ *
+ *  Description: Writes a row to the data file when events have been
+ *               lost to a full queue since the last one, e.g.
+ *               "Events dropped 3" (the count since the reset).
+ *
+ ***************************************************/
+static void writeDroppedEvents()
+{
+  uint8_t dropped = EVT_GetDroppedCount();
+  if (dropped == s_droppedEvents) { return; }
+  s_droppedEvents = dropped;
+
+  // Anything still queued first, so the rows stay in order
+  SD_StoreRecords();
+
+  char count[4];
+  FixedLengthAccumulator * accum = SD_StartEventRow();
+  accum->writeString(PStringToRAM(eventsdropped));
+  accum->writeString(utoa(dropped, count, 10));
+  SD_WriteEventRow();
+}
+
+/***************************************************
+ *  Name:        handleEvent
+ *
+ *  Returns:     Nothing.
+ *
+ *  Parameters:  The event taken from the queue.
+ *
+ *  Description: Dispatches one event posted by an interrupt.
+ *
+ ***************************************************/
+static void handleEvent(EVENT evt)
+{
+  switch(evt)
+  {
+    case EVT_TICK:
+      handleSecondTick();
+      break;
+
+    case EVT_PERIOD_COMPLETE:
+    {
+      PIPE_CompletePeriod();
+      uint8_t day = PIPE_NewestRecord()->time.day;
+      updatePowerCurve(PIPE_NewestRecord());
+      CHECKPOINT_PeriodComplete();
+      POWER_Update( PIPE_NewestRecord()->channels[PIPE_CH_BATTERY].mean );
+      if (SD_StoreIsDue())
+      {
+        if (!LED_IsBusy())
+        {
+          LED_Signal(LED_PATTERN_WRITE);
+        }
+        SD_StoreRecords();
+      }
+      writeDailyDiagnostics(day);
+      writeDroppedEvents();
+      break;
+    }
+
+    case EVT_CARD_CHANGE:
+      s_error = !SD_HandleCardChange();
+      break;
+
+    case EVT_ANALOG_SCAN_COMPLETE:
+      TRACE_BEGIN(TRACE_SAMPLE);
+      PIPE_AcquireSample();
+      PIPE_Aggregate();
+      TRACE_END(TRACE_SAMPLE);
+      break;
+
+    case EVT_TRANSFER_BLOCK:
+      XFER_SendBlock();
+      break;
+
+    case EVT_TELEMETRY_FRAME:
+      // Frames are dropped while a file transfer has the serial port
+      if (!XFER_IsActive())
+      {
+        TLM_SendFrame();
+      }
+      break;
+
+    case EVT_SERIAL_RX:
+      SERIAL_HandleCalibrationData();
+      if (s_calibrate_mode)
+      {
+        SERIAL_EnableRxEvent();
+      }
+      break;
+
+    default:
+      break;
+  }
 }
 
 /***************************************************
@@ -273,15 +522,27 @@ void readInputs()
  ***************************************************/
 void setup()
 {
+  TRACE_Setup();
+
   Serial.begin(115200);
   Wire.begin();
 
+  // Everything else reads its settings from here
+  EEPROM_Setup();
+
+  // Before the headers are written
+  FIELDS_Setup();
+
+  LED_Setup();
+
   SD_Setup();
   
   //Set up digital data lines
   pinMode(CALIBRATE_PIN,INPUT_PULLUP);
   
   analogReference(EXTERNAL);  // This should be default, but just to be sure
+  ANALOG_Setup();
+  ANALOG_PrintResolution();
 
   // Analog lines
   pinMode(VANE_PIN,INPUT);
@@ -300,6 +561,8 @@ void setup()
   
   // Read in the sample time from EEPROM
   SD_SetSampleTime( EEPROM_GetSampleTime() );
+
+  SD_SetEchoEnabled( EEPROM_GetSerialEcho() );
   
   // Read the Current Voltage Offset from the EEROM
   VA_SetCurrentOffset( EEPROM_GetCurrentOffset() );
@@ -313,7 +576,19 @@ void setup()
   VA_SetCurrentGain( EEPROM_GetCurrentGain() );
   
   WIND_SetWindvanePosition( EEPROM_GetWindwavePosition() );
+
+  WIND_SetAnemometerCalibration( EEPROM_GetAnemometerSlope(), EEPROM_GetAnemometerOffset() );
+
+  // Restore the running energy totals and other counters, and count this boot
+  CHECKPOINT_Setup();
+
+  // Read the battery thresholds from EEPROM and start in normal power mode
+  POWER_Setup();
   
+  // Card detect changes are posted as events
+  SD_EnableCardDetectInterrupt();
+  s_error = !SD_CardIsPresent();
+
   // Interrupt for the 1Hz signal from the RTC
   RTC_EnableInterrupt();
 
@@ -333,45 +608,56 @@ void setup()
  ***************************************************/
 void loop()
 {
+  EVENT evt;
 
-  readInputs();
-
-  // *********** WIND DIRECTION **************************************  
-  // Want to measure the wind direction every second to give good direction analysis
-  // This can be checked every second and an average used
-  WIND_ConvertWindDirection(analogRead(VANE_PIN));    // Run this every second. It increments the windDirectionArray 
-  
-  flashLED();
-
-  if(SD_WriteIsPending())
-  {  
-    ledOn();
-    SD_WriteDataToCard();
-    // Finish up write routine here:    
-    ledOff();
-    Serial.flush();    // Force out the end of the serial data
+  // Handle every event in the order the interrupts posted them.
+  // Idle sleep wakes for interrupts that post none (Timer0, the USART), which aren't traced.
+  if (EVT_Get(&evt))
+  {
+    TRACE_BEGIN(TRACE_LOOP);
+    do
+    {
+      handleEvent(evt);
+    } while (EVT_Get(&evt));
+    TRACE_END(TRACE_LOOP);
   }
-   
-  WIND_Debug();
-  
-  if(s_calibrate_mode)
-  {    
-    handleCalibration();
+
+  // This function blocks in sleep until an interrupt posts the next event.
+  // Calibrate mode uses idle sleep so the USART keeps receiving, and so does
+  // serial output still in the transmit buffer, which the USART interrupt sends
+  // a byte at a time while the CPU sleeps.
+  // Power-down stops the ADC clock, so a running scan needs ADC noise reduction sleep.
+  uint8_t sleep_mode = SLEEP_MODE_PWR_DOWN;
+  if (s_calibrate_mode || SERIAL_TxPending())
+  {
+    sleep_mode = SLEEP_MODE_IDLE;
   }
   else
-  {     
-    // This function blocks in sleep until the next RTC interrupt
-    SLEEP_SetWakeOnRTCAndSleep();
-  }  
+  {
+    if (ANALOG_IsBusy())
+    {
+      sleep_mode = SLEEP_MODE_ADC;
+    }
+    // Both stop the USART clock: wait for the last byte or two to leave the shift register
+    Serial.flush();
+  }
+  SLEEP_SleepUntilEvent(sleep_mode);
 }
 
 /* 
  * APP_SecondTick
- * Called by the RTC handler every second
+ * Called by the RTC handler every second (interrupt context)
  */
 void APP_SecondTick()
 {
-  s_aliveFlashCounter++;  
+  EVT_Post(EVT_TICK);
+
+  if (SD_SecondTick())
+  {
+    // Latch the pulse counts before the period event is queued
+    WIND_LatchPulseCounts();
+    EVT_Post(EVT_PERIOD_COMPLETE);
+  }
 }
 
 /* 
@@ -382,3 +668,12 @@ bool APP_InDebugMode()
 {
   return s_debugFlag;
 }
+
+/* 
+ * APP_InCalibrateMode
+ * Used by other modules to check if the calibrate switch is on (serial commands may arrive)
+ */
+bool APP_InCalibrateMode()
+{
+  return s_calibrate_mode;
+}
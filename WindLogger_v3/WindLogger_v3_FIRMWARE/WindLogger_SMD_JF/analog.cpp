@@ -0,0 +1,539 @@
+/*
+ * analog.cpp
+ *
+ * Background ADC scanning for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "bench.h"
+#include "trace.h"
+#include "events.h"
+#include "utility.h"
+#include "stats.h"
+#include "eeprom_storage.h"
+#include "battery.h"
+#include "external_volts_amps.h"
+#include "irradiance.h"
+#include "temperature.h"
+#include "wind.h"
+#include "analog.h"
+
+/*
+ * A scan walks the requested channels, taking a number of conversions
+ * on each and adding them into a per-channel sum.
+ *
+ * Each conversion is started from the ADC conversion-complete interrupt,
+ * so the scan runs by itself while the main loop sleeps in SLEEP_MODE_ADC
+ * (ADC noise reduction - the CPU and I/O clocks are stopped during each conversion).
+ * When the scan finishes an EVT_ANALOG_SCAN_COMPLETE event is posted and
+ * the averages can be read without blocking.
+ *
+ * The first conversion after each mux change is thrown away, to give the
+ * sample and hold time to settle on the high impedance dividers.
+ *
+ * Oversampling and decimation: for n extra bits of resolution 4^n conversions
+ * are summed and the sum shifted right by n. This relies on a little noise
+ * on the input (a few counts) to dither between codes, which the sensor
+ * dividers provide. Each conversion takes ~104us with the core's /128 prescaler,
+ * so 3 extra bits (64 conversions) costs ~7ms of ADC sleep per channel per tick.
+ *
+ * Results are then shifted left to the common ANALOG_RESULT_BITS scale,
+ * so a 10-bit channel reads 0, 8, 16... and a 13-bit channel 0, 1, 2...
+ * ANALOG_GetEffectiveBits reports how many of those bits are real.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define NO_PIN 0xFF
+
+// ADMUX reference bits: AREF pin, to match analogReference(EXTERNAL)
+#define ANALOG_REFERENCE_BITS 0x00
+
+
+enum analog_state
+{
+	ANALOG_IDLE = 0,
+	ANALOG_BUSY,
+	ANALOG_READY
+};
+
+/*
+ * Private Variables
+ */
+
+// Analog pin for each channel, in analog_channel order
+static const uint8_t s_channelPins[ANALOG_CHANNEL_COUNT] PROGMEM = {
+	BATT_VOLTAGE_PIN,
+#if READ_EXTERNAL_VOLTS == 1
+	VOLTAGE_PIN,
+#else
+	NO_PIN,
+#endif
+#if READ_EXTERNAL_AMPS == 1
+	CURRENT_1_PIN,
+#else
+	NO_PIN,
+#endif
+#if READ_IRRADIANCE == 1
+	IRRADIANCE_PIN,
+#else
+	NO_PIN,
+#endif
+#if READ_TEMPERATURE == 1
+	THERMISTOR_PIN,
+#else
+	NO_PIN,
+#endif
+#if READ_WIND_DIRECTION == 1
+	VANE_PIN
+#else
+	NO_PIN
+#endif
+};
+
+// Default extra bits for each channel, used until set over serial
+static const uint8_t s_defaultExtraBits[ANALOG_CHANNEL_COUNT] PROGMEM = {
+	2,	// Battery: 12 bits is ~1mV at the pin
+	2,	// External voltage
+	3,	// External current: the shunt/hall signal needs the finest steps
+	2,	// Irradiance
+	1,	// Temperature
+	0	// Vane: only banded into eight sectors
+};
+
+// Short channel names for the resolution report
+static const char s_channelNames[ANALOG_CHANNEL_COUNT] PROGMEM = {'B', 'V', 'I', 'L', 'T', 'W'};
+
+static const char s_pstr_bits[] PROGMEM = "ADC bits:";
+
+static uint8_t s_enabledChannels = 0xFF;  // Of the channels built in, those the logged fields use
+
+static uint8_t s_extraBits[ANALOG_CHANNEL_COUNT];
+static uint8_t s_samples[ANALOG_CHANNEL_COUNT];  // Conversions per channel per scan (4^extra bits)
+
+static volatile uint32_t s_sums[ANALOG_CHANNEL_COUNT];
+static volatile uint8_t s_state = ANALOG_IDLE;
+static volatile uint8_t s_scanMask = 0;  // Channels still to be converted in this scan
+static volatile uint8_t s_channel = 0;  // Channel being converted
+static volatile uint8_t s_remaining = 0;  // Conversions left on this channel
+static volatile bool s_discard = false;  // Throw away the next conversion
+static volatile bool s_postEvent = false;  // Post an event when the scan is done
+
+/*
+ * Private Functions
+ */
+
+/*
+ * select_next_channel
+ * Moves the mux to the next channel in the scan mask.
+ * Returns false if there are no channels left.
+ */
+static bool select_next_channel(void)
+{
+	while (s_scanMask)
+	{
+		uint8_t ch = s_channel;
+		s_channel++;
+
+		if (s_scanMask & ANALOG_CHANNEL_BIT(ch))
+		{
+			s_scanMask &= ~ANALOG_CHANNEL_BIT(ch);
+			s_channel = ch;
+			s_remaining = s_samples[ch];
+			s_discard = true;
+			ADMUX = ANALOG_REFERENCE_BITS | ((pgm_read_byte(&s_channelPins[ch]) - A0) & 0x07);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * ADC conversion complete interrupt
+ * Accumulates the result and starts the next conversion.
+ */
+ISR(ADC_vect)
+{
+	BENCH_BEGIN(BENCH_ADC);
+	TRACE_OFTEN(TRACE_ADC);
+	uint16_t reading = ADC;
+
+	if (s_discard)
+	{
+		s_discard = false;
+	}
+	else
+	{
+		s_sums[s_channel] += reading;
+		s_remaining--;
+	}
+
+	if (s_remaining == 0)
+	{
+		s_channel++;
+		if (!select_next_channel())
+		{
+			ADCSRA &= ~_BV(ADIE);
+			s_state = ANALOG_READY;
+			if (s_postEvent)
+			{
+				EVT_Post(EVT_ANALOG_SCAN_COMPLETE);
+			}
+			TRACE(TRACE_ADC_SCAN);
+			BENCH_END(BENCH_ADC);
+			return;
+		}
+	}
+
+	ADCSRA |= _BV(ADSC);
+	BENCH_END(BENCH_ADC);
+}
+
+/*
+ * start_scan
+ * Starts a scan of the channels in the mask.
+ * Only from idle: the results of a finished scan must be released first, or they would be overwritten.
+ */
+static bool start_scan(uint8_t channel_mask, bool post_event)
+{
+	channel_mask &= ANALOG_GetAvailableChannels();
+
+	if ((s_state != ANALOG_IDLE) || (channel_mask == 0)) { return false; }
+
+	for (uint8_t ch = 0; ch < ANALOG_CHANNEL_COUNT; ch++)
+	{
+		s_sums[ch] = 0;
+	}
+
+	s_scanMask = channel_mask;
+	s_channel = 0;
+	s_postEvent = post_event;
+	s_state = ANALOG_BUSY;
+
+	select_next_channel();
+
+	// The ADC is re-enabled after each power-down sleep with the core's clock prescaler
+	ADCSRA |= _BV(ADEN) | _BV(ADIF);  // Writing ADIF clears any stale flag
+	ADCSRA |= _BV(ADIE) | _BV(ADSC);
+	return true;
+}
+
+/*
+ * wait_for_scan
+ * Sleeps in the given mode until the current scan (if any) is done
+ */
+static void wait_for_scan(uint8_t sleep_mode)
+{
+	set_sleep_mode(sleep_mode);
+
+	cli();
+	while (s_state == ANALOG_BUSY)
+	{
+		sleep_enable();
+		sei();  // The instruction after sei() always runs before any pending interrupt
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	sei();
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * ANALOG_Setup
+ * Called by application at startup.
+ * Reads the oversampling settings from EEPROM (the vane is fixed at 10 bits).
+ */
+void ANALOG_Setup(void)
+{
+	for (uint8_t ch = 0; ch < ANALOG_CHANNEL_COUNT; ch++)
+	{
+		uint8_t bits = (ch == ANALOG_CH_VANE) ? 0xFF : EEPROM_GetOversampleBits(ch);
+		if (bits > ANALOG_MAX_EXTRA_BITS)
+		{
+			bits = pgm_read_byte(&s_defaultExtraBits[ch]);
+		}
+		ANALOG_SetOversampling(ch, bits);
+	}
+}
+
+/*
+ * ANALOG_GetBuiltChannels
+ * Returns a mask of the channels built into this firmware
+ */
+uint8_t ANALOG_GetBuiltChannels(void)
+{
+	uint8_t mask = 0;
+	for (uint8_t ch = 0; ch < ANALOG_CHANNEL_COUNT; ch++)
+	{
+		if (pgm_read_byte(&s_channelPins[ch]) != NO_PIN)
+		{
+			mask |= ANALOG_CHANNEL_BIT(ch);
+		}
+	}
+	return mask;
+}
+
+/*
+ * ANALOG_GetAvailableChannels
+ * Returns a mask of the channels built in and enabled
+ */
+uint8_t ANALOG_GetAvailableChannels(void)
+{
+	return ANALOG_GetBuiltChannels() & s_enabledChannels;
+}
+
+/*
+ * ANALOG_SetEnabledChannels
+ * Sets which of the built in channels are scanned. The battery always is.
+ */
+void ANALOG_SetEnabledChannels(uint8_t channel_mask)
+{
+	s_enabledChannels = channel_mask | ANALOG_CHANNEL_BIT(ANALOG_CH_BATTERY);
+}
+
+/*
+ * ANALOG_PinsConflict
+ * Returns true if two channels in the mask are on the same pin
+ * (e.g. irradiance and external voltage on the standard board),
+ * so can't be enabled together
+ */
+bool ANALOG_PinsConflict(uint8_t channel_mask)
+{
+	uint8_t pins[ANALOG_CHANNEL_COUNT];
+	uint8_t count = 0;
+
+	channel_mask &= ANALOG_GetBuiltChannels();
+
+	for (uint8_t ch = 0; ch < ANALOG_CHANNEL_COUNT; ch++)
+	{
+		if (channel_mask & ANALOG_CHANNEL_BIT(ch))
+		{
+			uint8_t pin = pgm_read_byte(&s_channelPins[ch]);
+			for (uint8_t i = 0; i < count; i++)
+			{
+				if (pins[i] == pin) { return true; }
+			}
+			pins[count++] = pin;
+		}
+	}
+	return false;
+}
+
+/*
+ * ANALOG_SetOversampling
+ * Sets the number of extra bits (0 to ANALOG_MAX_EXTRA_BITS) on a channel
+ */
+void ANALOG_SetOversampling(uint8_t channel, uint8_t extra_bits)
+{
+	if ((channel >= ANALOG_CHANNEL_COUNT) || (s_state == ANALOG_BUSY)) { return; }
+
+	if (extra_bits > ANALOG_MAX_EXTRA_BITS) { extra_bits = ANALOG_MAX_EXTRA_BITS; }
+
+	s_extraBits[channel] = extra_bits;
+	s_samples[channel] = 1 << (2 * extra_bits);
+}
+
+/*
+ * ANALOG_StoreOversampling
+ * Called by application to set the extra bits on a channel
+ * and store in EEPROM
+ */
+void ANALOG_StoreOversampling(uint8_t channel, uint8_t extra_bits)
+{
+	if ((channel >= ANALOG_CH_VANE) || (extra_bits > ANALOG_MAX_EXTRA_BITS)) { return; }
+
+	ANALOG_SetOversampling(channel, extra_bits);
+	EEPROM_SetOversampleBits(channel, extra_bits);
+	ANALOG_PrintResolution();
+}
+
+/*
+ * ANALOG_GetOversampling
+ * Returns the extra bits set on a channel
+ */
+uint8_t ANALOG_GetOversampling(uint8_t channel)
+{
+	return (channel < ANALOG_CHANNEL_COUNT) ? s_extraBits[channel] : 0;
+}
+
+/*
+ * ANALOG_GetEffectiveBits
+ * Returns the real resolution of a channel's readings
+ */
+uint8_t ANALOG_GetEffectiveBits(uint8_t channel)
+{
+	return (channel < ANALOG_CHANNEL_COUNT) ? 10 + s_extraBits[channel] : 0;
+}
+
+/*
+ * ANALOG_PrintResolution
+ * Prints the effective bits of each channel in this build, e.g. "ADC bits:B12 I13 W10"
+ */
+void ANALOG_PrintResolution(void)
+{
+	uint8_t available = ANALOG_GetAvailableChannels();
+
+	Serial.print(PStringToRAM(s_pstr_bits));
+	for (uint8_t ch = 0; ch < ANALOG_CHANNEL_COUNT; ch++)
+	{
+		if (available & ANALOG_CHANNEL_BIT(ch))
+		{
+			Serial.print((char)pgm_read_byte(&s_channelNames[ch]));
+			Serial.print(ANALOG_GetEffectiveBits(ch));
+			Serial.print(' ');
+		}
+	}
+	Serial.println();
+}
+
+/*
+ * ANALOG_StartScan
+ * Starts a background scan of the channels in the mask.
+ * EVT_ANALOG_SCAN_COMPLETE is posted when it finishes.
+ * Returns false if a scan is already running, or the last one's results haven't been released.
+ */
+bool ANALOG_StartScan(uint8_t channel_mask)
+{
+	return start_scan(channel_mask, true);
+}
+
+/*
+ * ANALOG_IsBusy
+ * Returns TRUE while a scan is running (the main loop must not power-down)
+ */
+bool ANALOG_IsBusy(void)
+{
+	return s_state == ANALOG_BUSY;
+}
+
+/*
+ * ANALOG_WaitForScan
+ * Sleeps in ADC noise reduction mode until the current scan (if any) is done.
+ * That mode stops the USART clock, so in calibrate mode idle sleep is used instead,
+ * or a command arriving at the end of a period would be lost.
+ */
+void ANALOG_WaitForScan(void)
+{
+	wait_for_scan(APP_InCalibrateMode() ? SLEEP_MODE_IDLE : SLEEP_MODE_ADC);
+}
+
+/*
+ * ANALOG_ResultsReady
+ * Returns TRUE if a finished scan has not been released yet
+ */
+bool ANALOG_ResultsReady(void)
+{
+	return s_state == ANALOG_READY;
+}
+
+/*
+ * ANALOG_GetAverage
+ * Returns the decimated reading of a channel from the last finished scan,
+ * on the ANALOG_RESULT_BITS scale (0 if the channel was not in the scan)
+ */
+uint16_t ANALOG_GetAverage(uint8_t channel)
+{
+	if ((channel >= ANALOG_CHANNEL_COUNT) || (s_state != ANALOG_READY)) { return 0; }
+
+	uint8_t bits = s_extraBits[channel];
+	uint32_t decimated = s_sums[channel];
+
+	if (bits)
+	{
+		decimated = (decimated + (1UL << (bits - 1))) >> bits;
+		// Rounding up can carry past the top code
+		if (decimated >= (1UL << (10 + bits))) { decimated = (1UL << (10 + bits)) - 1; }
+	}
+
+	return (uint16_t)(decimated << (ANALOG_MAX_EXTRA_BITS - bits));
+}
+
+/*
+ * ANALOG_ReleaseResults
+ * Called once the results have been read, so a new scan can be started
+ */
+void ANALOG_ReleaseResults(void)
+{
+	if (s_state == ANALOG_READY)
+	{
+		s_state = ANALOG_IDLE;
+	}
+}
+
+/*
+ * ANALOG_Measure
+ * Takes an average of many readings of one channel into result, sleeping while it runs.
+ * The result is on the ANALOG_RESULT_BITS scale.
+ * Any background scan in progress is allowed to finish first. Returns false (and no result)
+ * if its results are still waiting to be collected, rather than lose them.
+ */
+bool ANALOG_Measure(uint8_t channel, uint8_t samples, uint16_t * result)
+{
+	if (channel >= ANALOG_CHANNEL_COUNT) { return false; }
+
+	ANALOG_WaitForScan();
+
+	uint8_t old_samples = s_samples[channel];
+	s_samples[channel] = samples ? samples : 1;
+
+	bool started = start_scan(ANALOG_CHANNEL_BIT(channel), false);
+	if (started)
+	{
+		ANALOG_WaitForScan();
+		uint8_t n = s_samples[channel];
+		*result = (uint16_t)(((s_sums[channel] << ANALOG_MAX_EXTRA_BITS) + (n / 2)) / n);
+		s_state = ANALOG_IDLE;
+	}
+
+	s_samples[channel] = old_samples;
+	return started;
+}
+
+/*
+ * ANALOG_ReadRaw
+ * Takes a single 10-bit conversion of each channel in the mask (0 for channels not read),
+ * for live displays. Waits in idle sleep so the USART keeps running - about 0.2ms per channel.
+ * Only runs when the ADC is idle, so a background scan and its results are never disturbed.
+ * Returns false if the ADC was in use.
+ */
+bool ANALOG_ReadRaw(uint8_t channel_mask, uint16_t * readings)
+{
+	uint8_t old_samples[ANALOG_CHANNEL_COUNT];
+
+	if (s_state != ANALOG_IDLE) { return false; }
+
+	memcpy(old_samples, s_samples, sizeof(old_samples));
+	memset(s_samples, 1, sizeof(s_samples));
+
+	bool started = start_scan(channel_mask, false);
+	if (started)
+	{
+		wait_for_scan(SLEEP_MODE_IDLE);
+		s_state = ANALOG_IDLE;
+	}
+
+	for (uint8_t ch = 0; ch < ANALOG_CHANNEL_COUNT; ch++)
+	{
+		readings[ch] = (started && (channel_mask & ANALOG_CHANNEL_BIT(ch))) ? (uint16_t)s_sums[ch] : 0;
+	}
+
+	memcpy(s_samples, old_samples, sizeof(old_samples));
+	return started;
+}
@@ -0,0 +1,53 @@
+#ifndef _ANALOG_H_
+#define _ANALOG_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// The analog channels walked by the background scan
+enum analog_channel
+{
+	ANALOG_CH_BATTERY = 0,
+	ANALOG_CH_EXT_VOLTS,
+	ANALOG_CH_EXT_AMPS,
+	ANALOG_CH_IRRADIANCE,
+	ANALOG_CH_TEMPERATURE,
+	ANALOG_CH_VANE,
+	ANALOG_CHANNEL_COUNT
+};
+
+#define ANALOG_CHANNEL_BIT(ch) (1 << (ch))
+
+// Oversampling: 4^n conversions are summed and decimated for n extra bits.
+// All readings are returned on one scale of ANALOG_RESULT_BITS, whatever the
+// channel's own setting, so the converters only need to know one full scale.
+#define ANALOG_MAX_EXTRA_BITS 3
+#define ANALOG_RESULT_BITS (10 + ANALOG_MAX_EXTRA_BITS)
+#define ANALOG_FULL_SCALE (1UL << ANALOG_RESULT_BITS)	// Counts for the reference voltage
+
+// Public Functions
+void ANALOG_Setup(void);
+
+uint8_t ANALOG_GetBuiltChannels(void);
+uint8_t ANALOG_GetAvailableChannels(void);
+void ANALOG_SetEnabledChannels(uint8_t channel_mask);
+bool ANALOG_PinsConflict(uint8_t channel_mask);
+void ANALOG_SetOversampling(uint8_t channel, uint8_t extra_bits);
+void ANALOG_StoreOversampling(uint8_t channel, uint8_t extra_bits);
+uint8_t ANALOG_GetOversampling(uint8_t channel);
+uint8_t ANALOG_GetEffectiveBits(uint8_t channel);
+void ANALOG_PrintResolution(void);
+
+bool ANALOG_StartScan(uint8_t channel_mask);
+bool ANALOG_IsBusy(void);
+void ANALOG_WaitForScan(void);
+
+bool ANALOG_ResultsReady(void);
+uint16_t ANALOG_GetAverage(uint8_t channel);
+void ANALOG_ReleaseResults(void);
+
+bool ANALOG_Measure(uint8_t channel, uint8_t samples, uint16_t * result);
+bool ANALOG_ReadRaw(uint8_t channel_mask, uint16_t * readings);
+
+#endif
@@ -5,23 +5,94 @@
  * Defines and typedefs
  */
 
-// If READ_WINDSPEED is 1, the windspeed will be read and included in serial data
+// Each READ_xxx set to 1 builds that field into the firmware.
+// Which of the built in fields are written is chosen at runtime with the "F" serial command
+// (see fields.h), so a logger can be changed in the field without reflashing.
+// The defaults are the fields the logger has always had. Each one built in costs flash and RAM,
+// so check a build with more of them with tools/budget.py. With energy (and so with every field) the firmware
+// doesn't fit the ATmega328P (see "Flash and RAM" in the README). The host build has them all.
+
+// Wind 1 and 2 pulse counts
+#ifndef READ_WINDSPEED
 #define READ_WINDSPEED 1
+#endif
 
-// If READ_WIND_DIRECTION is 1, the windspeed will be read and included in serial data
+// Wind vane direction
+#ifndef READ_WIND_DIRECTION
 #define READ_WIND_DIRECTION 1
+#endif
 
-// If READ_TEMPERATURE is 1, the temperature will be read and included in serial data
+// Thermistor temperature
+#ifndef READ_TEMPERATURE
 #define READ_TEMPERATURE 0
+#endif
 
-// If READ_IRRADIANCE is 1, the irradiance will be read and included in serial data
+// Irradiance (on the same pin as the external voltage on the standard board, so only one can be written)
+#ifndef READ_IRRADIANCE
 #define READ_IRRADIANCE 1
+#endif
 
-// If READ_EXTERNAL_VOLTS is 1, the external voltage will be read and included in serial data
+// External voltage
+#ifndef READ_EXTERNAL_VOLTS
 #define READ_EXTERNAL_VOLTS 0
+#endif
 
-// If READ_EXTERNAL_AMPS is 1, the external current will be read and included in serial data
+// External current (with the external voltage, also energy)
+#ifndef READ_EXTERNAL_AMPS
 #define READ_EXTERNAL_AMPS 0
+#endif
+
+// Energy is built in with both the external voltage and current
+#define READ_ENERGY ((READ_EXTERNAL_VOLTS == 1) && (READ_EXTERNAL_AMPS == 1))
+
+// If WRITE_CHANNEL_STATS is 1, each analog field is written as mean, sd, min and max
+// over the sample period instead of just the mean
+#define WRITE_CHANNEL_STATS 0
+
+// RAM_MONITOR 1 fills the free RAM with a pattern at reset, so the least free RAM since then (how deep
+// the stack has been) can be read with the "H" serial command, and is written to the data file once a day.
+// It costs flash and a little RAM, so it is off by default: build a logger with it to find the real stack
+// headroom. The host build leaves it out (host/sim/stack.cpp measures the stack there).
+#ifndef RAM_MONITOR
+#define RAM_MONITOR 0
+#endif
+
+// TRANSFER_ENABLED 1 builds in the file listing and download over serial ("L" and "G" commands, transfer.h,
+// tools/logger_files.py). TELEMETRY_ENABLED 1 builds in the live binary frames ("M" command, telemetry.h,
+// tools/live_view.py), which use Timer2. Both are off by default, as with them the firmware doesn't fit the
+// ATmega328P's flash (see "Flash and RAM" in the README). The host build has them.
+#ifndef TRANSFER_ENABLED
+#define TRANSFER_ENABLED 0
+#endif
+
+#ifndef TELEMETRY_ENABLED
+#define TELEMETRY_ENABLED 0
+#endif
+
+// CHECKPOINT_ENABLED 1 builds in the EEPROM checkpoints (checkpoint.h): the boot count, the energy totals and the
+// sample period in progress, kept across resets. They are built in with energy, whose totals would otherwise start
+// from zero at every reset, and left out otherwise for the flash (see "Flash and RAM" in the README).
+#ifndef CHECKPOINT_ENABLED
+#define CHECKPOINT_ENABLED READ_ENERGY
+#endif
+
+// TRACE_ENABLED 1 keeps a timestamp of each phase of the main loop and each interrupt in a ring in RAM
+// (trace.h, TRACE_LENGTH entries of 3 bytes), sent with the "X" serial command for tools/trace_view.py.
+// It uses Timer1. TRACE_FREQUENT 1 adds the interrupts that can come many times a second (the anemometer
+// pulses, every ADC conversion and the telemetry timer), which soon fill the ring in a wind.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+#ifndef TRACE_FREQUENT
+#define TRACE_FREQUENT 0
+#endif
+
+// BENCH_MARKERS 1 marks the sections the cycle benchmark (bench/) times, with writes to GPIOR0.
+// The benchmark build sets it on the command line, leave it 0 here.
+#ifndef BENCH_MARKERS
+#define BENCH_MARKERS 0
+#endif
 
 /*
  * Application functions
@@ -29,5 +100,6 @@
 
 void APP_SecondTick();
 bool APP_InDebugMode();
+bool APP_InCalibrateMode();
 
 #endif
@@ -9,35 +9,37 @@
 
 #include <Arduino.h>
 
+#include "app.h"
 #include "utility.h"
+#include "stats.h"
+#include "analog.h"
 #include "battery.h"
 
 /* 
- * Private Variables
+ * Public Functions
  */
-static char s_batteryVoltStr[6];      // Hold the battery voltage as a string
 
 /* 
- * Public Functions
+ * BATT_ReadingToMillivolts
+ * Converts an ADC reading to the battery voltage in mV (integer only)
  */
+uint16_t BATT_ReadingToMillivolts(uint16_t reading)
+{
+	// 3300mV over the full scale, then x(470k+100k)/100k for the divider
+	return (uint16_t)(((uint32_t)reading * 3300UL * 57UL) / (ANALOG_FULL_SCALE * 10UL));
+}
 
 /* 
- * BATT_UpdateBatteryVoltage
- * Called by application to set new battery voltage from ADC reading
+ * BATT_WriteVoltageToBuffer
+ * Called by application to write the battery voltage for the period (in mV)
  */
-void BATT_UpdateBatteryVoltage(void)
+void BATT_WriteVoltageToBuffer(const struct stats_summary * millivolts, FixedLengthAccumulator * accum)
 {
+	if (!millivolts || !accum) { return; }
+
 	// *********** BATTERY VOLTAGE ***************************************
     // From Vcc-470k-DATA-100k-GND potential divider
     // This is to test in case battery voltage has dropped too low - alert?
-    float batteryVoltage;
-    batteryVoltage = float(analogRead(BATT_VOLTAGE_PIN))*(3.3f/1024.0f)*((470.0f+100.0f)/100.0f);        // Temporary store for float
-    dtostrf(batteryVoltage, 2, 2, s_batteryVoltStr);     // Hold the battery voltage as a string
-}
-
-
-void BATT_WriteVoltageToBuffer(FixedLengthAccumulator * accum)
-{
-	if (!accum) { return; }
-	accum->writeString(s_batteryVoltStr);
+    // Written with two decimal places, rounded from the mV values
+    STATS_WriteSummaryToBuffer(millivolts, 3, 2, accum);
 }
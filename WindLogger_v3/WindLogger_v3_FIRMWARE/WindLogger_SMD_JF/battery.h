@@ -4,8 +4,11 @@
 // Defines
 #define BATT_VOLTAGE_PIN A1   // The battery voltage with a potential divider (470k//100k)
 
+#define BATTERY_HEADERS STATS_HEADERS("Batt V")
+#define BATTERY_COLUMNS STATS_COLUMNS
+
 // Public Functions
-void BATT_UpdateBatteryVoltage(void);
-void BATT_WriteVoltageToBuffer(FixedLengthAccumulator * accum);
+uint16_t BATT_ReadingToMillivolts(uint16_t reading);
+void BATT_WriteVoltageToBuffer(const struct stats_summary * millivolts, FixedLengthAccumulator * accum);
 
 #endif
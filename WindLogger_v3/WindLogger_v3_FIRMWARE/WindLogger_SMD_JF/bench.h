@@ -0,0 +1,30 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// Code sections timed by the cycle benchmark (bench/).
+// Each is marked by writing its number to GPIOR0 at the start, and with BENCH_END_FLAG at the end.
+enum bench_section
+{
+	BENCH_PULSE = 1,	// Anemometer 1 pulse interrupt
+	BENCH_ADC,			// ADC conversion complete interrupt
+	BENCH_TICK,			// Per-second work on EVT_TICK
+	BENCH_RECORD,		// Turning the period into a record (PIPE_CompletePeriod)
+	BENCH_WRITE			// Writing one record to the card
+};
+
+#define BENCH_END_FLAG 0x80
+
+#if BENCH_MARKERS == 1
+// A single OUT instruction each
+#define BENCH_BEGIN(section) (GPIOR0 = (section))
+#define BENCH_END(section) (GPIOR0 = ((section) | BENCH_END_FLAG))
+#else
+#define BENCH_BEGIN(section)
+#define BENCH_END(section)
+#endif
+
+#endif
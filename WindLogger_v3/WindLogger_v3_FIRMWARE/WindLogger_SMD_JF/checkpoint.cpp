@@ -0,0 +1,396 @@
+/*
+ * checkpoint.cpp
+ *
+ * Wear-leveled EEPROM storage of counters for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "utility.h"
+#include "stats.h"
+#include "eeprom_storage.h"
+#include "rtc.h"
+#include "analog.h"
+#include "energy.h"
+#include "wind.h"
+#include "pipeline.h"
+#include "sd.h"
+#include "checkpoint.h"
+
+#if CHECKPOINT_ENABLED == 1
+
+/*
+ * The counters change all the time, so rather than rewrite one location
+ * (which would wear it out in weeks at the EEPROM's 100,000 writes) each
+ * checkpoint goes in the next slot of a ring filling the free EEPROM:
+ *
+ *  slot - checkpoint, period in progress, uint32 sequence, CRC-16/XMODEM of the rest
+ *
+ * Checkpoint n always goes in slot n % RING_SLOTS, so each cell is written
+ * once every RING_SLOTS checkpoints (tools/checkpoint_sim.py works out
+ * the lifetime). Going round the ring the sequence counts up by one from
+ * slot 0 until the first slot still holding the lap before, so the newest
+ * slot is found with a binary search of the sequences: 4 reads for the
+ * 7 slots, however full the ring is.
+ *
+ * The CRC is written after the rest of the slot, so a write cut short by
+ * a reset fails its CRC and the slot before it is used.
+ *
+ * The period in progress is its statistics, pulse and direction counts and
+ * energy so far, and how far into it the checkpoint was. At startup it is
+ * carried on if the RTC says it hasn't ended yet (the logger was off for
+ * less than the rest of it, and it is the same day), so the record has
+ * everything but the samples missed while the logger was off.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+struct slot
+{
+	struct checkpoint data;
+	struct period_checkpoint period;
+	uint32_t sequence;
+	uint16_t crc;	// Of everything before it
+} __attribute__((packed));
+
+#define RING_SLOTS ((uint8_t)((EEPROM_RING_END - EEPROM_RING_START) / sizeof(struct slot)))
+
+static_assert((EEPROM_RING_END - EEPROM_RING_START) / sizeof(struct slot) >= 2, "No room for the checkpoint ring");
+static_assert((EEPROM_RING_END - EEPROM_RING_START) / sizeof(struct slot) <= 255, "Too many checkpoint slots");
+
+#define ERASED_SEQUENCE 0xFFFFFFFFUL
+#define NO_SLOT 0xFF
+
+/*
+ * Private Variables
+ */
+
+static struct checkpoint s_checkpoint;
+static uint32_t s_nextSequence = 0;
+static uint16_t s_secondsSinceSave = 0;
+
+static const char s_pstr_boot[] PROGMEM = "Boot ";
+static const char s_pstr_fresh[] PROGMEM = "Checkpoints: none found";
+static const char s_pstr_period[] PROGMEM = "Period continued at ";
+
+/*
+ * Private Functions
+ */
+
+static uint8_t * slot_address(uint8_t index)
+{
+	return (uint8_t *)(EEPROM_RING_START + (index * sizeof(struct slot)));
+}
+
+static uint32_t read_sequence(uint8_t index)
+{
+	return eeprom_read_dword((const uint32_t *)(slot_address(index) + offsetof(struct slot, sequence)));
+}
+
+/*
+ * slot_is_complete
+ * Returns true if the slot holds a complete checkpoint, read straight from
+ * the EEPROM so that no copy of a slot is needed
+ */
+static bool slot_is_complete(uint8_t index)
+{
+	const uint8_t * address = slot_address(index);
+	uint32_t sequence = read_sequence(index);
+	uint16_t crc = 0;
+
+	if ((sequence == ERASED_SEQUENCE) || ((sequence % RING_SLOTS) != index)) { return false; }
+
+	for (uint8_t i = 0; i < offsetof(struct slot, crc); i++)
+	{
+		crc = _crc_xmodem_update(crc, eeprom_read_byte(address + i));
+	}
+	return crc == eeprom_read_word((const uint16_t *)(address + offsetof(struct slot, crc)));
+}
+
+/*
+ * write_part
+ * Writes part of a slot, adding it to the CRC. Only changed bytes are written.
+ */
+static void write_part(uint8_t * address, const void * data, uint8_t length, uint16_t * crc)
+{
+	const uint8_t * p = (const uint8_t *)data;
+
+	for (uint8_t i = 0; i < length; i++)
+	{
+		*crc = _crc_xmodem_update(*crc, p[i]);
+	}
+	eeprom_update_block(data, address, length);
+}
+
+/*
+ * find_newest
+ * Returns the last slot whose sequence follows on from slot 0's
+ */
+static uint8_t find_newest(void)
+{
+	uint32_t first = read_sequence(0);
+	uint8_t low = 0;
+	uint8_t high = RING_SLOTS - 1;
+
+	// Slot low is always in the current lap
+	while (low < high)
+	{
+		uint8_t mid = (low + high + 1) / 2;
+
+		if ((read_sequence(mid) - first) == mid)
+		{
+			low = mid;
+		}
+		else
+		{
+			high = mid - 1;
+		}
+	}
+	return low;
+}
+
+/*
+ * recover
+ * Returns the slot with the newest complete checkpoint, or NO_SLOT if there are none
+ */
+static uint8_t recover(void)
+{
+	uint8_t newest = find_newest();
+
+	if (slot_is_complete(newest)) { return newest; }
+
+	// The last write was cut short: the slot before it has the last checkpoint
+	uint8_t before = (newest == 0) ? (RING_SLOTS - 1) : (newest - 1);
+	if (slot_is_complete(before)) { return before; }
+
+	// Otherwise look at every slot for the highest sequence
+	uint8_t found = NO_SLOT;
+
+	for (uint8_t i = 0; i < RING_SLOTS; i++)
+	{
+		if (slot_is_complete(i) && ((found == NO_SLOT) || (read_sequence(i) > read_sequence(found))))
+		{
+			found = i;
+		}
+	}
+	return found;
+}
+
+/*
+ * seconds_of_day, seconds_since
+ * Seconds from an earlier time the same day to now, or -1 if it wasn't the same day
+ */
+static long seconds_of_day(const struct timestamp * ts)
+{
+	return ((long)ts->hour * 3600L) + ((long)ts->minute * 60L) + ts->second;
+}
+
+static long seconds_since(const struct timestamp * then, const struct timestamp * now)
+{
+	if ((then->year != now->year) || (then->month != now->month) || (then->day != now->day)) { return -1; }
+
+	return seconds_of_day(now) - seconds_of_day(then);
+}
+
+/*
+ * save_period, restore_period
+ * Collect the period in progress from each module into a slot, and give it back
+ * to them if it is still in progress. It is written and read a part at a time,
+ * in the order of struct period_checkpoint (so the CRC is the same), rather than
+ * through a copy of it on the stack.
+ */
+#define PERIOD_PART(address, member) ((address) + offsetof(struct slot, period) + offsetof(struct period_checkpoint, member))
+
+static void save_period(uint8_t * address, uint16_t * crc)
+{
+	struct timestamp now;
+	uint16_t seconds = (uint16_t)SD_GetCounter();
+	uint16_t ticks = PIPE_GetPeriod();
+	int32_t pulses[2] = {(int32_t)WIND_GetLivePulseCount(0), (int32_t)WIND_GetLivePulseCount(1)};
+	uint16_t directions[8];
+	struct energy_period energy;
+	struct channel_period channel;
+
+	RTC_GetTimestamp(&now);
+	write_part(PERIOD_PART(address, time), &now, sizeof(now), crc);
+	write_part(PERIOD_PART(address, seconds), &seconds, sizeof(seconds), crc);
+	write_part(PERIOD_PART(address, ticks), &ticks, sizeof(ticks), crc);
+	write_part(PERIOD_PART(address, pulses), pulses, sizeof(pulses), crc);
+	WIND_GetDirectionCounts(directions);
+	write_part(PERIOD_PART(address, directions), directions, sizeof(directions), crc);
+	ENERGY_GetPeriod(&energy);
+	write_part(PERIOD_PART(address, energy), &energy, sizeof(energy), crc);
+
+	for (uint8_t ch = 0; ch < PIPE_ANALOG_CHANNELS; ch++)
+	{
+		PIPE_GetPeriodChannel(ch, &channel);
+		write_part(PERIOD_PART(address, channels) + (ch * sizeof(channel)), &channel, sizeof(channel), crc);
+	}
+}
+
+static void restore_period(const uint8_t * address)
+{
+	struct timestamp then, now;
+	uint16_t directions[8];
+	int32_t saved_pulses[2];
+	struct energy_period energy;
+	struct channel_period channel;
+	long seconds;
+
+	eeprom_read_block(&then, PERIOD_PART(address, time), sizeof(then));
+	RTC_GetTimestamp(&now);
+	seconds = seconds_since(&then, &now);
+	if (seconds < 0) { return; }
+
+	seconds += eeprom_read_word((const uint16_t *)PERIOD_PART(address, seconds));
+	if (!SD_ContinuePeriod(seconds)) { return; }
+
+	PIPE_SetPeriod(eeprom_read_word((const uint16_t *)PERIOD_PART(address, ticks)));
+	for (uint8_t ch = 0; ch < PIPE_ANALOG_CHANNELS; ch++)
+	{
+		eeprom_read_block(&channel, PERIOD_PART(address, channels) + (ch * sizeof(channel)), sizeof(channel));
+		PIPE_SetPeriodChannel(ch, &channel);
+	}
+
+	eeprom_read_block(saved_pulses, PERIOD_PART(address, pulses), sizeof(saved_pulses));
+	long pulses[2] = {saved_pulses[0], saved_pulses[1]};
+	WIND_SetLivePulseCounts(pulses);
+	eeprom_read_block(directions, PERIOD_PART(address, directions), sizeof(directions));
+	WIND_SetDirectionCounts(directions);
+	eeprom_read_block(&energy, PERIOD_PART(address, energy), sizeof(energy));
+	ENERGY_SetPeriod(&energy);
+
+	Serial.print(PStringToRAM(s_pstr_period));
+	Serial.println(seconds);
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * CHECKPOINT_Setup
+ * Called by application at startup, after EEPROM_Setup, RTC_Setup and SD_SetSampleTime.
+ * Restores the counters and the period in progress, and counts the boot.
+ */
+void CHECKPOINT_Setup(void)
+{
+	uint8_t newest = recover();
+
+	if (newest != NO_SLOT)
+	{
+		const uint8_t * address = slot_address(newest);
+
+		eeprom_read_block(&s_checkpoint, address + offsetof(struct slot, data), sizeof(s_checkpoint));
+		s_nextSequence = read_sequence(newest) + 1;
+
+		restore_period(address);
+	}
+	else
+	{
+		// First start of the ring: the original firmware kept no totals, so they start from zero
+		memset(&s_checkpoint, 0, sizeof(s_checkpoint));
+		s_nextSequence = 0;
+
+		Serial.println(PStringToRAM(s_pstr_fresh));
+	}
+
+	ENERGY_SetTotals(s_checkpoint.wattHours, s_checkpoint.milliwattHours, s_checkpoint.ampHours, s_checkpoint.milliampHours);
+
+	s_checkpoint.boots++;
+	CHECKPOINT_Save();
+
+	Serial.print(PStringToRAM(s_pstr_boot));
+	Serial.println(s_checkpoint.boots);
+}
+
+/*
+ * CHECKPOINT_SecondTick
+ * Called by application every second.
+ * Writes a checkpoint if CHECKPOINT_INTERVAL has passed since the last one,
+ * unless a sample period has just ended: its record hasn't been made yet,
+ * so CHECKPOINT_PeriodComplete writes it instead.
+ */
+void CHECKPOINT_SecondTick(void)
+{
+	if (s_secondsSinceSave < CHECKPOINT_INTERVAL) { s_secondsSinceSave++; }
+
+	if ((s_secondsSinceSave >= CHECKPOINT_INTERVAL) && (SD_GetCounter() != 0))
+	{
+		CHECKPOINT_Save();
+	}
+}
+
+/*
+ * CHECKPOINT_PeriodComplete
+ * Called by application at the end of each sample period, once its record has been made
+ */
+void CHECKPOINT_PeriodComplete(void)
+{
+	s_checkpoint.records++;
+
+	if (s_secondsSinceSave >= CHECKPOINT_INTERVAL)
+	{
+		CHECKPOINT_Save();
+	}
+}
+
+/*
+ * CHECKPOINT_Save
+ * Writes a checkpoint now (e.g. when the battery is failing)
+ */
+void CHECKPOINT_Save(void)
+{
+	long wattHours, milliwattHours, ampHours, milliampHours;
+	uint32_t sequence = s_nextSequence++;
+	uint16_t crc = 0;
+
+	ENERGY_GetTotals(&wattHours, &milliwattHours, &ampHours, &milliampHours);
+	s_checkpoint.wattHours = wattHours;
+	s_checkpoint.milliwattHours = (int16_t)milliwattHours;
+	s_checkpoint.ampHours = ampHours;
+	s_checkpoint.milliampHours = (int16_t)milliampHours;
+
+	// The CRC goes last, on its own, since eeprom_update_block doesn't promise an order
+	uint8_t * address = slot_address(sequence % RING_SLOTS);
+	write_part(address + offsetof(struct slot, data), &s_checkpoint, sizeof(s_checkpoint), &crc);
+	save_period(address, &crc);
+	write_part(address + offsetof(struct slot, sequence), &sequence, sizeof(sequence), &crc);
+	eeprom_update_word((uint16_t *)(address + offsetof(struct slot, crc)), crc);
+
+	s_secondsSinceSave = 0;
+}
+
+uint16_t CHECKPOINT_GetBootCount(void)
+{
+	return s_checkpoint.boots;
+}
+
+uint32_t CHECKPOINT_GetRecordCount(void)
+{
+	return s_checkpoint.records;
+}
+
+#else
+
+void CHECKPOINT_Setup(void) {}
+void CHECKPOINT_SecondTick(void) {}
+void CHECKPOINT_PeriodComplete(void) {}
+void CHECKPOINT_Save(void) {}
+uint16_t CHECKPOINT_GetBootCount(void) { return 0; }
+uint32_t CHECKPOINT_GetRecordCount(void) { return 0; }
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// A checkpoint is written this often (seconds)
+#define CHECKPOINT_INTERVAL 600
+
+// Counters kept across resets and brown-outs
+struct checkpoint
+{
+	uint16_t boots;
+	uint32_t records;		// Sample periods completed since the ring was started
+	int32_t wattHours;		// Energy totals (see energy.cpp), whole part
+	int16_t milliwattHours;	// and the remainder
+	int32_t ampHours;
+	int16_t milliampHours;
+} __attribute__((packed));
+
+// The sample period in progress, carried on after a reset if it hasn't ended by then
+struct period_checkpoint
+{
+	struct timestamp time;	// When it was saved
+	uint16_t seconds;		// Into the period
+	uint16_t ticks;			// Samples in the period statistics
+	int32_t pulses[2];
+	uint16_t directions[8];
+	struct energy_period energy;
+	struct channel_period channels[PIPE_ANALOG_CHANNELS];	// By analog channel
+} __attribute__((packed));
+
+// Public Functions
+
+void CHECKPOINT_Setup(void);
+void CHECKPOINT_SecondTick(void);
+void CHECKPOINT_PeriodComplete(void);
+void CHECKPOINT_Save(void);
+
+uint16_t CHECKPOINT_GetBootCount(void);
+uint32_t CHECKPOINT_GetRecordCount(void);
+
+#endif
@@ -10,13 +10,78 @@
 /************ External Libraries*****************************/
 #include <Arduino.h>
 #include <EEPROM.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+/************ Application Libraries*****************************/
+#include "utility.h"
+#include "analog.h"
+#include "power.h"
+#include "eeprom_storage.h"
+
+/*
+ * The settings are kept as one packed block, read into RAM in one go at startup:
+ *
+ *  header - version, size of the values and a CRC-16/XMODEM of the values
+ *  values - the settings themselves
+ *
+ * The EEPROM_GetXXX functions read the RAM copy. EEPROM_SetXXX change it and
+ * write the block back with eeprom_update_block, which only writes the bytes
+ * that have changed (the value and the CRC).
+ *
+ * A block that fails its CRC (a fresh chip, or one corrupted by a brown-out
+ * during a write) is replaced with the defaults, so a unit never runs on
+ * garbage settings. New values must only ever be added to the end of
+ * config_values and the version increased: an older block then loads over the
+ * defaults and the new values keep theirs.
+ *
+ * The block sits above the per-value locations the original firmware used (0-12).
+ * If the block has never been written, values at those locations that are in range
+ * are taken over, so updating the firmware doesn't lose a logger's calibration.
+ *
+ * The counters that change all the time (energy totals, boot count) are kept
+ * in the wear-leveled ring above the block, see checkpoint.cpp.
+ */
 
 /*
  * Defines and Typedefs
  */
 
+#define CONFIG_VERSION 2
+#define CONFIG_LOCATION 64
+
+struct config_header
+{
+	uint8_t version;
+	uint8_t size;	// sizeof(struct config_values) when written
+	uint16_t crc;
+} __attribute__((packed));
+
+struct config_values
+{
+	char device_id[2];
+	uint16_t sample_time;
+	uint16_t current_offset;
+	uint16_t r1;
+	uint16_t r2;
+	uint16_t current_gain;
+	uint8_t windvane_position;
+	uint16_t power_thresholds[POWER_THRESHOLD_COUNT];	// 0xFFFF = power.cpp default
+	uint8_t oversample_bits[ANALOG_CH_VANE];			// 0xFF = analog.cpp default
+	uint16_t anemometer_slope;							// 0xFFFF = wind.cpp default
+	uint16_t anemometer_offset;							// 0xFFFF = wind.cpp default
+	uint8_t serial_echo;
+	uint8_t field_mask;									// 0xFF = fields.cpp default (version 2)
+} __attribute__((packed));
+
+struct config
+{
+	struct config_header header;
+	struct config_values values;
+} __attribute__((packed));
+
 /*
- * An enumeration of the EEPROM storage locations.
+ * Locations the original firmware used, before the settings block
  * Byte-wise indexing, so take datatype length into account
  */
 
@@ -31,13 +96,156 @@ enum eeprom_locations_enum
 	LOC_WINDVANE_POSITION = 12
 };
 
+#if CONFIG_LOCATION <= LOC_WINDVANE_POSITION
+#error "Settings block overlaps the old EEPROM locations"
+#endif
+
+static_assert(CONFIG_LOCATION + sizeof(struct config) <= EEPROM_RING_START, "Settings block overlaps the checkpoint ring");
+
+/*
+ * Private Variables
+ */
+
+static const struct config_values s_defaults PROGMEM = {
+	{'0', '0'},		// Device ID
+	600,			// Sample time (s)
+	4096,			// Current offset: half the 13-bit scale
+	100, 10,		// R1, R2 (k Ohm): 0 to 36V
+	100,			// Current gain (mV/A)
+	0,				// Windvane at the bottom of the divider
+	{0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF},
+	{0xFF, 0xFF, 0xFF, 0xFF, 0xFF},
+	0xFFFF, 0xFFFF,
+	1,				// Serial echo on
+	0xFF			// Fields
+};
+
+static const char s_pstr_config_defaults[] PROGMEM = "EEPROM: defaults";
+static const char s_pstr_config_old[] PROGMEM = "EEPROM: old settings";
+
+static struct config s_config;
+
+/*
+ * Private Functions
+ */
+
+/*
+ * values_crc
+ * Returns the CRC of the first size bytes of the values
+ */
+static uint16_t values_crc(uint8_t size)
+{
+	uint16_t crc = 0;
+	const uint8_t * p = (const uint8_t *)&s_config.values;
+
+	for (uint8_t i = 0; i < size; i++)
+	{
+		crc = _crc_xmodem_update(crc, p[i]);
+	}
+	return crc;
+}
+
+/*
+ * save
+ * Writes the RAM copy back, changed bytes only
+ */
+static void save(void)
+{
+	s_config.header.version = CONFIG_VERSION;
+	s_config.header.size = sizeof(s_config.values);
+	s_config.header.crc = values_crc(sizeof(s_config.values));
+
+	eeprom_update_block(&s_config, (void *)CONFIG_LOCATION, sizeof(s_config));
+}
+
+/*
+ * read_old_word
+ * Returns the value at an old per-value location (high byte first)
+ * if it is in range, otherwise value. Erased EEPROM (0xFFFF) never is.
+ */
+static uint16_t read_old_word(int loc, uint16_t min, uint16_t max, uint16_t value)
+{
+	uint16_t old = (EEPROM.read(loc) << 8) + EEPROM.read(loc + 1);
+
+	return ((old != 0xFFFF) && (old >= min) && (old <= max)) ? old : value;
+}
+
+/*
+ * read_old_locations
+ * Takes over the in-range values written by the original firmware,
+ * with the same limits as the serial commands. The settings it didn't have keep their defaults.
+ */
+static void read_old_locations(void)
+{
+	struct config_values * v = &s_config.values;
+	char id[2] = {(char)EEPROM.read(LOC_DEVICE_ID), (char)EEPROM.read(LOC_DEVICE_ID + 1)};
+
+	if ((id[0] > ' ') && (id[0] <= '~') && (id[1] > ' ') && (id[1] <= '~'))
+	{
+		v->device_id[0] = id[0];
+		v->device_id[1] = id[1];
+	}
+
+	v->sample_time = read_old_word(LOC_SAMPLE_TIME, 1, 65534, v->sample_time);
+	v->r1 = read_old_word(LOC_R1, 1, 9999, v->r1);
+	v->r2 = read_old_word(LOC_R2, 1, 9999, v->r2);
+	v->current_gain = read_old_word(LOC_CURRENT_GAIN, 1, 6500, v->current_gain);
+
+	// Older firmware kept the offset as a 10-bit reading, so it is scaled to the 13-bit result
+	uint16_t offset = read_old_word(LOC_CURRENT_OFFSET, 0, 1023, 0xFFFF);
+	if (offset != 0xFFFF) { v->current_offset = offset << ANALOG_MAX_EXTRA_BITS; }
+
+	uint8_t position = EEPROM.read(LOC_WINDVANE_POSITION);
+	if (position <= 1) { v->windvane_position = position; }
+}
+
 /*
  * Public Functions
  */
 
+/*
+ * EEPROM_Setup
+ * Called by application at startup, before any settings are read.
+ * Loads the settings block, or the defaults if it is not valid.
+ */
+void EEPROM_Setup(void)
+{
+	eeprom_read_block(&s_config, (const void *)CONFIG_LOCATION, sizeof(s_config));
+
+	uint8_t size = s_config.header.size;
+	bool valid = (s_config.header.version != 0xFF) && (size > 0) && (size <= sizeof(s_config.values))
+		&& (values_crc(size) == s_config.header.crc);
+
+	if (valid)
+	{
+		if (size < sizeof(s_config.values))
+		{
+			// Written by older firmware: the new values take their defaults
+			memcpy_P((uint8_t *)&s_config.values + size, (const uint8_t *)&s_defaults + size, sizeof(s_config.values) - size);
+			save();
+		}
+		return;
+	}
+
+	memcpy_P(&s_config.values, &s_defaults, sizeof(s_config.values));
+
+	if (s_config.header.version == 0xFF)
+	{
+		// Never written - a fresh chip, or a logger updated from older firmware
+		read_old_locations();
+		Serial.println(PStringToRAM(s_pstr_config_old));
+	}
+	else
+	{
+		Serial.println(PStringToRAM(s_pstr_config_defaults));
+	}
+
+	save();
+}
+
 /* 
  * EEPROM_GetXXX, EEPROM_SetXXX 
- * For each value in the eeprom_locations_enum,
+ * For each value in config_values,
  * get and set functions are defined here.
  */
 
@@ -45,8 +253,8 @@ void EEPROM_GetDeviceID(char * buffer)
 {
 	if (buffer)
 	{
-		buffer[0] = (char)EEPROM.read(LOC_DEVICE_ID);
-		buffer[1] = (char)EEPROM.read(LOC_DEVICE_ID+1);
+		buffer[0] = s_config.values.device_id[0];
+		buffer[1] = s_config.values.device_id[1];
 	}
 }
 
@@ -54,72 +262,147 @@ void EEPROM_SetDeviceID(char * buffer)
 {
 	if (buffer)
 	{
-		EEPROM.write(LOC_DEVICE_ID,buffer[0]);
-		EEPROM.write(LOC_DEVICE_ID+1,buffer[1]);
+		s_config.values.device_id[0] = buffer[0];
+		s_config.values.device_id[1] = buffer[1];
+		save();
 	}
 }
 
 uint16_t EEPROM_GetSampleTime(void)
 {
-	return (EEPROM.read(LOC_SAMPLE_TIME) << 8) + EEPROM.read(LOC_SAMPLE_TIME+1);	
+	return s_config.values.sample_time;
 }
 
 void EEPROM_SetSampleTime(uint16_t sampleTime)
 {
-	EEPROM.write(LOC_SAMPLE_TIME, sampleTime >> 8);
-    EEPROM.write(LOC_SAMPLE_TIME+1, sampleTime & 0xff);
+	s_config.values.sample_time = sampleTime;
+	save();
 }
 
 uint16_t EEPROM_GetCurrentOffset(void)
 {
-	return (EEPROM.read(LOC_CURRENT_OFFSET) << 8) + EEPROM.read(LOC_CURRENT_OFFSET+1);
+	return s_config.values.current_offset;
 }
 
 void EEPROM_SetCurrentOffset(uint16_t currentOffset)
 {
-    EEPROM.write(LOC_CURRENT_OFFSET, currentOffset >> 8);
-    EEPROM.write(LOC_CURRENT_OFFSET+1, currentOffset & 0xff);  
+	s_config.values.current_offset = currentOffset;
+	save();
 }
 
 uint16_t EEPROM_GetR1(void)
 {
-	return (EEPROM.read(LOC_R1) << 8) + EEPROM.read(LOC_R1+1);	
+	return s_config.values.r1;
 }
 
 void EEPROM_SetR1(uint16_t r1)
 {
-    EEPROM.write(LOC_R1, r1 >> 8);
-    EEPROM.write(LOC_R1+1, r1 & 0xff);  
+	s_config.values.r1 = r1;
+	save();
 }
 
 uint16_t EEPROM_GetR2(void)
 {
-	return (EEPROM.read(LOC_R2) << 8) + EEPROM.read(LOC_R2+1);	
+	return s_config.values.r2;
 }
 
 void EEPROM_SetR2(uint16_t r2)
 {
-    EEPROM.write(LOC_R2, r2 >> 8);
-    EEPROM.write(LOC_R2+1, r2 & 0xff);  
+	s_config.values.r2 = r2;
+	save();
 }
 
 uint16_t EEPROM_GetCurrentGain(void)
 {
-	return (EEPROM.read(LOC_CURRENT_GAIN) << 8) + EEPROM.read(LOC_CURRENT_GAIN+1);	
+	return s_config.values.current_gain;
 }
 
 void EEPROM_SetCurrentGain(uint16_t currentGain)
 {
-    EEPROM.write(LOC_CURRENT_GAIN, currentGain >> 8);
-    EEPROM.write(LOC_CURRENT_GAIN+1, currentGain & 0xff);  
+	s_config.values.current_gain = currentGain;
+	save();
 }
 
 bool EEPROM_GetWindwavePosition(void)
 {
-	return (bool)EEPROM.read(LOC_WINDVANE_POSITION);
+	return s_config.values.windvane_position != 0;
 }
 
 void EEPROM_SetWindwavePosition(bool set)
 {
-	EEPROM.write(LOC_WINDVANE_POSITION, (char)set);	
+	s_config.values.windvane_position = set ? 1 : 0;
+	save();
+}
+
+uint16_t EEPROM_GetAnemometerSlope(void)
+{
+	return s_config.values.anemometer_slope;
+}
+
+void EEPROM_SetAnemometerSlope(uint16_t slope)
+{
+	s_config.values.anemometer_slope = slope;
+	save();
+}
+
+uint16_t EEPROM_GetAnemometerOffset(void)
+{
+	return s_config.values.anemometer_offset;
+}
+
+void EEPROM_SetAnemometerOffset(uint16_t offset)
+{
+	s_config.values.anemometer_offset = offset;
+	save();
 }
+
+bool EEPROM_GetSerialEcho(void)
+{
+	return s_config.values.serial_echo != 0;
+}
+
+void EEPROM_SetSerialEcho(bool echo)
+{
+	s_config.values.serial_echo = echo ? 1 : 0;
+	save();
+}
+
+uint8_t EEPROM_GetFieldMask(void)
+{
+	return s_config.values.field_mask;
+}
+
+void EEPROM_SetFieldMask(uint8_t mask)
+{
+	s_config.values.field_mask = mask;
+	save();
+}
+
+uint16_t EEPROM_GetPowerThreshold(uint8_t index)
+{
+	return (index < POWER_THRESHOLD_COUNT) ? s_config.values.power_thresholds[index] : 0xFFFF;
+}
+
+void EEPROM_SetPowerThreshold(uint8_t index, uint16_t millivolts)
+{
+	if (index < POWER_THRESHOLD_COUNT)
+	{
+		s_config.values.power_thresholds[index] = millivolts;
+		save();
+	}
+}
+
+uint8_t EEPROM_GetOversampleBits(uint8_t channel)
+{
+	return (channel < ANALOG_CH_VANE) ? s_config.values.oversample_bits[channel] : 0xFF;
+}
+
+void EEPROM_SetOversampleBits(uint8_t channel, uint8_t bits)
+{
+	if (channel < ANALOG_CH_VANE)
+	{
+		s_config.values.oversample_bits[channel] = bits;
+		save();
+	}
+}
+
@@ -1,6 +1,12 @@
 #ifndef _EEPROM_STORAGE_H_
 #define _EEPROM_STORAGE_H_
 
+// EEPROM after the settings block, used by checkpoint.cpp
+#define EEPROM_RING_START 128
+#define EEPROM_RING_END (E2END + 1)
+
+void EEPROM_Setup(void);
+
 void EEPROM_GetDeviceID(char * buffer);
 void EEPROM_SetDeviceID(char * buffer);
 
@@ -22,4 +28,22 @@ void EEPROM_SetCurrentGain(uint16_t currentGain);
 bool EEPROM_GetWindwavePosition(void);
 void EEPROM_SetWindwavePosition(bool set);
 
+uint16_t EEPROM_GetAnemometerSlope(void);
+void EEPROM_SetAnemometerSlope(uint16_t slope);
+
+uint16_t EEPROM_GetAnemometerOffset(void);
+void EEPROM_SetAnemometerOffset(uint16_t offset);
+
+bool EEPROM_GetSerialEcho(void);
+void EEPROM_SetSerialEcho(bool echo);
+
+uint8_t EEPROM_GetFieldMask(void);
+void EEPROM_SetFieldMask(uint8_t mask);
+
+uint16_t EEPROM_GetPowerThreshold(uint8_t index);
+void EEPROM_SetPowerThreshold(uint8_t index, uint16_t millivolts);
+
+uint8_t EEPROM_GetOversampleBits(uint8_t channel);
+void EEPROM_SetOversampleBits(uint8_t channel, uint8_t bits);
+
 #endif
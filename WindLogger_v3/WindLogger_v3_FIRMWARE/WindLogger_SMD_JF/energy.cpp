@@ -0,0 +1,244 @@
+/*
+ * energy.cpp
+ *
+ * Energy and charge integration for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "utility.h"
+#include "stats.h"
+#include "external_volts_amps.h"
+#include "energy.h"
+
+/*
+ * Every tick the external voltage and current readings are multiplied
+ * to give the power for that second, which is integrated into:
+ *
+ *  - energy for the period (mWh) and charge for the period (mAh)
+ *  - mean and peak power for the period (mW)
+ *  - running totals (Wh, Ah), kept in EEPROM by checkpoint.cpp
+ *
+ * Everything is in 32-bit integers. Each integral is held as a whole
+ * part plus a remainder (e.g. mWh + mWs), so nothing is lost however
+ * long the period is, and nothing overflows for a few kW over a day.
+ */
+
+#if READ_ENERGY == 1
+
+/*
+ * Defines and Typedefs
+ */
+
+#define SECONDS_PER_HOUR 3600L
+
+/*
+ * Private Variables
+ */
+
+static long s_periodMilliwattHours = 0;
+static long s_periodMilliwattSeconds = 0;  // Remainder below 1mWh
+static long s_periodMilliampHours = 0;
+static long s_periodMilliampSeconds = 0;  // Remainder below 1mAh
+static long s_peakMilliwatts = 0;
+static uint16_t s_ticks = 0;
+
+static long s_totalWattHours = 0;
+static long s_totalMilliwattHours = 0;  // Remainder below 1Wh
+static long s_totalAmpHours = 0;
+static long s_totalMilliampHours = 0;  // Remainder below 1Ah
+
+/*
+ * Private Functions
+ */
+
+/*
+ * accumulate
+ * Adds an amount to a whole + remainder pair, carrying into the whole part.
+ * Returns the change in the whole part.
+ */
+static long accumulate(long * whole, long * remainder, long amount, long per_whole)
+{
+	long carry;
+
+	*remainder += amount;
+	carry = *remainder / per_whole;
+	*remainder -= carry * per_whole;
+	*whole += carry;
+
+	return carry;
+}
+
+/*
+ * mean_milliwatts
+ * Period energy over the number of ticks, without overflowing mWh x 3600
+ */
+static long mean_milliwatts(void)
+{
+	if (s_ticks == 0) { return 0; }
+
+	long whole = s_periodMilliwattHours / s_ticks;
+	long part = s_periodMilliwattHours % s_ticks;
+
+	return (whole * SECONDS_PER_HOUR) + (((part * SECONDS_PER_HOUR) + s_periodMilliwattSeconds) / s_ticks);
+}
+
+/*
+ * fill_period
+ * Copies the period values into the struct
+ */
+static void fill_period(struct energy * period)
+{
+	period->milliwattHours = s_periodMilliwattHours;
+	period->milliampHours = s_periodMilliampHours;
+	period->meanMilliwatts = mean_milliwatts();
+	period->peakMilliwatts = s_peakMilliwatts;
+	period->totalWattHours = s_totalWattHours;
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * ENERGY_AddSample
+ * Called by the aggregation stage for each tick's readings
+ */
+void ENERGY_AddSample(uint16_t volts_reading, uint16_t amps_reading)
+{
+	long millivolts = VA_ReadingToMillivolts(volts_reading);
+	long milliamps = VA_ReadingToMilliamps(amps_reading);
+
+	// Hundredths of volts x hundredths of amps is in tenths of mW
+	// (fits 32 bits up to ~165V and ~200A)
+	long milliwatts = ((millivolts / 10) * (milliamps / 10)) / 10;
+
+	// Each tick is one second, so power is added as mWs and current as mAs
+	long mWh = accumulate(&s_periodMilliwattHours, &s_periodMilliwattSeconds, milliwatts, SECONDS_PER_HOUR);
+	long mAh = accumulate(&s_periodMilliampHours, &s_periodMilliampSeconds, milliamps, SECONDS_PER_HOUR);
+
+	accumulate(&s_totalWattHours, &s_totalMilliwattHours, mWh, 1000L);
+	accumulate(&s_totalAmpHours, &s_totalMilliampHours, mAh, 1000L);
+
+	if ((s_ticks == 0) || (milliwatts > s_peakMilliwatts))
+	{
+		s_peakMilliwatts = milliwatts;
+	}
+	s_ticks++;
+}
+
+/*
+ * ENERGY_StorePeriod
+ * Called at the end of the sample period to fill the record, then resets the period
+ */
+void ENERGY_StorePeriod(struct energy * period)
+{
+	if (period) { fill_period(period); }
+
+	s_periodMilliwattHours = 0;
+	s_periodMilliwattSeconds = 0;
+	s_periodMilliampHours = 0;
+	s_periodMilliampSeconds = 0;
+	s_peakMilliwatts = 0;
+	s_ticks = 0;
+}
+
+/*
+ * ENERGY_SnapshotPeriod
+ * Fills the struct from the period so far, without resetting anything
+ */
+void ENERGY_SnapshotPeriod(struct energy * period)
+{
+	if (period) { fill_period(period); }
+}
+
+/*
+ * ENERGY_GetPeriod, ENERGY_SetPeriod
+ * The period so far, saved and restored by checkpoint.cpp
+ */
+void ENERGY_GetPeriod(struct energy_period * period)
+{
+	period->milliwattHours = s_periodMilliwattHours;
+	period->milliwattSeconds = (int16_t)s_periodMilliwattSeconds;
+	period->milliampHours = s_periodMilliampHours;
+	period->milliampSeconds = (int16_t)s_periodMilliampSeconds;
+	period->peakMilliwatts = s_peakMilliwatts;
+	period->ticks = s_ticks;
+}
+
+void ENERGY_SetPeriod(const struct energy_period * period)
+{
+	s_periodMilliwattHours = period->milliwattHours;
+	s_periodMilliwattSeconds = period->milliwattSeconds;
+	s_periodMilliampHours = period->milliampHours;
+	s_periodMilliampSeconds = period->milliampSeconds;
+	s_peakMilliwatts = period->peakMilliwatts;
+	s_ticks = period->ticks;
+}
+
+/*
+ * ENERGY_GetTotals, ENERGY_SetTotals
+ * The running totals as whole and remainder parts (Wh + mWh, Ah + mAh),
+ * saved and restored by checkpoint.cpp
+ */
+void ENERGY_GetTotals(long * wattHours, long * milliwattHours, long * ampHours, long * milliampHours)
+{
+	*wattHours = s_totalWattHours;
+	*milliwattHours = s_totalMilliwattHours;
+	*ampHours = s_totalAmpHours;
+	*milliampHours = s_totalMilliampHours;
+}
+
+void ENERGY_SetTotals(long wattHours, long milliwattHours, long ampHours, long milliampHours)
+{
+	s_totalWattHours = wattHours;
+	s_totalMilliwattHours = milliwattHours;
+	s_totalAmpHours = ampHours;
+	s_totalMilliampHours = milliampHours;
+}
+
+/*
+ * ENERGY_WritePeriodToBuffer
+ * Writes "Wh, Ah, Mean W, Peak W, Total Wh"
+ */
+void ENERGY_WritePeriodToBuffer(const struct energy * period, FixedLengthAccumulator * accum)
+{
+	if (!period || !accum) { return; }
+
+	WriteFixedPoint(period->milliwattHours, 3, accum);
+	accum->writeChar(',');
+	WriteFixedPoint(period->milliampHours, 3, accum);
+	accum->writeChar(',');
+	WriteFixedPoint(period->meanMilliwatts, 3, accum);
+	accum->writeChar(',');
+	WriteFixedPoint(period->peakMilliwatts, 3, accum);
+	accum->writeChar(',');
+	WriteFixedPoint(period->totalWattHours, 0, accum);
+}
+
+#else
+
+void ENERGY_AddSample(uint16_t volts_reading, uint16_t amps_reading) { (void)volts_reading; (void)amps_reading; }
+void ENERGY_StorePeriod(struct energy * period) { (void)period; }
+void ENERGY_SnapshotPeriod(struct energy * period) { (void)period; }
+void ENERGY_GetPeriod(struct energy_period * period) { memset(period, 0, sizeof(*period)); }
+void ENERGY_SetPeriod(const struct energy_period * period) { (void)period; }
+void ENERGY_GetTotals(long * wattHours, long * milliwattHours, long * ampHours, long * milliampHours)
+{
+	*wattHours = 0; *milliwattHours = 0; *ampHours = 0; *milliampHours = 0;
+}
+void ENERGY_SetTotals(long wattHours, long milliwattHours, long ampHours, long milliampHours)
+{
+	(void)wattHours; (void)milliwattHours; (void)ampHours; (void)milliampHours;
+}
+void ENERGY_WritePeriodToBuffer(const struct energy * period, FixedLengthAccumulator * accum) { (void)period; (void)accum; }
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _ENERGY_H_
+#define _ENERGY_H_
+
+/*
+ * Defines and typedefs
+ */
+
+#if READ_ENERGY == 1
+#define ENERGY_HEADERS "Wh, Ah, Mean W, Peak W, Total Wh, "
+#define ENERGY_COLUMNS 5
+#else
+#define ENERGY_HEADERS ""
+#define ENERGY_COLUMNS 0
+#endif
+
+// Energy over one sample period, in fixed point
+struct energy
+{
+	long milliwattHours;	// Period energy
+	long milliampHours;		// Period charge
+	long meanMilliwatts;
+	long peakMilliwatts;
+	long totalWattHours;	// Running total since the counters were last cleared
+};
+
+// The period so far, as kept in a checkpoint (checkpoint.h)
+struct energy_period
+{
+	int32_t milliwattHours;
+	int16_t milliwattSeconds;	// Remainder, within +/-1mWh
+	int32_t milliampHours;
+	int16_t milliampSeconds;	// Remainder, within +/-1mAh
+	int32_t peakMilliwatts;
+	uint16_t ticks;
+} __attribute__((packed));
+
+// Public Functions
+void ENERGY_AddSample(uint16_t volts_reading, uint16_t amps_reading);
+void ENERGY_StorePeriod(struct energy * period);
+void ENERGY_SnapshotPeriod(struct energy * period);
+void ENERGY_GetPeriod(struct energy_period * period);
+void ENERGY_SetPeriod(const struct energy_period * period);
+
+void ENERGY_GetTotals(long * wattHours, long * milliwattHours, long * ampHours, long * milliampHours);
+void ENERGY_SetTotals(long wattHours, long milliwattHours, long ampHours, long milliampHours);
+
+void ENERGY_WritePeriodToBuffer(const struct energy * period, FixedLengthAccumulator * accum);
+
+#endif
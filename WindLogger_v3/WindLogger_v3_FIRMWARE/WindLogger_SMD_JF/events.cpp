@@ -0,0 +1,119 @@
+/*
+ * events.cpp
+ *
+ * Interrupt to main loop event queue for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "events.h"
+
+/*
+ * Single producer, single consumer ring of event bytes.
+ *
+ * The producer is interrupt context. AVR interrupts do not nest, so all the
+ * ISRs (RTC, anemometers, card detect, serial RX, ADC, telemetry timer) act as one producer.
+ * The main loop can join them with interrupts disabled (EVT_PostFromMain).
+ * The consumer is the main loop.
+ *
+ * The head index is only written by the producer and the tail index
+ * only by the consumer. Both are single bytes, so reads and writes are
+ * atomic and neither side needs to disable interrupts.
+ *
+ * One slot is always left empty to tell a full queue from an empty one.
+ */
+
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+
+#if (EVENT_QUEUE_SIZE & EVENT_QUEUE_MASK) != 0
+#error "EVENT_QUEUE_SIZE must be a power of two"
+#endif
+
+/*
+ * Private Variables
+ */
+
+static volatile EVENT s_queue[EVENT_QUEUE_SIZE];
+static volatile uint8_t s_head = 0;  // Next slot to write (producer owned)
+static volatile uint8_t s_tail = 0;  // Next slot to read (consumer owned)
+static volatile uint8_t s_dropped = 0;  // Events lost because the queue was full
+
+/*
+ * Public Functions
+ */
+
+/*
+ * EVT_Post
+ * Called from interrupt context to add an event to the queue.
+ * Returns false (and counts the loss) if the queue was full.
+ */
+bool EVT_Post(EVENT evt)
+{
+	uint8_t head = s_head;
+	uint8_t next = (head + 1) & EVENT_QUEUE_MASK;
+
+	if (next == s_tail)
+	{
+		if (s_dropped < 255) { s_dropped++; }
+		return false;
+	}
+
+	s_queue[head] = evt;
+	s_head = next;	// Publish only after the slot is written
+	return true;
+}
+
+/*
+ * EVT_PostFromMain
+ * Called from the main loop to add an event to the queue.
+ * The ISRs are held off so there is still only one producer at a time.
+ */
+bool EVT_PostFromMain(EVENT evt)
+{
+	bool posted;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		posted = EVT_Post(evt);
+	}
+
+	return posted;
+}
+
+/*
+ * EVT_Get
+ * Called from the main loop to take the oldest event from the queue.
+ * Returns false if the queue was empty.
+ */
+bool EVT_Get(EVENT * evt)
+{
+	uint8_t tail = s_tail;
+
+	if (tail == s_head) { return false; }
+
+	if (evt) { *evt = s_queue[tail]; }
+	s_tail = (tail + 1) & EVENT_QUEUE_MASK;  // Release the slot after reading it
+	return true;
+}
+
+/*
+ * EVT_Pending
+ * Returns true if there is at least one event waiting
+ */
+bool EVT_Pending(void)
+{
+	return s_tail != s_head;
+}
+
+/*
+ * EVT_GetDroppedCount
+ * Returns the number of events lost to a full queue since boot
+ */
+uint8_t EVT_GetDroppedCount(void)
+{
+	return s_dropped;
+}
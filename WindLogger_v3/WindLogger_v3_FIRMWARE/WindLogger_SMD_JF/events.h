@@ -0,0 +1,38 @@
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// Must be a power of two so the ring indexes can wrap with a mask
+#define EVENT_QUEUE_SIZE 16
+
+enum event_type
+{
+	EVT_NONE = 0,
+	EVT_TICK,				// 1Hz tick from the RTC CLKOUT
+	EVT_PERIOD_COMPLETE,	// Sample period has elapsed and a record is due
+	EVT_CARD_CHANGE,		// SD card detect pin has changed state
+	EVT_SERIAL_RX,			// Activity on the serial RX line
+	EVT_ANALOG_SCAN_COMPLETE,	// Background ADC scan has finished
+	EVT_TRANSFER_BLOCK,		// A file transfer has another block to send
+	EVT_TELEMETRY_FRAME		// A live telemetry frame is due
+};
+
+typedef uint8_t EVENT;
+
+// Public Functions
+
+// Producer side (interrupt context only)
+bool EVT_Post(EVENT evt);
+
+// For the occasional event raised by the main loop itself
+bool EVT_PostFromMain(EVENT evt);
+
+// Consumer side (main loop only)
+bool EVT_Get(EVENT * evt);
+bool EVT_Pending(void);
+uint8_t EVT_GetDroppedCount(void);
+
+#endif
@@ -12,8 +12,16 @@
 
 #include "app.h"
 #include "utility.h"
+#include "stats.h"
 #include "external_volts_amps.h"
 #include "eeprom_storage.h"
+#include "analog.h"
+
+/*
+ * Defines and Typedefs
+ */
+
+#define CURRENT_OFFSET_SAMPLES 255
 
 /* 
  * Private Variables
@@ -22,19 +30,31 @@
 ///********* External Voltage ****************/
 #if READ_EXTERNAL_VOLTS == 1
 static int  s_r1, s_r2;  // The potential divider values  
-static float s_externalVoltage;        // Temporary store for float
-static char  s_externalVoltStr[6];      // Hold the battery voltage as a string
+static uint32_t s_dividerGain;  // (R1+R2)/R2, fixed point with 8 fractional bits
 #endif
 
 ///********* Current 1 ****************/
 #if READ_EXTERNAL_AMPS == 1
-static long int s_currentData1;      // Temp holder for value
-static float s_current1;        // Temporary store for float
-static float s_currentOffset;  // Holds the offset current
-static char s_current1Str[7];      // Hold the current as a string
+static long s_currentOffset;  // Holds the offset voltage in uV
 static int s_iGain;    // Holds the current conversion factor in mV/A
 #endif
 
+/*
+ * Private Functions
+ */
+
+/*
+ * reading_to_microvolts
+ * Converts an analog reading to the voltage at the pin in uV.
+ * 3300000uV / ANALOG_FULL_SCALE, arranged to stay within 32 bits.
+ */
+#if (READ_EXTERNAL_VOLTS == 1) || (READ_EXTERNAL_AMPS == 1)
+static uint32_t reading_to_microvolts(uint16_t reading)
+{
+	return ((uint32_t)reading * (3300000UL / 8UL)) / (ANALOG_FULL_SCALE / 8UL);
+}
+#endif
+
 /* 
  * Public Functions
  */
@@ -46,8 +66,8 @@ static int s_iGain;    // Holds the current conversion factor in mV/A
  */
 void VA_SetCurrentOffset(int newOffset)
 {
-	// Convert the current offset to a voltage
-  	s_currentOffset = float(newOffset)*3.3f/1023.0f;
+	// Convert the current offset (an analog reading) to a voltage
+  	s_currentOffset = reading_to_microvolts(newOffset);
 }
 
 /* 
@@ -62,27 +82,29 @@ void VA_SetCurrentGain(int newGain)
 /* 
  * VA_StoreNewCurrentOffset
  * Called by application to read a new offset at 0A
- * and store in EEPROM
+ * and store in EEPROM. Returns false (and keeps the old offset) if the ADC was in use.
  */
-void VA_StoreNewCurrentOffset(void)
+bool VA_StoreNewCurrentOffset(void)
 {
-    s_currentData1 = 0;  // Reset this holder
-    for(int i = 0;i<=19;i++)
-    {  
-      s_currentData1 += analogRead(CURRENT_1_PIN);
-      delay(20);
-    }           
-    
-    s_currentData1 /= 20;
+    // Average enough readings to span a whole mains cycle (~27ms),
+    // with the CPU asleep while the ADC converts
+    uint16_t reading;
+    if (!ANALOG_Measure(ANALOG_CH_EXT_AMPS, CURRENT_OFFSET_SAMPLES, &reading)) { return false; }
 
-    VA_SetCurrentOffset(s_currentData1);
+    int offset = (int)reading;
+    VA_SetCurrentOffset(offset);
     
+    char offsetStr[8];
+    FixedLengthAccumulator accum(offsetStr, sizeof(offsetStr));
+    WriteFixedPoint((s_currentOffset + 5000) / 10000, 2, &accum);
+
     Serial.print("Ioffset:");
-    Serial.print(s_currentOffset);
+    Serial.print(offsetStr);
     Serial.println("V");
 
     // Write the offset to EEPROM   
-    EEPROM_SetCurrentOffset(s_currentData1);
+    EEPROM_SetCurrentOffset(offset);
+    return true;
 }
 
 /* 
@@ -100,59 +122,65 @@ void VA_StoreNewCurrentGain(int value)
 }
 
 /* 
- * VA_UpdateExternalCurrent
- * Called by application to read the external current
+ * VA_ReadingToMilliamps
+ * Converts an analog reading from the current sensor to mA (integer only)
  */
-void VA_UpdateExternalCurrent(void)
+long VA_ReadingToMilliamps(uint16_t reading)
 {
-    s_currentData1 = 0;  // Reset the value
-
-    // Lets average the data here over 20 samples.
-    for(int i = 0;i<=19;i++)
-    {  
-      s_currentData1 += analogRead(CURRENT_1_PIN);
-      delay(2);
-    }
-
-    s_current1 = float(s_currentData1)/20.0f;  
-    s_current1 = (s_current1*3.3f/1023.0f) - s_currentOffset;
-    // Current 1 holds the incoming voltage.
+    long current1;  // Voltage then current, as scaled integers
+
+    current1 = (long)reading_to_microvolts(reading) - s_currentOffset;
+    // Current 1 holds the incoming voltage (uV from the offset).
      
     // ********** LEM HTFS 200-P SENSOR *********************************
     // Voutput is Vref +/- 1.25 * Ip/Ipn 
     // Vref = Vsupply/2 +/1 0.025V (Would be best to remove this with analog stage)
-    //s_current1 = (s_current1*200.0f)/1.25f;
-    s_current1 = s_current1*float(s_iGain);  
+    //current1 = (current1*200.0f)/1.25f;
+    // In 10uV steps x gain gives A x 100000, so /100 for mA.
+    // (Fits 32 bits for gains up to ~6500.)
+    current1 = ((current1 / 10) * s_iGain) / 100;
   
 //    // ************* ACS*** Hall Effect **********************
 //    // Output is Input Voltage - offset / mV per Amp sensitivity
 //    // Datasheet says 60mV/A     
 
-    // Convert the current to a string.
-    dtostrf(s_current1,2,2, s_current1Str);     // Hold the battery voltage as a string
+    return current1;
 }
 
-void VA_WriteExternalCurrentToBuffer(FixedLengthAccumulator * accum)
+/* 
+ * VA_WriteExternalCurrentToBuffer
+ * Called by application to write the external current for the period
+ * (in hundredths of an amp)
+ */
+void VA_WriteExternalCurrentToBuffer(const struct stats_summary * centiamps, FixedLengthAccumulator * accum)
 {
-    if (!accum) { return; }
-    accum->writeString(s_current1Str);
+    // In amps to two decimal places
+    STATS_WriteSummaryToBuffer(centiamps, 2, 2, accum);
 }
 
 #else
 
-void VA_UpdateExternalCurrent(void) {}
-
 void VA_SetCurrentGain(int gain) { (void)gain; } 
 void VA_SetCurrentOffset(int offset) { (void)offset; } 
 
-void VA_StoreNewCurrentOffset(void) {} 
+bool VA_StoreNewCurrentOffset(void) { return true; } 
 void VA_StoreNewCurrentGain(int gain) { (void)gain; } 
 
-void VA_WriteExternalCurrentToBuffer(FixedLengthAccumulator * accum) {(void)accum;}
+long VA_ReadingToMilliamps(uint16_t reading) { (void)reading; return 0; }
+void VA_WriteExternalCurrentToBuffer(const struct stats_summary * centiamps, FixedLengthAccumulator * accum) { (void)centiamps; (void)accum; }
 
 #endif
 
 #if READ_EXTERNAL_VOLTS == 1
+/*
+ * update_divider_gain
+ * Works out the divider ratio once, so each reading is a multiply and divide
+ */
+static void update_divider_gain(void)
+{
+	s_dividerGain = s_r2 ? (((uint32_t)s_r1 + (uint32_t)s_r2) << 8) / (uint32_t)s_r2 : 0;
+}
+
 /* 
  * VA_SetVoltageDivider
  * Called by application to set the voltage divider parameters
@@ -161,6 +189,7 @@ void VA_SetVoltageDivider(uint16_t newR1, uint16_t newR2)
 {
 	s_r1 = newR1;
 	s_r2 = newR2;
+	update_divider_gain();
 }
 
 /* 
@@ -172,6 +201,7 @@ void VA_SetVoltageDivider(uint16_t newR1, uint16_t newR2)
 void VA_StoreNewResistor1(int value)
 {
     s_r1 = value;  // Use this new value
+    update_divider_gain();
     Serial.print("R1:");
     Serial.println(value);   
     // Write this info to EEPROM   
@@ -181,6 +211,7 @@ void VA_StoreNewResistor1(int value)
 void VA_StoreNewResistor2(int value)
 {
     s_r2 = value; // Use this new value
+    update_divider_gain();
     Serial.print("R2:");
     Serial.println(value);   
     // Write this info to EEPROM   
@@ -188,31 +219,35 @@ void VA_StoreNewResistor2(int value)
 }
 
 /* 
- * VA_UpdateExternalVoltage
- * Called by application to read the external voltage
+ * VA_ReadingToMillivolts
+ * Converts an analog reading to the external voltage in mV (integer only)
  */
-void VA_UpdateExternalVoltage(void)
+long VA_ReadingToMillivolts(uint16_t reading)
 {
-	s_externalVoltage = float(analogRead(VOLTAGE_PIN))*(3.3f/1023.0f)*((float(s_r1)+float(s_r2))/float(s_r2));
-    dtostrf(s_externalVoltage,2,2, s_externalVoltStr);
+    // 100uV steps at the pin, times the divider ratio (8 fractional bits) = 1/2560ths of a mV.
+    // Fits 32 bits for ratios up to ~500.
+    uint32_t pin100uV = (reading_to_microvolts(reading) + 50) / 100;
+    return (long)(((pin100uV * s_dividerGain) + 1280UL) / 2560UL);
 }
 
-
-void VA_WriteExternalVoltageToBuffer(FixedLengthAccumulator * accum)
+/* 
+ * VA_WriteExternalVoltageToBuffer
+ * Called by application to write the external voltage for the period
+ * (in hundredths of a volt)
+ */
+void VA_WriteExternalVoltageToBuffer(const struct stats_summary * centivolts, FixedLengthAccumulator * accum)
 {
-    if (!accum) { return; }
-    accum->writeString(s_externalVoltStr);
+    STATS_WriteSummaryToBuffer(centivolts, 2, 2, accum);
 }
 
 #else
 
-void VA_UpdateExternalVoltage(void) {}
-
 void VA_StoreNewResistor1(int r1) { (void)r1; } 
 void VA_StoreNewResistor2(int r2) { (void)r2; }
 
 void VA_SetVoltageDivider(uint16_t r1, uint16_t r2) { (void)r1; (void)r2; }
 
-void VA_WriteExternalVoltageToBuffer(FixedLengthAccumulator * accum) {(void)accum;}
+long VA_ReadingToMillivolts(uint16_t reading) { (void)reading; return 0; }
+void VA_WriteExternalVoltageToBuffer(const struct stats_summary * centivolts, FixedLengthAccumulator * accum) { (void)centivolts; (void)accum; }
 
 #endif
@@ -6,15 +6,19 @@
 #define CURRENT_1_PIN A3  // Current from a hall effect sensor
 
 #if READ_EXTERNAL_AMPS == 1
-#define EXTERNAL_AMPS_HEADERS "Current, "
+#define EXTERNAL_AMPS_HEADERS STATS_HEADERS("Current") ", "
+#define EXTERNAL_AMPS_COLUMNS STATS_COLUMNS
 #else
 #define EXTERNAL_AMPS_HEADERS ""
+#define EXTERNAL_AMPS_COLUMNS 0
 #endif
 
 #if READ_EXTERNAL_VOLTS == 1
-#define EXTERNAL_VOLTS_HEADERS "Ext V, "
+#define EXTERNAL_VOLTS_HEADERS STATS_HEADERS("Ext V") ", "
+#define EXTERNAL_VOLTS_COLUMNS STATS_COLUMNS
 #else
 #define EXTERNAL_VOLTS_HEADERS ""
+#define EXTERNAL_VOLTS_COLUMNS 0
 #endif
 
 // Public Functions
@@ -23,15 +27,15 @@ void VA_SetCurrentGain(int newGain);
 
 void VA_SetVoltageDivider(uint16_t newR1, uint16_t newR2);
 
-void VA_StoreNewCurrentOffset(void);
+bool VA_StoreNewCurrentOffset(void);
 void VA_StoreNewResistor1(int value);
 void VA_StoreNewResistor2(int value);
 void VA_StoreNewCurrentGain(int value);
 
-void VA_UpdateExternalVoltage(void);
-void VA_UpdateExternalCurrent(void);
+long VA_ReadingToMillivolts(uint16_t reading);
+long VA_ReadingToMilliamps(uint16_t reading);
 
-void VA_WriteExternalVoltageToBuffer(FixedLengthAccumulator * accum);
-void VA_WriteExternalCurrentToBuffer(FixedLengthAccumulator * accum);
+void VA_WriteExternalVoltageToBuffer(const struct stats_summary * centivolts, FixedLengthAccumulator * accum);
+void VA_WriteExternalCurrentToBuffer(const struct stats_summary * centiamps, FixedLengthAccumulator * accum);
 
 #endif
@@ -0,0 +1,307 @@
+/*
+ * fields.cpp
+ *
+ * Selection of the fields written to each data record for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "utility.h"
+#include "stats.h"
+#include "rtc.h"
+#include "analog.h"
+#include "energy.h"
+#include "pipeline.h"
+#include "wind.h"
+#include "temperature.h"
+#include "irradiance.h"
+#include "external_volts_amps.h"
+#include "battery.h"
+#include "eeprom_storage.h"
+#include "fields.h"
+
+/*
+ * The READ_xxx switches in app.h choose which fields are built into the
+ * firmware. Of those, a mask kept in EEPROM chooses which are written,
+ * so the columns can be changed over serial without reflashing.
+ *
+ * Each field in FIELD_LIST (fields.h) has an entry in s_fields, in column
+ * order, with its headers, the analog channels it needs scanned, any fields
+ * it needs enabled with it, and the function writing its columns. A field
+ * that isn't built in keeps its entry (so the mask bits don't move) but has
+ * no headers or write function and can't be enabled.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+struct field
+{
+	const char * headers;	// In flash, each header followed by ", "
+	uint8_t channels;		// Analog channels to scan (ANALOG_CHANNEL_BIT)
+	uint8_t requires;		// Fields that must be enabled with this one (FIELD_BIT)
+	void (*write)(const struct record * rec, FixedLengthAccumulator * accum);	// Writes ",value" for each column
+};
+
+/*
+ * count_columns
+ * The number of columns in a header string (one comma after each header)
+ */
+static constexpr uint8_t count_columns(const char * headers)
+{
+	return *headers ? ((*headers == ',') + count_columns(headers + 1)) : 0;
+}
+
+// Each field's headers must match what its writer writes, or every column after it is mislabelled
+#define FIELD_CHECK_COLUMNS(id, channels, requires) \
+	static_assert(count_columns(id##_HEADERS) == id##_COLUMNS, #id "_HEADERS and " #id "_COLUMNS don't match");
+FIELD_LIST(FIELD_CHECK_COLUMNS)
+static_assert(count_columns(FIELDS_ROW_START_HEADERS) == FIELDS_ROW_START_COLUMNS, "FIELDS_ROW_START_HEADERS don't match");
+static_assert(count_columns(BATTERY_HEADERS ", ") == BATTERY_COLUMNS, "BATTERY_HEADERS and BATTERY_COLUMNS don't match");
+
+/*
+ * Field writers
+ */
+
+#if READ_WINDSPEED == 1
+static void write_windspeed(const struct record * rec, FixedLengthAccumulator * accum)
+{
+	accum->writeChar(',');
+	WIND_WritePulseCountToBuffer(rec->pulses[0], accum);
+	accum->writeChar(',');
+	WIND_WritePulseCountToBuffer(rec->pulses[1], accum);
+}
+#define WRITE_WINDSPEED write_windspeed
+#else
+#define WRITE_WINDSPEED NULL
+#endif
+
+#if READ_WIND_DIRECTION == 1
+static void write_wind_direction(const struct record * rec, FixedLengthAccumulator * accum)
+{
+	accum->writeChar(',');
+	WIND_WriteDirectionToBuffer(rec->direction, accum);
+}
+#define WRITE_WIND_DIRECTION write_wind_direction
+#else
+#define WRITE_WIND_DIRECTION NULL
+#endif
+
+#if READ_TEMPERATURE == 1
+static void write_temperature(const struct record * rec, FixedLengthAccumulator * accum)
+{
+	accum->writeChar(',');
+	TEMP_WriteTemperatureToBuffer(&rec->channels[PIPE_CH_TEMPERATURE], accum);
+}
+#define WRITE_TEMPERATURE write_temperature
+#else
+#define WRITE_TEMPERATURE NULL
+#endif
+
+#if READ_IRRADIANCE == 1
+static void write_irradiance(const struct record * rec, FixedLengthAccumulator * accum)
+{
+	accum->writeChar(',');
+	IRR_WriteIrradianceToBuffer(&rec->channels[PIPE_CH_IRRADIANCE], rec->insolation, accum);
+}
+#define WRITE_IRRADIANCE write_irradiance
+#else
+#define WRITE_IRRADIANCE NULL
+#endif
+
+#if READ_EXTERNAL_VOLTS == 1
+static void write_external_volts(const struct record * rec, FixedLengthAccumulator * accum)
+{
+	accum->writeChar(',');
+	VA_WriteExternalVoltageToBuffer(&rec->channels[PIPE_CH_EXT_VOLTS], accum);
+}
+#define WRITE_EXTERNAL_VOLTS write_external_volts
+#else
+#define WRITE_EXTERNAL_VOLTS NULL
+#endif
+
+#if READ_EXTERNAL_AMPS == 1
+static void write_external_amps(const struct record * rec, FixedLengthAccumulator * accum)
+{
+	accum->writeChar(',');
+	VA_WriteExternalCurrentToBuffer(&rec->channels[PIPE_CH_EXT_AMPS], accum);
+}
+#define WRITE_EXTERNAL_AMPS write_external_amps
+#else
+#define WRITE_EXTERNAL_AMPS NULL
+#endif
+
+#if READ_ENERGY == 1
+static void write_energy(const struct record * rec, FixedLengthAccumulator * accum)
+{
+	accum->writeChar(',');
+	ENERGY_WritePeriodToBuffer(&rec->energy, accum);
+}
+#define WRITE_ENERGY write_energy
+#else
+#define WRITE_ENERGY NULL
+#endif
+
+/*
+ * Private Variables
+ */
+
+#define FIELD_HEADER_STRING(id, channels, requires) static const char s_pstr_##id[] PROGMEM = id##_HEADERS;
+FIELD_LIST(FIELD_HEADER_STRING)
+
+// In field_id order
+#define FIELD_ENTRY(id, channels, requires) {s_pstr_##id, channels, requires, WRITE_##id},
+static const struct field s_fields[FIELD_COUNT] PROGMEM = {
+	FIELD_LIST(FIELD_ENTRY)
+};
+
+static uint8_t s_mask;
+
+/*
+ * Private Functions
+ */
+
+static void read_field(uint8_t field, struct field * entry)
+{
+	memcpy_P(entry, &s_fields[field], sizeof(struct field));
+}
+
+/*
+ * channels_for
+ * Returns the analog channels needed by the fields in the mask
+ */
+static uint8_t channels_for(uint8_t mask)
+{
+	struct field entry;
+	uint8_t channels = 0;
+
+	for (uint8_t f = 0; f < FIELD_COUNT; f++)
+	{
+		if (mask & FIELD_BIT(f))
+		{
+			read_field(f, &entry);
+			channels |= entry.channels;
+		}
+	}
+	return channels;
+}
+
+/*
+ * mask_is_valid
+ * A mask can only have fields that are built in, with the fields they need,
+ * and no two fields read from the same pin
+ */
+static bool mask_is_valid(uint8_t mask)
+{
+	struct field entry;
+
+	if (mask & ~FIELDS_BUILT) { return false; }
+
+	for (uint8_t f = 0; f < FIELD_COUNT; f++)
+	{
+		if (mask & FIELD_BIT(f))
+		{
+			read_field(f, &entry);
+			if ((mask & entry.requires) != entry.requires) { return false; }
+		}
+	}
+
+	return !ANALOG_PinsConflict(channels_for(mask) | ANALOG_CHANNEL_BIT(ANALOG_CH_BATTERY));
+}
+
+static void apply_mask(uint8_t mask)
+{
+	s_mask = mask;
+	ANALOG_SetEnabledChannels(channels_for(mask));
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * FIELDS_Setup
+ * Called by application at startup, after EEPROM_Setup and before the first file is opened
+ */
+void FIELDS_Setup(void)
+{
+	uint8_t mask = EEPROM_GetFieldMask();
+
+	if (!mask_is_valid(mask))
+	{
+		// Not set, or set for firmware with other fields built in
+		mask = FIELDS_DEFAULT & FIELDS_BUILT;
+	}
+	apply_mask(mask);
+}
+
+/*
+ * FIELDS_GetMask, FIELDS_IsEnabled
+ * The fields being written
+ */
+uint8_t FIELDS_GetMask(void)
+{
+	return s_mask;
+}
+
+bool FIELDS_IsEnabled(uint8_t field)
+{
+	return (s_mask & FIELD_BIT(field)) != 0;
+}
+
+/*
+ * FIELDS_StoreMask
+ * Changes the fields written and saves them to EEPROM.
+ * Returns false (and changes nothing) if the mask is not valid.
+ */
+bool FIELDS_StoreMask(uint8_t mask)
+{
+	if (!mask_is_valid(mask)) { return false; }
+
+	apply_mask(mask);
+	EEPROM_SetFieldMask(mask);
+	return true;
+}
+
+/*
+ * FIELDS_GetHeader
+ * Returns the headers (in flash) of the nth enabled field, or NULL after the last
+ */
+const char * FIELDS_GetHeader(uint8_t n)
+{
+	for (uint8_t f = 0; f < FIELD_COUNT; f++)
+	{
+		if ((s_mask & FIELD_BIT(f)) && (n-- == 0))
+		{
+			return (const char *)pgm_read_ptr(&s_fields[f].headers);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * FIELDS_WriteRecord
+ * Writes the columns of the enabled fields
+ */
+void FIELDS_WriteRecord(const struct record * rec, FixedLengthAccumulator * accum)
+{
+	struct field entry;
+
+	for (uint8_t f = 0; f < FIELD_COUNT; f++)
+	{
+		if (s_mask & FIELD_BIT(f))
+		{
+			read_field(f, &entry);
+			entry.write(rec, accum);
+		}
+	}
+}
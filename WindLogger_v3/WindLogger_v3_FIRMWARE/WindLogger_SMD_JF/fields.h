@@ -0,0 +1,72 @@
+#ifndef _FIELDS_H_
+#define _FIELDS_H_
+
+/*
+ * Defines and typedefs
+ */
+
+/*
+ * FIELD_LIST
+ * Every optional field of a data record, in column order, as X(ID, channels, requires).
+ * The Ref, Date and Time columns come first and the battery last, always.
+ *
+ *   ID        FIELD_ID below. Its bit in the field mask (kept in EEPROM) is its place
+ *             in this list, so new fields go on the end.
+ *   channels  the analog channels it needs scanned (ANALOG_CHANNEL_BIT)
+ *   requires  the fields that must be enabled with it (FIELD_BIT)
+ *
+ * Everything else about a field is found from its ID:
+ *   READ_ID     (app.h) 1 if it is built in
+ *   ID_HEADERS  (its module's header) its column headers, each followed by ", "
+ *   ID_COLUMNS  (its module's header) the number of columns its writer writes
+ *   WRITE_ID    (fields.cpp) the writer, NULL if it isn't built in
+ *
+ * The field ids, header strings and writer table in fields.cpp, and the
+ * host's schema of the data files (tools/field_schema.py), are all made from this list.
+ */
+#define FIELD_LIST(X) \
+	X(WINDSPEED, 0, 0) \
+	X(WIND_DIRECTION, ANALOG_CHANNEL_BIT(ANALOG_CH_VANE), 0) \
+	X(TEMPERATURE, ANALOG_CHANNEL_BIT(ANALOG_CH_TEMPERATURE), 0) \
+	X(IRRADIANCE, ANALOG_CHANNEL_BIT(ANALOG_CH_IRRADIANCE), 0) \
+	X(EXTERNAL_VOLTS, ANALOG_CHANNEL_BIT(ANALOG_CH_EXT_VOLTS), 0) \
+	X(EXTERNAL_AMPS, ANALOG_CHANNEL_BIT(ANALOG_CH_EXT_AMPS), 0) \
+	X(ENERGY, 0, FIELD_BIT(FIELD_EXTERNAL_VOLTS) | FIELD_BIT(FIELD_EXTERNAL_AMPS))
+
+#define FIELD_ENUM_ENTRY(id, channels, requires) FIELD_##id,
+enum field_id
+{
+	FIELD_LIST(FIELD_ENUM_ENTRY)
+	FIELD_COUNT
+};
+
+#define FIELD_BIT(field) (1 << (field))
+#define FIELD_ALL ((1 << FIELD_COUNT) - 1)
+
+// The fields built into this firmware
+#define FIELD_BUILT_BIT(id, channels, requires) | ((READ_##id == 1) ? FIELD_BIT(FIELD_##id) : 0)
+#define FIELDS_BUILT (0 FIELD_LIST(FIELD_BUILT_BIT))
+
+// The most columns a record can have after the row start, less the battery's (a field not built in has none)
+#define FIELD_BUILT_COLUMNS(id, channels, requires) + id##_COLUMNS
+#define FIELDS_BUILT_COLUMNS (0 FIELD_LIST(FIELD_BUILT_COLUMNS))
+
+// The headers of the columns before the fields. The battery's (BATTERY_HEADERS) come after them.
+#define FIELDS_ROW_START_HEADERS "Ref, Date, Time, "
+#define FIELDS_ROW_START_COLUMNS 3
+
+// Used until set over serial: the fields of the original logger
+#define FIELDS_DEFAULT (FIELD_BIT(FIELD_WINDSPEED) | FIELD_BIT(FIELD_WIND_DIRECTION) | FIELD_BIT(FIELD_IRRADIANCE))
+
+// Public Functions
+
+void FIELDS_Setup(void);
+
+uint8_t FIELDS_GetMask(void);
+bool FIELDS_IsEnabled(uint8_t field);
+bool FIELDS_StoreMask(uint8_t mask);
+
+const char * FIELDS_GetHeader(uint8_t n);
+void FIELDS_WriteRecord(const struct record * rec, FixedLengthAccumulator * accum);
+
+#endif
@@ -15,16 +15,13 @@
 
 #include "app.h"
 #include "utility.h"
+#include "stats.h"
+#include "analog.h"
+#include "irradiance.h"
 
 
 #if READ_IRRADIANCE == 1
 
-/* 
- * Defines and Typedefs
- */
-
-#define IRRADIANCE_PIN A2
-
 /*
  * Local Variables
  */
@@ -32,51 +29,60 @@
 const char s_pstr_irradiance_dbg[] PROGMEM = "Irradiance: ";
 
 /*
- * Private Functions
+ * Public Functions
  */
 
-/* reading_to_irridiance
+/* IRR_ReadingToIrradiance
  * Outputs: 
  * 	The irradiance in W/m^2 (watts per meter squared)
  * Inputs:
- * 	1.The raw analog input reading
+ * 	1.The analog reading (ANALOG_RESULT_BITS scale)
  */
 
-static float reading_to_irridiance(uint16_t reading)
+uint16_t IRR_ReadingToIrradiance(uint16_t reading)
 {
   // From testing Approx 1mV = 1.1w/m2
   // This conversion is APPROXIMATE and from testing.
-  float result = (reading * 3000.0f )/ 1024;
-  return result; 
+  return (uint16_t)((((uint32_t)reading * 3000UL) + (ANALOG_FULL_SCALE / 2)) / ANALOG_FULL_SCALE);
 }
 
 /*
- * Public Functions
+ * IRR_WriteIrradianceToBuffer
+ * Writes the period irradiance statistics (W/m^2) then the insolation (Wh/m^2).
+ * Each tick is one second, so the sum of the tick irradiances is the insolation in Ws/m^2.
  */
-
-void IRR_WriteIrradianceToBuffer(FixedLengthAccumulator * accum)
+void IRR_WriteIrradianceToBuffer(const struct stats_summary * irradiance, long wattSeconds, FixedLengthAccumulator * accum)
 {
-  if (!accum) { return; }
+  if (!irradiance || !accum) { return; }
   
-  uint16_t reading = analogRead(IRRADIANCE_PIN);
-  float irr = reading_to_irridiance(reading);
-  
-  char buffer[10];
-  dtostrf(irr, 2, 0, buffer);  // Convert the irradiance value (double) into a string
-
-  accum->writeString(buffer);
+#if WRITE_CHANNEL_STATS == 1
+  STATS_WriteSummaryToBuffer(irradiance, 0, 0, accum);
+#else
+  WriteFixedPoint(irradiance->mean, 0, accum);
+  accum->writeChar(',');
+  WriteFixedPoint(irradiance->min, 0, accum);
+  accum->writeChar(',');
+  WriteFixedPoint(irradiance->max, 0, accum);
+#endif
+  accum->writeChar(',');
+  // Ws to hundredths of a Wh is / 36
+  WriteFixedPoint((wattSeconds + 18) / 36, 2, accum);
 
   if(APP_InDebugMode())
   {
     Serial.print(PStringToRAM(s_pstr_irradiance_dbg));
-    Serial.println(buffer);  
+    Serial.println(irradiance->mean);  
   }
 }
 
 #else
 
-void IRR_WriteIrradianceToBuffer(FixedLengthAccumulator * accum)
+uint16_t IRR_ReadingToIrradiance(uint16_t reading) { (void)reading; return 0; }
+
+void IRR_WriteIrradianceToBuffer(const struct stats_summary * irradiance, long wattSeconds, FixedLengthAccumulator * accum)
 {
+	(void)irradiance;
+	(void)wattSeconds;
 	(void)accum;
 }
 
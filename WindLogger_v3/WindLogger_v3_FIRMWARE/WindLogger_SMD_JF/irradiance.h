@@ -1,12 +1,23 @@
 #ifndef _IRRADIANCE_H_
 #define _IRRADIANCE_H_
 
+#define IRRADIANCE_PIN A2
+
 #if READ_IRRADIANCE == 1
-#define IRRADIANCE_HEADERS "Irradiance Wm-2, "
+#if WRITE_CHANNEL_STATS == 1
+#define IRRADIANCE_HEADERS STATS_HEADERS("Irradiance Wm-2") ", Insolation Whm-2, "
+#define IRRADIANCE_COLUMNS (STATS_COLUMNS + 1)
+#else
+#define IRRADIANCE_HEADERS "Irradiance Wm-2, Irr min, Irr max, Insolation Whm-2, "
+#define IRRADIANCE_COLUMNS 4
+#endif
 #else
 #define IRRADIANCE_HEADERS ""
+#define IRRADIANCE_COLUMNS 0
 #endif
 
-void IRR_WriteIrradianceToBuffer(FixedLengthAccumulator * accum);
+uint16_t IRR_ReadingToIrradiance(uint16_t reading);
+
+void IRR_WriteIrradianceToBuffer(const struct stats_summary * irradiance, long wattSeconds, FixedLengthAccumulator * accum);
 
 #endif
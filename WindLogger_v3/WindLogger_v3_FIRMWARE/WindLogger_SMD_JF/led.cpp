@@ -0,0 +1,186 @@
+/*
+ * led.cpp
+ *
+ * Application status LED functionality for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+#include <util/atomic.h>
+
+#include "app.h"
+#include "led.h"
+#include "trace.h"
+
+/*
+ * The LED is driven as a short pulse pattern stepped by the watchdog
+ * interrupt. The watchdog keeps running in power-down sleep, so the CPU
+ * only wakes for a few microseconds at each LED edge instead of busy-waiting.
+ *
+ * Each pattern is a list of steps in PROGMEM. A step is the LED state
+ * (LED_STEP_ON) plus a watchdog timeout (WDTO_15MS, WDTO_30MS ...) that
+ * the state is held for.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define LED_STEP_ON 0x80
+#define LED_STEP_OFF 0x00
+#define LED_STEP_TIME_MASK 0x0F
+#define LED_STEP_END 0xFF
+
+/*
+ * Private Variables
+ */
+
+static const uint8_t s_alivePattern[] PROGMEM = {
+	LED_STEP_ON | WDTO_15MS,
+	LED_STEP_END
+};
+
+static const uint8_t s_errorPattern[] PROGMEM = {
+	LED_STEP_ON | WDTO_15MS, LED_STEP_OFF | WDTO_60MS,
+	LED_STEP_ON | WDTO_15MS, LED_STEP_OFF | WDTO_60MS,
+	LED_STEP_ON | WDTO_15MS, LED_STEP_OFF | WDTO_60MS,
+	LED_STEP_ON | WDTO_15MS, LED_STEP_OFF | WDTO_60MS,
+	LED_STEP_ON | WDTO_15MS, LED_STEP_OFF | WDTO_60MS,
+	LED_STEP_ON | WDTO_15MS,
+	LED_STEP_END
+};
+
+static const uint8_t s_writePattern[] PROGMEM = {
+	LED_STEP_ON | WDTO_15MS,
+	LED_STEP_END
+};
+
+static const uint8_t * const s_patterns[LED_PATTERN_COUNT] PROGMEM = {
+	s_alivePattern,
+	s_errorPattern,
+	s_writePattern
+};
+
+static const uint8_t * volatile s_step = NULL;  // Next step to run (NULL if idle)
+static bool s_enabled = true;
+
+/*
+ * Private Functions
+ */
+
+/*
+ * wdt_interrupt_start, wdt_interrupt_stop
+ * Start the watchdog in interrupt-only mode (no reset) with the given timeout,
+ * or stop it. Must be called with interrupts disabled (the WDCE sequence is timed).
+ */
+static void wdt_interrupt_start(uint8_t timeout)
+{
+	uint8_t prescaler = (timeout & 0x07) | ((timeout & 0x08) ? _BV(WDP3) : 0);
+
+	wdt_reset();
+	MCUSR &= ~_BV(WDRF);
+	WDTCSR = _BV(WDCE) | _BV(WDE);
+	WDTCSR = _BV(WDIE) | prescaler;
+}
+
+static void wdt_interrupt_stop(void)
+{
+	wdt_reset();
+	MCUSR &= ~_BV(WDRF);
+	WDTCSR = _BV(WDCE) | _BV(WDE);
+	WDTCSR = 0;
+}
+
+/*
+ * run_step
+ * Applies the next step of the current pattern and arms the watchdog for it.
+ * At the end of the pattern the LED pin is made an input (saves power).
+ */
+static void run_step(void)
+{
+	uint8_t step = LED_STEP_END;
+
+	if (s_step)
+	{
+		step = pgm_read_byte(s_step);
+	}
+
+	if (step == LED_STEP_END)
+	{
+		digitalWrite(RED_LED_PIN, LOW);
+		pinMode(RED_LED_PIN, INPUT);
+		wdt_interrupt_stop();
+		s_step = NULL;
+		return;
+	}
+
+	digitalWrite(RED_LED_PIN, (step & LED_STEP_ON) ? HIGH : LOW);
+	wdt_interrupt_start(step & LED_STEP_TIME_MASK);
+	s_step++;
+}
+
+/*
+ * Watchdog interrupt
+ * Moves the LED on to the next step.
+ */
+ISR(WDT_vect)
+{
+	TRACE(TRACE_WDT);
+	run_step();
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * LED_Setup
+ * Called by application at startup
+ */
+void LED_Setup(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		wdt_interrupt_stop();
+	}
+	pinMode(RED_LED_PIN, INPUT);
+}
+
+/*
+ * LED_Signal
+ * Starts an LED pattern. Returns immediately, the pattern runs from the watchdog interrupt.
+ * A pattern already running is replaced.
+ */
+void LED_Signal(uint8_t pattern)
+{
+	if (!s_enabled || (pattern >= LED_PATTERN_COUNT)) { return; }
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		s_step = (const uint8_t *)pgm_read_ptr(&s_patterns[pattern]);
+		pinMode(RED_LED_PIN, OUTPUT);
+		run_step();
+	}
+}
+
+/*
+ * LED_IsBusy
+ * Returns TRUE while a pattern is running
+ */
+bool LED_IsBusy(void)
+{
+	return s_step != NULL;
+}
+
+/*
+ * LED_Enable
+ * Allows the LED to be switched off completely (e.g. to save power)
+ */
+void LED_Enable(bool enable)
+{
+	s_enabled = enable;
+}
@@ -0,0 +1,21 @@
+#ifndef _LED_H_
+#define _LED_H_
+
+// Defines
+#define RED_LED_PIN 4      // The output led is on pin 4
+
+enum led_pattern
+{
+	LED_PATTERN_ALIVE = 0,	// One short flash
+	LED_PATTERN_ERROR,		// Six short flashes
+	LED_PATTERN_WRITE,		// One short flash at the start of an SD write
+	LED_PATTERN_COUNT
+};
+
+// Public Functions
+void LED_Setup(void);
+void LED_Signal(uint8_t pattern);
+bool LED_IsBusy(void);
+void LED_Enable(bool enable);
+
+#endif
@@ -0,0 +1,467 @@
+/*
+ * pipeline.cpp
+ *
+ * Acquisition and aggregation stages for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "bench.h"
+#include "trace.h"
+#include "utility.h"
+#include "stats.h"
+#include "rtc.h"
+#include "wind.h"
+#include "battery.h"
+#include "external_volts_amps.h"
+#include "analog.h"
+#include "energy.h"
+#include "irradiance.h"
+#include "temperature.h"
+#include "pipeline.h"
+
+/*
+ * The data path is split into stages joined by small queues of binary structs:
+ *
+ *  Acquisition (every tick)  - a background ADC scan is started on the tick,
+ *                              and its averages go into the sample queue
+ *                              when it finishes
+ *  Aggregation               - samples converted to engineering units and
+ *                              added to the period statistics, then
+ *                              one record per period into the record queue
+ *  Formatting and storage    - sd.cpp turns queued records into CSV lines,
+ *                              as many at a time as it wants
+ *
+ * Sensor read time is therefore independent of when (and how) records are written.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define SAMPLE_QUEUE_MASK (SAMPLE_QUEUE_SIZE - 1)
+#define RECORD_QUEUE_MASK (RECORD_QUEUE_SIZE - 1)
+
+// Energy is only integrated while both of its channels are being read
+#define ENERGY_CHANNELS (ANALOG_CHANNEL_BIT(ANALOG_CH_EXT_VOLTS) | ANALOG_CHANNEL_BIT(ANALOG_CH_EXT_AMPS))
+
+#if ((SAMPLE_QUEUE_SIZE & SAMPLE_QUEUE_MASK) != 0) || ((RECORD_QUEUE_SIZE & RECORD_QUEUE_MASK) != 0)
+#error "Pipeline queue sizes must be powers of two"
+#endif
+
+/*
+ * Private Variables
+ */
+
+// The analog channel of each pipeline channel (enum pipe_channel)
+static const uint8_t s_analogChannels[PIPE_CHANNEL_COUNT] PROGMEM = {
+	ANALOG_CH_BATTERY,
+#if READ_EXTERNAL_VOLTS == 1
+	ANALOG_CH_EXT_VOLTS,
+#endif
+#if READ_EXTERNAL_AMPS == 1
+	ANALOG_CH_EXT_AMPS,
+#endif
+#if READ_IRRADIANCE == 1
+	ANALOG_CH_IRRADIANCE,
+#endif
+#if READ_TEMPERATURE == 1
+	ANALOG_CH_TEMPERATURE,
+#endif
+};
+
+static uint8_t s_vaneInterval = 1;  // Read the vane every this many ticks
+static uint8_t s_vaneCountdown = 0;
+static uint8_t s_scanMask = 0;  // Channels in the scan started this tick
+
+static struct sample s_samples[SAMPLE_QUEUE_SIZE];
+static uint8_t s_sampleTail = 0;
+static uint8_t s_sampleCount = 0;
+
+static ChannelStats s_stats[PIPE_CHANNEL_COUNT];
+static uint16_t s_ticks = 0;  // Number of samples in the period
+static int16_t s_lastValues[PIPE_CHANNEL_COUNT];  // Used when a snapshot has no samples yet
+
+static struct record s_records[RECORD_QUEUE_SIZE];
+static uint8_t s_recordTail = 0;
+static uint8_t s_recordCount = 0;
+
+/*
+ * Private Functions
+ */
+
+/*
+ * analog_channel, pipe_channel
+ * The analog channel of a pipeline channel, and the pipeline channel of an
+ * analog channel (PIPE_CHANNEL_COUNT if it isn't built in)
+ */
+static uint8_t analog_channel(uint8_t ch)
+{
+	return pgm_read_byte(&s_analogChannels[ch]);
+}
+
+static uint8_t pipe_channel(uint8_t analog)
+{
+	uint8_t ch = 0;
+	while ((ch < PIPE_CHANNEL_COUNT) && (analog_channel(ch) != analog)) { ch++; }
+	return ch;
+}
+
+/*
+ * clamp_int16
+ * Limits a value to the 16 bits the channel statistics are kept in
+ */
+static int16_t clamp_int16(long value)
+{
+	if (value > INT16_MAX) { return INT16_MAX; }
+	if (value < INT16_MIN) { return INT16_MIN; }
+	return (int16_t)value;
+}
+
+/*
+ * convert_reading
+ * Converts a reading to the units the channel statistics are kept in:
+ * battery mV, external volts and amps in hundredths, irradiance W/m^2
+ * and temperature in hundredths of a degree C
+ */
+static int16_t convert_reading(uint8_t ch, uint16_t reading)
+{
+	switch(analog_channel(ch))
+	{
+		case ANALOG_CH_BATTERY: return (int16_t)BATT_ReadingToMillivolts(reading);
+		case ANALOG_CH_EXT_VOLTS: return clamp_int16(VA_ReadingToMillivolts(reading) / 10);
+		case ANALOG_CH_EXT_AMPS: return clamp_int16(VA_ReadingToMilliamps(reading) / 10);
+		case ANALOG_CH_IRRADIANCE: return (int16_t)IRR_ReadingToIrradiance(reading);
+		case ANALOG_CH_TEMPERATURE: return TEMP_ReadingToCentidegrees(reading);
+		default: return 0;
+	}
+}
+
+/*
+ * summarise_channels
+ * Fills the record with the statistics of each channel over the samples so far
+ */
+static void summarise_channels(struct record * rec)
+{
+	for (uint8_t ch = 0; ch < PIPE_CHANNEL_COUNT; ch++)
+	{
+		if (s_stats[ch].count())
+		{
+			s_stats[ch].summarise(&rec->channels[ch]);
+		}
+		else
+		{
+			rec->channels[ch].mean = s_lastValues[ch];
+#if WRITE_CHANNEL_STATS == 1
+			rec->channels[ch].sd = 0;
+#endif
+			rec->channels[ch].min = s_lastValues[ch];
+			rec->channels[ch].max = s_lastValues[ch];
+		}
+	}
+
+#if READ_IRRADIANCE == 1
+	rec->insolation = s_stats[PIPE_CH_IRRADIANCE].total();
+#else
+	rec->insolation = 0;
+#endif
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * PIPE_StartAcquisition
+ * Called by application every tick to start the background ADC scan.
+ * The readings are collected by PIPE_AcquireSample when it finishes.
+ */
+void PIPE_StartAcquisition(void)
+{
+	// The last scan's readings may not have been collected yet (its event still queued):
+	// take them now, as the ADC won't start another scan over them
+	PIPE_AcquireSample();
+
+	uint8_t mask = ANALOG_GetAvailableChannels();
+	uint8_t vane = mask & ANALOG_CHANNEL_BIT(ANALOG_CH_VANE);
+
+	mask &= ~vane;
+
+#if READ_WIND_DIRECTION == 1
+	if (s_vaneCountdown == 0)
+	{
+		mask |= vane;
+		s_vaneCountdown = s_vaneInterval;
+	}
+	s_vaneCountdown--;
+#endif
+
+	if (ANALOG_StartScan(mask))
+	{
+		s_scanMask = mask;
+	}
+}
+
+/*
+ * PIPE_AcquireSample
+ * Called by application when the ADC scan has finished, to queue its readings.
+ * Does nothing if there are no new readings.
+ */
+void PIPE_AcquireSample(void)
+{
+	if (!ANALOG_ResultsReady()) { return; }
+
+	if (s_sampleCount == SAMPLE_QUEUE_SIZE)
+	{
+		// Aggregation has fallen behind - catch up rather than drop a sample
+		PIPE_Aggregate();
+	}
+
+	struct sample * sample = &s_samples[(s_sampleTail + s_sampleCount) & SAMPLE_QUEUE_MASK];
+
+	for (uint8_t ch = 0; ch < PIPE_CHANNEL_COUNT; ch++)
+	{
+		sample->adc[ch] = ANALOG_GetAverage(analog_channel(ch));
+	}
+
+	sample->vane = VANE_NOT_SAMPLED;
+	if (s_scanMask & ANALOG_CHANNEL_BIT(ANALOG_CH_VANE))
+	{
+		// Direction banding works in 10-bit counts
+		sample->vane = ANALOG_GetAverage(ANALOG_CH_VANE) >> ANALOG_MAX_EXTRA_BITS;
+	}
+
+	ANALOG_ReleaseResults();
+
+	s_sampleCount++;
+}
+
+/*
+ * PIPE_SetVaneInterval
+ * Sets how often (in ticks) the wind vane is read. 1 = every tick.
+ */
+void PIPE_SetVaneInterval(uint8_t ticks)
+{
+	s_vaneInterval = ticks ? ticks : 1;
+	s_vaneCountdown = 0;
+}
+
+/*
+ * PIPE_Aggregate
+ * Adds all queued samples to the period statistics
+ */
+void PIPE_Aggregate(void)
+{
+	uint8_t available = ANALOG_GetAvailableChannels();
+
+	while (s_sampleCount)
+	{
+		const struct sample * sample = &s_samples[s_sampleTail];
+
+		for (uint8_t ch = 0; ch < PIPE_CHANNEL_COUNT; ch++)
+		{
+			if (available & ANALOG_CHANNEL_BIT(analog_channel(ch)))
+			{
+				s_lastValues[ch] = convert_reading(ch, sample->adc[ch]);
+				s_stats[ch].add(s_lastValues[ch]);
+			}
+		}
+
+		// Want to measure the wind direction every second to give good direction analysis
+		// This increments the windDirectionArray
+		if (sample->vane != VANE_NOT_SAMPLED)
+		{
+			WIND_ConvertWindDirection(sample->vane);
+		}
+
+#if READ_ENERGY == 1
+		// Energy has to be integrated tick by tick, not from the period means
+		if ((available & ENERGY_CHANNELS) == ENERGY_CHANNELS)
+		{
+			ENERGY_AddSample(sample->adc[PIPE_CH_EXT_VOLTS], sample->adc[PIPE_CH_EXT_AMPS]);
+		}
+#endif
+
+		s_ticks++;
+		s_sampleTail = (s_sampleTail + 1) & SAMPLE_QUEUE_MASK;
+		s_sampleCount--;
+	}
+}
+
+/*
+ * PIPE_CompletePeriod
+ * Called by application at the end of the sample period.
+ * Turns the period statistics into a record and resets them.
+ * Returns false if the record queue was full (the oldest record is lost).
+ */
+bool PIPE_CompletePeriod(void)
+{
+	bool queued = true;
+
+	BENCH_BEGIN(BENCH_RECORD);
+	TRACE_BEGIN(TRACE_RECORD);
+
+	// The scan for the final tick of the period may still be running
+	ANALOG_WaitForScan();
+	PIPE_AcquireSample();
+	PIPE_Aggregate();
+
+	if (s_recordCount == RECORD_QUEUE_SIZE)
+	{
+		PIPE_ReleaseRecord();
+		queued = false;
+	}
+
+	struct record * rec = &s_records[(s_recordTail + s_recordCount) & RECORD_QUEUE_MASK];
+
+	RTC_GetTimestamp(&rec->time);
+	rec->ticks = s_ticks;
+
+	// *********** WIND SPEED ******************************************
+	// The number of pulses in the sample time gives us the average wind speed.
+	// This can be converted into the wind speed using the time and
+	// the pulse-wind speed characterisitic of the anemometer.
+	// Do this as post processing - pulse count is most important.
+	WIND_StoreWindPulseCounts(rec->pulses);
+	rec->direction = WIND_AnalyseWindDirection();
+
+	summarise_channels(rec);
+#if READ_ENERGY == 1
+	ENERGY_StorePeriod(&rec->energy);
+#endif
+
+	for (uint8_t ch = 0; ch < PIPE_CHANNEL_COUNT; ch++)
+	{
+		s_stats[ch].reset();
+	}
+	s_ticks = 0;
+
+	s_recordCount++;
+	TRACE_END(TRACE_RECORD);
+	BENCH_END(BENCH_RECORD);
+	return queued;
+}
+
+/*
+ * PIPE_SnapshotRecord
+ * Fills a record from the period so far, without resetting anything.
+ * Used for the live data output in calibrate mode.
+ */
+void PIPE_SnapshotRecord(struct record * rec)
+{
+	if (!rec) { return; }
+
+	PIPE_Aggregate();
+
+	RTC_GetTimestamp(&rec->time);
+	rec->ticks = s_ticks;
+	rec->pulses[0] = WIND_GetLivePulseCount(0);
+	rec->pulses[1] = WIND_GetLivePulseCount(1);
+	rec->direction = WIND_GetDominantDirection();
+	summarise_channels(rec);
+#if READ_ENERGY == 1
+	ENERGY_SnapshotPeriod(&rec->energy);
+#endif
+}
+
+/*
+ * PIPE_GetPeriod, PIPE_GetPeriodChannel, PIPE_SetPeriod, PIPE_SetPeriodChannel
+ * The period ticks and statistics so far, saved and restored by checkpoint.cpp
+ * a channel at a time. PIPE_GetPeriod takes in any samples still queued, so call
+ * it before the channels. Each channel carries on from its summary, so the mean
+ * and sd after a restore are close to, not exactly, what they would have been.
+ * The channels are analog channels (below PIPE_ANALOG_CHANNELS): one that isn't
+ * built in has an empty summary, and one restored to it is ignored.
+ */
+uint16_t PIPE_GetPeriod(void)
+{
+	PIPE_Aggregate();
+	return s_ticks;
+}
+
+void PIPE_GetPeriodChannel(uint8_t analog, struct channel_period * channel)
+{
+	uint8_t ch = pipe_channel(analog);
+	struct stats_summary summary;
+
+	if (ch == PIPE_CHANNEL_COUNT)
+	{
+		memset(channel, 0, sizeof(*channel));
+		return;
+	}
+
+	s_stats[ch].summarise(&summary);
+
+	channel->count = s_stats[ch].count();
+	channel->mean = summary.mean;
+#if WRITE_CHANNEL_STATS == 1
+	channel->sd = summary.sd;
+#else
+	channel->sd = 0;
+#endif
+	channel->min = summary.min;
+	channel->max = summary.max;
+}
+
+void PIPE_SetPeriod(uint16_t ticks)
+{
+	s_ticks = ticks;
+}
+
+void PIPE_SetPeriodChannel(uint8_t analog, const struct channel_period * channel)
+{
+	uint8_t ch = pipe_channel(analog);
+	if (ch == PIPE_CHANNEL_COUNT) { return; }
+
+	s_stats[ch].restore(channel->count, channel->mean, channel->sd, channel->min, channel->max);
+	if (channel->count) { s_lastValues[ch] = channel->mean; }
+}
+
+/*
+ * PIPE_RecordCount
+ * Returns the number of records waiting to be stored
+ */
+uint8_t PIPE_RecordCount(void)
+{
+	return s_recordCount;
+}
+
+/*
+ * PIPE_PeekRecord
+ * Returns the oldest waiting record (or NULL if there are none).
+ * The record stays queued until PIPE_ReleaseRecord is called.
+ */
+const struct record * PIPE_PeekRecord(void)
+{
+	return s_recordCount ? &s_records[s_recordTail] : NULL;
+}
+
+/*
+ * PIPE_NewestRecord
+ * Returns the most recently queued record (or NULL if there are none)
+ */
+const struct record * PIPE_NewestRecord(void)
+{
+	return s_recordCount ? &s_records[(s_recordTail + s_recordCount - 1) & RECORD_QUEUE_MASK] : NULL;
+}
+
+/*
+ * PIPE_ReleaseRecord
+ * Removes the oldest record from the queue
+ */
+void PIPE_ReleaseRecord(void)
+{
+	if (s_recordCount)
+	{
+		s_recordTail = (s_recordTail + 1) & RECORD_QUEUE_MASK;
+		s_recordCount--;
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// Queue depths. Both must be powers of two.
+// Each record is 51 bytes of RAM (71 with energy). Records are only queued for more than a
+// moment in conserve (power.cpp), which writes them RECORD_QUEUE_SIZE at a time.
+#define SAMPLE_QUEUE_SIZE 2
+#define RECORD_QUEUE_SIZE 2
+
+// The analog channels averaged over each sample period: the analog scan channels built in,
+// less the vane which is handled separately. In the same order as the analog channels.
+// A channel that isn't built in takes no room in the samples, statistics and records.
+enum pipe_channel
+{
+	PIPE_CH_BATTERY,
+#if READ_EXTERNAL_VOLTS == 1
+	PIPE_CH_EXT_VOLTS,
+#endif
+#if READ_EXTERNAL_AMPS == 1
+	PIPE_CH_EXT_AMPS,
+#endif
+#if READ_IRRADIANCE == 1
+	PIPE_CH_IRRADIANCE,
+#endif
+#if READ_TEMPERATURE == 1
+	PIPE_CH_TEMPERATURE,
+#endif
+	PIPE_CHANNEL_COUNT
+};
+
+// Every analog channel that can be averaged (all but the vane), built in or not.
+// A checkpoint has a place for each, so its layout is the same whichever are built in.
+#define PIPE_ANALOG_CHANNELS ANALOG_CH_VANE
+
+// Marks a tick on which the vane was not read
+#define VANE_NOT_SAMPLED 0xFFFF
+
+// Raw readings taken on one tick
+struct sample
+{
+	uint16_t adc[PIPE_CHANNEL_COUNT];  // ANALOG_RESULT_BITS scale
+	uint16_t vane;	// 10-bit
+};
+
+// One channel's statistics for the period so far, as kept in a checkpoint (checkpoint.h)
+struct channel_period
+{
+	uint16_t count;
+	int16_t mean;
+	int16_t sd;		// 0 without WRITE_CHANNEL_STATS
+	int16_t min;
+	int16_t max;
+} __attribute__((packed));
+
+// Everything needed to write one data record, in binary form
+struct record
+{
+	struct timestamp time;	// End of the sample period
+	uint16_t ticks;			// Number of samples aggregated into this record
+	long pulses[2];			// Anemometer pulses in the period
+	uint8_t direction;		// Most frequent direction (0 = N, 1 = NE ... 7 = NW)
+	struct stats_summary channels[PIPE_CHANNEL_COUNT];  // Period statistics of each analog channel (see pipeline.cpp for units)
+#if READ_ENERGY == 1
+	struct energy energy;	// Integrated from the external volts and amps every tick
+#endif
+	long insolation;		// Sum of the tick irradiances, Ws/m^2
+};
+
+// Public Functions
+
+// Acquisition stage (per tick)
+void PIPE_StartAcquisition(void);
+void PIPE_AcquireSample(void);
+void PIPE_SetVaneInterval(uint8_t ticks);
+
+// Aggregation stage
+void PIPE_Aggregate(void);
+bool PIPE_CompletePeriod(void);
+void PIPE_SnapshotRecord(struct record * rec);
+uint16_t PIPE_GetPeriod(void);
+void PIPE_GetPeriodChannel(uint8_t analog, struct channel_period * channel);
+void PIPE_SetPeriod(uint16_t ticks);
+void PIPE_SetPeriodChannel(uint8_t analog, const struct channel_period * channel);
+
+// Record queue, consumed by the storage stage
+uint8_t PIPE_RecordCount(void);
+const struct record * PIPE_PeekRecord(void);
+const struct record * PIPE_NewestRecord(void);
+void PIPE_ReleaseRecord(void);
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ * power.cpp
+ *
+ * Application power management functionality for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "utility.h"
+#include "stats.h"
+#include "eeprom_storage.h"
+#include "led.h"
+#include "rtc.h"
+#include "analog.h"
+#include "energy.h"
+#include "irradiance.h"
+#include "pipeline.h"
+#include "sd.h"
+#include "checkpoint.h"
+#include "power.h"
+
+/*
+ * The logger steps down through three power states as the battery voltage falls:
+ *
+ *  NORMAL   - everything as configured
+ *  CONSERVE - vane read less often, records batched per SD write,
+ *             no serial echo and no LED
+ *  SURVIVAL - as conserve, with the vane read even less often
+ *             and only hourly records
+ *
+ * Each state has separate enter and exit thresholds (hysteresis),
+ * so a battery sitting on a threshold does not flip the state every period.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+// Readings below this are taken as "no battery fitted" (e.g. on USB power)
+#define POWER_MIN_VALID_MV 1000
+
+#define SURVIVAL_SAMPLE_TIME 3600
+
+struct power_settings
+{
+	uint8_t vane_interval;
+	uint8_t records_per_flush;
+	bool serial_echo;
+	bool led;
+	long sample_time_override;
+};
+
+/*
+ * Private Variables
+ */
+
+static const uint16_t s_defaultThresholds[POWER_THRESHOLD_COUNT] PROGMEM = {
+	3600, 3750,	// Conserve enter/exit
+	3400, 3550	// Survival enter/exit
+};
+
+static const struct power_settings s_settings[] PROGMEM = {
+	{1, 1, true, true, 0},								// POWER_NORMAL
+	{4, RECORD_QUEUE_SIZE, false, false, 0},			// POWER_CONSERVE
+	{16, 1, false, false, SURVIVAL_SAMPLE_TIME}			// POWER_SURVIVAL (records are hourly, so each is stored as it is made)
+};
+
+static const char s_pstr_state_names[][9] PROGMEM = {"NORMAL", "CONSERVE", "SURVIVAL"};
+const char s_pstr_power[] PROGMEM = "Power ";
+const char s_pstr_threshold[] PROGMEM = "Power threshold ";
+static const char s_pstr_mv[] PROGMEM = "mV";
+
+static uint16_t s_thresholds[POWER_THRESHOLD_COUNT];
+static uint8_t s_state = POWER_NORMAL;
+
+/*
+ * Private Functions
+ */
+
+/*
+ * apply_state
+ * Sets up the other modules for the current power state
+ */
+static void apply_state(void)
+{
+	struct power_settings settings;
+	memcpy_P(&settings, &s_settings[s_state], sizeof(settings));
+
+	PIPE_SetVaneInterval(settings.vane_interval);
+	SD_SetRecordsPerFlush(settings.records_per_flush);
+	SD_SetSerialEcho(settings.serial_echo);
+	LED_Enable(settings.led);
+	SD_SetSampleTimeOverride(settings.sample_time_override);
+}
+
+/*
+ * log_state_change
+ * Writes an event row such as "Power CONSERVE 3520mV"
+ */
+static void log_state_change(uint16_t battery_mv)
+{
+	char mv[6];
+	FixedLengthAccumulator * accum = SD_StartEventRow();
+
+	accum->writeString(PStringToRAM(s_pstr_power));
+	accum->writeString(PStringToRAM(s_pstr_state_names[s_state]));
+	accum->writeChar(' ');
+	accum->writeString(utoa(battery_mv, mv, 10));
+	accum->writeString(PStringToRAM(s_pstr_mv));
+
+	SD_WriteEventRow();
+}
+
+/*
+ * next_state
+ * Works out the new power state for a battery voltage
+ */
+static uint8_t next_state(uint16_t battery_mv)
+{
+	switch(s_state)
+	{
+		case POWER_NORMAL:
+			if (battery_mv < s_thresholds[POWER_SURVIVAL_ENTER]) { return POWER_SURVIVAL; }
+			if (battery_mv < s_thresholds[POWER_CONSERVE_ENTER]) { return POWER_CONSERVE; }
+			break;
+
+		case POWER_CONSERVE:
+			if (battery_mv < s_thresholds[POWER_SURVIVAL_ENTER]) { return POWER_SURVIVAL; }
+			if (battery_mv > s_thresholds[POWER_CONSERVE_EXIT]) { return POWER_NORMAL; }
+			break;
+
+		case POWER_SURVIVAL:
+			if (battery_mv > s_thresholds[POWER_SURVIVAL_EXIT])
+			{
+				return (battery_mv > s_thresholds[POWER_CONSERVE_EXIT]) ? POWER_NORMAL : POWER_CONSERVE;
+			}
+			break;
+	}
+
+	return s_state;
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * POWER_Setup
+ * Called by application at startup to read the thresholds from EEPROM
+ */
+void POWER_Setup(void)
+{
+	for (uint8_t i = 0; i < POWER_THRESHOLD_COUNT; i++)
+	{
+		s_thresholds[i] = EEPROM_GetPowerThreshold(i);
+		if (s_thresholds[i] == 0xFFFF)
+		{
+			// Never been set - use the default
+			s_thresholds[i] = pgm_read_word(&s_defaultThresholds[i]);
+		}
+	}
+
+	s_state = POWER_NORMAL;
+	apply_state();
+}
+
+/*
+ * POWER_Update
+ * Called by application once per sample period with the period battery voltage
+ */
+void POWER_Update(uint16_t battery_mv)
+{
+	if (battery_mv < POWER_MIN_VALID_MV) { return; }
+
+	uint8_t new_state = next_state(battery_mv);
+
+	if (new_state != s_state)
+	{
+		// Write out anything queued under the old state first, so the rows stay in order
+		SD_StoreRecords();
+
+		if (new_state == POWER_SURVIVAL)
+		{
+			// The battery may not last until the next checkpoint
+			CHECKPOINT_Save();
+		}
+
+		s_state = new_state;
+		apply_state();
+		log_state_change(battery_mv);
+	}
+}
+
+/*
+ * POWER_GetState
+ * Returns the current power state
+ */
+uint8_t POWER_GetState(void)
+{
+	return s_state;
+}
+
+/*
+ * POWER_StoreNewThreshold
+ * Called by application to set a new threshold (in mV)
+ * and store in EEPROM
+ */
+void POWER_StoreNewThreshold(uint8_t index, uint16_t millivolts)
+{
+	if (index >= POWER_THRESHOLD_COUNT) { return; }
+
+	s_thresholds[index] = millivolts;
+
+	Serial.print(PStringToRAM(s_pstr_threshold));
+	Serial.print(index + 1);
+	Serial.print(':');
+	Serial.println(millivolts);
+
+	EEPROM_SetPowerThreshold(index, millivolts);
+}
+
+/*
+ * POWER_GetThreshold
+ * Returns a threshold in use (in mV)
+ */
+uint16_t POWER_GetThreshold(uint8_t index)
+{
+	return (index < POWER_THRESHOLD_COUNT) ? s_thresholds[index] : 0;
+}
@@ -0,0 +1,30 @@
+#ifndef _POWER_H_
+#define _POWER_H_
+
+// Defines
+
+enum power_state
+{
+	POWER_NORMAL = 0,
+	POWER_CONSERVE,
+	POWER_SURVIVAL
+};
+
+// Indexes of the battery voltage thresholds (in mV) stored in EEPROM
+enum power_threshold
+{
+	POWER_CONSERVE_ENTER = 0,	// Go to conserve below this
+	POWER_CONSERVE_EXIT,		// Back to normal above this
+	POWER_SURVIVAL_ENTER,		// Go to survival below this
+	POWER_SURVIVAL_EXIT,		// Leave survival above this
+	POWER_THRESHOLD_COUNT
+};
+
+// Public Functions
+void POWER_Setup(void);
+void POWER_Update(uint16_t battery_mv);
+uint8_t POWER_GetState(void);
+void POWER_StoreNewThreshold(uint8_t index, uint16_t millivolts);
+uint16_t POWER_GetThreshold(uint8_t index);
+
+#endif
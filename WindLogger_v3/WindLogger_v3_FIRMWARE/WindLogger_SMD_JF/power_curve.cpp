@@ -0,0 +1,184 @@
+/*
+ * power_curve.cpp
+ *
+ * Power curve (method of bins) for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+#include <math.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "utility.h"
+#include "rtc.h"
+#include "power_curve.h"
+
+/*
+ * Each sample period gives one point: the mean wind speed (from the
+ * anemometer 1 pulse count) and the mean electrical power (from the
+ * energy integration). The point is added to the 0.5m/s wide bin for its
+ * wind speed, which keeps a count, the sum of power and the sum of power
+ * squared - enough for the mean and standard deviation of each bin.
+ *
+ * This is the "method of bins" used for turbine power curves, which is
+ * based on period means (normally 10 minutes) rather than single seconds.
+ *
+ * The bins cover one day. At midnight the application writes them to
+ * the card as a small summary file and starts again.
+ */
+
+#if PCURVE_ENABLED
+
+/*
+ * Defines and Typedefs
+ */
+
+struct bin
+{
+	uint16_t count;
+	long sumWatts;
+	float sumSquares;	// W^2 - too large for 32-bit integers over a day of 1s periods
+};
+
+/*
+ * Private Variables
+ */
+
+static struct bin s_bins[PCURVE_BINS];	// 10 bytes each
+static struct timestamp s_date;		// Day the bins were collected on
+static bool s_hasData = false;
+
+static const char s_pstr_pcurve_headers[] PROGMEM = PCURVE_HEADERS;
+
+/*
+ * Public Functions
+ */
+
+/*
+ * PCURVE_AddPeriod
+ * Called by application at the end of each sample period
+ */
+void PCURVE_AddPeriod(const struct timestamp * time, uint16_t speed_mms, long mean_milliwatts)
+{
+	if (!time) { return; }
+
+	uint8_t index = speed_mms / PCURVE_BIN_WIDTH_MMS;
+	if (index >= PCURVE_BINS) { index = PCURVE_BINS - 1; }
+
+	long watts = (mean_milliwatts >= 0) ? (mean_milliwatts + 500) / 1000 : (mean_milliwatts - 500) / 1000;
+
+	struct bin * bin = &s_bins[index];
+	if (bin->count < 0xFFFF)
+	{
+		bin->count++;
+		bin->sumWatts += watts;
+		bin->sumSquares += (float)watts * (float)watts;
+	}
+
+	if (!s_hasData)
+	{
+		s_date = *time;
+		s_hasData = true;
+	}
+}
+
+/*
+ * PCURVE_DayHasEnded
+ * Returns TRUE if the bins hold data from a day before "now"
+ */
+bool PCURVE_DayHasEnded(const struct timestamp * now)
+{
+	if (!s_hasData || !now) { return false; }
+
+	return (now->day != s_date.day) || (now->month != s_date.month) || (now->year != s_date.year);
+}
+
+/*
+ * PCURVE_GetDate
+ * Returns the date the bins were collected on
+ */
+const struct timestamp * PCURVE_GetDate(void)
+{
+	return &s_date;
+}
+
+/*
+ * PCURVE_Reset
+ * Clears all bins (after they have been written out)
+ */
+void PCURVE_Reset(void)
+{
+	memset(s_bins, 0, sizeof(s_bins));
+	s_hasData = false;
+}
+
+/*
+ * PCURVE_WriteBinToBuffer
+ * Writes "Speed m/s, Count, Mean W, SD W" for one bin (speed is the bin centre).
+ * Returns FALSE (and writes nothing) if the bin is empty.
+ */
+bool PCURVE_WriteBinToBuffer(uint8_t index, FixedLengthAccumulator * accum)
+{
+	if ((index >= PCURVE_BINS) || !accum) { return false; }
+
+	const struct bin * bin = &s_bins[index];
+	if (bin->count == 0) { return false; }
+
+	float mean = (float)bin->sumWatts / bin->count;
+	float variance = (bin->sumSquares / bin->count) - (mean * mean);
+	long sd = (variance > 0.0f) ? (long)(sqrt(variance) + 0.5f) : 0;
+
+	// Bin centre in cm/s
+	WriteFixedPoint(((long)index * PCURVE_BIN_WIDTH_MMS + (PCURVE_BIN_WIDTH_MMS / 2)) / 10, 2, accum);
+	accum->writeChar(',');
+	WriteFixedPoint(bin->count, 0, accum);
+	accum->writeChar(',');
+	WriteFixedPoint(lround(mean), 0, accum);
+	accum->writeChar(',');
+	WriteFixedPoint(sd, 0, accum);
+	return true;
+}
+
+/*
+ * PCURVE_PrintToSerial
+ * Prints the date and the non-empty bins so far today
+ */
+void PCURVE_PrintToSerial(void)
+{
+	char line[40];
+	FixedLengthAccumulator accum(line, sizeof(line));
+
+	if (s_hasData)
+	{
+		RTC_WriteDateToBuffer(&s_date, &accum);
+		Serial.println(line);
+	}
+
+	Serial.println((const __FlashStringHelper *)s_pstr_pcurve_headers);
+
+	for (uint8_t i = 0; i < PCURVE_BINS; i++)
+	{
+		accum.reset();
+		if (PCURVE_WriteBinToBuffer(i, &accum))
+		{
+			Serial.println(line);
+		}
+	}
+}
+
+#else
+
+void PCURVE_AddPeriod(const struct timestamp * time, uint16_t speed_mms, long mean_milliwatts) { (void)time; (void)speed_mms; (void)mean_milliwatts; }
+bool PCURVE_DayHasEnded(const struct timestamp * now) { (void)now; return false; }
+const struct timestamp * PCURVE_GetDate(void) { return NULL; }
+void PCURVE_Reset(void) {}
+bool PCURVE_WriteBinToBuffer(uint8_t index, FixedLengthAccumulator * accum) { (void)index; (void)accum; return false; }
+void PCURVE_PrintToSerial(void) {}
+
+#endif
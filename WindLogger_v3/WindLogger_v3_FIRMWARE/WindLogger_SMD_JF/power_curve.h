@@ -0,0 +1,26 @@
+#ifndef _POWER_CURVE_H_
+#define _POWER_CURVE_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// Needs both wind speed and electrical power
+#define PCURVE_ENABLED ((READ_WINDSPEED == 1) && READ_ENERGY)
+
+#define PCURVE_BIN_WIDTH_MMS 500	// 0.5m/s bins
+#define PCURVE_BINS 24				// 0 to 12m/s, faster periods go in the last bin
+
+#define PCURVE_HEADERS "Speed m/s, Count, Mean W, SD W"
+
+// Public Functions
+void PCURVE_AddPeriod(const struct timestamp * time, uint16_t speed_mms, long mean_milliwatts);
+
+bool PCURVE_DayHasEnded(const struct timestamp * now);
+const struct timestamp * PCURVE_GetDate(void);
+void PCURVE_Reset(void);
+
+bool PCURVE_WriteBinToBuffer(uint8_t index, FixedLengthAccumulator * accum);
+void PCURVE_PrintToSerial(void);
+
+#endif
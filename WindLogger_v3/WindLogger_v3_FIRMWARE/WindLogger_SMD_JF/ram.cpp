@@ -0,0 +1,150 @@
+/*
+ * ram.cpp
+ *
+ * Free RAM and stack high-water measurement for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "utility.h"
+#include "sd.h"
+#include "ram.h"
+
+/*
+ * The RAM from the end of .bss to the top is filled with a pattern at
+ * reset, before the C runtime starts. The stack grows down into it from
+ * the top, interrupts included, and however deep it goes the pattern
+ * below is left as it was. So counting the pattern up from the end of
+ * .bss (or the heap, if malloc() has been used) gives the least free RAM
+ * there has been since reset: the stack's high-water mark.
+ *
+ * RAM_Free is the gap to the stack pointer now, for comparison.
+ */
+
+#if RAM_MONITOR == 1
+
+/*
+ * Defines and Typedefs
+ */
+
+#define PAINT 0xC5
+
+extern uint8_t __heap_start;	// The end of .bss (avr-libc)
+extern char * __brkval;			// The top of the heap, NULL until malloc() is used
+
+/*
+ * Private Variables
+ */
+
+static const char s_pstr_ram[] PROGMEM = "RAM free ";
+static const char s_pstr_least[] PROGMEM = " least ";
+
+/*
+ * Private Functions
+ */
+
+/*
+ * ram_paint
+ * In .init1, before the stack pointer and r1 are set up (.init2),
+ * so no C and nothing on the stack. Fills __heap_start to RAMEND.
+ */
+void ram_paint(void) __attribute__((naked, used, section(".init1")));
+void ram_paint(void)
+{
+	__asm volatile (
+		"    ldi r30, lo8(__heap_start)\n"
+		"    ldi r31, hi8(__heap_start)\n"
+		"    ldi r24, %0\n"
+		"    ldi r25, hi8(%1)\n"
+		"    rjmp 2f\n"
+		"1:  st Z+, r24\n"
+		"2:  cpi r30, lo8(%1)\n"
+		"    cpc r31, r25\n"
+		"    brlo 1b\n"
+		"    breq 1b\n"
+		:: "M" (PAINT), "i" (RAMEND));
+}
+
+static uint8_t * heap_end(void)
+{
+	return __brkval ? (uint8_t *)__brkval : &__heap_start;
+}
+
+static void write_figures(FixedLengthAccumulator * accum)
+{
+	char number[6];
+
+	accum->writeString(PStringToRAM(s_pstr_ram));
+	accum->writeString(utoa(RAM_Free(), number, 10));
+	accum->writeString(PStringToRAM(s_pstr_least));
+	accum->writeString(utoa(RAM_LeastFree(), number, 10));
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * RAM_Free
+ * Bytes between the end of the heap and the stack pointer now
+ */
+uint16_t RAM_Free(void)
+{
+	return (uint16_t)(SP - (uintptr_t)heap_end());
+}
+
+/*
+ * RAM_LeastFree
+ * The fewest bytes there have been between the heap and the stack since reset
+ */
+uint16_t RAM_LeastFree(void)
+{
+	const uint8_t * p = heap_end();
+	uint16_t count = 0;
+
+	while ((p[count] == PAINT) && ((uintptr_t)&p[count] < SP))
+	{
+		count++;
+	}
+	return count;
+}
+
+/*
+ * RAM_PrintToSerial
+ * Prints "RAM free 412 least 287" (bytes)
+ */
+void RAM_PrintToSerial(void)
+{
+	char line[28];
+	FixedLengthAccumulator accum(line, sizeof(line));
+
+	write_figures(&accum);
+	Serial.println(accum.c_str());
+}
+
+/*
+ * RAM_WriteDiagnostics
+ * Writes the same as an event row in the data file
+ */
+void RAM_WriteDiagnostics(void)
+{
+	write_figures(SD_StartEventRow());
+	SD_WriteEventRow();
+}
+
+#else
+
+uint16_t RAM_Free(void) { return 0; }
+uint16_t RAM_LeastFree(void) { return 0; }
+void RAM_PrintToSerial(void) {}
+void RAM_WriteDiagnostics(void) {}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _RAM_H_
+#define _RAM_H_
+
+// Public Functions
+
+uint16_t RAM_Free(void);
+uint16_t RAM_LeastFree(void);
+
+void RAM_PrintToSerial(void);
+void RAM_WriteDiagnostics(void);
+
+#endif
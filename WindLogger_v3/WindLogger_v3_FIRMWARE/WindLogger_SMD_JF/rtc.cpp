@@ -9,13 +9,16 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+// The library is compiled here (the other files include it with LIBCALL_ENABLEINTERRUPT).
+// Nothing uses a port C (analog) pin change interrupt, so its handler and table are left out.
+#define EI_NOTPORTC
 #include <EnableInterrupt.h>
 #include <Rtc_Pcf8563.h>
 
 #include "app.h"
-#include "rtc.h"
 #include "utility.h"
-#include "sd.h"
+#include "rtc.h"
+#include "trace.h"
 
 /************ Real Time Clock code*******************
  * A PCF8563 RTC is attached to pins:
@@ -41,6 +44,8 @@
 static Rtc_Pcf8563 s_rtc;
 static int s_interrupt_pin;
 
+static const uint8_t s_daysInMonth[12] PROGMEM = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
 /* 
  * Private Functions
  */
@@ -54,13 +59,13 @@ static int s_interrupt_pin;
  *
  *  Description: I use the CLK_OUT from the RTC to give me exact 1Hz signal
  *               To do this I changed the initialise the RTC with the CLKOUT at 1Hz
+ *               The interrupt stays enabled so that no tick is ever missed,
+ *               the application turns each one into an event.
  *
  ***************************************************/
 static void rtcInterruptHandler()
 { 
-  disableInterrupt(s_interrupt_pin);
-
-  SD_SecondTick();
+  TRACE(TRACE_RTC);
   APP_SecondTick();
 }
 
@@ -154,6 +159,40 @@ const char * RTC_GetTime()
 	return s_rtc.formatTime();
 }
 
+/*
+ * writeTwoDigits
+ * Writes a 0-99 value to the buffer as two ASCII digits
+ */
+static void writeTwoDigits(char * buffer, uint8_t value)
+{
+  buffer[0] = (value/10) + '0';  // Convert from int to ascii
+  buffer[1] = (value%10) + '0';  // Convert from int to ascii
+}
+
+/*
+ * accumulateTwoDigits
+ * Writes a 0-99 value to the accumulator as two ASCII digits, after the separator (if not 0).
+ * Used rather than a formatted buffer, whose initial string would be a copy in RAM.
+ */
+static void accumulateTwoDigits(uint8_t value, char separator, FixedLengthAccumulator * accum)
+{
+  char digits[3];
+
+  if (separator) { accum->writeChar(separator); }
+  writeTwoDigits(digits, value);
+  digits[2] = '\0';
+  accum->writeString(digits);
+}
+
+/*
+ * readTwoDigits
+ * Reads two ASCII digits from the buffer as a 0-99 value
+ */
+static uint8_t readTwoDigits(const char * buffer)
+{
+  return ((buffer[0] - '0') * 10) + (buffer[1] - '0');
+}
+
 /*
  * RTC_GetYYMMDDString
  * Updates the local RTC date and fills the provided buffer with
@@ -163,16 +202,65 @@ void RTC_GetYYMMDDString(char * buffer)
 {
   s_rtc.getDate(); // Update local RTC date
   
-  int day_int = s_rtc.getDay();  // Get the actual day from the RTC
-  int month_int = s_rtc.getMonth();  // Get the month
-  int year_int = s_rtc.getYear();
-  
-  buffer[0]=(year_int/10) + '0';  // Convert from int to ascii
-  buffer[1]=(year_int%10) + '0';  // Convert from int to ascii 
-  buffer[2]= (month_int/10) + '0';  // Convert from int to ascii
-  buffer[3]= (month_int%10) + '0';  // Convert from int to ascii   
-  buffer[4]= (day_int/10) + '0';  // Convert from int to ascii
-  buffer[5]= (day_int%10) + '0';  // Convert from int to ascii 
+  writeTwoDigits(&buffer[0], s_rtc.getYear());
+  writeTwoDigits(&buffer[2], s_rtc.getMonth());
+  writeTwoDigits(&buffer[4], s_rtc.getDay());
+}
+
+/*
+ * RTC_GetTimestamp
+ * Reads the current date and time from the RTC in binary form
+ */
+void RTC_GetTimestamp(struct timestamp * ts)
+{
+  if (!ts) { return; }
+
+  // The individual get functions each re-read the RTC over I2C,
+  // so read the date and time once each and convert back from the strings.
+  const char * date = s_rtc.formatDate(RTCC_DATE_WORLD);  // DD-MM-YYYY
+  ts->day = readTwoDigits(&date[0]);
+  ts->month = readTwoDigits(&date[3]);
+  ts->year = readTwoDigits(&date[8]);
+
+  const char * time = s_rtc.formatTime(RTCC_TIME_HMS);  // HH:MM:SS
+  ts->hour = readTwoDigits(&time[0]);
+  ts->minute = readTwoDigits(&time[3]);
+  ts->second = readTwoDigits(&time[6]);
+}
+
+/*
+ * RTC_TimestampToYYMMDD
+ * Fills the provided buffer with the timestamp date in YYMMDD format.
+ */
+void RTC_TimestampToYYMMDD(const struct timestamp * ts, char * buffer)
+{
+  writeTwoDigits(&buffer[0], ts->year);
+  writeTwoDigits(&buffer[2], ts->month);
+  writeTwoDigits(&buffer[4], ts->day);
+}
+
+/*
+ * RTC_WriteDateToBuffer, RTC_WriteTimeToBuffer
+ * Write a timestamp as DD-MM-YYYY or HH:MM:SS
+ * (the same formats as RTCC_DATE_WORLD and RTCC_TIME_HMS)
+ */
+void RTC_WriteDateToBuffer(const struct timestamp * ts, FixedLengthAccumulator * accum)
+{
+  if (!ts || !accum) { return; }
+
+  accumulateTwoDigits(ts->day, 0, accum);
+  accumulateTwoDigits(ts->month, '-', accum);
+  accumulateTwoDigits(20, '-', accum);
+  accumulateTwoDigits(ts->year, 0, accum);
+}
+
+void RTC_WriteTimeToBuffer(const struct timestamp * ts, FixedLengthAccumulator * accum)
+{
+  if (!ts || !accum) { return; }
+
+  accumulateTwoDigits(ts->hour, 0, accum);
+  accumulateTwoDigits(ts->minute, ':', accum);
+  accumulateTwoDigits(ts->second, ':', accum);
 }
 
 /*
@@ -189,3 +277,18 @@ void RTC_SetDate(uint8_t day, uint8_t month, uint8_t year)
 	//day, weekday, month, century(1=1900, 0=2000), year(0-99)
 	s_rtc.setDate(day, 3, month, 0, year);
 }
+
+/*
+ * RTC_DateIsValid
+ * Returns true if the day is in the month (month 1-12, year 0-99 for 2000-2099,
+ * in which every fourth year is a leap year)
+ */
+bool RTC_DateIsValid(uint8_t day, uint8_t month, uint8_t year)
+{
+	if ((month < 1) || (month > 12) || (day < 1) || (year > 99)) { return false; }
+
+	uint8_t days = pgm_read_byte(&s_daysInMonth[month - 1]);
+	if ((month == 2) && ((year % 4) == 0)) { days++; }
+
+	return day <= days;
+}
@@ -3,6 +3,17 @@
 
 // Defines
 
+// A binary date and time, as read from the RTC
+struct timestamp
+{
+	uint8_t year;	// 0-99 (20xx)
+	uint8_t month;
+	uint8_t day;
+	uint8_t hour;
+	uint8_t minute;
+	uint8_t second;
+};
+
 // Public Functions
 void RTC_Setup(int scl, int sda, int interrupt_pin);
 void RTC_EnableInterrupt();
@@ -12,7 +23,13 @@ const char * RTC_GetDate(int format = 0);
 const char * RTC_GetTime();
 void RTC_GetYYMMDDString(char * buffer);
 
+void RTC_GetTimestamp(struct timestamp * ts);
+void RTC_TimestampToYYMMDD(const struct timestamp * ts, char * buffer);
+void RTC_WriteDateToBuffer(const struct timestamp * ts, FixedLengthAccumulator * accum);
+void RTC_WriteTimeToBuffer(const struct timestamp * ts, FixedLengthAccumulator * accum);
+
 void RTC_SetTime(uint8_t hour, uint8_t minute, uint8_t second);
 void RTC_SetDate(uint8_t day, uint8_t month, uint8_t year);
+bool RTC_DateIsValid(uint8_t day, uint8_t month, uint8_t year);
 
 #endif
@@ -9,20 +9,34 @@
 
 /************ External Libraries*****************************/
 #include <Arduino.h>
+#include <util/atomic.h>
 #include <Rtc_Pcf8563.h>
 #include <SdFat.h>
+#define LIBCALL_ENABLEINTERRUPT
+#include <EnableInterrupt.h>
 
 /************ Application Libraries*****************************/
 
 #include "app.h"
+#include "bench.h"
+#include "trace.h"
 #include "utility.h"
+#include "stats.h"
 #include "battery.h"
 #include "external_volts_amps.h"
 #include "wind.h"
 #include "temperature.h"
 #include "irradiance.h"
 #include "rtc.h"
+#include "events.h"
+#include "eeprom_storage.h"
+#include "analog.h"
+#include "energy.h"
+#include "pipeline.h"
+#include "fields.h"
+#include "power_curve.h"
 #include "sd.h"
+#include "transfer.h"
 
 /*
  * Defines
@@ -31,20 +45,32 @@
 #define SD_CHIP_SELECT_PIN 10 // The SD card Chip Select pin 10
 #define SD_CARD_DETECT_PIN 9  // The SD card detect is on pin 6
 
-#define DATA_STRING_LENGTH 128
+// After a change of fields the day's data goes on in DYYMMDD1.csv ... DYYMMDD9.csv
+#define MAX_FILE_VERSION 9
+
+// Sized for the fields built in: the row start ("AA,DD-MM-YYYY,HH:MM:SS"), then at most 12 characters
+// for each column after it (a comma and a value of up to 11), and the NUL
+#define ROW_START_LENGTH 22
+#define DATA_STRING_LENGTH (ROW_START_LENGTH + (12 * (FIELDS_BUILT_COLUMNS + BATTERY_COLUMNS)) + 1)
+
+// An event row is the row start and one column of up to 24 characters (e.g. "RAM free 1234 least 1234")
+static_assert(DATA_STRING_LENGTH >= ROW_START_LENGTH + 1 + 24 + 1, "The data string is too short for an event row");
 
 /*
  * Private Variables
  */
 
-static long s_dataCounter = 0;  // This holds the number of seconds since the last data store
-static long s_sampleTime = 2;  // This is the time between samples for the DAQ
+static volatile long s_dataCounter = 0;  // This holds the number of seconds since the last data store (interrupt owned)
+static volatile long s_sampleTime = 2;  // This is the time between samples for the DAQ (currently in use)
+static long s_userSampleTime = 2;  // The sample time set by the user
+static long s_sampleTimeOverride = 0;  // If non-zero, used instead of the user sample time
 
-static volatile bool s_writePending = false;  // A flag to tell the code when to write data
-static char s_last_used_date[16];
+static uint8_t s_recordsPerFlush = 1;  // Records to queue before writing them out together
+static bool s_serialEcho = true;  // Also print each record to the serial port (if the power state allows)
+static bool s_echoEnabled = true;  // The user setting (stored in EEPROM)
 
 // The other SD card pins (D11,D12,D13) are all set within s_SD.h
-static int s_lastCardDetect = LOW;  // This is the flag for the old reading of the card detect
+static bool s_cardPresent = true;  // The card state last acted upon by SD_HandleCardChange
 
 // SD file system object and file
 static SdFat s_sd;
@@ -53,98 +79,283 @@ static SdFile s_datafile;
 static char s_dataString[DATA_STRING_LENGTH];
 static FixedLengthAccumulator s_accumulator = FixedLengthAccumulator(NULL, 0);
 
-static char s_filename[] = "DXXXXXX.csv";  // This is a holder for the full file name
+static char s_filename[] = "DXXXXXXX.csv";  // This is a holder for the full file name (see set_file_version)
+static bool s_noFile = false;  // Every version of the day's file has other headers, so there is nowhere to write
+static bool s_eventCardOk = false;  // The card was there when the event row was started (SD_StartEventRow)
 static char s_deviceID[3]; // A buffer to hold the device ID
 
 static char comma = ',';
 
 // These are Char Strings - they are stored in program memory to save space in data memory
 // These are a mixutre of error messages and serial printed information
-// These MUST be in the same order as the fields are written to the CSV file!
-const char s_pstr_headers[] PROGMEM = \
-  "Ref, Date, Time, " \
-  WINDSPEED_HEADERS \
-  WIND_DIRECTION_HEADERS \
-  TEMPERATURE_HEADERS \
-  IRRADIANCE_HEADERS \
-  EXTERNAL_VOLTS_HEADERS \
-  EXTERNAL_AMPS_HEADERS \
-  "Batt V";
-  
+// The headers of the enabled fields (see fields.cpp) go between these two
+const char s_pstr_row_start_headers[] PROGMEM = FIELDS_ROW_START_HEADERS;
+const char s_pstr_battery_headers[] PROGMEM = BATTERY_HEADERS;
+
   
+#if PCURVE_ENABLED
+const char s_pstr_pcurve_headers[] PROGMEM = "Ref, Date, " PCURVE_HEADERS;
+#endif
+
 const char s_pstr_initialised[] PROGMEM = "Init SD OK. Headers:";
 const char s_pstr_not_initialised[] PROGMEM = "Init SD Failed";
 const char s_pstr_noSD[] PROGMEM = "No SD card";
 const char s_pstrerroropen[] PROGMEM = "Error open";
 const char s_pstr_file_already_exists[] PROGMEM = "File already exists";
+static const char s_pstr_csv[] PROGMEM = ".csv";
+const char s_pstr_no_file[] PROGMEM = "No data file";
 
 /*
  * Private Functions
  */
 
-static void write_configurable_fields(FixedLengthAccumulator * accum)
+/*
+ * cardDetectInterruptHandler
+ * The card detect switch bounces, so this just posts an event
+ * and the main loop works out what actually changed.
+ * It disables itself until SD_HandleCardChange has run, so a bouncing
+ * switch queues one event rather than filling the queue.
+ */
+static void cardDetectInterruptHandler()
 {
-  #if READ_WINDSPEED == 1
-  accum->writeChar(comma);
-  WIND_WritePulseCountToBuffer(0, accum);
-  accum->writeChar(comma);
-  WIND_WritePulseCountToBuffer(1, accum);
-  #endif
+  TRACE(TRACE_CARD);
+  disableInterrupt(SD_CARD_DETECT_PIN);
+  EVT_Post(EVT_CARD_CHANGE);
+}
 
-  #if READ_WIND_DIRECTION == 1
-  accum->writeChar(comma);
-  WIND_WriteDirectionToBuffer(accum);
-  #endif
+/*
+ * print_headers
+ * Prints the header line for the enabled fields.
+ * Printed straight from flash - with every field enabled the headers are longer than the PStringToRAM buffer
+ */
+template <class OUT>
+static void print_headers(OUT * out)
+{
+  const char * headers;
 
-  #if READ_TEMPERATURE == 1
-  accum->writeChar(comma);
-  TEMP_WriteTemperatureToBuffer(accum);
-  #endif
+  out->print((const __FlashStringHelper *)s_pstr_row_start_headers);
+  for (uint8_t n = 0; (headers = FIELDS_GetHeader(n)) != NULL; n++)
+  {
+    out->print((const __FlashStringHelper *)headers);
+  }
+  out->println((const __FlashStringHelper *)s_pstr_battery_headers);
+}
 
-  #if READ_IRRADIANCE == 1
-  accum->writeChar(comma);
-  IRR_WriteIrradianceToBuffer(accum);
-  #endif
+/*
+ * read_matches
+ * Reads the length of a flash string from the file, returns true if they are the same
+ */
+static bool read_matches(SdFile * file, const char * pstr)
+{
+  char c;
+  while ((c = pgm_read_byte(pstr++)) != '\0')
+  {
+    if (file->read() != c) { return false; }
+  }
+  return true;
+}
+
+/*
+ * headers_match
+ * Returns true if the file starts with the header line print_headers would write
+ */
+static bool headers_match(SdFile * file)
+{
+  const char * headers;
+
+  if (!read_matches(file, s_pstr_row_start_headers)) { return false; }
+  for (uint8_t n = 0; (headers = FIELDS_GetHeader(n)) != NULL; n++)
+  {
+    if (!read_matches(file, headers)) { return false; }
+  }
+  return read_matches(file, s_pstr_battery_headers) && (file->read() == '\r');
+}
+
+/*
+ * set_file_version
+ * Makes s_filename DYYMMDD.csv (version 0) or DYYMMDDn.csv
+ */
+static void set_file_version(uint8_t version)
+{
+  char * extension = &s_filename[7];
 
-  #if READ_EXTERNAL_VOLTS == 1
+  if (version)
+  {
+    *extension++ = '0' + version;
+  }
+  memcpy_P(extension, s_pstr_csv, 5);
+}
+
+/*
+ * format_row_start
+ * Writes the "Ref, Date, Time" columns common to every row
+ */
+static void format_row_start(const struct timestamp * time, FixedLengthAccumulator * accum)
+{
+  accum->reset();
+  accum->writeChar(s_deviceID[0]);
+  accum->writeChar(s_deviceID[1]);
   accum->writeChar(comma);
-  VA_WriteExternalVoltageToBuffer(accum);
-  #endif
-  
-  #if READ_EXTERNAL_AMPS == 1
+  RTC_WriteDateToBuffer(time, accum);
   accum->writeChar(comma);
-  VA_WriteExternalCurrentToBuffer(accum);
-  #endif
+  RTC_WriteTimeToBuffer(time, accum);
 }
 
 /*
- * writeDataString
- * Opens the current file for writing and appends the current data string
+ * format_record
+ * Formatting stage: turns a binary record into a CSV line
  */
-static void writeDataString()
+static void format_record(const struct record * rec, FixedLengthAccumulator * accum)
 {
-    s_datafile.open(s_filename, O_RDWR | O_CREAT | O_AT_END);    // Open the correct file
-    // if the file is available, write to it:
-    if (s_sd.exists(s_filename))
+  format_row_start(&rec->time, accum);
+
+  FIELDS_WriteRecord(rec, accum);
+
+  accum->writeChar(comma); 
+  BATT_WriteVoltageToBuffer(&rec->channels[PIPE_CH_BATTERY], accum);
+}
+
+/*
+ * create_file
+ * Picks the file for the date in s_filename: the first of DYYMMDD.csv, DYYMMDD1.csv ...
+ * that is new or has the headers of the enabled fields, so a file never mixes
+ * column layouts. A new file is created with the headers.
+ * If all of them have other headers nothing is written for that date (s_noFile).
+ */
+static void create_file()
+{
+  bool isNew = false;
+
+  if (s_datafile.isOpen()) { s_datafile.close(); }
+
+  s_noFile = true;
+  for (uint8_t version = 0; s_noFile && (version <= MAX_FILE_VERSION); version++)
+  {
+    set_file_version(version);
+
+    // Tried with open() rather than exists(), which puts a FatFile of its own on the stack
+    // at the deepest point of a record write
+    if (s_datafile.open(s_filename, O_READ))
     {
-      s_datafile.println(s_dataString);
+      s_noFile = !headers_match(&s_datafile);
       s_datafile.close();
-      // print to the serial port too:
-      Serial.println(s_dataString);
-    }  
-    // if the file isn't open, pop up an error:
-    else {
+    }
+    else
+    {
+      isNew = true;
+      s_noFile = false;
+    }
+  }
+
+  if (s_noFile)
+  {
+    Serial.println(PStringToRAM(s_pstr_no_file));
+    return;
+  }
+
+	if(APP_InDebugMode())
+	{
+		Serial.println(s_filename);
+	}
+
+	if(isNew)
+	{
+    // open the file for write at end like the Native SD library
+		if (!s_datafile.open(s_filename, O_RDWR | O_CREAT | O_AT_END)) 
+		{
       if(APP_InDebugMode())
       {
         Serial.println(PStringToRAM(s_pstrerroropen));
       }
+      return;
+		}
+    // if the file opened okay, write to it and close:
+    print_headers(&s_datafile);
+		s_datafile.close();
+	} 
+
+	else
+	{
+    if(APP_InDebugMode())
+    {
+      Serial.println(PStringToRAM(s_pstr_file_already_exists));
+    }
+	}
+}
+
+/*
+ * select_file_for_date
+ * Each day we want to write a new file.
+ * Compare the row date with the current filename and switch file if needed
+ */
+static void select_file_for_date(const struct timestamp * time)
+{
+  char yymmdd[6];
+  RTC_TimestampToYYMMDD(time, yymmdd);
+
+  if (memcmp(yymmdd, &s_filename[1], 6) != 0)
+  {
+    // If date has changed then create a new file
+    if (s_datafile.isOpen()) { s_datafile.close(); }
+    memcpy(&s_filename[1], yymmdd, 6);
+    create_file();
   }
 }
 
 /*
+ * writeDataString
+ * Appends the current data string to the current file, opening it if needed.
+ * The file is left open for the rest of the batch.
+ */
+static void writeDataString()
+{
+  BENCH_BEGIN(BENCH_WRITE);
+  TRACE_BEGIN(TRACE_WRITE);
+
+  if (!s_datafile.isOpen() && !s_noFile)
+  {
+    s_datafile.open(s_filename, O_RDWR | O_CREAT | O_AT_END);    // Open the correct file
+  }
+
+  // if the file is available, write to it:
+  if (s_datafile.isOpen())
+  {
+    s_datafile.println(s_dataString);
+  }
+  // if the file isn't open, pop up an error:
+  else
+  {
+    if(APP_InDebugMode())
+    {
+      Serial.println(PStringToRAM(s_pstrerroropen));
+    }
+  }
+
+  TRACE_END(TRACE_WRITE);
+  BENCH_END(BENCH_WRITE);
+}
+
+/*
+ * print_data_string
+ * Prints the data string to the serial port (if echo is on)
+ */
+static void print_data_string(bool card_ok)
+{
+  if (!s_serialEcho || !s_echoEnabled || XFER_IsActive()) { return; }
+
+  if (!card_ok)
+  {
+    Serial.println(PStringToRAM(s_pstr_noSD));
+  }
+  else if (s_noFile)
+  {
+    Serial.println(PStringToRAM(s_pstr_no_file));
+  }
+  Serial.println(s_dataString);
+}
 
-#define DATA_STRING_LENGTH 128 
-* Public Functions
+/*
+ * Public Functions
  */
 
 /*
@@ -178,7 +389,7 @@ void SD_Setup()
   	if(APP_InDebugMode())
   	{
   		Serial.println(PStringToRAM(s_pstr_initialised));
-      Serial.println(PStringToRAM(s_pstr_headers));
+      print_headers(&Serial);
   	}
   }
 }
@@ -199,7 +410,123 @@ void SD_SetDeviceID(char * id)
  */
 void SD_SetSampleTime(long newSampleTime)
 {
-	s_sampleTime = newSampleTime;
+  s_userSampleTime = newSampleTime;
+  SD_SetSampleTimeOverride(s_sampleTimeOverride);
+}
+
+/*
+ * SD_SetSampleTimeOverride
+ * Temporarily replaces the user sample time (e.g. to save power).
+ * Set to 0 to go back to the user sample time.
+ */
+void SD_SetSampleTimeOverride(long overrideSampleTime)
+{
+  s_sampleTimeOverride = overrideSampleTime;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+	  s_sampleTime = s_sampleTimeOverride ? s_sampleTimeOverride : s_userSampleTime;
+  }
+}
+
+/*
+ * SD_GetSampleTime
+ * Returns the sample time in use: the user's, or the power state's override
+ */
+long SD_GetSampleTime()
+{
+  long sampleTime;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    sampleTime = s_sampleTime;
+  }
+  return sampleTime;
+}
+
+/*
+ * SD_SetSerialEcho
+ * Turns printing of each record to the serial port on or off
+ * for the power state
+ */
+void SD_SetSerialEcho(bool echo)
+{
+  s_serialEcho = echo;
+}
+
+/*
+ * SD_SetEchoEnabled, SD_StoreEchoEnabled, SD_GetEchoEnabled
+ * The user setting for printing each record to the serial port.
+ * With it off nothing is sent between records, so the USART stays powered down.
+ */
+void SD_SetEchoEnabled(bool enabled)
+{
+  s_echoEnabled = enabled;
+}
+
+void SD_StoreEchoEnabled(bool enabled)
+{
+  s_echoEnabled = enabled;
+  EEPROM_SetSerialEcho(enabled);
+}
+
+bool SD_GetEchoEnabled()
+{
+  return s_echoEnabled;
+}
+
+/*
+ * SD_HasDataFile
+ * Returns false if there is no file on the card the records can go in
+ * (every version of the day's file has other headers)
+ */
+bool SD_HasDataFile()
+{
+  return !s_noFile;
+}
+
+/*
+ * SD_EnableCardDetectInterrupt
+ * Posts an EVT_CARD_CHANGE event whenever the card detect pin changes
+ */
+void SD_EnableCardDetectInterrupt()
+{
+  s_cardPresent = SD_CardIsPresent();
+  enableInterrupt(SD_CARD_DETECT_PIN, cardDetectInterruptHandler, CHANGE);
+}
+
+/*
+ * SD_HandleCardChange
+ * Called by the application on EVT_CARD_CHANGE.
+ * If a card has been inserted, re-initialise the card and filename.
+ * Returns TRUE if a card is present.
+ */
+bool SD_HandleCardChange()
+{
+  bool present = SD_CardIsPresent();
+
+  // Otherwise switch bounce, or this change has already been handled
+  if (present != s_cardPresent)
+  {
+    if (present)
+    {
+      delay(100);  // Wait for switch to settle down.
+      // There was no card previously so re-initialise and re-check the filename
+      SD_Setup();
+      SD_CreateFileForToday();
+    }
+
+    s_cardPresent = present;
+  }
+
+  // Re-arm the interrupt, and catch a change made while it was off
+  enableInterrupt(SD_CARD_DETECT_PIN, cardDetectInterruptHandler, CHANGE);
+  if (SD_CardIsPresent() != s_cardPresent)
+  {
+    EVT_PostFromMain(EVT_CARD_CHANGE);
+  }
+
+  return s_cardPresent;
 }
 
 /*
@@ -215,197 +542,198 @@ void SD_CreateFileForToday()
   // You must add on the '0' to convert to ASCII
 
 	RTC_GetYYMMDDString(&s_filename[1]);
+  create_file();
+}
 
-	if(APP_InDebugMode())
-	{
-		Serial.println(s_filename);
-	}
+/*
+ * SD_SetRecordsPerFlush, SD_GetRecordsPerFlush
+ * Sets how many records are queued up before they are written together
+ */
+void SD_SetRecordsPerFlush(uint8_t records)
+{
+  if (records < 1) { records = 1; }
+  if (records > RECORD_QUEUE_SIZE) { records = RECORD_QUEUE_SIZE; }
+  s_recordsPerFlush = records;
+}
 
-	if(!s_sd.exists(s_filename))
-	{
-    // open the file for write at end like the Native SD library
-		if (!s_datafile.open(s_filename, O_RDWR | O_CREAT | O_AT_END)) 
-		{
-      if(APP_InDebugMode())
-      {
-        Serial.println(PStringToRAM(s_pstrerroropen));
-      }
-		}
-    // if the file opened okay, write to it and sync:
-    s_datafile.println(PStringToRAM(s_pstr_headers));
-		s_datafile.sync();
-	} 
+uint8_t SD_GetRecordsPerFlush()
+{
+  return s_recordsPerFlush;
+}
 
-	else
-	{
-    if(APP_InDebugMode())
+/*
+ * SD_StoreIsDue
+ * Returns TRUE when enough records are queued to be written
+ */
+bool SD_StoreIsDue()
+{
+  return PIPE_RecordCount() >= s_recordsPerFlush;
+}
+
+/*
+ * SD_StoreRecords
+ * Storage stage: formats every queued record and writes them
+ * to the card (and serial port) with one file open/close.
+ */
+void SD_StoreRecords()
+{
+  const struct record * rec;
+
+  TRACE_BEGIN(TRACE_STORE);
+
+  // ************** Write it to the SD card *************
+  // This depends upon the card detect.
+  // If card is there then write to the file
+  // Card insertion (initialise the card/filenames) is handled by SD_HandleCardChange
+  // If card is not there then flash LEDs
+  bool card_ok = s_cardPresent && SD_CardIsPresent();
+
+  while ((rec = PIPE_PeekRecord()) != NULL)
+  {
+    format_record(rec, &s_accumulator);
+
+    if(card_ok)
     {
-      Serial.println(PStringToRAM(s_pstr_file_already_exists));
+      select_file_for_date(&rec->time);
+      // We then write the data to the SD card here:
+      writeDataString();
     }
-	}
 
+    print_data_string(card_ok);
+
+    PIPE_ReleaseRecord();
+  }
+
+  if (s_datafile.isOpen())
+  {
+    s_datafile.close();
+  }
+
+  TRACE_END(TRACE_STORE);
 }
 
-/***************************************************
- *  Name:        SD_WriteIsPending
- *
- *  Returns:     Value of s_writePending
- *
- *  Parameters:  None.
- *
- *  Description: Returns TRUE if application should begin write procedure
- *
- ***************************************************/
- bool SD_WriteIsPending()
- {
-  return s_writePending;
- }
+/*
+ * SD_StartEventRow
+ * Starts an event (e.g. a power state change) as its own row:
+ * "Ref, Date, Time, <event>". The caller writes the event text to the
+ * returned accumulator, then calls SD_WriteEventRow. The text goes straight
+ * into the data string, so the callers need no buffer of their own.
+ */
+FixedLengthAccumulator * SD_StartEventRow(void)
+{
+  struct timestamp now;
+  s_eventCardOk = s_cardPresent && SD_CardIsPresent();
 
-/***************************************************
- *  Name:        SD_WriteIsPending
- *
- *  Returns:     None
- *
- *  Parameters:  None
- *
- *  Description: Forces the write pending flag to true
- *
- ***************************************************/
- void SD_ForcePendingWrite()
- {
-  s_writePending = true;
- }
-
- void update_data()
- {
-  const char * current_date;
-  const char * current_time;
-
-  // *********** WIND SPEED ******************************************
-  // Want to get the number of pulses and average into the sample time
-  // This gives us the average wind speed
-  // pulsecounterold holds the value of pulses.
-  // This can be converted into the wind speed using the time and 
-  // the pulse-wind speed characterisitic of the anemometer.
-  // Do this as post processing - pulse count is most important.
-
-  // *********** WIND DIRECTION **************************************
-  // This can be checked every second and an average used
-    // If this interrupt has happened then we want to write data to SD card:
-  // Save the pulsecounter value (this will be stored to write to SD card)
-  WIND_StoreWindPulseCounts();
-  WIND_AnalyseWindDirection();
-
-  // *********** TEMPERATURE *****************************************
-  // Two versions of this - either with thermistor or I2C sensor (if connected)
-  // Thermistor version
-  // Get the temperature readings and store to variables   
-
-  BATT_UpdateBatteryVoltage();
-
-    // *********** EXTERNAL VOLTAGE ***************************************
-    // From Vcc-680k--46k-GND potential divider
-  VA_UpdateExternalVoltage();
-
-    // ********** EXTERNAL CURRENTS **************************************
-    // Measured using a hall effect current sensor
-    // Either using a ACS*** or a LEM HTFS 200-P
-    // Comment out whichever you are not using
-
-  VA_UpdateExternalCurrent();
-
-    // ******** put this data into a file ********************************
-    // ****** Check filename *********************************************
-    // Each day we want to write a new file.
-    // Compare date with previous stored date, every second
-  current_date = RTC_GetDate(RTCC_DATE_WORLD);
-  current_time = RTC_GetTime();
-
-  s_accumulator.reset();
-  s_accumulator.writeChar(s_deviceID[0]);
-  s_accumulator.writeChar(s_deviceID[1]);
-  s_accumulator.writeChar(comma);
-  s_accumulator.writeString(current_date);
+  RTC_GetTimestamp(&now);
+  if (s_eventCardOk)
+  {
+    // The file is picked now, while the date is to hand
+    select_file_for_date(&now);
+  }
+
+  format_row_start(&now, &s_accumulator);
   s_accumulator.writeChar(comma);
-  s_accumulator.writeString(current_time);
+  return &s_accumulator;
+}
 
-  write_configurable_fields(&s_accumulator);
+/*
+ * SD_WriteEventRow
+ * Writes the event row started by SD_StartEventRow
+ */
+void SD_WriteEventRow(void)
+{
+  if (s_eventCardOk)
+  {
+    writeDataString();
+    if (s_datafile.isOpen())
+    {
+      s_datafile.close();
+    }
+  }
 
-  s_accumulator.writeChar(comma); 
-  BATT_WriteVoltageToBuffer(&s_accumulator);
+  print_data_string(s_eventCardOk);
 }
 
-void SD_WriteDataToCard()
+#if PCURVE_ENABLED
+/*
+ * SD_WritePowerCurveFile
+ * Writes the power curve bins to a summary file for the day, CYYMMDD.csv.
+ * One row per non-empty bin: "Ref, Date, Speed m/s, Count, Mean W, SD W"
+ */
+void SD_WritePowerCurveFile(const struct timestamp * date)
 {
-  
-  update_data();
+  char filename[] = "CXXXXXX.csv";
+  SdFile file;
 
-  const char * current_date = RTC_GetDate(RTCC_DATE_WORLD);
-  
-  if(strcmp(current_date, s_last_used_date) != 0)
-  {
-     // If date has changed then create a new file
-     memcpy(s_last_used_date, current_date, 10);
-     SD_CreateFileForToday();  // Create the corrct filename (from date)
-  }    
+  if (!date || !(s_cardPresent && SD_CardIsPresent())) { return; }
 
-  // ************** Write it to the SD card *************
-  // This depends upon the card detect.
-  // If card is there then write to the file
-  // If card has recently been inserted then initialise the card/filenames
-  // If card is not there then flash LEDs
+  RTC_TimestampToYYMMDD(date, &filename[1]);
 
-  if(digitalRead(SD_CARD_DETECT_PIN)==LOW&&s_lastCardDetect==HIGH)
+  if (!file.open(filename, O_RDWR | O_CREAT | O_TRUNC))
   {
-    delay(100);  // Wait for switch to settle down.
-    // There was no card previously so re-initialise and re-check the filename
-    SD_Setup();
-    SD_CreateFileForToday();
+    if(APP_InDebugMode())
+    {
+      Serial.println(PStringToRAM(s_pstrerroropen));
+    }
+    return;
   }
-  if(digitalRead(SD_CARD_DETECT_PIN)==LOW&&s_lastCardDetect==LOW)
+
+  file.println((const __FlashStringHelper *)s_pstr_pcurve_headers);
+
+  for (uint8_t i = 0; i < PCURVE_BINS; i++)
   {
-      //Ensure that there is a card present)
-      // We then write the data to the SD card here:
-    writeDataString();
+    s_accumulator.reset();
+    s_accumulator.writeChar(s_deviceID[0]);
+    s_accumulator.writeChar(s_deviceID[1]);
+    s_accumulator.writeChar(comma);
+    RTC_WriteDateToBuffer(date, &s_accumulator);
+    s_accumulator.writeChar(comma);
+    if (PCURVE_WriteBinToBuffer(i, &s_accumulator))
+    {
+      file.println(s_dataString);
+    }
   }
-  else
-  {
-     // print to the serial port too:
-    Serial.println(PStringToRAM(s_pstr_noSD));
-    Serial.println(s_dataString);
-  }   
-    
-    s_lastCardDetect = digitalRead(SD_CARD_DETECT_PIN);  // Store the old value of the card detect
-    
-    s_writePending = false;
+
+  file.close();
 }
+#else
+void SD_WritePowerCurveFile(const struct timestamp * date) { (void)date; }
+#endif
 
-void SD_PrintDataToSerial()
+/*
+ * SD_PrintDataToSerial
+ * Prints a record of the period so far, without disturbing the period data.
+ * Never inlined, or its record would be in loop()'s stack frame under every card write.
+ */
+__attribute__((noinline)) void SD_PrintDataToSerial()
 {
-  update_data();
+  struct record rec;
+  PIPE_SnapshotRecord(&rec);
+  format_record(&rec, &s_accumulator);
   Serial.println(s_dataString);
 }
 
 /***************************************************
  *  Name:        SD_SecondTick
  *
- *  Returns:     Nothing.
+ *  Returns:     TRUE if the sample period has just completed.
  *
  *  Parameters:  None.
  *
- *  Description: To be called every second by the RTC library.
+ *  Description: To be called every second from the RTC interrupt.
  *               Decides when to update the SD card data
  *
  ***************************************************/
-void SD_SecondTick()
+bool SD_SecondTick()
 {
   s_dataCounter++;
-  if ((s_writePending == false) && (s_dataCounter >= s_sampleTime))  // This stops us loosing data if a second is missed
+  if (s_dataCounter >= s_sampleTime)
   { 
     // Reset the DataCounter
     s_dataCounter = 0;  
-    s_writePending = true;
+    return true;
   }
+  return false;
 }
 
 /***************************************************
@@ -420,7 +748,52 @@ void SD_SecondTick()
  ***************************************************/
 void SD_ResetCounter()
 {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
     s_dataCounter = 0;
+  }
+}
+
+/***************************************************
+ *  Name:        SD_GetCounter
+ *
+ *  Returns:     Seconds into the sample period (0 when one has just ended).
+ *
+ *  Parameters:  None.
+ *
+ *  Description: For the checkpoints.
+ *
+ ***************************************************/
+long SD_GetCounter()
+{
+  long seconds;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    seconds = s_dataCounter;
+  }
+  return seconds;
+}
+
+/***************************************************
+ *  Name:        SD_ContinuePeriod
+ *
+ *  Returns:     FALSE if the period would have ended by now.
+ *
+ *  Parameters:  Seconds into the period.
+ *
+ *  Description: Carries on a period restored from a checkpoint,
+ *               so it ends when it would have without the reset.
+ *
+ ***************************************************/
+bool SD_ContinuePeriod(long seconds)
+{
+  if ((seconds < 0) || (seconds >= s_sampleTime)) { return false; }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    s_dataCounter = seconds;
+  }
+  return true;
 }
 
 /***************************************************
@@ -6,12 +6,27 @@ void SD_CreateFileForToday();
 void SD_SetDeviceID(char * id);
 
 void SD_SetSampleTime(long newSampleTime);
+void SD_SetSampleTimeOverride(long overrideSampleTime);
+long SD_GetSampleTime();
+void SD_SetSerialEcho(bool echo);
+void SD_SetEchoEnabled(bool enabled);
+void SD_StoreEchoEnabled(bool enabled);
+bool SD_GetEchoEnabled();
 bool SD_CardIsPresent();
-void SD_WriteDataToCard();
+void SD_EnableCardDetectInterrupt();
+bool SD_HandleCardChange();
+bool SD_HasDataFile();
+void SD_SetRecordsPerFlush(uint8_t records);
+uint8_t SD_GetRecordsPerFlush();
+bool SD_StoreIsDue();
+void SD_StoreRecords();
+FixedLengthAccumulator * SD_StartEventRow(void);
+void SD_WriteEventRow(void);
+void SD_WritePowerCurveFile(const struct timestamp * date);
 void SD_PrintDataToSerial();
-void SD_ForcePendingWrite();
-bool SD_WriteIsPending();
 void SD_ResetCounter();
-void SD_SecondTick();
+long SD_GetCounter();
+bool SD_ContinuePeriod(long seconds);
+bool SD_SecondTick();
 
 #endif
\ No newline at end of file
@@ -8,62 +8,284 @@
 */
 
 #include <Arduino.h>
+#include <util/crc16.h>
 #include <Rtc_Pcf8563.h>
+#define LIBCALL_ENABLEINTERRUPT
+#include <EnableInterrupt.h>
 
 /************ Application Libraries*****************************/
 
+#include "app.h"
 #include "serial_handler.h"
+#include "events.h"
 #include "eeprom_storage.h"
+#include "utility.h"
 #include "sd.h"
 #include "rtc.h"
-#include "utility.h"
 #include "external_volts_amps.h"
 #include "wind.h"
+#include "power.h"
+#include "analog.h"
+#include "power_curve.h"
+#include "transfer.h"
+#include "telemetry.h"
+#include "fields.h"
+#include "ram.h"
+#include "trace.h"
+
+/*
+ * Commands are parsed a byte at a time as they arrive, so the work per byte
+ * is fixed and nothing is buffered except a short text field.
+ *
+ *  <letter>[<index>][<value>|?][*<crc>]E
+ *
+ *  letter - selects the command from s_commands
+ *  index  - one digit, for commands with several settings (e.g. P1 to P4)
+ *  value  - any number of digits, range checked against the table,
+ *           or a text field for the reference,
+ *           or (for G) up to three numbers separated by commas
+ *  ?      - prints the setting instead of changing it ("P?E" prints them all)
+ *  *crc   - optional: two hex digits of CRC-8 (polynomial 0x07, as _crc8_ccitt_update)
+ *           over everything from the letter up to the '*'
+ *
+ * Every command is answered with a final "OK" or "ERR <reason>" line, so a
+ * provisioning script can send the next command as soon as it sees it.
+ * Bytes between commands (spaces, line ends) are ignored, and a line end
+ * abandons an unfinished command.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define SERIAL_RX_PIN 0
+
+// As HardwareSerial.h, for cores that don't define it
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 64
+#endif
+
+#define COMMAND_TEXT_LENGTH 2
+#define COMMAND_CRC_DIGITS 2
+#define COMMAND_MAX_FIELDS 3
+#define COMMAND_FIELD_MAX 999999999L  // Fields after the first
+
+enum arg_type
+{
+    ARG_NONE,
+    ARG_NUMBER,
+    ARG_NUMBERS,    // Comma separated, the table range applies to the first
+    ARG_TEXT
+};
+
+enum parser_state
+{
+    STATE_COMMAND,  // Waiting for a command letter
+    STATE_INDEX,    // Waiting for the index digit
+    STATE_VALUE,    // Reading the value, or '?', '*' or 'E'
+    STATE_CRC,      // Reading the CRC digits
+    STATE_END,      // Waiting for 'E' (or '*' if there has been no CRC)
+    STATE_DISCARD   // Error - skipping to the end of the command
+};
+
+enum parse_error
+{
+    ERR_NONE,
+    ERR_COMMAND,
+    ERR_INDEX,
+    ERR_VALUE,
+    ERR_FORMAT,
+    ERR_CRC,
+    ERR_FILE,
+    ERR_BUSY
+};
+
+typedef void (*SET_FN)(uint8_t index, long value);
+typedef void (*QUERY_FN)(uint8_t index);
+
+struct command
+{
+    char letter;
+    uint8_t arg;
+    uint8_t indexes;    // 0 if the command has no index digit, else the highest index
+    long min;
+    long max;           // Must be below LONG_MAX / 10
+    SET_FN set;
+    QUERY_FN query;
+};
+
+/*
+ * Private Function Prototypes
+ */
+
+static void setReference(uint8_t index, long value);
+static void setTime(uint8_t index, long value);
+static void setDate(uint8_t index, long value);
+static void setSampleTime(uint8_t index, long value);
+static void setCurrentOffset(uint8_t index, long value);
+static void setResistor(uint8_t index, long value);
+static void setCurrentGain(uint8_t index, long value);
+static void setWindvanePosition(uint8_t index, long value);
+static void setPowerThreshold(uint8_t index, long value);
+static void setOversampling(uint8_t index, long value);
+static void setAnemometerCalibration(uint8_t index, long value);
+static void printPowerCurve(uint8_t index, long value);
+#if TRANSFER_ENABLED == 1
+static void listFiles(uint8_t index, long value);
+static void startTransfer(uint8_t index, long value);
+#endif
+#if TELEMETRY_ENABLED == 1
+static void setTelemetryRate(uint8_t index, long value);
+#endif
+static void setSerialEcho(uint8_t index, long value);
+static void setFieldMask(uint8_t index, long value);
+#if RAM_MONITOR == 1
+static void printRam(uint8_t index, long value);
+#endif
+#if TRACE_ENABLED == 1
+static void sendTrace(uint8_t index, long value);
+#endif
+
+static void queryReference(uint8_t index);
+static void queryTime(uint8_t index);
+static void queryDate(uint8_t index);
+static void querySampleTime(uint8_t index);
+static void queryCurrentOffset(uint8_t index);
+static void queryResistor(uint8_t index);
+static void queryCurrentGain(uint8_t index);
+static void queryWindvanePosition(uint8_t index);
+static void queryPowerThreshold(uint8_t index);
+static void queryOversampling(uint8_t index);
+static void queryAnemometerCalibration(uint8_t index);
+static void queryPowerCurve(uint8_t index);
+#if TRANSFER_ENABLED == 1
+static void queryFiles(uint8_t index);
+static void queryTransfer(uint8_t index);
+#endif
+#if TELEMETRY_ENABLED == 1
+static void queryTelemetryRate(uint8_t index);
+#endif
+static void querySerialEcho(uint8_t index);
+static void queryFieldMask(uint8_t index);
+#if RAM_MONITOR == 1
+static void queryRam(uint8_t index);
+#endif
+#if TRACE_ENABLED == 1
+static void queryTrace(uint8_t index);
+#endif
 
 /*
  * Private Variables
  */
 
-static char s_strBuffer[64];
-static int s_index = 0;
+static const struct command s_commands[] PROGMEM = {
+    {'R', ARG_TEXT, 0, 0, 0, setReference, queryReference},
+    {'T', ARG_NUMBER, 0, 0, 235959, setTime, queryTime},                // HHMMSS
+    {'D', ARG_NUMBER, 0, 10100, 311299, setDate, queryDate},            // DDMMYY
+    {'S', ARG_NUMBER, 0, 1, 65535, setSampleTime, querySampleTime},     // Seconds
+    {'O', ARG_NONE, 0, 0, 0, setCurrentOffset, queryCurrentOffset},
+    {'V', ARG_NUMBER, 2, 1, 9999, setResistor, queryResistor},          // k Ohm
+    {'I', ARG_NUMBER, 0, 1, 6500, setCurrentGain, queryCurrentGain},    // mV/A
+    {'W', ARG_NUMBER, 0, 0, 1, setWindvanePosition, queryWindvanePosition},
+    {'P', ARG_NUMBER, POWER_THRESHOLD_COUNT, 0, 20000, setPowerThreshold, queryPowerThreshold},  // mV
+    {'A', ARG_NUMBER, ANALOG_CH_VANE, 0, ANALOG_MAX_EXTRA_BITS, setOversampling, queryOversampling},
+    {'C', ARG_NUMBER, 2, 0, 65534, setAnemometerCalibration, queryAnemometerCalibration},
+    {'B', ARG_NONE, 0, 0, 0, printPowerCurve, queryPowerCurve},
+#if TRANSFER_ENABLED == 1
+    {'L', ARG_NONE, 0, 0, 0, listFiles, queryFiles},
+    {'G', ARG_NUMBERS, 0, 0, 9912319, startTransfer, queryTransfer},    // YYMMDD[n][,offset[,length]]
+#endif
+#if TELEMETRY_ENABLED == 1
+    {'M', ARG_NUMBER, 0, 0, TLM_MAX_RATE, setTelemetryRate, queryTelemetryRate},  // Frames per second, 0 = off
+#endif
+    {'U', ARG_NUMBER, 0, 0, 1, setSerialEcho, querySerialEcho},         // Record echo on/off
+    {'F', ARG_NUMBER, 0, 0, FIELD_ALL, setFieldMask, queryFieldMask},   // Fields written (FIELD_BIT mask)
+#if RAM_MONITOR == 1
+    {'H', ARG_NONE, 0, 0, 0, printRam, queryRam},
+#endif
+#if TRACE_ENABLED == 1
+    {'X', ARG_NONE, 0, 0, 0, sendTrace, queryTrace},
+#endif
+};
+
+#define COMMAND_COUNT (sizeof(s_commands) / sizeof(s_commands[0]))
+
+static uint8_t s_state = STATE_COMMAND;
+static uint8_t s_error = ERR_NONE;
+static struct command s_command;  // The command being parsed, copied from flash
+static uint8_t s_index;
+static long s_value;            // The field being read
+static long s_fields[COMMAND_MAX_FIELDS];
+static uint8_t s_fieldCount;
+static uint8_t s_digits;        // Characters received in the field
+static bool s_query;
+static char s_text[COMMAND_TEXT_LENGTH + 1];
+static uint8_t s_crc;           // Running CRC of the command
+static uint8_t s_receivedCrc;
+static uint8_t s_crcDigits;     // CRC digits received (or still to skip when discarding)
+static bool s_hasCrc;
 
 const char reference[] PROGMEM = "The ref is:";
+static const char s_pstr_ok[] PROGMEM = "OK";
+static const char s_pstr_sample_time[] PROGMEM = "Sample Time:";
+static const char s_pstr_err[] PROGMEM = "ERR ";
+static const char s_pstr_errors[][8] PROGMEM = {"", "command", "index", "value", "format", "crc", "file", "busy"};
 
 /*
  * Private Functions
  */
 
 /*
- * setReferenceFromBuffer
- * Sets the two-byte device ID
+ * rxInterruptHandler
+ * The first edge on the RX line posts an event. The handler then disables
+ * itself so a burst of bytes does not flood the event queue.
  */
-static void setReferenceFromBuffer(int i)
+static void rxInterruptHandler()
 {
-    SD_SetDeviceID(&s_strBuffer[i+1]);
-    EEPROM_SetDeviceID(&s_strBuffer[i+1]);
+    TRACE(TRACE_SERIAL_RX);
+    disableInterrupt(SERIAL_RX_PIN);
+    EVT_Post(EVT_SERIAL_RX);
+}
 
-    Serial.print(PStringToRAM(reference));
-    Serial.print(s_strBuffer[i+1]);
-    Serial.println(s_strBuffer[i+2]);
-    SD_CreateFileForToday();
+/*
+ * printSetting
+ * Prints a query reply, e.g. "P1=3600"
+ */
+static void printSetting(char letter, uint8_t index, long value)
+{
+    Serial.print(letter);
+    if (index) { Serial.print(index); }
+    Serial.print('=');
+    Serial.println(value);
 }
 
 /*
- * setTimeFromBuffer
- * Sets the RTC time
+ * Setters. The index is 1-based (0 if the command has none)
+ * and the value has already been range checked.
  */
-static void setTimeFromBuffer(int i)
+
+static void setReference(uint8_t index, long value)
+{
+    (void)index; (void)value;
+
+    SD_SetDeviceID(s_text);
+    EEPROM_SetDeviceID(s_text);
+
+    Serial.print(PStringToRAM(reference));
+    Serial.println(s_text);
+    SD_CreateFileForToday();
+}
+
+static void setTime(uint8_t index, long value)
 {
-    char temp[] = "00";
-    temp[0] = s_strBuffer[i+1]; temp[1] = s_strBuffer[i+2];
-    int hour = atoi(temp);
+    (void)index;
+
+    uint8_t hour = value / 10000;
+    uint8_t minute = (value / 100) % 100;
+    uint8_t second = value % 100;
 
-    temp[0] = s_strBuffer[i+3]; temp[1] = s_strBuffer[i+4];
-    int minute = atoi(temp);
+    if ((hour > 23) || (minute > 59) || (second > 59)) { s_error = ERR_VALUE; return; }
 
-    temp[0] = s_strBuffer[i+5]; temp[1] = s_strBuffer[i+6];
-    int second = atoi(temp);
-    
     //hr, min, sec into Real Time Clock
     RTC_SetTime(hour, minute, second);
 
@@ -72,22 +294,16 @@ static void setTimeFromBuffer(int i)
     Serial.println(RTC_GetTime());
 }
 
-/*
- * setDateFromBuffer
- * Sets the RTC date
- */
-static void setDateFromBuffer(int i)
+static void setDate(uint8_t index, long value)
 {
-    char temp[] = "00";
-    temp[0] = s_strBuffer[i+1]; temp[1] = s_strBuffer[i+2];
-    int day = atoi(temp);
+    (void)index;
 
-    temp[0] = s_strBuffer[i+3]; temp[1] = s_strBuffer[i+4];
-    int month = atoi(temp);
+    uint8_t day = value / 10000;
+    uint8_t month = (value / 100) % 100;
+    uint8_t year = value % 100;
+
+    if (!RTC_DateIsValid(day, month, year)) { s_error = ERR_VALUE; return; }
 
-    temp[0] = s_strBuffer[i+5]; temp[1] = s_strBuffer[i+6];
-    int year = atoi(temp);
-    
     RTC_SetDate(day, month, year);
 
     SD_CreateFileForToday();
@@ -95,119 +311,541 @@ static void setDateFromBuffer(int i)
     Serial.println(RTC_GetDate(RTCC_DATE_WORLD));
 }
 
+static void setSampleTime(uint8_t index, long value)
+{
+    (void)index;
+
+    EEPROM_SetSampleTime((uint16_t)value);
+
+    Serial.print(PStringToRAM(s_pstr_sample_time));
+    Serial.println(value);
+
+    SD_ResetCounter();
+    SD_SetSampleTime(value);
+}
+
+static void setCurrentOffset(uint8_t index, long value)
+{
+    (void)index; (void)value;
+    // The ADC's last readings haven't been collected: the offset would take them, so try again
+    if (!VA_StoreNewCurrentOffset()) { s_error = ERR_BUSY; }
+}
+
+static void setResistor(uint8_t index, long value)
+{
+    if (index == 1) { VA_StoreNewResistor1((int)value); }
+    else { VA_StoreNewResistor2((int)value); }
+}
+
+static void setCurrentGain(uint8_t index, long value)
+{
+    (void)index;
+    VA_StoreNewCurrentGain((int)value);
+}
+
+static void setWindvanePosition(uint8_t index, long value)
+{
+    (void)index;
+    WIND_SetWindvanePosition(value == 1);
+}
+
+static void setPowerThreshold(uint8_t index, long value)
+{
+    POWER_StoreNewThreshold(index - 1, (uint16_t)value);
+}
+
+static void setOversampling(uint8_t index, long value)
+{
+    ANALOG_StoreOversampling(index - 1, (uint8_t)value);
+}
+
+static void setAnemometerCalibration(uint8_t index, long value)
+{
+    // C1 is the anemometer slope (mm/s per Hz), C2 the offset (mm/s)
+    if (index == 1) { WIND_StoreNewAnemometerSlope((uint16_t)value); }
+    else { WIND_StoreNewAnemometerOffset((uint16_t)value); }
+}
+
+static void printPowerCurve(uint8_t index, long value)
+{
+    (void)index; (void)value;
+    PCURVE_PrintToSerial();
+}
+
+#if TRANSFER_ENABLED == 1
+static void listFiles(uint8_t index, long value)
+{
+    (void)index; (void)value;
+    XFER_ListFiles();
+}
+
+static void startTransfer(uint8_t index, long value)
+{
+    (void)index;
+
+    unsigned long offset = (s_fieldCount > 1) ? s_fields[1] : 0;
+    unsigned long length = (s_fieldCount > 2) ? s_fields[2] : 0;
+
+    // The blocks follow the OK line
+    if (!XFER_Start(value, offset, length)) { s_error = ERR_FILE; }
+}
+#endif
+
+#if TELEMETRY_ENABLED == 1
+static void setTelemetryRate(uint8_t index, long value)
+{
+    (void)index;
+
+    // The frames follow the OK line
+    TLM_SetRate((uint8_t)value);
+}
+#endif
+
+static void setSerialEcho(uint8_t index, long value)
+{
+    (void)index;
+    SD_StoreEchoEnabled(value == 1);
+}
+
+static void setFieldMask(uint8_t index, long value)
+{
+    (void)index;
+
+    // Records already queued are written under the old headers
+    SD_StoreRecords();
+
+    if (!FIELDS_StoreMask((uint8_t)value)) { s_error = ERR_VALUE; return; }
+
+    // Carry on in a file with the new headers
+    SD_CreateFileForToday();
+}
+
+#if RAM_MONITOR == 1
+static void printRam(uint8_t index, long value)
+{
+    (void)index; (void)value;
+    RAM_PrintToSerial();
+}
+#endif
+
+#if TRACE_ENABLED == 1
+static void sendTrace(uint8_t index, long value)
+{
+    (void)index; (void)value;
+
+    // The frame comes before the OK line
+    TRACE_SendFrame();
+}
+#endif
+
 /*
- * setSampleTimeFromBuffer
- * Sets the sampling rate (in seconds)
+ * Queries. Each prints the setting in use as "<letter><index>=<value>"
  */
-static void setSampleTimeFromBuffer(int i)
+
+static void queryReference(uint8_t index)
+{
+    (void)index;
+
+    char id[COMMAND_TEXT_LENGTH + 1] = {0};
+    EEPROM_GetDeviceID(id);
+    Serial.print('R');
+    Serial.print('=');
+    Serial.println(id);
+}
+
+static void queryTime(uint8_t index)
 {
-    long sampleTime = atol(&s_strBuffer[i+1]);  // Convert the string to a long int
+    (void)index;
+    Serial.print('T');
+    Serial.print('=');
+    Serial.println(RTC_GetTime());
+}
 
-    EEPROM_SetSampleTime((uint16_t)sampleTime);              
+static void queryDate(uint8_t index)
+{
+    (void)index;
+    Serial.print('D');
+    Serial.print('=');
+    Serial.println(RTC_GetDate(RTCC_DATE_WORLD));
+}
 
-    Serial.print("Sample Time:");
-    Serial.println(sampleTime);
+static void querySampleTime(uint8_t index) { printSetting('S', index, SD_GetSampleTime()); }  // The power state's if it overrides
+static void queryCurrentOffset(uint8_t index) { printSetting('O', index, EEPROM_GetCurrentOffset()); }
+static void queryResistor(uint8_t index) { printSetting('V', index, (index == 1) ? EEPROM_GetR1() : EEPROM_GetR2()); }
+static void queryCurrentGain(uint8_t index) { printSetting('I', index, EEPROM_GetCurrentGain()); }
+static void queryWindvanePosition(uint8_t index) { printSetting('W', index, EEPROM_GetWindwavePosition() ? 1 : 0); }
+static void queryPowerThreshold(uint8_t index) { printSetting('P', index, POWER_GetThreshold(index - 1)); }
+static void queryOversampling(uint8_t index) { printSetting('A', index, ANALOG_GetOversampling(index - 1)); }
 
-    SD_ResetCounter();
-    SD_SetSampleTime(sampleTime);
+static void queryAnemometerCalibration(uint8_t index)
+{
+    printSetting('C', index, (index == 1) ? WIND_GetAnemometerSlope() : WIND_GetAnemometerOffset());
+}
+
+static void queryPowerCurve(uint8_t index)
+{
+    (void)index;
+    PCURVE_PrintToSerial();
+}
+
+#if TRANSFER_ENABLED == 1
+static void queryFiles(uint8_t index)
+{
+    (void)index;
+    XFER_ListFiles();
+}
+
+static void queryTransfer(uint8_t index)
+{
+    printSetting('G', index, XFER_IsActive() ? 1 : 0);
 }
+#endif
+
+#if TELEMETRY_ENABLED == 1
+static void queryTelemetryRate(uint8_t index)
+{
+    printSetting('M', index, TLM_GetRate());
+}
+#endif
+
+static void querySerialEcho(uint8_t index)
+{
+    printSetting('U', index, SD_GetEchoEnabled() ? 1 : 0);
+}
+
+static void queryFieldMask(uint8_t index)
+{
+    printSetting('F', index, FIELDS_GetMask());
+}
+
+#if RAM_MONITOR == 1
+static void queryRam(uint8_t index)
+{
+    (void)index;
+    RAM_PrintToSerial();
+}
+#endif
+
+#if TRACE_ENABLED == 1
+static void queryTrace(uint8_t index)
+{
+    printSetting('X', index, TRACE_Count());
+}
+#endif
 
 /*
-* Public Functions
-*/
+ * hexValue
+ * Returns the value of a hex digit, or 0xFF if it is not one
+ */
+static uint8_t hexValue(char c)
+{
+    if ((c >= '0') && (c <= '9')) { return c - '0'; }
+    if ((c >= 'a') && (c <= 'f')) { return c - 'a' + 10; }
+    if ((c >= 'A') && (c <= 'F')) { return c - 'A' + 10; }
+    return 0xFF;
+}
 
 /*
- * SERIAL_HandleCalibrationData
- * Reads calibration settings from serial and hands off processing to appropriate functions
+ * findCommand
+ * Copies the table entry for a letter into s_command. Returns false if there is none.
  */
-void SERIAL_HandleCalibrationData()
+static bool findCommand(char letter)
 {
-    char next_byte = '\0';
-    if (Serial.available() > 0) 
+    for (uint8_t i = 0; i < COMMAND_COUNT; i++)
     {
-        while(Serial.available() && next_byte != 'E')
+        if ((char)pgm_read_byte(&s_commands[i].letter) == letter)
         {
-            next_byte = Serial.read(); 
-            s_strBuffer[s_index++] = next_byte;
+            memcpy_P(&s_command, &s_commands[i], sizeof(s_command));
+            return true;
         }
+    }
+    return false;
+}
+
+/*
+ * fail
+ * Abandons the command. The error is reported at its end.
+ */
+static void fail(uint8_t error)
+{
+    s_error = error;
+    s_crcDigits = 0;
+    s_state = STATE_DISCARD;
+}
+
+/*
+ * reply
+ * Prints the final line for a command and waits for the next one
+ */
+static void reply(void)
+{
+    if (s_error == ERR_NONE)
+    {
+        Serial.println(PStringToRAM(s_pstr_ok));
+    }
+    else
+    {
+        Serial.print(PStringToRAM(s_pstr_err));
+        Serial.println(PStringToRAM(s_pstr_errors[s_error]));
+    }
+
+    s_state = STATE_COMMAND;
+}
+
+/*
+ * dispatch
+ * Runs a complete command
+ */
+static void dispatch(void)
+{
+    if (s_hasCrc && (s_receivedCrc != s_crc)) { s_error = ERR_CRC; return; }
 
-        if (next_byte=='E')    // We read everything up to the byte 'E' which stands for END
+    if (s_query)
+    {
+        if (s_index)
         {
-            int buffer_length = strlen(s_strBuffer);  // We also find the length of the string so we know how many char to display 
-            // Depending upon what came before we update different values
-            // To change the reference number we enter R00E, where 00 can be any number up to 99 
+            s_command.query(s_index);
+        }
+        else
+        {
+            // No index given: print them all
+            for (uint8_t i = s_command.indexes ? 1 : 0; i <= s_command.indexes; i++)
+            {
+                s_command.query(i);
+            }
+        }
+        return;
+    }
+
+    switch(s_command.arg)
+    {
+        case ARG_NUMBER:
+        case ARG_NUMBERS:
+            if (s_digits == 0) { s_error = ERR_VALUE; return; }
+            s_fields[s_fieldCount++] = s_value;
+            if (s_fields[0] < s_command.min) { s_error = ERR_VALUE; return; }
+            s_value = s_fields[0];
+            break;
+
+        case ARG_TEXT:
+            if (s_digits != COMMAND_TEXT_LENGTH) { s_error = ERR_VALUE; return; }
+            break;
+
+        default:
+            break;
+    }
+
+    s_command.set(s_index, s_value);
+}
+
+/*
+ * startCommand
+ * Handles the first byte of a command
+ */
+static void startCommand(char c)
+{
+    s_error = ERR_NONE;
+    s_index = 0;
+    s_value = 0;
+    s_fieldCount = 0;
+    s_digits = 0;
+    s_query = false;
+    s_text[0] = '\0';
+    s_hasCrc = false;
+    s_crc = _crc8_ccitt_update(0, c);
+
+    if (!findCommand(c)) { fail(ERR_COMMAND); return; }
+
+    s_state = s_command.indexes ? STATE_INDEX : STATE_VALUE;
+}
+
+/*
+ * parseValueByte
+ * Handles a byte of the value field
+ */
+static void parseValueByte(char c)
+{
+    if (c == '?')
+    {
+        if (s_digits) { fail(ERR_FORMAT); return; }
+        s_query = true;
+        s_state = STATE_END;
+        return;
+    }
 
-            for (int i = buffer_length; i>=0; i--)  // Check the buffer from the end of the data, working backwards
+    switch(s_command.arg)
+    {
+        case ARG_NUMBERS:
+            if (c == ',')
             {
-                if (s_strBuffer[i]=='R')
-                {
-                    setReferenceFromBuffer(i);
-                }
-
-                if(s_strBuffer[i]=='T')
-                {
-                    setTimeFromBuffer(i);
-                }
-
-                if(s_strBuffer[i]=='D')
-                {
-                    setDateFromBuffer(i);
-                }           
-
-                if(s_strBuffer[i]=='S')
-                {          
-                    setSampleTimeFromBuffer(i);
-                }
-
-                if(s_strBuffer[i]=='O')
-                {    
-                    VA_StoreNewCurrentOffset();
-                }
-
-                if(s_strBuffer[i]=='V' && s_strBuffer[i+1]=='1')
-                {
-                    char temp[] = "000";
-                    temp[0] = s_strBuffer[i+2];
-                    temp[1] = s_strBuffer[i+3];
-                    temp[2] = s_strBuffer[i+4];
-                    int value = atoi(temp);
-                    VA_StoreNewResistor1(value);
-                }
-
-                if(s_strBuffer[i]=='V' && s_strBuffer[i+1]=='2')
-                {    
-                    char temp[] = "000";
-                    temp[0] = s_strBuffer[i+2];
-                    temp[1] = s_strBuffer[i+3];
-                    temp[2] = s_strBuffer[i+4];
-                    int value = atoi(temp);
-                    VA_StoreNewResistor2(value);
-                }
-
-                if(s_strBuffer[i]=='I')
-                {    
-                    char temp[] = "000";
-                    temp[0] = s_strBuffer[i+1];
-                    temp[1] = s_strBuffer[i+2];
-                    temp[2] = s_strBuffer[i+3];
-                    int value = atoi(temp);
-                    VA_StoreNewCurrentGain(value);
-                }   
-
-                if(s_strBuffer[i]=='W')
-                {    
-                    if (s_strBuffer[i+1]=='1')
-                    {
-                        WIND_SetWindvanePosition(true);
-                    }
-                    else if (s_strBuffer[i+1]=='0')
-                    {
-                        WIND_SetWindvanePosition(false);
-                    }
-                }       
+                if ((s_digits == 0) || (s_fieldCount == COMMAND_MAX_FIELDS - 1)) { fail(ERR_FORMAT); return; }
+                s_fields[s_fieldCount++] = s_value;
+                s_value = 0;
+                s_digits = 0;
+                return;
             }
-            s_strBuffer[0] = '\0';
-            s_index = 0;  // Reset the buffer to be filled again 
+            // Fall through
+
+        case ARG_NUMBER:
+            if ((c < '0') || (c > '9')) { fail(ERR_FORMAT); return; }
+            s_value = (s_value * 10) + (c - '0');
+            if (s_value > (s_fieldCount ? COMMAND_FIELD_MAX : s_command.max)) { fail(ERR_VALUE); return; }
+            s_digits++;
+            break;
+
+        case ARG_TEXT:
+            if (s_digits == COMMAND_TEXT_LENGTH) { fail(ERR_VALUE); return; }
+            s_text[s_digits++] = c;
+            s_text[s_digits] = '\0';
+            break;
+
+        default:
+            fail(ERR_FORMAT);
+            break;
+    }
+}
+
+/*
+ * parseByte
+ * Runs the parser state machine for one received byte
+ */
+static void parseByte(char c)
+{
+    bool line_end = (c == '\r') || (c == '\n');
+
+    if (s_state == STATE_COMMAND)
+    {
+        // Skip anything between commands, including a stray 'E'
+        if (!line_end && (c != ' ') && (c != 'E')) { startCommand(c); }
+        return;
+    }
+
+    if (line_end)
+    {
+        if (s_state != STATE_DISCARD) { s_error = ERR_FORMAT; }
+        reply();
+        return;
+    }
+
+    switch(s_state)
+    {
+        case STATE_INDEX:
+            s_crc = _crc8_ccitt_update(s_crc, c);
+            if (c == '?')
+            {
+                s_query = true;
+                s_state = STATE_END;
+            }
+            else if ((c >= '1') && (c <= ('0' + s_command.indexes)))
+            {
+                s_index = c - '0';
+                s_state = STATE_VALUE;
+            }
+            else if (c == 'E')
+            {
+                // The command has ended already, so there is nothing to discard
+                s_error = ERR_INDEX;
+                reply();
+            }
+            else
+            {
+                fail(ERR_INDEX);
+            }
+            break;
+
+        case STATE_VALUE:
+        case STATE_END:
+            if (c == 'E')
+            {
+                dispatch();
+                reply();
+            }
+            else if ((c == '*') && !s_hasCrc)
+            {
+                s_hasCrc = true;
+                s_receivedCrc = 0;
+                s_crcDigits = 0;
+                s_state = STATE_CRC;
+            }
+            else if (s_state == STATE_END)
+            {
+                fail(ERR_FORMAT);
+            }
+            else
+            {
+                s_crc = _crc8_ccitt_update(s_crc, c);
+                parseValueByte(c);
+            }
+            break;
+
+        case STATE_CRC:
+        {
+            // Counted, as the digits may themselves be 'E'
+            uint8_t nibble = hexValue(c);
+            if (nibble == 0xFF) { fail(ERR_FORMAT); break; }
+
+            s_receivedCrc = (s_receivedCrc << 4) | nibble;
+            if (++s_crcDigits == COMMAND_CRC_DIGITS) { s_state = STATE_END; }
+            break;
         }
+
+        case STATE_DISCARD:
+            if (s_crcDigits)
+            {
+                s_crcDigits--;
+            }
+            else if (c == '*')
+            {
+                s_crcDigits = COMMAND_CRC_DIGITS;
+            }
+            else if (c == 'E')
+            {
+                reply();
+            }
+            break;
+    }
+}
+
+/*
+* Public Functions
+*/
+
+/*
+ * SERIAL_EnableRxEvent, SERIAL_DisableRxEvent
+ * Arms/disarms the EVT_SERIAL_RX event on the next edge of the RX line.
+ * Re-arm after each EVT_SERIAL_RX has been handled.
+ */
+void SERIAL_EnableRxEvent()
+{
+    enableInterrupt(SERIAL_RX_PIN, rxInterruptHandler, CHANGE);
+
+    // Bytes that arrived after the last read made their edges before this was armed
+    if (Serial.available()) { EVT_PostFromMain(EVT_SERIAL_RX); }
+}
+
+void SERIAL_DisableRxEvent()
+{
+    disableInterrupt(SERIAL_RX_PIN);
+}
+
+/*
+ * SERIAL_TxPending
+ * Returns true while the transmit buffer still holds bytes.
+ * They are sent from the USART interrupt, which needs idle sleep (not power-down or ADC).
+ */
+bool SERIAL_TxPending()
+{
+    return Serial.availableForWrite() < (SERIAL_TX_BUFFER_SIZE - 1);
+}
+
+/*
+ * SERIAL_HandleCalibrationData
+ * Feeds all received bytes through the command parser
+ */
+void SERIAL_HandleCalibrationData()
+{
+    while (Serial.available() > 0)
+    {
+        parseByte((char)Serial.read());
     }
 }
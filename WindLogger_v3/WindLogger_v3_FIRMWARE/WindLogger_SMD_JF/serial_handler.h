@@ -2,5 +2,8 @@
 #define _SERIAL_HANDLER_H_
 
 void SERIAL_HandleCalibrationData();
+void SERIAL_EnableRxEvent();
+void SERIAL_DisableRxEvent();
+bool SERIAL_TxPending();
 
 #endif
\ No newline at end of file
@@ -12,34 +12,54 @@
 #include <avr/power.h>
 
 #include "sleep.h"
-#include "rtc.h"
+#include "events.h"
 
 /***************************************************
- *  Name:        SLEEP_SetWakeOnRTCAndSleep
+ *  Name:        SLEEP_SleepUntilEvent
  *
  *  Returns:     Nothing.
  *
- *  Parameters:  None.
+ *  Parameters:  sleep_mode - SLEEP_MODE_PWR_DOWN normally,
+ *               SLEEP_MODE_ADC while an ADC scan runs,
+ *               SLEEP_MODE_IDLE if the USART and timers must keep running
  *
- *  Description: Enters the arduino into sleep mode (turns on RTC interrupt).
+ *  Description: Sleeps until an interrupt has posted an event.
+ *               Returns straight away if events are already waiting.
+ *               Other than in idle sleep the USART has nothing to do,
+ *               so it is powered down in PRR until the CPU wakes.
  *
  ***************************************************/
-void SLEEP_SetWakeOnRTCAndSleep(void)
+void SLEEP_SleepUntilEvent(uint8_t sleep_mode)
 {
-  RTC_EnableInterrupt();
-  
-  sleep_enable();
-   
-  set_sleep_mode(SLEEP_MODE_PWR_DOWN);  
-  
+  bool power_down = (sleep_mode == SLEEP_MODE_PWR_DOWN);
   byte old_ADCSRA = ADCSRA;  // Store the old value to re-enable 
-  // disable ADC
-  ADCSRA = 0;
-
   byte old_PRR = PRR;  // Store previous version on PRR
-  // turn off various modules
-  PRR = 0b11111111;
-  
+
+  set_sleep_mode(sleep_mode);
+
+  // Check the queue with interrupts off, so an event posted between
+  // the check and sleep_cpu() cannot be slept through.
+  cli();
+  if (EVT_Pending())
+  {
+    sei();
+    return;
+  }
+
+  if (power_down)
+  {
+    // disable ADC
+    ADCSRA = 0;
+    // turn off various modules
+    PRR = 0b11111111;
+  }
+  else if (sleep_mode != SLEEP_MODE_IDLE)
+  {
+    PRR = old_PRR | _BV(PRUSART0);
+  }
+
+  sleep_enable();
+  sei();  // The instruction after sei() always runs before any pending interrupt
   sleep_cpu();
   /* The program will continue from here. */
   /************* ASLEEP *******************/
@@ -50,9 +70,16 @@ void SLEEP_SetWakeOnRTCAndSleep(void)
   /* First thing to do is disable sleep. */
   sleep_disable();
   
-  // turn ON various modules USART and ADC
-  PRR = old_PRR;  
-  
-  // enable ADC
-  ADCSRA = old_ADCSRA;  
+  if (power_down)
+  {
+    // turn ON various modules USART and ADC
+    PRR = old_PRR;  
+    
+    // enable ADC
+    ADCSRA = old_ADCSRA;  
+  }
+  else
+  {
+    PRR = old_PRR;
+  }
 }
@@ -1,6 +1,6 @@
 #ifndef _SLEEP_H_
 #define _SLEEP_H_
 
-void SLEEP_SetWakeOnRTCAndSleep(void);
+void SLEEP_SleepUntilEvent(uint8_t sleep_mode);
 
 #endif
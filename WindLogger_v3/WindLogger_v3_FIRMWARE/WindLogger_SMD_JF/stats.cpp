@@ -0,0 +1,67 @@
+/*
+ * stats.cpp
+ *
+ * Period statistics output for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "utility.h"
+#include "stats.h"
+
+/*
+ * Private Functions
+ */
+
+/*
+ * round_to_decimals
+ * Drops decimal places from a scaled value, rounding half away from zero
+ */
+static long round_to_decimals(long value, uint8_t unitDecimals, uint8_t decimals)
+{
+	long divisor = 1;
+	while (unitDecimals > decimals)
+	{
+		divisor *= 10;
+		unitDecimals--;
+	}
+
+	long half = divisor / 2;
+	return (value >= 0) ? ((value + half) / divisor) : ((value - half) / divisor);
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * STATS_WriteSummaryToBuffer
+ * Writes the period mean, followed by the standard deviation, minimum and maximum
+ * if WRITE_CHANNEL_STATS is set
+ */
+void STATS_WriteSummaryToBuffer(const struct stats_summary * summary, uint8_t unitDecimals, uint8_t decimals,
+    FixedLengthAccumulator * accum)
+{
+	if (!summary || !accum) { return; }
+
+	if (decimals > unitDecimals) { decimals = unitDecimals; }
+
+	WriteFixedPoint(round_to_decimals(summary->mean, unitDecimals, decimals), decimals, accum);
+
+#if WRITE_CHANNEL_STATS == 1
+	accum->writeChar(',');
+	WriteFixedPoint(round_to_decimals(summary->sd, unitDecimals, decimals), decimals, accum);
+	accum->writeChar(',');
+	WriteFixedPoint(round_to_decimals(summary->min, unitDecimals, decimals), decimals, accum);
+	accum->writeChar(',');
+	WriteFixedPoint(round_to_decimals(summary->max, unitDecimals, decimals), decimals, accum);
+#endif
+}
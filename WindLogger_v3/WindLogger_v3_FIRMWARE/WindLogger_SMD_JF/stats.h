@@ -0,0 +1,178 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// Column headers for one channel: "name" or "name mean, name sd, name min, name max"
+// and the number of columns STATS_WriteSummaryToBuffer writes
+#if WRITE_CHANNEL_STATS == 1
+#define STATS_HEADERS(name) name " mean, " name " sd, " name " min, " name " max"
+#define STATS_COLUMNS 4
+#else
+#define STATS_HEADERS(name) name
+#define STATS_COLUMNS 1
+#endif
+
+// The statistics of one channel over a period, in the channel's own units.
+// The standard deviation is only kept if it is written.
+struct stats_summary
+{
+	int16_t mean;
+#if WRITE_CHANNEL_STATS == 1
+	int16_t sd;
+#endif
+	int16_t min;
+	int16_t max;
+};
+
+/*
+ * NoSumSquares
+ *
+ * Stands in for the sum of squares when the standard deviation isn't needed:
+ * one byte instead of eight per channel, and no 64-bit arithmetic.
+ */
+struct NoSumSquares
+{
+    NoSumSquares(uint32_t value = 0) { (void)value; }
+    NoSumSquares & operator+=(const NoSumSquares & other) { (void)other; return *this; }
+    NoSumSquares operator*(const NoSumSquares & other) const { (void)other; return *this; }
+    operator float() const { return 0.0f; }
+};
+
+/*
+ * FixedPointStats
+ *
+ * Period statistics of an integer channel: count, sum, sum of squares, min and max.
+ *
+ * The sums are of the difference from the first value of the period, so they stay
+ * small for a steady channel and the variance has no large terms to cancel.
+ * The sum of squares is exact (64-bit), and only the final standard deviation
+ * uses floating point.
+ *
+ *  T      - value type
+ *  SUM_T  - must hold (max deviation x max count)
+ *  SQ_T   - must hold (max deviation squared x max count)
+ */
+
+template <typename T, typename SUM_T = long, typename SQ_T = uint64_t>
+class FixedPointStats
+{
+    public:
+        FixedPointStats() { reset(); }
+
+        void reset(void)
+        {
+            m_count = 0;
+            m_first = 0;
+            m_sum = 0;
+            m_sumSquares = 0;
+            m_min = 0;
+            m_max = 0;
+        }
+
+        void add(T value)
+        {
+            if (m_count == 0xFFFF) { return; }
+
+            if (m_count == 0)
+            {
+                m_first = value;
+                m_min = value;
+                m_max = value;
+            }
+            else
+            {
+                if (value < m_min) { m_min = value; }
+                if (value > m_max) { m_max = value; }
+            }
+
+            SUM_T deviation = (SUM_T)value - (SUM_T)m_first;
+            SQ_T magnitude = (SQ_T)((deviation < 0) ? -deviation : deviation);
+
+            m_sum += deviation;
+            m_sumSquares += magnitude * magnitude;
+            m_count++;
+        }
+
+        // No min() and max(): the Arduino core defines those as macros, summarise() gives them
+        uint16_t count(void) const { return m_count; }
+
+        // The sum of all the values (e.g. insolation from irradiance)
+        long total(void) const { return ((long)m_first * m_count) + (long)m_sum; }
+
+        // Rounded to the nearest unit
+        T mean(void) const
+        {
+            if (m_count == 0) { return 0; }
+
+            SUM_T half = (m_sum >= 0) ? (SUM_T)(m_count / 2) : -(SUM_T)(m_count / 2);
+            return m_first + (T)((m_sum + half) / (SUM_T)m_count);
+        }
+
+        // Population standard deviation, rounded to the nearest unit.
+        // Half the range of T at most, which only rounds past the largest T at the very extremes.
+        T sd(void) const
+        {
+            if (m_count < 2) { return 0; }
+
+            const float largest = (float)((1UL << ((8 * sizeof(T)) - 1)) - 1);  // T is signed
+            float meanDeviation = (float)m_sum / m_count;
+            float variance = ((float)m_sumSquares / m_count) - (meanDeviation * meanDeviation);
+            if (variance <= 0.0f) { return 0; }
+
+            float rounded = sqrt(variance) + 0.5f;
+            return (T)((rounded > largest) ? largest : rounded);
+        }
+
+        // Starts again from a summary of count values (a checkpoint, see checkpoint.cpp):
+        // the sums are as if every value was the mean, with a spread of sd
+        void restore(uint16_t count, T mean, T sd, T min, T max)
+        {
+            reset();
+            if (count == 0) { return; }
+
+            m_count = count;
+            m_first = mean;
+            m_sumSquares = (SQ_T)((uint32_t)sd * (uint32_t)sd) * (SQ_T)count;
+            m_min = min;
+            m_max = max;
+        }
+
+        void summarise(struct stats_summary * summary) const
+        {
+            if (!summary) { return; }
+
+            summary->mean = mean();
+#if WRITE_CHANNEL_STATS == 1
+            summary->sd = sd();
+#endif
+            summary->min = m_min;
+            summary->max = m_max;
+        }
+
+    private:
+        uint16_t m_count;
+        T m_first;
+        SUM_T m_sum;
+        SQ_T m_sumSquares;
+        T m_min;
+        T m_max;
+};
+
+// One analog channel in engineering units (mV, W/m^2, hundredths of a degree ...)
+#if WRITE_CHANNEL_STATS == 1
+typedef FixedPointStats<int16_t> ChannelStats;
+#else
+typedef FixedPointStats<int16_t, long, NoSumSquares> ChannelStats;
+#endif
+
+// Public Functions
+
+// Writes "mean" or "mean,sd,min,max" (see WRITE_CHANNEL_STATS).
+// The values are in units of 10^-unitDecimals and are written rounded to decimals places.
+void STATS_WriteSummaryToBuffer(const struct stats_summary * summary, uint8_t unitDecimals, uint8_t decimals,
+    FixedLengthAccumulator * accum);
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * telemetry.cpp
+ *
+ * Live binary telemetry for commissioning the Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "events.h"
+#include "utility.h"
+#include "wind.h"
+#include "analog.h"
+#include "telemetry.h"
+#include "trace.h"
+
+/*
+ * In calibrate mode the logger can stream small binary frames (see telemetry.h)
+ * of the live pulse counts, the vane and the analog channels, for setting up
+ * anemometers and vanes with tools/live_view.py.
+ *
+ * Timer2 interrupts at TLM_TIMER_HZ and posts EVT_TELEMETRY_FRAME at the set rate.
+ * Each frame takes its own single conversions of the analog channels, and only
+ * when the ADC is idle, so the period scan, statistics, direction counts and
+ * pulse counts are read but never changed. The timer is stopped when streaming
+ * is off, as the logger could not power-down sleep with it running.
+ */
+
+#if TELEMETRY_ENABLED == 1
+
+/*
+ * Defines and Typedefs
+ */
+
+#define TIMER2_PRESCALER 1024UL
+#define TIMER2_TOP ((F_CPU / TIMER2_PRESCALER / TLM_TIMER_HZ) - 1)
+
+#if TIMER2_TOP > 255
+#error "Telemetry timer rate too low for Timer2"
+#endif
+
+/*
+ * Private Variables
+ */
+
+static uint8_t s_rate = 0;  // Frames per second, 0 = off
+static volatile uint8_t s_interval;  // Timer ticks per frame
+static volatile uint8_t s_countdown;
+static volatile uint16_t s_time;  // Timer ticks since streaming started
+
+static uint8_t s_sequence;
+static uint16_t s_readings[ANALOG_CHANNEL_COUNT];
+static uint8_t s_channels;  // Channels in s_readings
+
+/*
+ * Private Functions
+ */
+
+/*
+ * write_byte, write_u16
+ * Send frame bytes and add them to the CRC
+ */
+static void write_byte(uint8_t b, uint16_t * crc)
+{
+	Serial.write(b);
+	*crc = _crc_xmodem_update(*crc, b);
+}
+
+static void write_u16(uint16_t value, uint16_t * crc)
+{
+	write_byte((uint8_t)value, crc);
+	write_byte((uint8_t)(value >> 8), crc);
+}
+
+/*
+ * start_timer, stop_timer
+ * Timer2 in CTC mode, interrupting at TLM_TIMER_HZ
+ */
+static void start_timer(void)
+{
+	PRR &= ~_BV(PRTIM2);
+
+	TIMSK2 = 0;
+	TCCR2A = _BV(WGM21);
+	TCCR2B = _BV(CS22) | _BV(CS21) | _BV(CS20);  // /1024
+	OCR2A = TIMER2_TOP;
+	TCNT2 = 0;
+	TIMSK2 = _BV(OCIE2A);
+}
+
+static void stop_timer(void)
+{
+	TIMSK2 = 0;
+	TCCR2B = 0;
+}
+
+/*
+ * Timer2 compare interrupt
+ */
+ISR(TIMER2_COMPA_vect)
+{
+	TRACE_OFTEN(TRACE_TIMER2);
+	s_time++;
+
+	if (--s_countdown == 0)
+	{
+		s_countdown = s_interval;
+		EVT_Post(EVT_TELEMETRY_FRAME);
+	}
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * TLM_SetRate
+ * Starts streaming at hz frames per second (up to TLM_MAX_RATE), or stops it if hz is 0
+ */
+void TLM_SetRate(uint8_t hz)
+{
+	if (hz > TLM_MAX_RATE) { hz = TLM_MAX_RATE; }
+
+	stop_timer();
+	s_rate = hz;
+
+	if (hz)
+	{
+		s_interval = TLM_TIMER_HZ / hz;
+		s_countdown = s_interval;
+		s_time = 0;
+		s_sequence = 0;
+		s_channels = 0;
+		start_timer();
+	}
+}
+
+/*
+ * TLM_GetRate
+ * Returns the frames per second (0 = off)
+ */
+uint8_t TLM_GetRate(void)
+{
+	return s_rate;
+}
+
+/*
+ * TLM_IsActive
+ * Returns true while streaming (the text calibrate output is not wanted)
+ */
+bool TLM_IsActive(void)
+{
+	return s_rate != 0;
+}
+
+/*
+ * TLM_SendFrame
+ * Called by application on EVT_TELEMETRY_FRAME to read and send one frame
+ */
+void TLM_SendFrame(void)
+{
+	uint16_t crc = 0;
+	uint16_t time;
+	uint8_t flags = 0;
+
+	if (!s_rate) { return; }
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		time = s_time;
+	}
+
+	uint8_t mask = ANALOG_GetAvailableChannels();
+	if (ANALOG_ReadRaw(mask, s_readings))
+	{
+		s_channels = mask;
+	}
+	else
+	{
+		// The period scan has the ADC - send the last readings again
+		flags = TLM_FLAG_REPEATED;
+	}
+
+	uint16_t vane = s_readings[ANALOG_CH_VANE];
+	uint8_t direction = (s_channels & ANALOG_CHANNEL_BIT(ANALOG_CH_VANE)) ? WIND_ReadingToDirection(vane) : WIND_NO_DIRECTION;
+
+	Serial.write((uint8_t)TLM_FRAME_START);
+	write_byte(TLM_FRAME_LIVE, &crc);
+	write_byte(s_sequence++, &crc);
+	write_u16(time, &crc);
+	write_u16(WIND_GetPulseTotal(0), &crc);
+	write_u16(WIND_GetPulseTotal(1), &crc);
+	write_u16(vane, &crc);
+	write_byte(direction, &crc);
+	for (uint8_t ch = 0; ch < ANALOG_CH_VANE; ch++)
+	{
+		write_u16(s_readings[ch], &crc);
+	}
+	write_byte(s_channels | flags, &crc);
+
+	Serial.write((uint8_t)crc);
+	Serial.write((uint8_t)(crc >> 8));
+}
+
+#else
+
+void TLM_SetRate(uint8_t hz) { (void)hz; }
+uint8_t TLM_GetRate(void) { return 0; }
+bool TLM_IsActive(void) { return false; }
+void TLM_SendFrame(void) {}
+
+#endif
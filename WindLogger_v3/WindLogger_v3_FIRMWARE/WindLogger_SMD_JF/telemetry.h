@@ -0,0 +1,31 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// Frames are sent every TLM_TIMER_HZ / rate timer ticks
+#define TLM_TIMER_HZ 100
+#define TLM_MAX_RATE 10
+
+// Frame, all values little-endian:
+//   TLM_FRAME_START, TLM_FRAME_LIVE, then
+//   uint8 sequence, uint16 time (1/TLM_TIMER_HZ s, wraps),
+//   uint16 pulses[2] (free running, wrap), uint16 vane (10-bit), uint8 direction (0 = N ... 7 = NW, 0xFF = none),
+//   uint16 adc[ANALOG_CH_VANE] (10-bit, analog_channel order), uint8 channels, then uint16 CRC
+// The CRC is CRC-16/XMODEM of everything after TLM_FRAME_START, as for file transfer blocks.
+// channels has a bit set for each channel read for this frame (ANALOG_CHANNEL_BIT),
+// plus TLM_FLAG_REPEATED if the ADC was busy and the readings are those of the last frame.
+#define TLM_FRAME_START 0x02
+#define TLM_FRAME_LIVE 'T'
+#define TLM_FLAG_REPEATED 0x80
+
+// Public Functions
+
+void TLM_SetRate(uint8_t hz);
+uint8_t TLM_GetRate(void);
+bool TLM_IsActive(void);
+void TLM_SendFrame(void);
+
+#endif
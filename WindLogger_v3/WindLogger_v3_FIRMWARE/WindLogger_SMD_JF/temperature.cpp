@@ -15,104 +15,86 @@
 
 #include "app.h"
 #include "utility.h"
+#include "stats.h"
+#include "analog.h"
+#include "temperature.h"
 
 /* 
  * Defines and Typedefs
  */
 
-enum {
-  T_KELVIN=0,
-  T_CELSIUS,
-  T_FAHRENHEIT
-};
+// Choose one thermistor
+//#define THERMISTOR_TYPE THERMISTOR_EPICOS_K164
+#define THERMISTOR_TYPE THERMISTOR_GT_10K
+//#define THERMISTOR_TYPE THERMISTOR_VISHAY_10K
 
-#define THERMISTOR_PIN A0  // This is the analog pin for the thermistor
+#if READ_TEMPERATURE == 1
 
-/* Thermistor data for use in thermistor_to_temperature function */
-struct thermistor
-{
-	float B;
-	float T0;
-	float R0;
-};
+/*
+ * The temperature comes from a table of hundredths of a degree against
+ * analog reading, generated on the PC by tools/thermistor_table.py from the
+ * thermistor B parameter equation. Readings between entries are
+ * interpolated in integer maths, so there is no float or log() here.
+ *
+ * Each tick's reading is converted and the period statistics are taken of
+ * the temperatures (see pipeline.cpp), rather than converting the period
+ * mean reading, as the curve is not linear.
+ */
 
-#if READ_TEMPERATURE == 1
+#include "thermistor_table.h"
 
-// Choose one thermsitor (comment out the others)
-//static struct thermistor s_thermistor = {4300.0f,298.15f,10000.0f};			// Epicos K164 10K
-static struct thermistor s_thermistor = {4126.0f,298.15f,10000.0f};					// GT 10K
-//static struct thermistor s_thermistor = {4090.0f,298.15f,47000.0f};	// Vishay 10K
+static_assert(THERMISTOR_TABLE_BITS == ANALOG_RESULT_BITS, "Regenerate thermistor_table.h for the analog scale");
 
 /*
- * Private Functions
+ * Public Functions
  */
 
-/* thermistor_to_temperature
+/* TEMP_ReadingToCentidegrees
  * Outputs: 
- * 	the actual temperature (float)
+ * 	the temperature in hundredths of a degree C
  * Inputs:
- * 	1. data - ADC reading
- * 	2. OuputUnit - output in celsius, kelvin or fahrenheit
- * 	3. Your balance resistor resistance in ohms
- *	4. Set true if thermistor is a pullup
+ * 	1. reading - analog reading (ANALOG_RESULT_BITS scale)
  */
-
-static float thermistor_to_temperature(float data, int OutputUnit, float R_Balance, bool pullup)
+int16_t TEMP_ReadingToCentidegrees(uint16_t reading)
 {
-  float R,T;
+  uint8_t index = reading >> THERMISTOR_TABLE_SHIFT;
+  uint8_t frac = reading & ((1 << THERMISTOR_TABLE_SHIFT) - 1);
 
-  if (pullup)
+  if (index >= THERMISTOR_TABLE_SIZE - 1)
   {
-  	R = (1024.0f*R_Balance/data)-R_Balance;
-  }
-  else
-  {
-  	R = (data*R_Balance)/(1024.0f-data);
+    return (int16_t)pgm_read_word(&s_thermistorTable[THERMISTOR_TABLE_SIZE - 1]);
   }
 
-  T=1.0f/(1.0f/s_thermistor.T0+(1.0f/s_thermistor.B)*log(R/s_thermistor.R0));
+  int16_t low = (int16_t)pgm_read_word(&s_thermistorTable[index]);
+  int16_t high = (int16_t)pgm_read_word(&s_thermistorTable[index + 1]);
 
-  switch(OutputUnit) {
-    case T_CELSIUS :
-      T-=273.15f;
-    break;
-    case T_FAHRENHEIT :
-      T=9.0f*(T-273.15f)/5.0f+32.0f;
-    break;
-    default:
-    break;
-  };
-
-  return T;
+  return low + (int16_t)(((long)(high - low) * frac) / (1 << THERMISTOR_TABLE_SHIFT));
 }
 
 /*
- * Public Functions
+ * TEMP_WriteTemperatureToBuffer
+ * Writes the period temperature in degrees C to two decimal places
  */
-
-void TEMP_WriteTemperatureToBuffer(FixedLengthAccumulator * accum)
+void TEMP_WriteTemperatureToBuffer(const struct stats_summary * centidegrees, FixedLengthAccumulator * accum)
 {
-  if (!accum) { return; }
-
-  float data = float(analogRead(THERMISTOR_PIN));
-  float tempC = thermistor_to_temperature(data, T_CELSIUS, 10000.0f, true);
-  
-  char tempCstr[6];  // A string buffer to hold the converted string
-  dtostrf(tempC, 2, 2, tempCstr);  // Convert the temperature value (double) into a string
+  if (!centidegrees || !accum) { return; }
 
-  accum->writeString(tempCstr);
+  STATS_WriteSummaryToBuffer(centidegrees, 2, 2, accum);
 
   if(APP_InDebugMode())
   {
     Serial.print("Therm: ");
-    Serial.println(tempCstr);  
+    Serial.println(centidegrees->mean);  
   }
 }
 
 #else
 
-void TEMP_WriteTemperatureToBuffer(FixedLengthAccumulator * accum)
+int16_t TEMP_ReadingToCentidegrees(uint16_t reading) { (void)reading; return 0; }
+
+void TEMP_WriteTemperatureToBuffer(const struct stats_summary * centidegrees, FixedLengthAccumulator * accum)
 {
+	(void)centidegrees;
 	(void)accum;
 }
 
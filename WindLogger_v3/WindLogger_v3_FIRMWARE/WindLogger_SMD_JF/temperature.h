@@ -1,12 +1,23 @@
 #ifndef _TEMPERATURE_H_
 #define _TEMPERATURE_H_
 
+#define THERMISTOR_PIN A6  // This is the analog pin for the thermistor (A0 on the original board: see the .ino pin list)
+
+// Supported thermistors (see tools/thermistor_table.py)
+#define THERMISTOR_EPICOS_K164 1
+#define THERMISTOR_GT_10K 2
+#define THERMISTOR_VISHAY_10K 3
+
 #if READ_TEMPERATURE == 1
-#define TEMPERATURE_HEADERS "Temp C, "
+#define TEMPERATURE_HEADERS STATS_HEADERS("Temp C") ", "
+#define TEMPERATURE_COLUMNS STATS_COLUMNS
 #else
 #define TEMPERATURE_HEADERS ""
+#define TEMPERATURE_COLUMNS 0
 #endif
 
-void TEMP_WriteTemperatureToBuffer(FixedLengthAccumulator * accum);
+int16_t TEMP_ReadingToCentidegrees(uint16_t reading);
+
+void TEMP_WriteTemperatureToBuffer(const struct stats_summary * centidegrees, FixedLengthAccumulator * accum);
 
 #endif
@@ -0,0 +1,78 @@
+#ifndef _THERMISTOR_TABLE_H_
+#define _THERMISTOR_TABLE_H_
+
+/*
+ * Generated by tools/thermistor_table.py - do not edit by hand.
+ * Temperature in hundredths of a degree C, one entry every 64 readings
+ * (13-bit scale), thermistor as the pull-up over a 10k balance resistor.
+ */
+
+#define THERMISTOR_TABLE_BITS 13
+#define THERMISTOR_TABLE_SHIFT 6
+#define THERMISTOR_TABLE_SIZE 129
+
+#if THERMISTOR_TYPE == THERMISTOR_EPICOS_K164  // Epicos K164 10K: B=4300, R0=10000
+static const int16_t s_thermistorTable[THERMISTOR_TABLE_SIZE] PROGMEM = {
+	-5500, -4996, -4154, -3626, -3234, -2918, -2651, -2419,
+	-2213, -2027, -1857, -1699, -1553, -1415, -1285, -1162,
+	-1045, -932, -825, -721, -621, -525, -431, -340,
+	-252, -165, -81, 1, 82, 161, 238, 315,
+	390, 463, 536, 608, 679, 749, 818, 887,
+	955, 1022, 1089, 1155, 1221, 1286, 1351, 1416,
+	1480, 1544, 1608, 1672, 1736, 1799, 1863, 1926,
+	1989, 2053, 2116, 2180, 2243, 2307, 2371, 2436,
+	2500, 2565, 2630, 2695, 2761, 2827, 2894, 2961,
+	3029, 3097, 3166, 3235, 3306, 3377, 3449, 3521,
+	3595, 3669, 3745, 3822, 3900, 3979, 4059, 4141,
+	4224, 4309, 4396, 4484, 4575, 4667, 4762, 4859,
+	4958, 5061, 5166, 5274, 5386, 5502, 5622, 5746,
+	5874, 6009, 6148, 6295, 6448, 6609, 6779, 6959,
+	7150, 7354, 7573, 7809, 8066, 8346, 8656, 9001,
+	9393, 9842, 10371, 11011, 11818, 12900, 14517, 15000,
+	15000
+};
+#elif THERMISTOR_TYPE == THERMISTOR_GT_10K  // GT 10K: B=4126, R0=10000
+static const int16_t s_thermistorTable[THERMISTOR_TABLE_SIZE] PROGMEM = {
+	-5500, -5231, -4370, -3830, -3428, -3103, -2830, -2591,
+	-2380, -2188, -2013, -1851, -1699, -1558, -1424, -1297,
+	-1176, -1060, -949, -842, -739, -639, -542, -448,
+	-357, -267, -180, -95, -12, 70, 151, 230,
+	307, 384, 459, 533, 607, 679, 751, 822,
+	893, 963, 1032, 1101, 1169, 1237, 1304, 1372,
+	1439, 1505, 1572, 1638, 1704, 1770, 1836, 1902,
+	1968, 2034, 2100, 2166, 2233, 2299, 2366, 2433,
+	2500, 2567, 2635, 2704, 2772, 2841, 2911, 2981,
+	3051, 3123, 3195, 3267, 3341, 3415, 3490, 3566,
+	3643, 3721, 3800, 3880, 3961, 4044, 4128, 4214,
+	4301, 4390, 4481, 4574, 4668, 4765, 4865, 4967,
+	5071, 5178, 5289, 5403, 5520, 5642, 5768, 5898,
+	6034, 6175, 6322, 6476, 6637, 6807, 6987, 7177,
+	7378, 7594, 7825, 8075, 8346, 8643, 8972, 9338,
+	9754, 10232, 10796, 11478, 12340, 13500, 15000, 15000,
+	15000
+};
+#elif THERMISTOR_TYPE == THERMISTOR_VISHAY_10K  // Vishay 10K: B=4090, R0=47000
+static const int16_t s_thermistorTable[THERMISTOR_TABLE_SIZE] PROGMEM = {
+	-5500, -3277, -2244, -1592, -1104, -710, -376, -85,
+	174, 410, 625, 825, 1011, 1186, 1352, 1509,
+	1659, 1802, 1940, 2073, 2201, 2326, 2446, 2563,
+	2678, 2789, 2898, 3005, 3109, 3212, 3312, 3411,
+	3509, 3605, 3700, 3793, 3886, 3977, 4068, 4158,
+	4247, 4335, 4422, 4509, 4596, 4682, 4767, 4853,
+	4937, 5022, 5107, 5191, 5275, 5359, 5443, 5527,
+	5611, 5696, 5780, 5864, 5949, 6034, 6119, 6205,
+	6291, 6378, 6465, 6552, 6640, 6729, 6819, 6909,
+	7000, 7092, 7184, 7278, 7373, 7469, 7566, 7664,
+	7764, 7865, 7967, 8071, 8177, 8285, 8394, 8506,
+	8619, 8735, 8854, 8975, 9099, 9225, 9355, 9489,
+	9626, 9767, 9912, 10062, 10217, 10377, 10543, 10716,
+	10895, 11082, 11277, 11482, 11697, 11923, 12163, 12417,
+	12687, 12976, 13288, 13624, 13991, 14394, 14840, 15000,
+	15000, 15000, 15000, 15000, 15000, 15000, 15000, 15000,
+	15000
+};
+#else
+#error "Unknown THERMISTOR_TYPE"
+#endif
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * trace.cpp
+ *
+ * Phase and interrupt trace for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "trace.h"
+
+/*
+ * With TRACE_ENABLED each TRACE() keeps the id and a Timer1 timestamp in a
+ * ring in RAM, the oldest entries overwritten as it fills. The "X" serial
+ * command sends the ring as one binary frame (see trace.h) and empties it,
+ * and tools/trace_view.py turns it into a timeline and a histogram of each
+ * phase's duration.
+ *
+ * Recording stops when calibrate mode is entered (TRACE_Hold), so the first
+ * dump is of the logger as it ran before, not of the serial session. It
+ * starts again, empty, after each dump.
+ *
+ * Timer1 is otherwise unused: it is set free running from the reset, with
+ * no interrupt. A record is one read of TCNT1 and three stores with
+ * interrupts off, so it can be used in interrupts and around them.
+ */
+
+#if TRACE_ENABLED == 1
+
+#if (TRACE_LENGTH & (TRACE_LENGTH - 1)) || (TRACE_LENGTH > 128)
+#error "TRACE_LENGTH must be a power of 2, up to 128"
+#endif
+
+/*
+ * Defines and Typedefs
+ */
+
+#define TRACE_MASK (TRACE_LENGTH - 1)
+#define TICKS_PER_MS (F_CPU / TRACE_PRESCALER / 1000UL)
+
+struct trace_entry
+{
+	uint8_t id;
+	uint16_t time;
+};
+
+/*
+ * Private Variables
+ */
+
+static struct trace_entry s_entries[TRACE_LENGTH];
+static uint8_t s_head;		// Next entry written
+static uint8_t s_count;
+static uint8_t s_lost;
+static volatile bool s_held;	// Nothing is recorded until the next dump
+
+/*
+ * Private Functions
+ */
+
+/*
+ * write_byte, write_u16
+ * Send frame bytes and add them to the CRC
+ */
+static void write_byte(uint8_t b, uint16_t * crc)
+{
+	Serial.write(b);
+	*crc = _crc_xmodem_update(*crc, b);
+}
+
+static void write_u16(uint16_t value, uint16_t * crc)
+{
+	write_byte((uint8_t)value, crc);
+	write_byte((uint8_t)(value >> 8), crc);
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * TRACE_Setup
+ * Starts Timer1 free running at F_CPU / TRACE_PRESCALER.
+ * The Arduino core sets it up for PWM, which nothing here uses.
+ */
+void TRACE_Setup(void)
+{
+	PRR &= ~_BV(PRTIM1);
+
+	TIMSK1 = 0;
+	TCCR1A = 0;
+	TCCR1B = _BV(CS11) | _BV(CS10);  // Normal mode, /64
+	TCNT1 = 0;
+}
+
+/*
+ * TRACE_Record
+ * Adds an entry to the ring, overwriting the oldest if it is full
+ */
+void TRACE_Record(uint8_t id)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if (!s_held)
+		{
+			struct trace_entry * entry = &s_entries[s_head];
+
+			entry->time = TCNT1;
+			entry->id = id;
+			s_head = (s_head + 1) & TRACE_MASK;
+
+			if (s_count < TRACE_LENGTH) { s_count++; }
+			else if (s_lost < 255) { s_lost++; }
+		}
+	}
+}
+
+/*
+ * TRACE_Hold
+ * Stops recording until the ring has been sent
+ */
+void TRACE_Hold(void)
+{
+	s_held = true;
+}
+
+/*
+ * TRACE_Count
+ * Entries in the ring
+ */
+uint8_t TRACE_Count(void)
+{
+	return s_count;
+}
+
+/*
+ * TRACE_SendFrame
+ * Sends the ring as a dump frame, oldest entry first, and empties it
+ */
+void TRACE_SendFrame(void)
+{
+	uint16_t crc = 0;
+	uint8_t count;
+	uint8_t index;
+
+	// Nothing else changes the ring until it is released
+	s_held = true;
+
+	count = s_count;
+	index = (s_head - count) & TRACE_MASK;
+
+	Serial.write(TRACE_FRAME_START);
+	write_byte(TRACE_FRAME_DUMP, &crc);
+	write_u16(TICKS_PER_MS, &crc);
+	write_byte(s_lost, &crc);
+	write_byte(count, &crc);
+
+	while (count--)
+	{
+		write_byte(s_entries[index].id, &crc);
+		write_u16(s_entries[index].time, &crc);
+		index = (index + 1) & TRACE_MASK;
+	}
+	Serial.write((uint8_t)crc);
+	Serial.write((uint8_t)(crc >> 8));
+
+	s_count = 0;
+	s_lost = 0;
+	s_held = false;
+}
+
+#else
+
+void TRACE_Setup(void) {}
+void TRACE_Record(uint8_t id) { (void)id; }
+void TRACE_Hold(void) {}
+uint8_t TRACE_Count(void) { return 0; }
+void TRACE_SendFrame(void) {}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// What is recorded in the trace ring (trace.cpp).
+// Phases are recorded as they start, and with TRACE_END_FLAG as they end.
+// Interrupts are recorded once, as they run.
+enum trace_id
+{
+	// Phases
+	TRACE_LOOP = 1,		// Handling the events loop() was woken for
+	TRACE_TICK,			// Per-second work on EVT_TICK
+	TRACE_SAMPLE,		// Taking the scan into the period statistics (EVT_ANALOG_SCAN_COMPLETE)
+	TRACE_RECORD,		// Turning the period into a record (PIPE_CompletePeriod)
+	TRACE_STORE,		// Writing the queued records to the card, closing the file
+	TRACE_WRITE,		// Writing one record to the card (writeDataString)
+
+	// Interrupts
+	TRACE_RTC = 0x20,	// RTC 1Hz
+	TRACE_ADC_SCAN,		// ADC scan complete
+	TRACE_ADC,			// ADC conversion (TRACE_FREQUENT)
+	TRACE_PULSE1,		// Anemometer 1 pulse (TRACE_FREQUENT)
+	TRACE_PULSE2,		// Anemometer 2 pulse (TRACE_FREQUENT)
+	TRACE_CARD,			// Card detect change
+	TRACE_SERIAL_RX,	// Serial RX pin change
+	TRACE_WDT,			// Watchdog (LED pattern step)
+	TRACE_TIMER2		// Telemetry timer (TRACE_FREQUENT)
+};
+
+#define TRACE_END_FLAG 0x80
+
+// Entries in the ring, a power of 2. Each is 3 bytes of RAM.
+#ifndef TRACE_LENGTH
+#define TRACE_LENGTH 64
+#endif
+
+// Timestamps are Timer1 counts of F_CPU / TRACE_PRESCALER (4us at 16MHz), wrapping every 65536.
+// Timer1 is stopped in power-down and ADC noise reduction sleep, so they are awake time.
+#define TRACE_PRESCALER 64
+
+// Dump frame, all values little-endian:
+//   TRACE_FRAME_START, TRACE_FRAME_DUMP, then
+//   uint16 ticks per ms, uint8 lost (entries overwritten since the last dump, up to 255),
+//   uint8 count, then count x (uint8 id, uint16 time) oldest first, then uint16 CRC
+// The CRC is CRC-16/XMODEM of everything after TRACE_FRAME_START, as for telemetry frames.
+#define TRACE_FRAME_START 0x02
+#define TRACE_FRAME_DUMP 'X'
+
+#if TRACE_ENABLED == 1
+#define TRACE(id) TRACE_Record(id)
+#define TRACE_BEGIN(phase) TRACE_Record(phase)
+#define TRACE_END(phase) TRACE_Record((phase) | TRACE_END_FLAG)
+#else
+#define TRACE(id)
+#define TRACE_BEGIN(phase)
+#define TRACE_END(phase)
+#endif
+
+#if (TRACE_ENABLED == 1) && (TRACE_FREQUENT == 1)
+#define TRACE_OFTEN(id) TRACE_Record(id)
+#else
+#define TRACE_OFTEN(id)
+#endif
+
+// Public Functions
+
+void TRACE_Setup(void);
+void TRACE_Record(uint8_t id);
+void TRACE_Hold(void);
+uint8_t TRACE_Count(void);
+void TRACE_SendFrame(void);
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * transfer.cpp
+ *
+ * Serial file listing and download for Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+#include <util/crc16.h>
+#include <SdFat.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "events.h"
+#include "utility.h"
+#include "sd.h"
+#include "transfer.h"
+
+/*
+ * A transfer sends a byte range of one data file as framed blocks (see transfer.h).
+ *
+ * One block is sent per EVT_TRANSFER_BLOCK, so the main loop still handles
+ * ticks and records between blocks. The file is read in small pieces straight
+ * into the serial buffer - SdFat reads each whole sector into its own cache once,
+ * so there is no second 512 byte buffer here.
+ *
+ * Every block has its own offset and CRC. The host keeps the blocks that
+ * check out and asks again from the first one that didn't, so a transfer can be
+ * resumed from any offset, including after a reset or a lost connection.
+ */
+
+#if TRANSFER_ENABLED == 1
+
+/*
+ * Defines and Typedefs
+ */
+
+#define CHUNK_SIZE 32
+
+/*
+ * Private Variables
+ */
+
+static SdFile s_file;
+static uint32_t s_offset;      // Next byte to send
+static uint32_t s_end;         // One past the last byte to send
+static bool s_active = false;
+
+/*
+ * Private Functions
+ */
+
+/*
+ * write_byte
+ * Sends one frame byte and adds it to the CRC
+ */
+static void write_byte(uint8_t b, uint16_t * crc)
+{
+	Serial.write(b);
+	*crc = _crc_xmodem_update(*crc, b);
+}
+
+/*
+ * write_header
+ * Starts a block frame
+ */
+static void write_header(uint32_t offset, uint16_t length, uint16_t * crc)
+{
+	Serial.write((uint8_t)XFER_FRAME_START);
+
+	*crc = 0;
+	write_byte(XFER_FRAME_BLOCK, crc);
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		write_byte((uint8_t)(offset >> (8 * i)), crc);
+	}
+	write_byte((uint8_t)length, crc);
+	write_byte((uint8_t)(length >> 8), crc);
+}
+
+/*
+ * write_crc
+ * Ends a block frame
+ */
+static void write_crc(uint16_t crc)
+{
+	Serial.write((uint8_t)crc);
+	Serial.write((uint8_t)(crc >> 8));
+}
+
+/*
+ * finish
+ * Sends the end frame and closes the file
+ */
+static void finish(void)
+{
+	uint16_t crc;
+
+	write_header(s_offset, 0, &crc);
+	write_crc(crc);
+	Serial.flush();
+
+	s_file.close();
+	s_active = false;
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * XFER_ListFiles
+ * Prints "name,size" for each file on the card
+ */
+void XFER_ListFiles(void)
+{
+	SdFile file;
+	char name[13];
+
+	if (!SD_CardIsPresent() || !SdFile::cwd()) { return; }
+
+	SdFile::cwd()->rewind();
+	while (file.openNext(SdFile::cwd(), O_READ))
+	{
+		if (file.isFile() && file.getName(name, sizeof(name)))
+		{
+			Serial.print(name);
+			Serial.print(',');
+			Serial.println((unsigned long)file.fileSize());
+		}
+		file.close();
+	}
+}
+
+/*
+ * XFER_Start
+ * Starts sending a data file from offset, for length bytes (0 = to the end).
+ * The file is given by the digits of its name: YYMMDD for DYYMMDD.csv,
+ * or YYMMDDn for DYYMMDDn.csv (written after a change of fields).
+ * Returns false if the file can't be opened or the offset is past its end.
+ */
+bool XFER_Start(long digits, unsigned long offset, unsigned long length)
+{
+	char filename[] = "DXXXXXXX.csv";
+	uint8_t count = (digits > 999999L) ? 7 : 6;
+
+	XFER_Abort();
+
+	if ((digits < 0) || (digits > 9999999L) || !SD_CardIsPresent()) { return false; }
+
+	memcpy(&filename[count + 1], ".csv", 5);
+	for (uint8_t i = count; i > 0; i--)
+	{
+		filename[i] = '0' + (digits % 10);
+		digits /= 10;
+	}
+
+	if (!s_file.open(filename, O_READ)) { return false; }
+
+	// Only what is in the file now - records written during the transfer are left for next time
+	uint32_t size = s_file.fileSize();
+
+	if ((offset > size) || !s_file.seekSet(offset))
+	{
+		s_file.close();
+		return false;
+	}
+
+	s_offset = offset;
+	s_end = ((length == 0) || (length > (size - offset))) ? size : offset + length;
+	s_active = true;
+
+	EVT_PostFromMain(EVT_TRANSFER_BLOCK);
+	return true;
+}
+
+/*
+ * XFER_SendBlock
+ * Called by application on EVT_TRANSFER_BLOCK to send the next block
+ */
+void XFER_SendBlock(void)
+{
+	uint8_t chunk[CHUNK_SIZE];
+	uint16_t crc;
+
+	if (!s_active) { return; }
+
+	if (s_offset >= s_end)
+	{
+		finish();
+		return;
+	}
+
+	uint16_t length = ((s_end - s_offset) > XFER_BLOCK_SIZE) ? XFER_BLOCK_SIZE : (uint16_t)(s_end - s_offset);
+	uint16_t sent = 0;
+	bool read_ok = true;
+
+	write_header(s_offset, length, &crc);
+
+	while (sent < length)
+	{
+		uint8_t count = ((length - sent) > CHUNK_SIZE) ? CHUNK_SIZE : (uint8_t)(length - sent);
+
+		if (read_ok && (s_file.read(chunk, count) != count))
+		{
+			// Card error or removed: the block still has to be the length
+			// in its header, so pad it and make sure the CRC fails
+			read_ok = false;
+		}
+
+		if (!read_ok) { memset(chunk, 0, count); }
+
+		Serial.write(chunk, count);
+		for (uint8_t i = 0; i < count; i++)
+		{
+			crc = _crc_xmodem_update(crc, chunk[i]);
+		}
+		sent += count;
+	}
+
+	if (!read_ok)
+	{
+		write_crc(~crc);
+		finish();
+		return;
+	}
+
+	write_crc(crc);
+	s_offset += length;
+
+	EVT_PostFromMain(EVT_TRANSFER_BLOCK);
+}
+
+/*
+ * XFER_IsActive
+ * Returns true while a transfer is running (other serial output should wait)
+ */
+bool XFER_IsActive(void)
+{
+	return s_active;
+}
+
+/*
+ * XFER_Abort
+ * Stops any transfer, without an end frame
+ */
+void XFER_Abort(void)
+{
+	if (s_active)
+	{
+		s_file.close();
+		s_active = false;
+	}
+}
+
+#else
+
+void XFER_ListFiles(void) {}
+bool XFER_Start(long digits, unsigned long offset, unsigned long length) { (void)digits; (void)offset; (void)length; return false; }
+void XFER_SendBlock(void) {}
+bool XFER_IsActive(void) { return false; }
+void XFER_Abort(void) {}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _TRANSFER_H_
+#define _TRANSFER_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// One block per SD sector
+#define XFER_BLOCK_SIZE 512
+
+// Block frame, all values little-endian:
+//   XFER_FRAME_START, XFER_FRAME_BLOCK, uint32 offset, uint16 length, data, uint16 CRC
+// The CRC is CRC-16/XMODEM (as _crc_xmodem_update) of everything after XFER_FRAME_START.
+// A block of length 0 ends the transfer, its offset is where the transfer stopped.
+#define XFER_FRAME_START 0x02
+#define XFER_FRAME_BLOCK 'B'
+#define XFER_FRAME_OVERHEAD 10
+
+// Public Functions
+
+void XFER_ListFiles(void);
+
+bool XFER_Start(long digits, unsigned long offset, unsigned long length);
+void XFER_SendBlock(void);
+bool XFER_IsActive(void);
+void XFER_Abort(void);
+
+#endif
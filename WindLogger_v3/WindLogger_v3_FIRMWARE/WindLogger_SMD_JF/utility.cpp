@@ -17,7 +17,8 @@
  * Defines
  */
 
-#define MAX_STRING 130      // Sets the maximum length of string probably could be lower
+// The longest message copied, with its terminator. Header lines are printed straight from flash.
+#define MAX_STRING 32
 
 /* 
  * Private Variables
@@ -53,13 +54,66 @@ byte DecToBcd(byte value)
  *  Parameters:  Pointer to string in PROGMEM.
  *
  *  Description: Copies string from flash to RAM and returns pointer to the RAM copy
+ *               (cut short at MAX_STRING - 1 characters)
  *
  ***************************************************/
 char* PStringToRAM(const char* str) {
-	strcpy_P(s_progmemBuffer, str);
+	strncpy_P(s_progmemBuffer, str, MAX_STRING - 1);
+	s_progmemBuffer[MAX_STRING - 1] = '\0';
 	return s_progmemBuffer;
 }
 
+/***************************************************
+ *  Name:        WriteFixedPoint
+ *
+ *  Returns:     Nothing.
+ *
+ *  Parameters:  Scaled integer value, number of decimal places in the scaling, accumulator
+ *
+ *  Description: Writes the value as a decimal string without using floats
+ *               (e.g. -5, 2 => "-0.05")
+ *
+ ***************************************************/
+void WriteFixedPoint(long value, uint8_t decimals, FixedLengthAccumulator * accum)
+{
+	if (!accum) { return; }
+
+	char digits[12];
+	uint8_t length;
+
+	if (value < 0)
+	{
+		accum->writeChar('-');
+		value = -value;
+	}
+
+	ultoa((unsigned long)value, digits, 10);
+	length = strlen(digits);
+
+	if (length <= decimals)
+	{
+		// Less than one: "0." then zeros up to the first digit
+		accum->writeChar('0');
+		accum->writeChar('.');
+		for (uint8_t i = length; i < decimals; i++)
+		{
+			accum->writeChar('0');
+		}
+		accum->writeString(digits);
+	}
+	else
+	{
+		for (uint8_t i = 0; i < length; i++)
+		{
+			if (decimals && (i == (length - decimals)))
+			{
+				accum->writeChar('.');
+			}
+			accum->writeChar(digits[i]);
+		}
+	}
+}
+
 /* FixedLengthAccumulator class 
  * Copied from Datalogger project (https://github.com/re-innovation/DataLogger)
  */
@@ -39,4 +39,7 @@ class FixedLengthAccumulator
         uint16_t m_writeIndex;
 };
 
+// Writes a scaled integer as a decimal string (e.g. 1234, 2 => "12.34")
+void WriteFixedPoint(long value, uint8_t decimals, FixedLengthAccumulator * accum);
+
 #endif
\ No newline at end of file
@@ -8,11 +8,14 @@
  */
 
 #include <Arduino.h>
+#include <util/atomic.h>
 
 #define LIBCALL_ENABLEINTERRUPT
 #include <EnableInterrupt.h>
 
 #include "app.h"
+#include "bench.h"
+#include "trace.h"
 #include "eeprom_storage.h"
 #include "utility.h"
 #include "wind.h"
@@ -23,14 +26,31 @@
 
 /********** Wind Direction Storage *************/
 #if READ_WIND_DIRECTION
-static char s_windDirection[3]; // Hold "N", "NE", "E" etc. strings
 static int s_windDirectionArray[] = {0,0,0,0,0,0,0,0};  //Holds count of each cardinal wind direction
+
+// "N", "NE", "E" etc. strings, indexed the same as s_windDirectionArray
+const char s_pstr_directions[8][3] PROGMEM = {"N", "NE", "E", "SE", "S", "SW", "W", "NW"};
+static const char s_pstr_slope[] PROGMEM = "Anemo slope:";
+static const char s_pstr_offset[] PROGMEM = "Anemo offset:";
 #endif
 
 // Variables for the Pulse Counter
+// The interrupts count in 16 bits and count the wraps alongside, and the RTC
+// interrupt latches both together at the end of the period, so a long count
+// never depends on the main loop keeping up.
 #if READ_WINDSPEED
-static volatile long s_livePulseCounters[2] = {0, 0};  // This counts pulses from the flow sensor  - Needs to be long to hold number
-static volatile long s_pulseCountersOld[2] = {0, 0};  // This is storage for the old flow sensor - Needs to be long to hold number
+static volatile uint16_t s_livePulseCounters[2] = {0, 0};  // This counts pulses from the flow sensor (interrupt owned)
+static volatile uint16_t s_liveOverflows[2] = {0, 0};  // Number of times each live counter has wrapped this period (interrupt owned)
+static volatile uint16_t s_latchedPulseCounters[2] = {0, 0};  // Live counts captured at the end of the sample period
+static volatile uint16_t s_latchedOverflows[2] = {0, 0};  // and their wraps
+static uint16_t s_pulseBases[2] = {0, 0};  // Pulses before the live counts were last reset (wraps)
+
+// Anemometer calibration: speed = slope x pulse frequency + offset (when turning)
+// The defaults are for the NRG #40C
+#define DEFAULT_ANEMOMETER_SLOPE 765  // mm/s per Hz
+#define DEFAULT_ANEMOMETER_OFFSET 350  // mm/s
+static uint16_t s_anemometerSlope = DEFAULT_ANEMOMETER_SLOPE;
+static uint16_t s_anemometerOffset = DEFAULT_ANEMOMETER_OFFSET;
 #endif
 
 static bool s_windwave_is_at_top_of_divider = false;
@@ -52,10 +72,16 @@ static bool s_windwave_is_at_top_of_divider = false;
  ***************************************************/
 static void pulse1(void)
 {
+  BENCH_BEGIN(BENCH_PULSE);
+  TRACE_OFTEN(TRACE_PULSE1);
   // If the anemometer has spun around
   // Increment the pulse counter
-  s_livePulseCounters[0]++;
+  if (++s_livePulseCounters[0] == 0)
+  {
+    s_liveOverflows[0]++;
+  }
   // ***TO DO**** Might need to debounce this
+  BENCH_END(BENCH_PULSE);
 }
 
 /***************************************************
@@ -70,9 +96,13 @@ static void pulse1(void)
  ***************************************************/
 static void pulse2(void)
 {
+  TRACE_OFTEN(TRACE_PULSE2);
   // If the anemometer has spun around
   // Increment the pulse counter
-  s_livePulseCounters[1]++;
+  if (++s_livePulseCounters[1] == 0)
+  {
+    s_liveOverflows[1]++;
+  }
   // ***TO DO**** Might need to debounce this
 }
 #endif
@@ -97,57 +127,166 @@ void WIND_SetupWindPulseInterrupts()
 	enableInterrupt(ANEMOMETER2, &pulse2, FALLING); 
 }
 
-void WIND_WritePulseCountToBuffer(uint8_t counter, FixedLengthAccumulator * accum)
+void WIND_WritePulseCountToBuffer(long count, FixedLengthAccumulator * accum)
 {
 	if (!accum) { return; }
 	char temp[16];
 
+	(void)ltoa(count, temp, 10);
+	accum->writeString(temp);
+}
+
+/* 
+ * WIND_GetLivePulseCount
+ * Called by application to get the live pulse count
+ */
+long WIND_GetLivePulseCount(uint8_t counter)
+{
+	long count = 0;
+
 	if (counter < 2)
 	{
-		(void)ltoa(s_pulseCountersOld[counter], temp, 10);
-		accum->writeString(temp);
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			count = ((long)s_liveOverflows[counter] << 16) + s_livePulseCounters[counter];
+		}
 	}
-	else
+
+	return count;
+}
+
+/* 
+ * WIND_SetLivePulseCounts
+ * Called at startup to carry on counting the period restored from a checkpoint (counts[2])
+ */
+void WIND_SetLivePulseCounts(const long * counts)
+{
+	for (uint8_t i = 0; i < 2; i++)
 	{
-		accum->writeString("??");
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			s_livePulseCounters[i] = (uint16_t)counts[i];
+			s_liveOverflows[i] = (uint16_t)(counts[i] >> 16);
+		}
 	}
 }
 
 /* 
- * WIND_GetLivePulseCount
- * Called by application to get the live pulse count
+ * WIND_GetPulseTotal
+ * Returns a free running 16-bit pulse count that is not reset at the end of each period.
+ * For live displays, which take the difference between two readings.
  */
-long WIND_GetLivePulseCount(uint8_t counter)
+uint16_t WIND_GetPulseTotal(uint8_t counter)
 {
-	long count;
+	uint16_t total = 0;
 
-	switch(counter)
+	if (counter < 2)
 	{
-		case 0:
-			count = s_livePulseCounters[0];
-			break;
-		case 1:
-			count = s_livePulseCounters[1];
-			break;
-		default:
-			count = 0;
-			break;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			total = s_pulseBases[counter] + s_livePulseCounters[counter];
+		}
 	}
 
-	return count;
+	return total;
 }
 
+/* 
+ * WIND_LatchPulseCounts
+ * Called from the RTC interrupt at the end of each sample period.
+ * Captures and resets the live counts so the period boundary is exact.
+ */
+void WIND_LatchPulseCounts()
+{
+	s_pulseBases[0] += s_livePulseCounters[0];
+	s_pulseBases[1] += s_livePulseCounters[1];
+	s_latchedPulseCounters[0] = s_livePulseCounters[0];
+	s_latchedPulseCounters[1] = s_livePulseCounters[1];
+	s_latchedOverflows[0] = s_liveOverflows[0];
+	s_latchedOverflows[1] = s_liveOverflows[1];
+	s_livePulseCounters[0] = 0;
+	s_livePulseCounters[1] = 0;
+	s_liveOverflows[0] = 0;
+	s_liveOverflows[1] = 0;
+}
 
 /* 
  * WIND_StoreWindPulseCounts
- * Saves the latest pulse counts and resets the live counts
+ * Saves the pulse counts latched at the end of the sample period into counts[2]
+ */
+void WIND_StoreWindPulseCounts(long * counts)
+{
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			counts[i] = ((long)s_latchedOverflows[i] << 16) + s_latchedPulseCounters[i];
+		}
+	}
+}
+
+/* 
+ * WIND_SetAnemometerCalibration
+ * Called by application to set the anemometer calibration
+ * (slope in mm/s per Hz, offset in mm/s). 0xFFFF selects the default.
+ */
+void WIND_SetAnemometerCalibration(uint16_t slope, uint16_t offset)
+{
+	s_anemometerSlope = (slope == 0xFFFF) ? DEFAULT_ANEMOMETER_SLOPE : slope;
+	s_anemometerOffset = (offset == 0xFFFF) ? DEFAULT_ANEMOMETER_OFFSET : offset;
+}
+
+/* 
+ * WIND_StoreNewAnemometerSlope
+ * WIND_StoreNewAnemometerOffset
+ * Called by application to set new calibration values
+ * and store in EEPROM
+ */
+void WIND_StoreNewAnemometerSlope(uint16_t slope)
+{
+	s_anemometerSlope = slope;
+	Serial.print(PStringToRAM(s_pstr_slope));
+	Serial.println(slope);
+	EEPROM_SetAnemometerSlope(slope);
+}
+
+void WIND_StoreNewAnemometerOffset(uint16_t offset)
+{
+	s_anemometerOffset = offset;
+	Serial.print(PStringToRAM(s_pstr_offset));
+	Serial.println(offset);
+	EEPROM_SetAnemometerOffset(offset);
+}
+
+/* 
+ * WIND_GetAnemometerSlope
+ * WIND_GetAnemometerOffset
+ * Return the calibration values in use
  */
-void WIND_StoreWindPulseCounts()
+uint16_t WIND_GetAnemometerSlope(void)
 {
-	s_pulseCountersOld[0] = s_livePulseCounters[0];
-    s_pulseCountersOld[1] = s_livePulseCounters[1];
-    s_livePulseCounters[0] = 0;
-    s_livePulseCounters[1] = 0;
+	return s_anemometerSlope;
+}
+
+uint16_t WIND_GetAnemometerOffset(void)
+{
+	return s_anemometerOffset;
+}
+
+/* 
+ * WIND_PulsesToSpeed
+ * Converts a pulse count over a number of seconds to a mean wind speed in mm/s
+ */
+uint16_t WIND_PulsesToSpeed(long pulses, uint16_t seconds)
+{
+	if ((pulses <= 0) || (seconds == 0)) { return 0; }
+
+	// Whole Hz and the remainder separately, so slope x pulses can't overflow
+	uint32_t speed = ((uint32_t)pulses / seconds) * s_anemometerSlope;
+	speed += (((uint32_t)pulses % seconds) * s_anemometerSlope) / seconds;
+	speed += s_anemometerOffset;
+
+	return (speed > 0xFFFF) ? 0xFFFF : (uint16_t)speed;
 }
 
 /* 
@@ -168,13 +307,22 @@ void WIND_Debug()
 
 #else
 void WIND_SetupWindPulseInterrupts() {}
-void WIND_WritePulseCountToBuffer(uint8_t counter, FixedLengthAccumulator * accum)
+void WIND_WritePulseCountToBuffer(long count, FixedLengthAccumulator * accum)
 {
-	(void)counter;
+	(void)count;
 	(void)accum;
 }
 long WIND_GetLivePulseCount(uint8_t counter) { (void)counter; return 0;}
-void WIND_StoreWindPulseCounts() {}
+void WIND_SetLivePulseCounts(const long * counts) { (void)counts; }
+uint16_t WIND_GetPulseTotal(uint8_t counter) { (void)counter; return 0; }
+void WIND_LatchPulseCounts() {}
+void WIND_StoreWindPulseCounts(long * counts) { counts[0] = counts[1] = 0; }
+void WIND_SetAnemometerCalibration(uint16_t slope, uint16_t offset) { (void)slope; (void)offset; }
+void WIND_StoreNewAnemometerSlope(uint16_t slope) { (void)slope; }
+void WIND_StoreNewAnemometerOffset(uint16_t offset) { (void)offset; }
+uint16_t WIND_GetAnemometerSlope(void) { return 0; }
+uint16_t WIND_GetAnemometerOffset(void) { return 0; }
+uint16_t WIND_PulsesToSpeed(long pulses, uint16_t seconds) { (void)pulses; (void)seconds; return 0; }
 void WIND_Debug() {};
 
 #endif
@@ -191,7 +339,7 @@ void WIND_SetWindvanePosition(bool windwave_is_at_top_of_divider)
 	EEPROM_SetWindwavePosition(s_windwave_is_at_top_of_divider);
 }
 
-// ******** WIND_ConvertWindDirection *********
+// ******** WIND_ReadingToDirection *********
 // This routine takes in an analog read value and converts it into a wind direction
 // The Wind vane uses a series of resistors to show what direction the wind comes from
 // The different values are (with a 10k to Ground):
@@ -207,9 +355,10 @@ void WIND_SetWindvanePosition(bool windwave_is_at_top_of_divider)
 // The different values are (with a 10k to Vbattery):
 // The value will be 1024 - vane integer reading
 
-// This means we can 'band' the data into 8 bands
+// This means we can 'band' the data into 8 bands.
+// Returns the band (0 = N, 1 = NE ... 7 = NW) or WIND_NO_DIRECTION.
 
-void WIND_ConvertWindDirection(int reading)
+uint8_t WIND_ReadingToDirection(int reading)
 {
 
 	if (s_windwave_is_at_top_of_divider)
@@ -219,51 +368,67 @@ void WIND_ConvertWindDirection(int reading)
 	
 	if(reading>0&&reading<100)
 	{
-		s_windDirectionArray[6]++;
+		return 6;
 	}
 	else if(reading>100&&reading<200)
 	{
-		s_windDirectionArray[7]++;
+		return 7;
 	}
 	else if(reading>200&&reading<350)
 	{
-		s_windDirectionArray[0]++; 
+		return 0; 
 	}
 	else if(reading>350&&reading<450)
 	{
-		s_windDirectionArray[5]++;
+		return 5;
 	}  
 	else if(reading>450&&reading<650)
 	{
-		s_windDirectionArray[1]++;
+		return 1;
 	}  
 	else if(reading>650&&reading<800)
 	{
-		s_windDirectionArray[4]++;
+		return 4;
 	}
 	else if(reading>800&&reading<900)
 	{
-		s_windDirectionArray[3]++;
+		return 3;
 	}
 	else if(reading>900&&reading<1024)
 	{
-		s_windDirectionArray[2]++;
+		return 2;
 	}
 	else
 	{
 	  // This is an error reading
+	  return WIND_NO_DIRECTION;
 	}
 }
 
-void WIND_AnalyseWindDirection()
+/* 
+ * WIND_ConvertWindDirection
+ * Adds a vane reading to the direction counts for the period
+ */
+void WIND_ConvertWindDirection(int reading)
 {
-	// When a data sample period is over we need to see the most frequent wind direction.
-	// This needs to be converted back to a direction and stored on SD
+	uint8_t direction = WIND_ReadingToDirection(reading);
+
+	if (direction != WIND_NO_DIRECTION)
+	{
+		s_windDirectionArray[direction]++;
+	}
+}
 
+/* 
+ * WIND_GetDominantDirection
+ * Returns the index of the most frequent wind direction so far
+ */
+uint8_t WIND_GetDominantDirection()
+{
 	int data1 = s_windDirectionArray[0];
-	int maxIndex = 0;
+	uint8_t maxIndex = 0;
 	// First need to find the maximum integer in the array
-	for(int i=1;i<8;i++)
+	for(uint8_t i=1;i<8;i++)
 	{
 		if(data1<s_windDirectionArray[i])
 		{
@@ -271,59 +436,63 @@ void WIND_AnalyseWindDirection()
 			maxIndex = i;
 		}
 	}
- 	// Serial.println(maxIndex);  Testing
-	
-	// Clear the wind direction string and fill based on maxIndex	
-	s_windDirection[0] = s_windDirection[1] = s_windDirection[2] = '\0';  
- 	switch(maxIndex)
-	{
-		case 0:
-			s_windDirection[0] = 'N';
-			break;
-		case 1:
-			s_windDirection[0] = 'N';
-			s_windDirection[1] = 'E';
-			break;    
-		case 2:
-			s_windDirection[0] = 'E';
-			break;  
-		case 3:
-			s_windDirection[0] = 'S';
-			s_windDirection[1] = 'E';
-			break;
-		case 4:
-			s_windDirection[0] = 'S';
-			break;  
-		case 5:
-			s_windDirection[0] = 'S';
-			s_windDirection[1] = 'W';
-			break;
-		case 6:
-			s_windDirection[0] = 'W';
-			break;
-		case 7:
-			s_windDirection[0] = 'N';
-			s_windDirection[1] = 'W';
-			break;
-	}
+	return maxIndex;
+}
+
+/* 
+ * WIND_AnalyseWindDirection
+ * When a data sample period is over we need to see the most frequent wind direction.
+ * Returns the direction index (to be stored on SD) and resets the counts.
+ */
+uint8_t WIND_AnalyseWindDirection()
+{
+	uint8_t maxIndex = WIND_GetDominantDirection();
 
 	for(int i=0;i<8;i++)
 	{
 		//Resets the wind direction array
 		s_windDirectionArray[i]=0;
 	}
+
+	return maxIndex;
+}
+
+/* 
+ * WIND_GetDirectionCounts, WIND_SetDirectionCounts
+ * The direction counts for the period so far (counts[8]), kept in the checkpoints
+ */
+void WIND_GetDirectionCounts(uint16_t * counts)
+{
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		counts[i] = (uint16_t)s_windDirectionArray[i];
+	}
 }
 
-void WIND_WriteDirectionToBuffer(FixedLengthAccumulator * accum)
+void WIND_SetDirectionCounts(const uint16_t * counts)
 {
-	if (!accum) { return; }
-	accum->writeString(s_windDirection);
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		s_windDirectionArray[i] = (int)counts[i];
+	}
+}
+
+void WIND_WriteDirectionToBuffer(uint8_t direction, FixedLengthAccumulator * accum)
+{
+	if (!accum || (direction > 7)) { return; }
+	char buffer[3];
+	strcpy_P(buffer, s_pstr_directions[direction]);
+	accum->writeString(buffer);
 }
 
 #else
 
+uint8_t WIND_ReadingToDirection(int reading) { (void)reading; return WIND_NO_DIRECTION; }
 void WIND_ConvertWindDirection(int reading) { (void)reading; }
-void WIND_AnalyseWindDirection() {}
-void WIND_WriteDirectionToBuffer(FixedLengthAccumulator * accum) { (void)accum; }
+uint8_t WIND_GetDominantDirection() { return 0; }
+uint8_t WIND_AnalyseWindDirection() { return 0; }
+void WIND_GetDirectionCounts(uint16_t * counts) { memset(counts, 0, 8 * sizeof(uint16_t)); }
+void WIND_SetDirectionCounts(const uint16_t * counts) { (void)counts; }
+void WIND_WriteDirectionToBuffer(uint8_t direction, FixedLengthAccumulator * accum) { (void)direction; (void)accum; }
 
 #endif
@@ -8,31 +8,52 @@
 
 #if READ_WINDSPEED == 1
 #define WINDSPEED_HEADERS "Wind 1, Wind 2, "
+#define WINDSPEED_COLUMNS 2
 #else
 #define WINDSPEED_HEADERS ""
+#define WINDSPEED_COLUMNS 0
 #endif
 
 #if READ_WIND_DIRECTION == 1
 #define WIND_DIRECTION_HEADERS "Direction, "
+#define WIND_DIRECTION_COLUMNS 1
 #else
 #define WIND_DIRECTION_HEADERS ""
+#define WIND_DIRECTION_COLUMNS 0
 #endif
 
+// Returned for a vane reading between the direction bands
+#define WIND_NO_DIRECTION 0xFF
+
 // Public Functions
 
 void WIND_SetupWindPulseInterrupts();
 
 void WIND_SetWindvanePosition(bool windwave_is_at_top_of_divider);
 
+uint8_t WIND_ReadingToDirection(int reading);
 void WIND_ConvertWindDirection(int reading);
-void WIND_AnalyseWindDirection();
+uint8_t WIND_GetDominantDirection();
+uint8_t WIND_AnalyseWindDirection();
 
-void WIND_WritePulseCountToBuffer(uint8_t counter, FixedLengthAccumulator * accum);
-void WIND_WriteDirectionToBuffer(FixedLengthAccumulator * accum);
+void WIND_WritePulseCountToBuffer(long count, FixedLengthAccumulator * accum);
+void WIND_WriteDirectionToBuffer(uint8_t direction, FixedLengthAccumulator * accum);
 
 long WIND_GetLivePulseCount(uint8_t counter);
-
-void WIND_StoreWindPulseCounts();
+void WIND_SetLivePulseCounts(const long * counts);
+void WIND_GetDirectionCounts(uint16_t * counts);
+void WIND_SetDirectionCounts(const uint16_t * counts);
+uint16_t WIND_GetPulseTotal(uint8_t counter);
+
+void WIND_SetAnemometerCalibration(uint16_t slope, uint16_t offset);
+void WIND_StoreNewAnemometerSlope(uint16_t slope);
+void WIND_StoreNewAnemometerOffset(uint16_t offset);
+uint16_t WIND_GetAnemometerSlope(void);
+uint16_t WIND_GetAnemometerOffset(void);
+uint16_t WIND_PulsesToSpeed(long pulses, uint16_t seconds);
+
+void WIND_LatchPulseCounts();
+void WIND_StoreWindPulseCounts(long * counts);
 void WIND_Debug();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,409 @@
+/*
+ * main.c
+ *
+ * Cycle benchmark for the Wind Data logger firmware, under simavr
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "sim_cycle_timers.h"
+#include "avr_ioport.h"
+#include "avr_adc.h"
+#include "avr_uart.h"
+
+#include "bench.h"
+#include "sd_card.h"
+#include "pcf8563.h"
+
+/*
+ * The firmware built with BENCH_MARKERS=1 (the ELF arduino-cli makes for
+ * the Uno) runs on simavr's ATmega328P, with the board around it:
+ *
+ *  - the PCF8563 on TWI, and its 1Hz CLKOUT on D2
+ *  - anemometer square waves on D3 and D5 for a steady wind speed
+ *  - steady voltages on the analog inputs
+ *  - an SD card on SPI, backed by a FAT image, with card detect (D9) low
+ *  - D6 low, so the logger runs rather than waiting in calibrate mode
+ *
+ * The firmware writes a section number to GPIOR0 as it enters each marked
+ * section and the number with BENCH_END_FLAG as it leaves. The cycles
+ * between the two are that section's cost. A section marked inside another
+ * (an ISR during a record write) is taken off the outer one. Unmarked
+ * interrupts stay in whatever they interrupted, and an ISR's prologue and
+ * epilogue are outside its markers.
+ *
+ * The cycles the CPU isn't asleep give the duty cycle, hour by hour.
+ * Everything is counted in CPU cycles, so a run is the same every time and
+ * the host's speed doesn't matter.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define MCU "atmega328p"
+#define F_CPU 16000000UL
+
+#define GPIOR0_ADDRESS 0x3E  // Data space (I/O 0x1E)
+
+#define RTC_CLOCK_PIN 2
+#define ANEMOMETER1_PIN 3
+#define ANEMOMETER2_PIN 5
+#define CALIBRATE_PIN 6
+#define CARD_DETECT_PIN 1  // PB1, D9
+
+#define ANEMOMETER2_RATIO 0.92  // The second anemometer sits lower and sees less wind
+
+#define MAX_NESTING 8
+#define MAX_HOURS (24 * 366)
+
+struct section_stats
+{
+	uint32_t count;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+};
+
+struct open_section
+{
+	uint8_t section;
+	avr_cycle_count_t start;
+	avr_cycle_count_t nested;  // Cycles in sections marked inside this one
+};
+
+// A square wave on a port D pin
+struct square_wave
+{
+	uint8_t pin;
+	uint8_t level;
+	avr_cycle_count_t halfPeriod;
+};
+
+/*
+ * Private Variables
+ */
+
+static const char s_usage[] =
+	"usage: windlogger_bench --elf FILE --card IMAGE [options]\n"
+	"  --elf FILE           firmware built with BENCH_MARKERS=1\n"
+	"  --card IMAGE         FAT image standing in for the SD card (written to)\n"
+	"  --hours N            simulated hours to run (24)\n"
+	"  --wind M/S           steady wind speed on anemometer 1 (6)\n"
+	"  --sd-busy-us N       time the card is busy after each block written (1000)\n"
+	"  --json FILE          write the results here as JSON (- for stdout)\n"
+	"  --serial FILE        write the serial output here\n";
+
+static const char * const s_sectionNames[] = {
+	"", "pulse1", "adc_isr", "second_tick", "complete_period", "write_data_string"
+};
+#define SECTION_COUNT (sizeof(s_sectionNames) / sizeof(s_sectionNames[0]))
+
+// Steady analog inputs, in mV against the 3.3V AREF
+static const struct { uint8_t channel; uint32_t millivolts; } s_analog[] = {
+	{ 0, 1271 },  // Vane: SW
+	{ 1, 2175 },  // Battery: 12.4V through 5.7:1
+	{ 2, 880 },   // Irradiance: 800W/m2
+	{ 3, 1700 },  // Current: 5A
+	{ 6, 1071 }   // Thermistor: 10C
+};
+
+static struct section_stats s_sections[SECTION_COUNT];
+static struct open_section s_open[MAX_NESTING];
+static uint8_t s_depth = 0;
+static uint32_t s_unmatched = 0;
+
+static uint64_t s_hourAwake[MAX_HOURS];
+static uint64_t s_serialBytes = 0;
+static FILE * s_serial = NULL;
+
+/*
+ * Private Functions
+ */
+
+static void section_end(uint8_t section, avr_cycle_count_t now)
+{
+	struct open_section * open;
+	struct section_stats * stats;
+	uint64_t cycles;
+
+	if ((s_depth == 0) || (s_open[s_depth - 1].section != section))
+	{
+		// A marker missed (e.g. an early return without BENCH_END): start again
+		s_unmatched++;
+		s_depth = 0;
+		return;
+	}
+
+	open = &s_open[--s_depth];
+	cycles = (now - open->start) - open->nested;
+	if (s_depth) { s_open[s_depth - 1].nested += now - open->start; }
+
+	stats = &s_sections[section];
+	if ((stats->count == 0) || (cycles < stats->min)) { stats->min = cycles; }
+	if (cycles > stats->max) { stats->max = cycles; }
+	stats->total += cycles;
+	stats->count++;
+}
+
+/*
+ * marker_written
+ * The firmware wrote GPIOR0
+ */
+static void marker_written(struct avr_t * avr, avr_io_addr_t addr, uint8_t v, void * param)
+{
+	uint8_t section = v & ~BENCH_END_FLAG;
+
+	(void)param;
+	avr->data[addr] = v;
+
+	if ((section == 0) || (section >= SECTION_COUNT)) { return; }
+
+	if (v & BENCH_END_FLAG)
+	{
+		section_end(section, avr->cycle);
+	}
+	else if (s_depth < MAX_NESTING)
+	{
+		s_open[s_depth].section = section;
+		s_open[s_depth].start = avr->cycle;
+		s_open[s_depth].nested = 0;
+		s_depth++;
+	}
+	else
+	{
+		s_unmatched++;
+	}
+}
+
+static avr_cycle_count_t toggle_wave(struct avr_t * avr, avr_cycle_count_t when, void * param)
+{
+	struct square_wave * wave = (struct square_wave *)param;
+
+	wave->level = !wave->level;
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), wave->pin), wave->level);
+	return when + wave->halfPeriod;
+}
+
+static void start_wave(struct avr_t * avr, struct square_wave * wave, uint8_t pin, double hz)
+{
+	wave->pin = pin;
+	wave->level = 1;
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), pin), 1);
+
+	if (hz > 0.0)
+	{
+		wave->halfPeriod = (avr_cycle_count_t)(avr->frequency / (2.0 * hz));
+		avr_cycle_timer_register(avr, wave->halfPeriod, toggle_wave, wave);
+	}
+}
+
+// The anemometer's pulse rate for a wind speed (speed = 0.765 * Hz + 0.35)
+static double anemometer_hz(double speed)
+{
+	return (speed > 0.35) ? (speed - 0.35) / 0.765 : 0.0;
+}
+
+static void serial_byte(struct avr_irq_t * irq, uint32_t value, void * param)
+{
+	(void)irq;
+	(void)param;
+
+	s_serialBytes++;
+	if (s_serial) { fputc((int)value, s_serial); }
+}
+
+// Time passes in sleep as the cycle count jumps to the next timer, not on the host clock
+static void no_sleep(struct avr_t * avr, avr_cycle_count_t how_long)
+{
+	(void)avr;
+	(void)how_long;
+}
+
+static void write_json(FILE * f, struct avr_t * avr, struct sd_card * card, uint32_t hours, double wind, uint64_t awake)
+{
+	double seconds = (double)avr->cycle / avr->frequency;
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"mcu\": \"%s\",\n", MCU);
+	fprintf(f, "  \"frequency\": %u,\n", (unsigned)avr->frequency);
+	fprintf(f, "  \"hours\": %u,\n", (unsigned)hours);
+	fprintf(f, "  \"wind\": %.2f,\n", wind);
+	fprintf(f, "  \"sections\": {\n");
+	for (uint8_t s = 1; s < SECTION_COUNT; s++)
+	{
+		struct section_stats * stats = &s_sections[s];
+		fprintf(f, "    \"%s\": {\"count\": %u, \"min\": %llu, \"max\": %llu, \"mean\": %.1f}%s\n",
+			s_sectionNames[s], (unsigned)stats->count, (unsigned long long)stats->min, (unsigned long long)stats->max,
+			stats->count ? (double)stats->total / stats->count : 0.0, (s + 1U < SECTION_COUNT) ? "," : "");
+	}
+	fprintf(f, "  },\n");
+	fprintf(f, "  \"unmatched_markers\": %u,\n", (unsigned)s_unmatched);
+	fprintf(f, "  \"awake_cycles\": %llu,\n", (unsigned long long)awake);
+	fprintf(f, "  \"awake_cycles_per_second\": %.1f,\n", seconds > 0 ? awake / seconds : 0.0);
+	fprintf(f, "  \"duty_cycle\": [");
+	for (uint32_t h = 0; h < hours; h++)
+	{
+		fprintf(f, "%s%.6f", h ? ", " : "", (double)s_hourAwake[h] / (3600.0 * avr->frequency));
+	}
+	fprintf(f, "],\n");
+	fprintf(f, "  \"serial_bytes\": %llu,\n", (unsigned long long)s_serialBytes);
+	fprintf(f, "  \"sd_blocks_read\": %u,\n", (unsigned)card->blocksRead);
+	fprintf(f, "  \"sd_blocks_written\": %u\n", (unsigned)card->blocksWritten);
+	fprintf(f, "}\n");
+}
+
+/*
+ * Public Functions
+ */
+
+int main(int argc, char ** argv)
+{
+	static const struct option s_options[] = {
+		{ "elf", required_argument, NULL, 'e' },
+		{ "card", required_argument, NULL, 'c' },
+		{ "hours", required_argument, NULL, 'h' },
+		{ "wind", required_argument, NULL, 'w' },
+		{ "sd-busy-us", required_argument, NULL, 'b' },
+		{ "json", required_argument, NULL, 'j' },
+		{ "serial", required_argument, NULL, 's' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	const char * elfPath = NULL;
+	const char * cardPath = NULL;
+	const char * jsonPath = "-";
+	uint32_t hours = 24;
+	double wind = 6.0;
+	uint32_t busyUs = 1000;
+
+	elf_firmware_t firmware;
+	struct avr_t * avr;
+	struct sd_card card;
+	struct pcf8563 rtc;
+	struct square_wave rtcClock, anemometer1, anemometer2;
+	avr_cycle_count_t end;
+	uint64_t awake = 0;
+	uint32_t flags = 0;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "", s_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'e': elfPath = optarg; break;
+			case 'c': cardPath = optarg; break;
+			case 'h': hours = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 'w': wind = atof(optarg); break;
+			case 'b': busyUs = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 'j': jsonPath = optarg; break;
+			case 's':
+				s_serial = fopen(optarg, "wb");
+				if (!s_serial) { perror(optarg); return 1; }
+				break;
+			default: fputs(s_usage, stderr); return 1;
+		}
+	}
+
+	if (!elfPath || !cardPath || (hours == 0) || (hours > MAX_HOURS))
+	{
+		fputs(s_usage, stderr);
+		return 1;
+	}
+
+	memset(&firmware, 0, sizeof(firmware));
+	if (elf_read_firmware(elfPath, &firmware) != 0)
+	{
+		fprintf(stderr, "%s: can't read the firmware\n", elfPath);
+		return 1;
+	}
+
+	avr = avr_make_mcu_by_name(MCU);
+	if (!avr)
+	{
+		fprintf(stderr, "simavr has no %s\n", MCU);
+		return 1;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &firmware);
+	avr->frequency = F_CPU;
+	avr->aref = 3300;
+	avr->avcc = 5000;
+	avr->vcc = 5000;
+	avr->sleep = no_sleep;
+
+	avr_register_io_write(avr, GPIOR0_ADDRESS, marker_written, NULL);
+
+	if (!SD_CARD_Attach(&card, avr, cardPath, busyUs))
+	{
+		perror(cardPath);
+		return 1;
+	}
+	PCF8563_Attach(&rtc, avr, PCF8563_SecondsFromDate(2026, 10, 19, 0, 0, 0));
+
+	// Serial output comes to us, not simavr's stdout
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), serial_byte, NULL);
+
+	for (uint8_t i = 0; i < sizeof(s_analog) / sizeof(s_analog[0]); i++)
+	{
+		avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0 + s_analog[i].channel), s_analog[i].millivolts);
+	}
+
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), CARD_DETECT_PIN), 0);
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), CALIBRATE_PIN), 0);
+
+	start_wave(avr, &rtcClock, RTC_CLOCK_PIN, 1.0);
+	start_wave(avr, &anemometer1, ANEMOMETER1_PIN, anemometer_hz(wind));
+	start_wave(avr, &anemometer2, ANEMOMETER2_PIN, anemometer_hz(wind * ANEMOMETER2_RATIO));
+
+	end = (avr_cycle_count_t)hours * 3600 * avr->frequency;
+	while (avr->cycle < end)
+	{
+		avr_cycle_count_t before = avr->cycle;
+		int running = (avr->state == cpu_Running);
+		int state = avr_run(avr);
+
+		if (running)
+		{
+			awake += avr->cycle - before;
+			s_hourAwake[before / (3600ULL * avr->frequency)] += avr->cycle - before;
+		}
+
+		if ((state == cpu_Done) || (state == cpu_Crashed))
+		{
+			fprintf(stderr, "firmware stopped at cycle %llu (%s)\n", (unsigned long long)avr->cycle,
+				(state == cpu_Crashed) ? "crashed" : "done");
+			SD_CARD_Detach(&card);
+			return 2;
+		}
+	}
+
+	if (strcmp(jsonPath, "-") == 0)
+	{
+		write_json(stdout, avr, &card, hours, wind, awake);
+	}
+	else
+	{
+		FILE * f = fopen(jsonPath, "w");
+		if (!f) { perror(jsonPath); return 1; }
+		write_json(f, avr, &card, hours, wind, awake);
+		fclose(f);
+	}
+
+	SD_CARD_Detach(&card);
+	if (s_serial) { fclose(s_serial); }
+	return (s_unmatched == 0) ? 0 : 3;
+}
@@ -0,0 +1,195 @@
+/*
+ * pcf8563.c
+ *
+ * The PCF8563 real time clock for the cycle benchmark
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sim_avr.h"
+#include "sim_irq.h"
+#include "avr_twi.h"
+
+#include "pcf8563.h"
+
+/*
+ * A TWI slave at 0x51 with the register pointer of the real part: the first
+ * byte written after the address sets it, and each byte read or written
+ * moves it on. The time registers are filled in from the cycle count when a
+ * transfer starts, so a multi-byte read is consistent. A time written by
+ * the firmware (the "T" command) is taken when the transfer stops.
+ *
+ * CLKOUT isn't modelled here. The benchmark drives D2 from the cycle count.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define PCF8563_ADDRESS 0x51
+
+#define REG_SECONDS 0x02
+#define REG_MINUTES 0x03
+#define REG_HOURS 0x04
+#define REG_DAYS 0x05
+#define REG_WEEKDAYS 0x06
+#define REG_MONTHS 0x07
+#define REG_YEARS 0x08
+
+#define CENTURY_BIT 0x80
+
+static const char * s_irqNames[2] = {
+	[TWI_IRQ_INPUT] = "8>pcf8563.out",
+	[TWI_IRQ_OUTPUT] = "32<pcf8563.in",
+};
+
+/*
+ * Private Functions
+ */
+
+static uint8_t to_bcd(int v) { return (uint8_t)(((v / 10) << 4) | (v % 10)); }
+static int from_bcd(uint8_t v) { return ((v >> 4) * 10) + (v & 0x0F); }
+
+// Days from 2000-01-01 to a date, and back (proleptic Gregorian)
+static int64_t days_from_civil(int y, int m, int d)
+{
+	y -= m <= 2;
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	int64_t yoe = y - era * 400;
+	int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 730425;
+}
+
+static void civil_from_days(int64_t z, int * y, int * m, int * d)
+{
+	z += 730425;
+	int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+	int64_t doe = z - era * 146097;
+	int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	int64_t mp = (5 * doy + 2) / 153;
+	*d = (int)(doy - (153 * mp + 2) / 5 + 1);
+	*m = (int)(mp < 10 ? mp + 3 : mp - 9);
+	*y = (int)(yoe + era * 400 + (*m <= 2));
+}
+
+static void load_time(struct pcf8563 * rtc)
+{
+	int64_t seconds = PCF8563_Seconds(rtc);
+	int64_t days = seconds / 86400;
+	int64_t inDay = seconds % 86400;
+	int year, month, day;
+
+	civil_from_days(days, &year, &month, &day);
+
+	rtc->regs[REG_SECONDS] = to_bcd((int)(inDay % 60));
+	rtc->regs[REG_MINUTES] = to_bcd((int)((inDay / 60) % 60));
+	rtc->regs[REG_HOURS] = to_bcd((int)(inDay / 3600));
+	rtc->regs[REG_DAYS] = to_bcd(day);
+	rtc->regs[REG_WEEKDAYS] = (uint8_t)((days + 6) % 7);  // 2000-01-01 was a Saturday
+	rtc->regs[REG_MONTHS] = to_bcd(month) | ((year >= 2100) ? CENTURY_BIT : 0);
+	rtc->regs[REG_YEARS] = to_bcd(year % 100);
+}
+
+static void store_time(struct pcf8563 * rtc)
+{
+	int year = 2000 + from_bcd(rtc->regs[REG_YEARS]) + ((rtc->regs[REG_MONTHS] & CENTURY_BIT) ? 100 : 0);
+	int64_t seconds = PCF8563_SecondsFromDate(year,
+		from_bcd(rtc->regs[REG_MONTHS] & 0x1F), from_bcd(rtc->regs[REG_DAYS] & 0x3F),
+		from_bcd(rtc->regs[REG_HOURS] & 0x3F), from_bcd(rtc->regs[REG_MINUTES] & 0x7F),
+		from_bcd(rtc->regs[REG_SECONDS] & 0x7F));
+
+	rtc->offset += seconds - PCF8563_Seconds(rtc);
+}
+
+static void twi_message(struct avr_irq_t * irq, uint32_t value, void * param)
+{
+	struct pcf8563 * rtc = (struct pcf8563 *)param;
+	avr_twi_msg_irq_t v;
+
+	(void)irq;
+	v.u.v = value;
+
+	if (v.u.twi.msg & TWI_COND_STOP)
+	{
+		if (rtc->selected && rtc->timeWritten) { store_time(rtc); }
+		rtc->selected = 0;
+		rtc->timeWritten = 0;
+	}
+
+	if (v.u.twi.msg & TWI_COND_START)
+	{
+		rtc->selected = 0;
+		rtc->pointerSet = 0;
+		if ((v.u.twi.addr >> 1) == PCF8563_ADDRESS)
+		{
+			rtc->selected = v.u.twi.addr;
+			load_time(rtc);
+			avr_raise_irq(rtc->irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_ACK, rtc->selected, 1));
+		}
+	}
+
+	if (!rtc->selected) { return; }
+
+	if (v.u.twi.msg & TWI_COND_WRITE)
+	{
+		avr_raise_irq(rtc->irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_ACK, rtc->selected, 1));
+		if (!rtc->pointerSet)
+		{
+			rtc->pointer = v.u.twi.data % PCF8563_REGISTERS;
+			rtc->pointerSet = 1;
+		}
+		else
+		{
+			rtc->regs[rtc->pointer] = v.u.twi.data;
+			if ((rtc->pointer >= REG_SECONDS) && (rtc->pointer <= REG_YEARS)) { rtc->timeWritten = 1; }
+			rtc->pointer = (rtc->pointer + 1) % PCF8563_REGISTERS;
+		}
+	}
+
+	if (v.u.twi.msg & TWI_COND_READ)
+	{
+		avr_raise_irq(rtc->irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_READ, rtc->selected, rtc->regs[rtc->pointer]));
+		rtc->pointer = (rtc->pointer + 1) % PCF8563_REGISTERS;
+	}
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * PCF8563_Attach
+ * Connects the RTC to the TWI bus, with the time it shows at cycle 0
+ */
+void PCF8563_Attach(struct pcf8563 * rtc, struct avr_t * avr, int64_t start_seconds)
+{
+	memset(rtc, 0, sizeof(*rtc));
+	rtc->avr = avr;
+	rtc->offset = start_seconds;
+
+	rtc->irq = avr_alloc_irq(&avr->irq_pool, 0, 2, s_irqNames);
+	avr_irq_register_notify(rtc->irq + TWI_IRQ_OUTPUT, twi_message, rtc);
+
+	avr_connect_irq(rtc->irq + TWI_IRQ_INPUT, avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT));
+	avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT), rtc->irq + TWI_IRQ_OUTPUT);
+}
+
+/*
+ * PCF8563_Seconds
+ * The time the RTC shows now, in seconds since 2000
+ */
+int64_t PCF8563_Seconds(struct pcf8563 * rtc)
+{
+	return rtc->offset + (int64_t)(rtc->avr->cycle / rtc->avr->frequency);
+}
+
+int64_t PCF8563_SecondsFromDate(int year, int month, int day, int hour, int minute, int second)
+{
+	return (days_from_civil(year, month, day) * 86400) + (hour * 3600) + (minute * 60) + second;
+}
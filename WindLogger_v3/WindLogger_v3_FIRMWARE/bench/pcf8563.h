@@ -0,0 +1,29 @@
+#ifndef _PCF8563_H_
+#define _PCF8563_H_
+
+/*
+ * Defines and typedefs
+ */
+
+#define PCF8563_REGISTERS 16
+
+// The PCF8563 RTC on the simulated AVR's TWI bus. Time runs from the AVR's cycle count.
+struct pcf8563
+{
+	struct avr_t * avr;
+	struct avr_irq_t * irq;
+	int64_t offset;			// Seconds since 2000 at cycle 0
+	uint8_t regs[PCF8563_REGISTERS];
+	uint8_t selected;
+	uint8_t pointerSet;		// Register pointer written in this transfer
+	uint8_t pointer;
+	uint8_t timeWritten;	// A time register was written in this transfer
+};
+
+// Public Functions
+
+void PCF8563_Attach(struct pcf8563 * rtc, struct avr_t * avr, int64_t start_seconds);
+int64_t PCF8563_Seconds(struct pcf8563 * rtc);
+int64_t PCF8563_SecondsFromDate(int year, int month, int day, int hour, int minute, int second);
+
+#endif
@@ -0,0 +1,366 @@
+/*
+ * sd_card.c
+ *
+ * An SD card in SPI mode for the cycle benchmark, on an image file
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sim_avr.h"
+#include "sim_irq.h"
+#include "avr_ioport.h"
+#include "avr_spi.h"
+
+#include "sd_card.h"
+
+/*
+ * Just enough of the SD SPI protocol for SdFat: reset and initialise
+ * (CMD0, CMD8, ACMD41, CMD58), the CSD/CID, status, and single and
+ * multiple block reads and writes. It says it is SDHC, so addresses are
+ * in blocks. CRCs are ignored, as SdFat doesn't turn them on.
+ *
+ * SPI is full duplex: the byte the card sends back during each transfer
+ * comes from the out queue, filled as commands complete. After a block is
+ * written the card holds MISO low for busyCycles, which SdFat polls for.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define SD_CS_PORT 'B'
+#define SD_CS_PIN 2  // D10
+
+#define BLOCK_SIZE 512
+
+#define R1_READY 0x00
+#define R1_IDLE 0x01
+#define R1_ILLEGAL_COMMAND 0x04
+
+#define TOKEN_START_BLOCK 0xFE
+#define TOKEN_START_MULTIPLE 0xFC
+#define TOKEN_STOP_MULTIPLE 0xFD
+#define DATA_ACCEPTED 0x05
+
+enum sd_state
+{
+	SD_COMMAND = 0,	// Waiting for a command
+	SD_WRITE_TOKEN,	// Waiting for a data token (after CMD24/CMD25)
+	SD_WRITE_DATA,	// Receiving a block
+	SD_READ_MULTIPLE	// Sending blocks until CMD12
+};
+
+/*
+ * Private Functions
+ */
+
+static void queue(struct sd_card * card, uint8_t b)
+{
+	if (card->outCount < sizeof(card->out))
+	{
+		card->out[(card->outHead + card->outCount) % sizeof(card->out)] = b;
+		card->outCount++;
+	}
+}
+
+static uint8_t next_out(struct sd_card * card)
+{
+	uint8_t b = card->out[card->outHead];
+	card->outHead = (card->outHead + 1) % sizeof(card->out);
+	card->outCount--;
+	return b;
+}
+
+// A response, after the one byte gap (NCR) before it
+static void respond(struct sd_card * card, uint8_t r1)
+{
+	queue(card, 0xFF);
+	queue(card, r1);
+}
+
+static void queue_block(struct sd_card * card, uint32_t block)
+{
+	uint8_t data[BLOCK_SIZE];
+
+	memset(data, 0, sizeof(data));
+	if (block < card->blocks)
+	{
+		fseek(card->image, (long)block * BLOCK_SIZE, SEEK_SET);
+		if (fread(data, 1, BLOCK_SIZE, card->image) != BLOCK_SIZE) { memset(data, 0, sizeof(data)); }
+	}
+	card->blocksRead++;
+
+	queue(card, 0xFF);
+	queue(card, TOKEN_START_BLOCK);
+	for (uint16_t i = 0; i < BLOCK_SIZE; i++) { queue(card, data[i]); }
+	queue(card, 0xFF);  // CRC
+	queue(card, 0xFF);
+}
+
+static void queue_register(struct sd_card * card, const uint8_t * reg)
+{
+	respond(card, R1_READY);
+	queue(card, 0xFF);
+	queue(card, TOKEN_START_BLOCK);
+	for (uint8_t i = 0; i < 16; i++) { queue(card, reg[i]); }
+	queue(card, 0xFF);
+	queue(card, 0xFF);
+}
+
+static void write_block(struct sd_card * card)
+{
+	if (card->block < card->blocks)
+	{
+		fseek(card->image, (long)card->block * BLOCK_SIZE, SEEK_SET);
+		fwrite(card->data, 1, BLOCK_SIZE, card->image);
+	}
+	card->blocksWritten++;
+	card->busyUntil = card->avr->cycle + card->busyCycles;
+
+	queue(card, DATA_ACCEPTED);
+}
+
+static void run_command(struct sd_card * card)
+{
+	uint8_t index = card->command[0] & 0x3F;
+	uint32_t arg = ((uint32_t)card->command[1] << 24) | ((uint32_t)card->command[2] << 16) |
+		((uint32_t)card->command[3] << 8) | card->command[4];
+	uint8_t app = card->appCommand;
+
+	card->appCommand = 0;
+
+	if (app)
+	{
+		// ACMD41 (initialise) finishes at once, the rest are accepted and ignored
+		respond(card, R1_READY);
+		return;
+	}
+
+	switch (index)
+	{
+		case 0:  // GO_IDLE_STATE
+			card->state = SD_COMMAND;
+			card->outCount = 0;
+			respond(card, R1_IDLE);
+			break;
+
+		case 8:  // SEND_IF_COND: voltage accepted, check pattern echoed
+			respond(card, R1_IDLE);
+			queue(card, 0x00);
+			queue(card, 0x00);
+			queue(card, 0x01);
+			queue(card, (uint8_t)arg);
+			break;
+
+		case 9:  // SEND_CSD (version 2)
+		{
+			uint32_t c_size = (card->blocks / 1024) - 1;
+			uint8_t csd[16] = {0x40, 0x0E, 0x00, 0x32, 0x5B, 0x59, 0x00, 0, 0, 0, 0x7F, 0x80, 0x0A, 0x40, 0x00, 0x01};
+			csd[7] = (uint8_t)((c_size >> 16) & 0x3F);
+			csd[8] = (uint8_t)(c_size >> 8);
+			csd[9] = (uint8_t)c_size;
+			queue_register(card, csd);
+			break;
+		}
+
+		case 10:  // SEND_CID
+		{
+			static const uint8_t s_cid[16] = {0x03, 'W', 'L', 'B', 'E', 'N', 'C', 'H', 0x10, 0, 0, 0, 1, 0x01, 0xA1, 0x01};
+			queue_register(card, s_cid);
+			break;
+		}
+
+		case 12:  // STOP_TRANSMISSION
+			card->state = SD_COMMAND;
+			card->outCount = 0;
+			queue(card, 0xFF);  // Stuff byte
+			respond(card, R1_READY);
+			break;
+
+		case 13:  // SEND_STATUS
+			respond(card, R1_READY);
+			queue(card, 0x00);
+			break;
+
+		case 17:  // READ_SINGLE_BLOCK
+			respond(card, R1_READY);
+			queue_block(card, arg);
+			break;
+
+		case 18:  // READ_MULTIPLE_BLOCK
+			respond(card, R1_READY);
+			card->block = arg;
+			queue_block(card, card->block++);
+			card->state = SD_READ_MULTIPLE;
+			break;
+
+		case 24:  // WRITE_BLOCK
+		case 25:  // WRITE_MULTIPLE_BLOCK
+			respond(card, R1_READY);
+			card->block = arg;
+			card->state = SD_WRITE_TOKEN;
+			break;
+
+		case 55:  // APP_CMD
+			card->appCommand = 1;
+			respond(card, R1_READY);
+			break;
+
+		case 58:  // READ_OCR: powered up, high capacity
+			respond(card, R1_READY);
+			queue(card, 0xC0);
+			queue(card, 0xFF);
+			queue(card, 0x80);
+			queue(card, 0x00);
+			break;
+
+		case 16:  // SET_BLOCKLEN
+		case 32:  // ERASE_WR_BLK_START
+		case 33:  // ERASE_WR_BLK_END
+		case 38:  // ERASE
+		case 59:  // CRC_ON_OFF
+			respond(card, R1_READY);
+			break;
+
+		default:
+			respond(card, R1_ILLEGAL_COMMAND);
+			break;
+	}
+}
+
+/*
+ * receive
+ * A byte from the AVR (MOSI)
+ */
+static void receive(struct sd_card * card, uint8_t b)
+{
+	switch (card->state)
+	{
+		case SD_WRITE_TOKEN:
+			if ((b == TOKEN_START_BLOCK) || (b == TOKEN_START_MULTIPLE))
+			{
+				card->dataCount = 0;
+				card->state = SD_WRITE_DATA;
+			}
+			else if (b == TOKEN_STOP_MULTIPLE)
+			{
+				card->busyUntil = card->avr->cycle + card->busyCycles;
+				card->state = SD_COMMAND;
+			}
+			else if ((b & 0xC0) == 0x40)
+			{
+				// A command instead of data (e.g. CMD13 after a single block)
+				card->state = SD_COMMAND;
+				card->command[0] = b;
+				card->commandLength = 1;
+			}
+			break;
+
+		case SD_WRITE_DATA:
+			card->data[card->dataCount++] = b;
+			if (card->dataCount == sizeof(card->data))
+			{
+				uint8_t multiple = (card->command[0] & 0x3F) == 25;
+				write_block(card);
+				card->block++;
+				card->state = multiple ? SD_WRITE_TOKEN : SD_COMMAND;
+			}
+			break;
+
+		default:
+			// Commands start 01xxxxxx, anything else between them is ignored
+			if ((card->commandLength == 0) && ((b & 0xC0) != 0x40)) { break; }
+
+			card->command[card->commandLength++] = b;
+			if (card->commandLength == sizeof(card->command))
+			{
+				card->commandLength = 0;
+				run_command(card);
+			}
+			break;
+	}
+}
+
+static void spi_byte(struct avr_irq_t * irq, uint32_t value, void * param)
+{
+	struct sd_card * card = (struct sd_card *)param;
+	uint8_t reply = 0xFF;
+
+	(void)irq;
+
+	if (card->selected)
+	{
+		if (card->avr->cycle < card->busyUntil)
+		{
+			reply = 0x00;
+		}
+		else if (card->outCount)
+		{
+			reply = next_out(card);
+		}
+
+		if ((card->state == SD_READ_MULTIPLE) && (card->outCount == 0))
+		{
+			queue_block(card, card->block++);
+		}
+
+		receive(card, (uint8_t)value);
+	}
+
+	avr_raise_irq(avr_io_getirq(card->avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT), reply);
+}
+
+static void chip_select(struct avr_irq_t * irq, uint32_t value, void * param)
+{
+	struct sd_card * card = (struct sd_card *)param;
+
+	(void)irq;
+
+	card->selected = (value == 0);
+	if (!card->selected)
+	{
+		card->commandLength = 0;
+	}
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * SD_CARD_Attach
+ * Connects the card to the SPI port and CS, with the image as its contents.
+ * Returns 0 if the image can't be opened.
+ */
+int SD_CARD_Attach(struct sd_card * card, struct avr_t * avr, const char * image_path, uint32_t busy_us)
+{
+	long size;
+
+	memset(card, 0, sizeof(*card));
+	card->avr = avr;
+	card->image = fopen(image_path, "r+b");
+	if (!card->image) { return 0; }
+
+	fseek(card->image, 0, SEEK_END);
+	size = ftell(card->image);
+	card->blocks = (uint32_t)(size / BLOCK_SIZE);
+	card->busyCycles = (uint32_t)(((uint64_t)busy_us * avr->frequency) / 1000000);
+
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT), spi_byte, card);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(SD_CS_PORT), SD_CS_PIN), chip_select, card);
+	return 1;
+}
+
+void SD_CARD_Detach(struct sd_card * card)
+{
+	if (card->image)
+	{
+		fclose(card->image);
+		card->image = NULL;
+	}
+}
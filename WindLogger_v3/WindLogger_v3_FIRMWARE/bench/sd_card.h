@@ -0,0 +1,40 @@
+#ifndef _SD_CARD_H_
+#define _SD_CARD_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// An SDHC card in SPI mode on the simulated AVR's SPI port, backed by an image file
+struct sd_card
+{
+	struct avr_t * avr;
+	FILE * image;
+	uint32_t blocks;
+	uint32_t busyCycles;	// Programming time after each block written
+
+	uint8_t selected;
+	uint8_t state;
+	uint8_t appCommand;
+	uint8_t command[6];
+	uint8_t commandLength;
+
+	uint8_t out[520];		// Bytes to send back on MISO
+	uint16_t outHead;
+	uint16_t outCount;
+
+	uint32_t block;			// Block being read or written
+	uint16_t dataCount;
+	uint8_t data[514];		// Block and CRC being received
+	uint64_t busyUntil;		// Cycle the card is busy programming until
+
+	uint32_t blocksRead;
+	uint32_t blocksWritten;
+};
+
+// Public Functions
+
+int SD_CARD_Attach(struct sd_card * card, struct avr_t * avr, const char * image_path, uint32_t busy_us);
+void SD_CARD_Detach(struct sd_card * card);
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef _ARDUINO_H_
+#define _ARDUINO_H_
+
+/*
+ * The parts of the Arduino core the firmware uses, for the host build.
+ * Pins, timing and the serial port are simulated (see hal_arduino.cpp).
+ */
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/*
+ * Defines and Typedefs
+ */
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define DEFAULT 1
+#define EXTERNAL 0
+#define INTERNAL 3
+
+#define DEC 10
+#define HEX 16
+
+static const uint8_t A0 = 14;
+static const uint8_t A1 = 15;
+static const uint8_t A2 = 16;
+static const uint8_t A3 = 17;
+static const uint8_t A4 = 18;
+static const uint8_t A5 = 19;
+static const uint8_t A6 = 20;
+static const uint8_t A7 = 21;
+
+#define HAL_PIN_COUNT 22
+
+#define SERIAL_TX_BUFFER_SIZE 64
+#define SERIAL_RX_BUFFER_SIZE 64
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+/*
+ * Print, Stream, HardwareSerial
+ * As in the Arduino core: everything goes through write(uint8_t),
+ * numbers are printed in the given base and println() ends lines with "\r\n".
+ */
+class Print
+{
+public:
+	virtual ~Print() {}
+
+	virtual size_t write(uint8_t b) = 0;
+	virtual size_t write(const uint8_t * buffer, size_t size);
+	size_t write(const char * str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+
+	size_t print(const __FlashStringHelper * str);
+	size_t print(const char * str);
+	size_t print(char c);
+	size_t print(unsigned char n, int base = DEC);
+	size_t print(int n, int base = DEC);
+	size_t print(unsigned int n, int base = DEC);
+	size_t print(long n, int base = DEC);
+	size_t print(unsigned long n, int base = DEC);
+	size_t print(double n, int digits = 2);
+
+	size_t println(void);
+	template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+	template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+
+private:
+	size_t printNumber(unsigned long n, uint8_t base);
+};
+
+class Stream : public Print
+{
+public:
+	virtual int available(void) = 0;
+	virtual int read(void) = 0;
+	virtual int peek(void) = 0;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+	void begin(unsigned long baud);
+	void end(void) {}
+
+	int available(void);
+	int read(void);
+	int peek(void);
+	int availableForWrite(void);
+	void flush(void);
+
+	size_t write(uint8_t b);
+	using Print::write;
+
+	operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+/*
+ * Public Functions
+ */
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogReference(uint8_t mode);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+char * itoa(int value, char * str, int base);
+char * ltoa(long value, char * str, int base);
+char * utoa(unsigned int value, char * str, int base);
+char * ultoa(unsigned long value, char * str, int base);
+char * dtostrf(double value, signed char width, unsigned char precision, char * str);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _EEPROM_H_
+#define _EEPROM_H_
+
+/*
+ * The Arduino EEPROM library for the host build, on the avr/eeprom.h functions
+ */
+
+#include <stdint.h>
+
+#include <avr/eeprom.h>
+
+struct EEPROMClass
+{
+	uint8_t read(int address) { return eeprom_read_byte((const uint8_t *)(uintptr_t)address); }
+	void write(int address, uint8_t value) { eeprom_write_byte((uint8_t *)(uintptr_t)address, value); }
+	void update(int address, uint8_t value) { eeprom_update_byte((uint8_t *)(uintptr_t)address, value); }
+	uint16_t length(void) { return E2END + 1; }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _ENABLE_INTERRUPT_H_
+#define _ENABLE_INTERRUPT_H_
+
+/*
+ * The EnableInterrupt library for the host build.
+ * The simulator calls the handler on a matching edge of HAL_DrivePin().
+ */
+
+#include <stdint.h>
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+void enableInterrupt(uint8_t pin, void (*handler)(void), uint8_t mode);
+void disableInterrupt(uint8_t pin);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _RTC_PCF8563_H_
+#define _RTC_PCF8563_H_
+
+/*
+ * The Rtc_Pcf8563 library for the host build.
+ * Every instance reads and sets the one simulated RTC (see hal_rtc.cpp).
+ */
+
+#include <Arduino.h>
+
+#define RTCC_DATE_WORLD 0x01
+#define RTCC_DATE_ASIA 0x02
+#define RTCC_DATE_US 0x04
+#define RTCC_TIME_HMS 0x01
+#define RTCC_TIME_HM 0x02
+
+#define RTCC_CENTURY_MASK 0x80
+
+class Rtc_Pcf8563
+{
+public:
+	void getDate(void);
+	void getTime(void);
+	void setDate(byte day, byte weekday, byte month, byte century, byte year);
+	void setTime(byte hour, byte minute, byte second);
+
+	byte getSecond(void) { return m_second; }
+	byte getMinute(void) { return m_minute; }
+	byte getHour(void) { return m_hour; }
+	byte getDay(void) { return m_day; }
+	byte getWeekday(void) { return m_weekday; }
+	byte getMonth(void) { return m_month; }
+	byte getYear(void) { return m_year; }
+
+	char * formatTime(byte style = RTCC_TIME_HMS);
+	char * formatDate(byte style = RTCC_DATE_US);
+
+private:
+	byte m_second, m_minute, m_hour;
+	byte m_day, m_weekday, m_month, m_year;
+	char m_strOut[16];
+	char m_strDate[16];
+};
+
+#endif
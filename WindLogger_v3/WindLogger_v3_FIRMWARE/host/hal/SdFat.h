@@ -0,0 +1,95 @@
+#ifndef _SD_FAT_H_
+#define _SD_FAT_H_
+
+/*
+ * The SdFat library for the host build.
+ *
+ * The card's root directory is a directory on the host (HAL_SetCardDirectory),
+ * each SdFile a host file in it. Or the card is a FAT32 image (HAL_CardOpenImage),
+ * read and written a sector at a time as SdFat would (hal_fat.cpp). Only the
+ * root directory is supported, as the firmware only uses that. While the card
+ * is out (HAL_SetCardPresent) nothing can be opened, read or written, and it
+ * must be begun again once it is back.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <Arduino.h>
+
+#include "hal_fat.h"
+
+#define O_READ 0x01
+#define O_RDONLY O_READ
+#define O_WRITE 0x02
+#define O_WRONLY O_WRITE
+#define O_RDWR (O_READ | O_WRITE)
+#define O_APPEND 0x04
+#define O_SYNC 0x08
+#define O_TRUNC 0x10
+#define O_AT_END 0x20
+#define O_CREAT 0x40
+#define O_EXCL 0x80
+
+#define SPI_FULL_SPEED 0
+#define SPI_HALF_SPEED 1
+#define SPI_QUARTER_SPEED 2
+
+class SdBaseFile : public Print
+{
+public:
+	SdBaseFile() : m_file(NULL), m_isRoot(false), m_flags(0), m_mount(0), m_next(0) { m_name[0] = '\0'; m_fat.open = false; }
+	~SdBaseFile() { close(); }
+
+	bool open(const char * path, uint8_t oflag = O_READ);
+	bool openNext(SdBaseFile * dir, uint8_t oflag = O_READ);
+	bool close(void);
+	bool sync(void);
+
+	bool isOpen(void) const { return m_isRoot || isFile(); }
+	bool isFile(void) const { return (m_file != NULL) || m_fat.open; }
+	bool isDir(void) const { return m_isRoot; }
+
+	int read(void);
+	int read(void * buffer, size_t count);
+	size_t write(uint8_t b);
+	size_t write(const uint8_t * buffer, size_t size);
+	using Print::write;
+
+	bool seekSet(uint32_t position);
+	uint32_t curPosition(void) const;
+	uint32_t fileSize(void) const;
+	void rewind(void);
+
+	bool getName(char * name, size_t size);
+
+	static SdBaseFile * cwd(void);
+
+private:
+	friend class SdFat;
+
+	bool usable(void) const;
+
+	FILE * m_file;
+	struct fat_file m_fat;  // On the card image
+	bool m_isRoot;
+	uint8_t m_flags;
+	uint32_t m_mount;  // Which mount of the card the file was opened on
+	uint16_t m_next;  // Next directory entry for openNext()
+	char m_name[13];  // 8.3
+};
+
+class SdFile : public SdBaseFile
+{
+};
+
+class SdFat
+{
+public:
+	bool begin(uint8_t cs_pin, uint8_t spi_speed = SPI_FULL_SPEED);
+	bool exists(const char * path);
+	bool remove(const char * path);
+	SdBaseFile * vwd(void) { return SdBaseFile::cwd(); }
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _WIRE_H_
+#define _WIRE_H_
+
+/*
+ * The Arduino Wire library for the host build.
+ * Only writes to the RTC are simulated: they set its time (see hal_rtc.cpp).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+class TwoWire
+{
+public:
+	void begin(void) {}
+	void beginTransmission(uint8_t address);
+	size_t write(uint8_t value);
+	uint8_t endTransmission(void);
+	uint8_t requestFrom(uint8_t address, uint8_t count) { (void)address; (void)count; return 0; }
+	int available(void) { return 0; }
+	int read(void) { return -1; }
+
+private:
+	uint8_t m_address;
+	uint8_t m_length;
+	uint8_t m_buffer[32];
+};
+
+extern TwoWire Wire;
+
+#endif
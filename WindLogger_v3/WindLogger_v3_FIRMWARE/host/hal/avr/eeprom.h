@@ -0,0 +1,27 @@
+#ifndef _AVR_EEPROM_H_
+#define _AVR_EEPROM_H_
+
+/*
+ * The avr-libc EEPROM functions for the host build, on a 1K array (see hal_avr.cpp).
+ * As on the AVR, each byte written takes 3.4ms with the CPU waiting.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint8_t eeprom_read_byte(const uint8_t * address);
+uint16_t eeprom_read_word(const uint16_t * address);
+uint32_t eeprom_read_dword(const uint32_t * address);
+void eeprom_read_block(void * destination, const void * source, size_t length);
+
+void eeprom_write_byte(uint8_t * address, uint8_t value);
+void eeprom_write_word(uint16_t * address, uint16_t value);
+void eeprom_write_dword(uint32_t * address, uint32_t value);
+void eeprom_write_block(const void * source, void * destination, size_t length);
+
+void eeprom_update_byte(uint8_t * address, uint8_t value);
+void eeprom_update_word(uint16_t * address, uint16_t value);
+void eeprom_update_dword(uint32_t * address, uint32_t value);
+void eeprom_update_block(const void * source, void * destination, size_t length);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+
+/*
+ * Interrupts for the host build. The simulator calls each vector the
+ * firmware defines when its source is due (see hal_avr.cpp).
+ */
+
+void sei(void);
+void cli(void);
+
+#define ISR(vector, ...) extern "C" void vector(void)
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+
+#endif
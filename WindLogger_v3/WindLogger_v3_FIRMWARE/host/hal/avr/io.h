@@ -0,0 +1,148 @@
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+
+/*
+ * The ATmega328P registers the firmware uses, for the host build.
+ *
+ * Each 8-bit register is a hal_register. Writes to the ones the simulator
+ * models (the ADC, watchdog, Timer2 and PRR) go through a hook, which can
+ * start things (a conversion, a timer) and decide the value kept, e.g.
+ * writing 1 to ADIF clears it. The rest just hold their value.
+ * Timer1's count runs from the simulated time (hal_timer_count).
+ */
+
+#include <stdint.h>
+
+class hal_register
+{
+public:
+	// hook(old value, written value) returns the value the register keeps
+	constexpr hal_register(uint8_t (*hook)(uint8_t old_value, uint8_t value) = nullptr, uint8_t value = 0) :
+		m_value(value), m_hook(hook) {}
+
+	operator uint8_t() const { return m_value; }
+
+	// Taking an int, as the AVR's registers take expressions like ~_BV(bit)
+	hal_register & operator=(int value) { write((uint8_t)value); return *this; }
+	hal_register & operator=(const hal_register & other) { write(other.m_value); return *this; }
+	hal_register & operator|=(int bits) { write((uint8_t)(m_value | bits)); return *this; }
+	hal_register & operator&=(int bits) { write((uint8_t)(m_value & bits)); return *this; }
+	hal_register & operator^=(int bits) { write((uint8_t)(m_value ^ bits)); return *this; }
+
+	// For the hardware side: changes the value without the hook
+	void set(uint8_t value) { m_value = value; }
+
+private:
+	// The hook runs with the new value in place, so it can read the other registers as they now are
+	void write(uint8_t value)
+	{
+		uint8_t old_value = m_value;
+		m_value = value;
+		if (m_hook) { m_value = m_hook(old_value, value); }
+	}
+
+	uint8_t m_value;
+	uint8_t (*m_hook)(uint8_t old_value, uint8_t value);
+};
+
+// Timer1's count, free running at the TCCR1B prescaler (normal mode only).
+// It stops in sleep other than idle, as Timer1's clock does.
+class hal_timer_count
+{
+public:
+	operator uint16_t() const;
+	hal_timer_count & operator=(uint16_t value);
+};
+
+extern hal_register ADCSRA, ADCSRB, ADMUX, DIDR0, PRR, SMCR, MCUSR, WDTCSR;
+extern hal_register TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+extern hal_register TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2, TIFR2, ASSR;
+extern hal_register UCSR0A, UCSR0B, UCSR0C;
+extern hal_register GPIOR0, GPIOR1, GPIOR2, SREG;
+extern volatile uint16_t ADC;
+extern hal_timer_count TCNT1;
+extern volatile uint16_t OCR1A, OCR1B;
+
+#define _BV(bit) (1 << (bit))
+
+// ADCSRA, ADMUX
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define MUX3 3
+#define MUX2 2
+#define MUX1 1
+#define MUX0 0
+
+// PRR
+#define PRTWI 7
+#define PRTIM2 6
+#define PRTIM0 5
+#define PRTIM1 3
+#define PRSPI 2
+#define PRUSART0 1
+#define PRADC 0
+
+// WDTCSR, MCUSR
+#define WDIF 7
+#define WDIE 6
+#define WDP3 5
+#define WDCE 4
+#define WDE 3
+#define WDP2 2
+#define WDP1 1
+#define WDP0 0
+#define WDRF 3
+#define BORF 2
+#define EXTRF 1
+#define PORF 0
+
+// Timer1
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM10 0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define TOIE1 0
+#define OCIE1A 1
+#define OCIE1B 2
+
+// Timer2
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define WGM20 0
+#define WGM21 1
+#define WGM22 3
+#define TOIE2 0
+#define OCIE2A 1
+#define OCIE2B 2
+#define OCF2A 1
+#define AS2 5
+#define TCN2UB 4
+
+// USART0
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+
+#define RAMSTART 0x100
+#define RAMEND 0x8FF
+#define E2END 0x3FF
+
+#endif
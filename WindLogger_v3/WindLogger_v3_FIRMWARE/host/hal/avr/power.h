@@ -0,0 +1,6 @@
+#ifndef _AVR_POWER_H_
+#define _AVR_POWER_H_
+
+// The firmware sets PRR directly (see avr/io.h)
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _AVR_SLEEP_H_
+#define _AVR_SLEEP_H_
+
+/*
+ * Sleep modes for the host build, with the ATmega328P's SMCR values.
+ * sleep_cpu() is where simulated time moves on (see sim.cpp).
+ */
+
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE 0x00
+#define SLEEP_MODE_ADC 0x02
+#define SLEEP_MODE_PWR_DOWN 0x04
+#define SLEEP_MODE_PWR_SAVE 0x06
+#define SLEEP_MODE_STANDBY 0x0C
+#define SLEEP_MODE_EXT_STANDBY 0x0E
+
+void set_sleep_mode(uint8_t mode);
+void sleep_enable(void);
+void sleep_disable(void);
+void sleep_cpu(void);
+void sleep_mode(void);
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef _HAL_H_
+#define _HAL_H_
+
+/*
+ * The simulator's side of the host HAL: what the world and the test
+ * scripts use to drive the firmware's inputs and read back what it did.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+// The level on an analog channel (ADMUX 0-7) as a 10 bit reading
+typedef uint16_t (*hal_analog_source)(uint8_t channel);
+
+struct hal_stats
+{
+	uint32_t serialBytesOut;
+	uint32_t serialBytesIn;
+	uint32_t serialBytesLost;  // Arrived while the USART was powered down
+	uint32_t eepromBytesWritten;
+	uint32_t eepromMostWrites;  // Writes to the most written cell
+	uint16_t eepromMostWritten;  // ... and its address
+	uint32_t cardBytesWritten;
+	uint32_t cardFilesCreated;
+};
+
+// What a sector written to the card image holds, for the write counts
+enum hal_card_kind
+{
+	HAL_CARD_DATA = 0,		// File contents
+	HAL_CARD_DIRECTORY,		// Directory entries
+	HAL_CARD_FAT,			// The FAT, both copies
+	HAL_CARD_SYSTEM,		// MBR, boot sector, FSInfo
+	HAL_CARD_KIND_COUNT
+};
+
+// The card image and the flash behind it (see hal_card.cpp)
+struct hal_card_config
+{
+	const char * image;
+	uint32_t sizeMB;			// Size of a new image
+	uint8_t clusterKB;			// Cluster size of a new image
+	uint32_t eraseBlockKB;		// Flash erase block
+	uint8_t openBlocks;			// Erase blocks the card can write into at once
+	uint32_t readUs;			// Latency of a sector read
+	uint32_t writeUs;			// ... a sector written into an open erase block
+	uint32_t eraseUs;			// ... extra when it needs an erase block erased
+	uint32_t failPpm;			// Sector writes that fail, per million
+	uint32_t endurance;			// Erase cycles each erase block lasts
+	uint32_t seed;
+};
+
+struct hal_card_stats
+{
+	uint32_t sectors;
+	uint32_t eraseBlocks;
+	uint64_t sectorsRead;
+	uint64_t sectorsWritten;
+	uint64_t sectorsWrittenAs[HAL_CARD_KIND_COUNT];
+	uint32_t distinctSectors;	// Sectors written at least once
+	uint32_t mostWrites;		// Writes to the most written sector
+	uint32_t mostWritten;		// ... and the sector
+	uint64_t erases;
+	uint32_t mostErases;		// Erases of the most erased erase block
+	uint32_t writeFailures;
+	uint64_t busyTime;			// Time the firmware waited on the card (us)
+	uint32_t longestOperation;	// Longest SdFat call (us)
+	const char * longestOperationName;
+};
+
+// Called with each file on the card image
+typedef void (*hal_card_visitor)(const char * name, const uint8_t * data, uint32_t size, void * param);
+
+// Public Functions
+
+void HAL_Init(void);
+
+bool HAL_DrivePin(uint8_t pin, uint8_t level);
+uint8_t HAL_PinLevel(uint8_t pin);
+void HAL_SetAnalogSource(hal_analog_source source);
+
+void HAL_SetSerialOutput(FILE * out);
+void HAL_SerialReceive(const char * text);
+
+void HAL_RtcSet(uint32_t seconds);
+uint32_t HAL_RtcSeconds(void);
+void HAL_RtcTick(void);
+
+bool HAL_SetCardDirectory(const char * path);
+void HAL_SetCardPresent(bool present);
+bool HAL_CardPresent(void);
+
+bool HAL_CardOpenImage(const struct hal_card_config * config);
+void HAL_CardCloseImage(void);
+bool HAL_CardImageInUse(void);
+void HAL_CardFail(uint32_t writes);
+void HAL_CardPull(uint32_t writes);
+void HAL_SetCardPullHandler(void (*handler)(void));
+void HAL_GetCardStats(struct hal_card_stats * stats);
+bool HAL_CardVisitFiles(hal_card_visitor visit, void * param);
+
+bool HAL_EepromLoad(const char * path);
+bool HAL_EepromSave(const char * path);
+
+void HAL_GetStats(struct hal_stats * stats);
+
+// Shared between the HAL files
+
+void HAL_CountCardWrite(uint32_t bytes);
+void HAL_CountCardFile(void);
+bool HAL_CardReadSector(uint32_t sector, uint8_t * data);
+bool HAL_CardWriteSector(uint32_t sector, const uint8_t * data, uint8_t kind);
+bool HAL_CardPeekSector(uint32_t sector, uint8_t * data);
+bool HAL_CardPokeSector(uint32_t sector, const uint8_t * data);
+uint32_t HAL_CardSectors(void);
+void HAL_CardTimeOperation(const char * name, uint64_t duration);
+void HAL_GetEepromStats(struct hal_stats * stats);
+void HAL_InitArduino(void);
+uint16_t HAL_AnalogConvert(uint8_t channel);
+
+#endif
@@ -0,0 +1,492 @@
+/*
+ * hal_arduino.cpp
+ *
+ * The Arduino core for the host build: pins and pin interrupts,
+ * timing, printing and the serial port
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+#include <EnableInterrupt.h>
+
+#include "hal.h"
+#include "sim.h"
+
+/*
+ * The serial port is modelled as the 328P's USART under the Arduino core:
+ * a byte takes 10 bit times on the line, the USART holds two (UDR and the
+ * shift register) and the core queues up to SERIAL_TX_BUFFER_SIZE - 1 more,
+ * which its data register empty interrupt feeds in. A write to a full queue
+ * waits, awake, for space. Nothing is sent while the USART is stopped by a
+ * sleep mode (see sim.cpp), which is why the firmware flushes before sleeping.
+ *
+ * Received bytes come in with HAL_SerialReceive(). Each one's start bit is an
+ * edge on RX (D0), but the USART only keeps it if it was running when it
+ * arrived, i.e. the CPU was awake or in idle sleep with the USART powered.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define USART_HOLDS 2  // UDR and the shift register
+#define DEFAULT_BAUD 9600UL
+#define RX_PIN 0
+
+#define RX_QUEUE_SIZE 4096  // Bytes waiting to be sent to the firmware
+
+/*
+ * Private Variables
+ */
+
+static uint8_t s_pinModes[HAL_PIN_COUNT];
+static uint8_t s_pinOutputs[HAL_PIN_COUNT];  // Output latch (the pull-up for an input)
+static uint8_t s_pinLevels[HAL_PIN_COUNT];  // Level driven onto an input from outside
+
+static void (*s_pinHandlers[HAL_PIN_COUNT])(void);
+static uint8_t s_pinHandlerModes[HAL_PIN_COUNT];
+
+static FILE * s_serialOut = NULL;
+static sim_time s_byteTime = 10 * SIM_SECOND / DEFAULT_BAUD;
+
+static uint8_t s_txQueued = 0;  // In the core's transmit buffer
+static uint8_t s_txInUsart = 0;  // In UDR and the shift register
+
+static uint8_t s_rxBuffer[SERIAL_RX_BUFFER_SIZE];
+static uint8_t s_rxHead = 0;
+static uint8_t s_rxTail = 0;
+
+static char s_rxQueue[RX_QUEUE_SIZE];
+static uint16_t s_rxQueueHead = 0;
+static uint16_t s_rxQueueTail = 0;
+
+static struct hal_stats s_stats;
+
+HardwareSerial Serial;
+
+/*
+ * Private Functions
+ */
+
+/*
+ * tx_byte_sent
+ * A byte has left the shift register. The next moves up from UDR, and the
+ * data register empty interrupt refills UDR from the transmit buffer.
+ */
+static bool tx_byte_sent(void)
+{
+	bool interrupted = false;
+
+	s_txInUsart--;
+	if (s_txQueued)
+	{
+		s_txQueued--;
+		s_txInUsart++;
+		interrupted = true;
+	}
+
+	if (s_txInUsart)
+	{
+		SIM_Schedule(SIM_SRC_USART_TX, SIM_Now() + s_byteTime);
+	}
+	return interrupted;
+}
+
+static bool tx_has_space(void)
+{
+	return s_txQueued < (SERIAL_TX_BUFFER_SIZE - 1);
+}
+
+static bool tx_is_empty(void)
+{
+	return (s_txQueued == 0) && (s_txInUsart == 0);
+}
+
+/*
+ * rx_byte_arrived
+ * The next queued byte arrives on RX
+ */
+static bool rx_byte_arrived(void)
+{
+	uint8_t b = (uint8_t)s_rxQueue[s_rxQueueTail];
+	uint8_t state = SIM_State();
+	bool usart_running = ((state == SIM_STATE_AWAKE) || (state == SIM_STATE_IDLE)) && !(PRR & _BV(PRUSART0));
+	bool interrupted;
+
+	s_rxQueueTail = (s_rxQueueTail + 1) % RX_QUEUE_SIZE;
+	if (s_rxQueueTail != s_rxQueueHead)
+	{
+		SIM_Schedule(SIM_SRC_USART_RX, SIM_Now() + s_byteTime);
+	}
+
+	// The start bit, and the line back to idle
+	interrupted = HAL_DrivePin(RX_PIN, LOW);
+	interrupted |= HAL_DrivePin(RX_PIN, HIGH);
+
+	uint8_t next = (s_rxHead + 1) % SERIAL_RX_BUFFER_SIZE;
+	if (usart_running && (next != s_rxTail))
+	{
+		s_rxBuffer[s_rxHead] = b;
+		s_rxHead = next;
+		s_stats.serialBytesIn++;
+		interrupted = true;
+	}
+	else
+	{
+		s_stats.serialBytesLost++;
+	}
+	return interrupted;
+}
+
+static char * unsigned_to_string(unsigned long value, char * str, int base)
+{
+	char digits[sizeof(unsigned long) * 8 + 1];
+	uint8_t count = 0;
+
+	do
+	{
+		uint8_t digit = value % base;
+		digits[count++] = (digit < 10) ? ('0' + digit) : ('a' + digit - 10);
+		value /= base;
+	} while (value);
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		str[i] = digits[count - 1 - i];
+	}
+	str[count] = '\0';
+	return str;
+}
+
+static char * signed_to_string(long value, char * str, int base)
+{
+	if ((value < 0) && (base == 10))
+	{
+		str[0] = '-';
+		unsigned_to_string(-(unsigned long)value, &str[1], base);
+		return str;
+	}
+	return unsigned_to_string((unsigned long)value, str, base);
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * HAL_InitArduino
+ * Called from HAL_Init: pins default to inputs pulled high by the board
+ */
+void HAL_InitArduino(void)
+{
+	for (uint8_t pin = 0; pin < HAL_PIN_COUNT; pin++)
+	{
+		s_pinModes[pin] = INPUT;
+		s_pinOutputs[pin] = LOW;
+		s_pinLevels[pin] = HIGH;
+		s_pinHandlers[pin] = NULL;
+	}
+
+	SIM_SetHandler(SIM_SRC_USART_TX, tx_byte_sent);
+	SIM_SetHandler(SIM_SRC_USART_RX, rx_byte_arrived);
+}
+
+/*
+ * HAL_DrivePin, HAL_PinLevel
+ * Drive an input from outside, running its pin interrupt on a matching edge.
+ * Returns true if the interrupt ran.
+ */
+bool HAL_DrivePin(uint8_t pin, uint8_t level)
+{
+	uint8_t old_level = s_pinLevels[pin];
+	uint8_t mode = s_pinHandlerModes[pin];
+
+	s_pinLevels[pin] = level;
+
+	if (!s_pinHandlers[pin] || (old_level == level)) { return false; }
+
+	if ((mode == CHANGE) || ((mode == RISING) && (level == HIGH)) || ((mode == FALLING) && (level == LOW)))
+	{
+		s_pinHandlers[pin]();
+		return true;
+	}
+	return false;
+}
+
+uint8_t HAL_PinLevel(uint8_t pin)
+{
+	return (s_pinModes[pin] == OUTPUT) ? s_pinOutputs[pin] : s_pinLevels[pin];
+}
+
+/*
+ * HAL_SetSerialOutput, HAL_SerialReceive
+ * Where the firmware's serial output goes (NULL to discard it),
+ * and text for it to receive, a byte time apart from now
+ */
+void HAL_SetSerialOutput(FILE * out)
+{
+	s_serialOut = out;
+}
+
+void HAL_SerialReceive(const char * text)
+{
+	bool idle = (s_rxQueueHead == s_rxQueueTail);
+
+	for (; *text; text++)
+	{
+		uint16_t next = (s_rxQueueHead + 1) % RX_QUEUE_SIZE;
+		if (next == s_rxQueueTail) { break; }
+
+		s_rxQueue[s_rxQueueHead] = *text;
+		s_rxQueueHead = next;
+	}
+
+	if (idle && (s_rxQueueHead != s_rxQueueTail))
+	{
+		SIM_Schedule(SIM_SRC_USART_RX, SIM_Now());
+	}
+}
+
+void HAL_CountCardWrite(uint32_t bytes)
+{
+	s_stats.cardBytesWritten += bytes;
+}
+
+void HAL_CountCardFile(void)
+{
+	s_stats.cardFilesCreated++;
+}
+
+void HAL_GetStats(struct hal_stats * stats)
+{
+	*stats = s_stats;
+	HAL_GetEepromStats(stats);
+}
+
+/*
+ * Pins
+ */
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	if (pin >= HAL_PIN_COUNT) { return; }
+
+	s_pinModes[pin] = mode;
+	if (mode == INPUT_PULLUP) { s_pinOutputs[pin] = HIGH; }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	if (pin >= HAL_PIN_COUNT) { return; }
+
+	s_pinOutputs[pin] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin)
+{
+	return (pin < HAL_PIN_COUNT) ? HAL_PinLevel(pin) : LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+	return HAL_AnalogConvert((pin >= A0) ? (pin - A0) : pin);
+}
+
+void analogReference(uint8_t mode)
+{
+	(void)mode;
+}
+
+/*
+ * EnableInterrupt
+ */
+void enableInterrupt(uint8_t pin, void (*handler)(void), uint8_t mode)
+{
+	if (pin >= HAL_PIN_COUNT) { return; }
+
+	s_pinHandlers[pin] = handler;
+	s_pinHandlerModes[pin] = mode;
+}
+
+void disableInterrupt(uint8_t pin)
+{
+	if (pin >= HAL_PIN_COUNT) { return; }
+
+	s_pinHandlers[pin] = NULL;
+}
+
+/*
+ * Timing
+ */
+unsigned long millis(void)
+{
+	return (unsigned long)(uint32_t)(SIM_Now() / SIM_MILLISECOND);
+}
+
+unsigned long micros(void)
+{
+	return (unsigned long)(uint32_t)SIM_Now();
+}
+
+void delay(unsigned long ms)
+{
+	SIM_Wait((sim_time)ms * SIM_MILLISECOND);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	SIM_Wait(us);
+}
+
+/*
+ * Number conversions (avr-libc)
+ */
+char * itoa(int value, char * str, int base) { return signed_to_string(value, str, base); }
+char * ltoa(long value, char * str, int base) { return signed_to_string(value, str, base); }
+char * utoa(unsigned int value, char * str, int base) { return unsigned_to_string(value, str, base); }
+char * ultoa(unsigned long value, char * str, int base) { return unsigned_to_string(value, str, base); }
+
+char * dtostrf(double value, signed char width, unsigned char precision, char * str)
+{
+	sprintf(str, "%*.*f", width, precision, value);
+	return str;
+}
+
+/*
+ * Print
+ */
+size_t Print::write(const uint8_t * buffer, size_t size)
+{
+	size_t n = 0;
+	while (size--)
+	{
+		n += write(*buffer++);
+	}
+	return n;
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base)
+{
+	char str[sizeof(unsigned long) * 8 + 1];
+	return write(unsigned_to_string(n, str, (base < 2) ? 10 : base));
+}
+
+size_t Print::print(const __FlashStringHelper * str) { return write(reinterpret_cast<const char *>(str)); }
+size_t Print::print(const char * str) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char n, int base) { return printNumber(n, base); }
+size_t Print::print(unsigned int n, int base) { return printNumber(n, base); }
+size_t Print::print(unsigned long n, int base) { return printNumber(n, base); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+
+size_t Print::print(long n, int base)
+{
+	if ((base == 10) && (n < 0))
+	{
+		return write((uint8_t)'-') + printNumber(-(unsigned long)n, 10);
+	}
+	return printNumber((unsigned long)n, base);
+}
+
+// As the core's printFloat: rounded to the digits, no exponent
+size_t Print::print(double number, int digits)
+{
+	size_t n = 0;
+
+	if (isnan(number)) { return print("nan"); }
+	if (isinf(number)) { return print("inf"); }
+	if (number > 4294967040.0) { return print("ovf"); }
+	if (number < -4294967040.0) { return print("ovf"); }
+
+	if (number < 0.0)
+	{
+		n += print('-');
+		number = -number;
+	}
+
+	double rounding = 0.5;
+	for (uint8_t i = 0; i < digits; ++i)
+	{
+		rounding /= 10.0;
+	}
+	number += rounding;
+
+	unsigned long int_part = (unsigned long)number;
+	double remainder = number - (double)int_part;
+	n += print(int_part);
+
+	if (digits > 0) { n += print('.'); }
+
+	while (digits-- > 0)
+	{
+		remainder *= 10.0;
+		unsigned int to_print = (unsigned int)remainder;
+		n += print(to_print);
+		remainder -= to_print;
+	}
+	return n;
+}
+
+size_t Print::println(void)
+{
+	return write((uint8_t)'\r') + write((uint8_t)'\n');
+}
+
+/*
+ * HardwareSerial
+ */
+void HardwareSerial::begin(unsigned long baud)
+{
+	s_byteTime = (10 * SIM_SECOND + baud - 1) / baud;
+}
+
+int HardwareSerial::available(void)
+{
+	return (SERIAL_RX_BUFFER_SIZE + s_rxHead - s_rxTail) % SERIAL_RX_BUFFER_SIZE;
+}
+
+int HardwareSerial::peek(void)
+{
+	return (s_rxHead == s_rxTail) ? -1 : s_rxBuffer[s_rxTail];
+}
+
+int HardwareSerial::read(void)
+{
+	int b = peek();
+	if (b >= 0)
+	{
+		s_rxTail = (s_rxTail + 1) % SERIAL_RX_BUFFER_SIZE;
+	}
+	return b;
+}
+
+int HardwareSerial::availableForWrite(void)
+{
+	return (SERIAL_TX_BUFFER_SIZE - 1) - s_txQueued;
+}
+
+void HardwareSerial::flush(void)
+{
+	SIM_WaitFor(tx_is_empty);
+}
+
+size_t HardwareSerial::write(uint8_t b)
+{
+	if (s_serialOut) { fputc(b, s_serialOut); }
+	s_stats.serialBytesOut++;
+
+	// As the core: straight into UDR if the buffer is empty and there is room
+	if ((s_txQueued == 0) && (s_txInUsart < USART_HOLDS))
+	{
+		if (s_txInUsart++ == 0)
+		{
+			SIM_Schedule(SIM_SRC_USART_TX, SIM_Now() + s_byteTime);
+		}
+		return 1;
+	}
+
+	SIM_WaitFor(tx_has_space);
+	s_txQueued++;
+	return 1;
+}
@@ -0,0 +1,501 @@
+/*
+ * hal_avr.cpp
+ *
+ * The ATmega328P peripherals the firmware uses, for the host build:
+ * the ADC, watchdog, Timers 1 and 2, sleep and EEPROM
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include <avr/eeprom.h>
+#include <EEPROM.h>
+
+#include "hal.h"
+#include "sim.h"
+
+/*
+ * Each peripheral is a source in the scheduler (sim.cpp). Register writes
+ * schedule it, and when it is due its handler does what the hardware would
+ * and calls the firmware's interrupt vector, if the firmware has one.
+ * The vectors are weak so the HAL links whichever modules are built.
+ */
+
+extern "C" void ADC_vect(void) __attribute__((weak));
+extern "C" void WDT_vect(void) __attribute__((weak));
+extern "C" void TIMER2_COMPA_vect(void) __attribute__((weak));
+
+/*
+ * Defines and Typedefs
+ */
+
+#define CLOCKS_TO_TIME(clocks) ((sim_time)(clocks) * SIM_SECOND / F_CPU)
+
+#define ADC_CONVERSION_CLOCKS 13
+#define ADC_FIRST_CONVERSION_CLOCKS 25  // After the ADC is enabled
+
+#define WDT_SHORTEST_TIMEOUT (16 * SIM_MILLISECOND)
+
+#define EEPROM_WRITE_TIME (3400ULL)  // 3.4ms per byte, with the CPU waiting
+#define EEPROM_SIZE (E2END + 1)
+
+/*
+ * Private Function Prototypes
+ */
+
+static uint8_t adcsra_written(uint8_t old_value, uint8_t value);
+static uint8_t wdtcsr_written(uint8_t old_value, uint8_t value);
+static uint8_t timer1_written(uint8_t old_value, uint8_t value);
+static uint8_t timer2_written(uint8_t old_value, uint8_t value);
+
+/*
+ * Registers
+ */
+
+hal_register ADCSRA(adcsra_written), ADCSRB, ADMUX, DIDR0, PRR, SMCR, MCUSR, WDTCSR(wdtcsr_written);
+hal_register TCCR1A, TCCR1B(timer1_written), TCCR1C, TIMSK1, TIFR1;
+hal_register TCCR2A, TCCR2B(timer2_written), TCNT2(timer2_written), OCR2A(timer2_written), OCR2B, TIMSK2(timer2_written), TIFR2, ASSR;
+hal_register UCSR0A, UCSR0B, UCSR0C;
+hal_register GPIOR0, GPIOR1, GPIOR2, SREG;
+volatile uint16_t ADC;
+hal_timer_count TCNT1;
+volatile uint16_t OCR1A, OCR1B;
+
+EEPROMClass EEPROM;
+
+/*
+ * Private Variables
+ */
+
+static hal_analog_source s_analogSource = NULL;
+static bool s_adcFirstConversion = true;
+
+static uint8_t s_sleepMode = SLEEP_MODE_IDLE;
+
+static uint16_t s_timer1Count;   // The count at s_timer1Since
+static sim_time s_timer1Since;
+static bool s_timer1Held;        // Asleep with its clock stopped
+
+static uint8_t s_eeprom[EEPROM_SIZE];
+static uint32_t s_eepromWrites[EEPROM_SIZE];
+
+/*
+ * Private Functions
+ */
+
+/*
+ * adcsra_written, adc_complete
+ * A conversion starts when ADSC is written with the ADC enabled and takes
+ * 13 ADC clocks (25 for the first after enabling). Writing 1 to ADIF clears it.
+ */
+static uint8_t adcsra_written(uint8_t old_value, uint8_t value)
+{
+	uint8_t result = (value & ~_BV(ADIF)) | (old_value & _BV(ADIF) & ~value);
+
+	if (!(result & _BV(ADEN)))
+	{
+		SIM_Cancel(SIM_SRC_ADC);
+		s_adcFirstConversion = true;
+		return result & ~_BV(ADSC);
+	}
+
+	if (old_value & _BV(ADSC))
+	{
+		// A conversion already running can't be stopped by writing 0
+		return result | _BV(ADSC);
+	}
+
+	if (result & _BV(ADSC))
+	{
+		uint8_t prescaler = result & 0x07;
+		uint32_t divider = (prescaler == 0) ? 2 : (1U << prescaler);
+		uint32_t clocks = s_adcFirstConversion ? ADC_FIRST_CONVERSION_CLOCKS : ADC_CONVERSION_CLOCKS;
+
+		s_adcFirstConversion = false;
+		SIM_Schedule(SIM_SRC_ADC, SIM_Now() + CLOCKS_TO_TIME(clocks * divider));
+	}
+	return result;
+}
+
+static bool adc_complete(void)
+{
+	ADC = s_analogSource ? (s_analogSource(ADMUX & 0x07) & 0x3FF) : 0;
+	ADCSRA.set((ADCSRA & ~_BV(ADSC)) | _BV(ADIF));
+
+	if ((ADCSRA & _BV(ADIE)) && ADC_vect)
+	{
+		ADCSRA.set(ADCSRA & ~_BV(ADIF));  // Cleared as the vector runs
+		ADC_vect();
+		return true;
+	}
+	return false;
+}
+
+/*
+ * wdt_timeout, wdtcsr_written, wdt_timed_out
+ * Only the interrupt mode is simulated, which fires every timeout while WDIE is set.
+ * The WDCE|WDE write that opens the timed sequence doesn't start a reset.
+ */
+static sim_time wdt_timeout(void)
+{
+	uint8_t prescaler = (WDTCSR & 0x07) | ((WDTCSR & _BV(WDP3)) ? 0x08 : 0);
+	return WDT_SHORTEST_TIMEOUT << prescaler;
+}
+
+static uint8_t wdtcsr_written(uint8_t old_value, uint8_t value)
+{
+	(void)old_value;
+
+	if ((value & _BV(WDCE)) && (value & _BV(WDE))) { return value; }
+
+	if (value & _BV(WDIE))
+	{
+		uint8_t prescaler = (value & 0x07) | ((value & _BV(WDP3)) ? 0x08 : 0);
+		SIM_Schedule(SIM_SRC_WATCHDOG, SIM_Now() + (WDT_SHORTEST_TIMEOUT << prescaler));
+	}
+	else
+	{
+		SIM_Cancel(SIM_SRC_WATCHDOG);
+	}
+	return value & ~_BV(WDIF);
+}
+
+static bool wdt_timed_out(void)
+{
+	SIM_Schedule(SIM_SRC_WATCHDOG, SIM_Now() + wdt_timeout());
+	if (WDT_vect) { WDT_vect(); }
+	return true;
+}
+
+/*
+ * timer1_count, timer1_written, timer1_hold
+ * Timer1 counts the prescaled clock from s_timer1Since, and is rebased on
+ * anything that changes its rate. Only the count is simulated.
+ */
+static uint16_t timer1_count(uint8_t tccr1b)
+{
+	static const uint16_t s_prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};  // 6 and 7 are the T1 pin
+	uint16_t prescaler = s_prescalers[tccr1b & 0x07];
+	sim_time elapsed = SIM_Now() - s_timer1Since;
+	uint64_t rate;
+
+	if (!prescaler || s_timer1Held) { return s_timer1Count; }
+
+	// Whole seconds and the rest, so the product fits; the count only needs its low 16 bits
+	rate = F_CPU / prescaler;
+	return (uint16_t)(s_timer1Count + (elapsed / SIM_SECOND) * rate + (elapsed % SIM_SECOND) * rate / SIM_SECOND);
+}
+
+static void timer1_rebase(uint16_t count)
+{
+	s_timer1Count = count;
+	s_timer1Since = SIM_Now();
+}
+
+static uint8_t timer1_written(uint8_t old_value, uint8_t value)
+{
+	// The count so far is at the old rate
+	timer1_rebase(timer1_count(old_value));
+	return value;
+}
+
+static void timer1_hold(bool held)
+{
+	timer1_rebase(timer1_count(TCCR1B));
+	s_timer1Held = held;
+}
+
+/*
+ * timer2_written, timer2_compare
+ * Timer2 in CTC mode: OCR2A + 1 counts of the prescaled clock per interrupt.
+ * Any write to its registers restarts the count.
+ */
+static void timer2_restart(void)
+{
+	static const uint16_t s_prescalers[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+	uint16_t prescaler = s_prescalers[TCCR2B & 0x07];
+
+	if (prescaler && (TIMSK2 & _BV(OCIE2A)))
+	{
+		SIM_Schedule(SIM_SRC_TIMER2, SIM_Now() + CLOCKS_TO_TIME((uint32_t)(OCR2A + 1) * prescaler));
+	}
+	else
+	{
+		SIM_Cancel(SIM_SRC_TIMER2);
+	}
+}
+
+static uint8_t timer2_written(uint8_t old_value, uint8_t value)
+{
+	(void)old_value;
+	timer2_restart();
+	return value;
+}
+
+static bool timer2_compare(void)
+{
+	timer2_restart();
+	if (TIMER2_COMPA_vect) { TIMER2_COMPA_vect(); }
+	return true;
+}
+
+/*
+ * eeprom_index, eeprom_write
+ * An address outside the EEPROM is a firmware bug, so it stops the run
+ */
+static uint16_t eeprom_index(const void * address, size_t length)
+{
+	uintptr_t index = (uintptr_t)address;
+
+	if (index + length > EEPROM_SIZE)
+	{
+		fprintf(stderr, "hal: EEPROM access of %u bytes at %lu is outside the EEPROM\n", (unsigned)length, (unsigned long)index);
+		exit(2);
+	}
+	return (uint16_t)index;
+}
+
+static void eeprom_write(uint16_t index, uint8_t value)
+{
+	s_eeprom[index] = value;
+	s_eepromWrites[index]++;
+	SIM_Wait(EEPROM_WRITE_TIME);
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * HAL_Init
+ * The registers as the Arduino core's init() leaves them, and the scheduler's handlers
+ */
+void HAL_Init(void)
+{
+	ADCSRA.set(_BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0));  // Enabled, /128
+	s_adcFirstConversion = true;
+
+	TCCR1A.set(_BV(WGM10));  // 8-bit phase correct PWM, /64 (only the count is simulated)
+	TCCR1B.set(_BV(CS11) | _BV(CS10));
+	timer1_rebase(0);
+	s_timer1Held = false;
+
+	for (uint16_t i = 0; i < EEPROM_SIZE; i++)
+	{
+		s_eeprom[i] = 0xFF;
+		s_eepromWrites[i] = 0;
+	}
+
+	SIM_SetHandler(SIM_SRC_ADC, adc_complete);
+	SIM_SetHandler(SIM_SRC_WATCHDOG, wdt_timed_out);
+	SIM_SetHandler(SIM_SRC_TIMER2, timer2_compare);
+
+	HAL_InitArduino();
+}
+
+void HAL_SetAnalogSource(hal_analog_source source)
+{
+	s_analogSource = source;
+}
+
+/*
+ * HAL_AnalogConvert
+ * A conversion for analogRead(), waiting for it as the core does
+ */
+uint16_t HAL_AnalogConvert(uint8_t channel)
+{
+	SIM_Wait(CLOCKS_TO_TIME(ADC_CONVERSION_CLOCKS * 128));
+	return s_analogSource ? (s_analogSource(channel & 0x07) & 0x3FF) : 0;
+}
+
+/*
+ * Interrupts only run while the firmware waits (see sim.cpp), so enabling
+ * and disabling them has nothing to do
+ */
+void sei(void) {}
+void cli(void) {}
+
+/*
+ * Sleep
+ */
+void set_sleep_mode(uint8_t mode) { s_sleepMode = mode; }
+void sleep_enable(void) {}
+void sleep_disable(void) {}
+void sleep_cpu(void)
+{
+	bool stops_timer1 = (s_sleepMode != SLEEP_MODE_IDLE);
+
+	if (stops_timer1) { timer1_hold(true); }
+	SIM_Sleep(s_sleepMode);
+	if (stops_timer1) { timer1_hold(false); }
+}
+void sleep_mode(void) { sleep_cpu(); }
+
+/*
+ * Timer1 count
+ */
+hal_timer_count::operator uint16_t() const
+{
+	return timer1_count(TCCR1B);
+}
+
+hal_timer_count & hal_timer_count::operator=(uint16_t value)
+{
+	timer1_rebase(value);
+	return *this;
+}
+
+/*
+ * Watchdog
+ */
+void wdt_reset(void)
+{
+	if (WDTCSR & _BV(WDIE))
+	{
+		SIM_Schedule(SIM_SRC_WATCHDOG, SIM_Now() + wdt_timeout());
+	}
+}
+
+void wdt_enable(uint8_t timeout)
+{
+	WDTCSR = _BV(WDCE) | _BV(WDE);
+	WDTCSR = _BV(WDIE) | (timeout & 0x07) | ((timeout & 0x08) ? _BV(WDP3) : 0);
+}
+
+void wdt_disable(void)
+{
+	WDTCSR = _BV(WDCE) | _BV(WDE);
+	WDTCSR = 0;
+}
+
+/*
+ * EEPROM
+ * The update functions only write the bytes that change,
+ * eeprom_update_block from the last byte back as avr-libc does
+ */
+uint8_t eeprom_read_byte(const uint8_t * address)
+{
+	return s_eeprom[eeprom_index(address, 1)];
+}
+
+uint16_t eeprom_read_word(const uint16_t * address)
+{
+	uint16_t value;
+	eeprom_read_block(&value, address, sizeof(value));
+	return value;
+}
+
+uint32_t eeprom_read_dword(const uint32_t * address)
+{
+	uint32_t value;
+	eeprom_read_block(&value, address, sizeof(value));
+	return value;
+}
+
+void eeprom_read_block(void * destination, const void * source, size_t length)
+{
+	memcpy(destination, &s_eeprom[eeprom_index(source, length)], length);
+}
+
+void eeprom_write_byte(uint8_t * address, uint8_t value)
+{
+	eeprom_write(eeprom_index(address, 1), value);
+}
+
+void eeprom_write_word(uint16_t * address, uint16_t value)
+{
+	eeprom_write_block(&value, address, sizeof(value));
+}
+
+void eeprom_write_dword(uint32_t * address, uint32_t value)
+{
+	eeprom_write_block(&value, address, sizeof(value));
+}
+
+void eeprom_write_block(const void * source, void * destination, size_t length)
+{
+	uint16_t index = eeprom_index(destination, length);
+
+	for (size_t i = 0; i < length; i++)
+	{
+		eeprom_write(index + i, ((const uint8_t *)source)[i]);
+	}
+}
+
+void eeprom_update_byte(uint8_t * address, uint8_t value)
+{
+	uint16_t index = eeprom_index(address, 1);
+	if (s_eeprom[index] != value) { eeprom_write(index, value); }
+}
+
+void eeprom_update_word(uint16_t * address, uint16_t value)
+{
+	eeprom_update_block(&value, address, sizeof(value));
+}
+
+void eeprom_update_dword(uint32_t * address, uint32_t value)
+{
+	eeprom_update_block(&value, address, sizeof(value));
+}
+
+void eeprom_update_block(const void * source, void * destination, size_t length)
+{
+	uint16_t index = eeprom_index(destination, length);
+
+	while (length--)
+	{
+		uint8_t value = ((const uint8_t *)source)[length];
+		if (s_eeprom[index + length] != value) { eeprom_write(index + length, value); }
+	}
+}
+
+/*
+ * HAL_EepromLoad, HAL_EepromSave
+ * Keep the EEPROM in a file between runs, as it is kept through power cycles.
+ * A missing file is a new (erased) EEPROM.
+ */
+bool HAL_EepromLoad(const char * path)
+{
+	FILE * file = fopen(path, "rb");
+	if (!file) { return false; }
+
+	size_t count = fread(s_eeprom, 1, EEPROM_SIZE, file);
+	fclose(file);
+	return count == EEPROM_SIZE;
+}
+
+bool HAL_EepromSave(const char * path)
+{
+	FILE * file = fopen(path, "wb");
+	if (!file) { return false; }
+
+	size_t count = fwrite(s_eeprom, 1, EEPROM_SIZE, file);
+	return (fclose(file) == 0) && (count == EEPROM_SIZE);
+}
+
+void HAL_GetEepromStats(struct hal_stats * stats)
+{
+	stats->eepromBytesWritten = 0;
+	stats->eepromMostWrites = 0;
+	stats->eepromMostWritten = 0;
+
+	for (uint16_t i = 0; i < EEPROM_SIZE; i++)
+	{
+		stats->eepromBytesWritten += s_eepromWrites[i];
+		if (s_eepromWrites[i] > stats->eepromMostWrites)
+		{
+			stats->eepromMostWrites = s_eepromWrites[i];
+			stats->eepromMostWritten = i;
+		}
+	}
+}
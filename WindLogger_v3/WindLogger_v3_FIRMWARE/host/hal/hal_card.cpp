@@ -0,0 +1,322 @@
+/*
+ * hal_card.cpp
+ *
+ * The SD card as a block device for the host build: an image file,
+ * with the card's flash behind it counted and timed
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <unordered_map>
+
+#include <Arduino.h>
+
+#include "hal.h"
+#include "hal_fat.h"
+#include "sim.h"
+
+/*
+ * The image is read and written a sector at a time, as the card is over
+ * SPI. It is a sparse file, so a 4GB card only takes the space written.
+ * A new image is made with a FAT32 volume (hal_fat.cpp) when it doesn't exist.
+ *
+ * Behind the sectors is the flash, in erase blocks. The card can write
+ * into a few open erase blocks at once, each from the start forward.
+ * A sector written anywhere else (a block that isn't open, or a sector
+ * before one already written in its block, such as the directory entry
+ * rewritten at every close) costs an erase block erased, and the erase
+ * latency on top of the write. That erase is the wear on the card, and
+ * the latency the firmware waits for, in simulated time.
+ *
+ * Writes can be made to fail, at random (failPpm, the same every run for a
+ * seed), a number in a row (HAL_CardFail), or by the card coming out part
+ * way through (HAL_CardPull, the world takes it out). A failed write
+ * leaves the sector as it was.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define SECTOR_SIZE 512
+#define MAX_OPEN_BLOCKS 16
+#define NO_BLOCK UINT32_MAX
+
+struct open_block
+{
+	uint32_t block;
+	uint32_t next;  // The sector after the last one written
+};
+
+/*
+ * Private Variables
+ */
+
+static int s_image = -1;
+static struct hal_card_config s_config;
+static uint32_t s_sectors = 0;
+static uint32_t s_eraseBlockSectors = 256;
+
+static struct open_block s_open[MAX_OPEN_BLOCKS];  // Most recently used first
+static std::unordered_map<uint32_t, uint32_t> s_sectorWrites;
+static std::unordered_map<uint32_t, uint32_t> s_blockErases;
+
+static struct hal_card_stats s_stats;
+static uint32_t s_writeAttempts = 0;
+static uint32_t s_failWrites = 0;
+static uint32_t s_pullAfter = 0;
+static void (*s_pullHandler)(void) = NULL;
+
+/*
+ * Private Functions
+ */
+
+static uint32_t hash(uint32_t a, uint32_t b)
+{
+	uint32_t h = (a * 0x9E3779B1U) ^ (b + 0x7F4A7C15U + (a << 6) + (a >> 2));
+	h ^= h >> 16;
+	h *= 0x85EBCA6BU;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35U;
+	return h ^ (h >> 16);
+}
+
+/*
+ * program
+ * Writes a sector into the flash. Returns the latency, in microseconds.
+ */
+static uint32_t program(uint32_t sector)
+{
+	uint32_t block = sector / s_eraseBlockSectors;
+	uint8_t slot;
+	bool erase = true;
+
+	for (slot = 0; slot < s_config.openBlocks - 1; slot++)
+	{
+		if (s_open[slot].block == block) { break; }
+	}
+
+	if ((s_open[slot].block == block) && (sector >= s_open[slot].next))
+	{
+		erase = false;
+	}
+
+	// Most recently used to the front (the last one drops out when a new block opens)
+	memmove(&s_open[1], &s_open[0], slot * sizeof(s_open[0]));
+	s_open[0].block = block;
+	s_open[0].next = sector + 1;
+
+	if (!erase) { return s_config.writeUs; }
+
+	uint32_t erases = ++s_blockErases[block];
+	s_stats.erases++;
+	if (erases > s_stats.mostErases) { s_stats.mostErases = erases; }
+	return s_config.eraseUs + s_config.writeUs;
+}
+
+static void busy(uint32_t latency)
+{
+	s_stats.busyTime += latency;
+	SIM_Wait(latency);
+}
+
+static bool write_fails(void)
+{
+	if (s_failWrites)
+	{
+		s_failWrites--;
+		return true;
+	}
+	return s_config.failPpm && ((hash(s_config.seed, s_writeAttempts) % 1000000U) < s_config.failPpm);
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * HAL_CardOpenImage
+ * Uses an image file as the card, instead of the card directory.
+ * A new image is made (sparse) and formatted FAT32.
+ */
+bool HAL_CardOpenImage(const struct hal_card_config * config)
+{
+	struct stat info;
+	bool exists = stat(config->image, &info) == 0;
+
+	s_config = *config;
+	if (s_config.openBlocks < 1) { s_config.openBlocks = 1; }
+	if (s_config.openBlocks > MAX_OPEN_BLOCKS) { s_config.openBlocks = MAX_OPEN_BLOCKS; }
+	s_eraseBlockSectors = (s_config.eraseBlockKB * 1024) / SECTOR_SIZE;
+	if (s_eraseBlockSectors == 0) { s_eraseBlockSectors = 1; }
+
+	s_image = open(config->image, O_RDWR | O_CREAT, 0666);
+	if (s_image < 0) { return false; }
+
+	if (exists)
+	{
+		s_sectors = (uint32_t)(info.st_size / SECTOR_SIZE);
+	}
+	else
+	{
+		s_sectors = (uint32_t)(((uint64_t)config->sizeMB * 1024 * 1024) / SECTOR_SIZE);
+		if ((ftruncate(s_image, (off_t)s_sectors * SECTOR_SIZE) != 0) ||
+			!FAT_Format(s_sectors, (uint8_t)((config->clusterKB * 1024) / SECTOR_SIZE), s_eraseBlockSectors))
+		{
+			HAL_CardCloseImage();
+			return false;
+		}
+	}
+
+	// Formatting isn't the firmware's
+	memset(&s_stats, 0, sizeof(s_stats));
+	s_writeAttempts = 0;
+	s_sectorWrites.clear();
+	s_blockErases.clear();
+	for (uint8_t slot = 0; slot < MAX_OPEN_BLOCKS; slot++)
+	{
+		s_open[slot].block = NO_BLOCK;
+	}
+	return true;
+}
+
+void HAL_CardCloseImage(void)
+{
+	if (s_image >= 0)
+	{
+		close(s_image);
+		s_image = -1;
+	}
+}
+
+bool HAL_CardImageInUse(void)
+{
+	return s_image >= 0;
+}
+
+uint32_t HAL_CardSectors(void)
+{
+	return s_sectors;
+}
+
+/*
+ * HAL_CardReadSector, HAL_CardWriteSector
+ * SdFat's reads and writes, which the firmware waits for.
+ * They fail while the card is out.
+ */
+bool HAL_CardReadSector(uint32_t sector, uint8_t * data)
+{
+	if (!HAL_CardPresent() || (sector >= s_sectors)) { return false; }
+
+	s_stats.sectorsRead++;
+	busy(s_config.readUs);
+	return HAL_CardPeekSector(sector, data);
+}
+
+bool HAL_CardWriteSector(uint32_t sector, const uint8_t * data, uint8_t kind)
+{
+	if (!HAL_CardPresent() || (sector >= s_sectors)) { return false; }
+
+	if (s_pullAfter && (--s_pullAfter == 0))
+	{
+		if (s_pullHandler) { s_pullHandler(); }
+		HAL_SetCardPresent(false);
+		return false;
+	}
+
+	s_writeAttempts++;
+	if (write_fails())
+	{
+		s_stats.writeFailures++;
+		busy(s_config.writeUs);
+		return false;
+	}
+
+	s_stats.sectorsWritten++;
+	s_stats.sectorsWrittenAs[kind]++;
+
+	uint32_t writes = ++s_sectorWrites[sector];
+	if (writes > s_stats.mostWrites)
+	{
+		s_stats.mostWrites = writes;
+		s_stats.mostWritten = sector;
+	}
+
+	busy(program(sector));
+	return pwrite(s_image, data, SECTOR_SIZE, (off_t)sector * SECTOR_SIZE) == SECTOR_SIZE;
+}
+
+/*
+ * HAL_CardPeekSector, HAL_CardPokeSector
+ * Reads or writes a sector without the card knowing (formatting, the report)
+ */
+bool HAL_CardPeekSector(uint32_t sector, uint8_t * data)
+{
+	if ((s_image < 0) || (sector >= s_sectors)) { return false; }
+
+	return pread(s_image, data, SECTOR_SIZE, (off_t)sector * SECTOR_SIZE) == SECTOR_SIZE;
+}
+
+bool HAL_CardPokeSector(uint32_t sector, const uint8_t * data)
+{
+	if ((s_image < 0) || (sector >= s_sectors)) { return false; }
+
+	return pwrite(s_image, data, SECTOR_SIZE, (off_t)sector * SECTOR_SIZE) == SECTOR_SIZE;
+}
+
+/*
+ * HAL_CardFail, HAL_CardPull
+ * The next number of sector writes fail, or the card comes out at the write
+ */
+void HAL_CardFail(uint32_t writes)
+{
+	s_failWrites = writes;
+}
+
+void HAL_CardPull(uint32_t writes)
+{
+	s_pullAfter = writes;
+}
+
+void HAL_SetCardPullHandler(void (*handler)(void))
+{
+	s_pullHandler = handler;
+}
+
+/*
+ * HAL_CardTimeOperation
+ * How long an SdFat call kept the firmware waiting
+ */
+void HAL_CardTimeOperation(const char * name, uint64_t duration)
+{
+	if (duration > s_stats.longestOperation)
+	{
+		s_stats.longestOperation = (uint32_t)duration;
+		s_stats.longestOperationName = name;
+	}
+}
+
+void HAL_GetCardStats(struct hal_card_stats * stats)
+{
+	*stats = s_stats;
+	stats->sectors = s_sectors;
+	stats->eraseBlocks = s_sectors / s_eraseBlockSectors;
+	stats->distinctSectors = (uint32_t)s_sectorWrites.size();
+}
+
+/*
+ * HAL_CardVisitFiles
+ * Calls visit() with each file in the image's root directory, as it is on the card
+ */
+bool HAL_CardVisitFiles(hal_card_visitor visit, void * param)
+{
+	return (s_image >= 0) && FAT_VisitFiles(visit, param);
+}
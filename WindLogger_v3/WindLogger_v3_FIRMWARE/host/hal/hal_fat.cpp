@@ -0,0 +1,949 @@
+/*
+ * hal_fat.cpp
+ *
+ * A FAT32 volume on the card image, for the host build's SdFat
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include <Arduino.h>
+#include <SdFat.h>
+
+#include "hal.h"
+#include "hal_fat.h"
+
+/*
+ * The sector traffic is what matters here, so this does what SdFat 1.x
+ * does on the AVR: one 512 byte cache for data, directory and FAT
+ * sectors alike, written back when another sector is needed or on a
+ * sync. A FAT sector is written to both FATs. A data sector is written
+ * as soon as it is full, and a new one past the end of the file isn't
+ * read first. The directory entry (size, first cluster) is only written
+ * on a sync or close. Clusters are allocated searching on from the last
+ * one. FSInfo isn't kept up to date, as SdFat doesn't.
+ *
+ * Only the root directory, and 8.3 names: the firmware uses nothing else.
+ * No date callback is set, so entries have SdFat's default date.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define SECTOR_SIZE 512
+#define ENTRY_SIZE 32
+#define ENTRIES_PER_SECTOR (SECTOR_SIZE / ENTRY_SIZE)
+#define FAT_ENTRIES_PER_SECTOR (SECTOR_SIZE / 4)
+
+#define CACHE_NONE UINT32_MAX
+
+#define CLUSTER_FREE 0
+#define CLUSTER_EOC 0x0FFFFFFF
+#define CLUSTER_MASK 0x0FFFFFFF
+#define MIN_FAT32_CLUSTERS 65525
+
+#define NAME_DELETED 0xE5
+#define ATTR_READ_ONLY 0x01
+#define ATTR_VOLUME_ID 0x08  // Also set in long name entries
+#define ATTR_DIRECTORY 0x10
+#define ATTR_ARCHIVE 0x20
+
+#define FAT_DEFAULT_DATE (((2000 - 1980) << 9) | (1 << 5) | 1)  // 2000-01-01, as SdFat
+
+// Offsets in the boot sector and a directory entry
+#define BPB_BYTES_PER_SECTOR 11
+#define BPB_SECTORS_PER_CLUSTER 13
+#define BPB_RESERVED_SECTORS 14
+#define BPB_FAT_COUNT 16
+#define BPB_ROOT_ENTRIES 17
+#define BPB_TOTAL_SECTORS_16 19
+#define BPB_FAT_SIZE_16 22
+#define BPB_HIDDEN_SECTORS 28
+#define BPB_TOTAL_SECTORS_32 32
+#define BPB_FAT_SIZE_32 36
+#define BPB_ROOT_CLUSTER 44
+
+#define DIR_ATTRIBUTES 11
+#define DIR_CREATE_TIME 14
+#define DIR_CREATE_DATE 16
+#define DIR_ACCESS_DATE 18
+#define DIR_CLUSTER_HIGH 20
+#define DIR_MODIFY_TIME 22
+#define DIR_MODIFY_DATE 24
+#define DIR_CLUSTER_LOW 26
+#define DIR_FILE_SIZE 28
+
+#define MBR_PARTITION 0x1BE
+
+enum cache_option
+{
+	CACHE_READ = 0,		// Read it
+	CACHE_WRITE,		// Read it, to change
+	CACHE_RESERVE		// To overwrite, no need to read it
+};
+
+struct volume
+{
+	uint32_t start;  // First sector of the volume
+	uint8_t sectorsPerCluster;
+	uint8_t fatCount;
+	uint32_t fatStart;
+	uint32_t fatSize;
+	uint32_t dataStart;
+	uint32_t clusterCount;
+	uint32_t rootCluster;
+};
+
+// A place in the root directory
+struct dir_cursor
+{
+	uint32_t index;		// Next entry
+	uint32_t cluster;	// Cluster of the entry before it (the first cluster to start)
+};
+
+/*
+ * Private Variables
+ */
+
+static struct volume s_vol;
+static bool s_mounted = false;
+static uint32_t s_allocSearch = 1;  // Searches for a free cluster start after this
+
+static uint8_t s_cache[SECTOR_SIZE];
+static uint32_t s_cacheSector = CACHE_NONE;
+static uint8_t s_cacheKind = HAL_CARD_DATA;
+static bool s_cacheDirty = false;
+static uint32_t s_cacheMirror = 0;  // The same FAT sector in the second FAT
+
+/*
+ * Private Functions
+ */
+
+static uint16_t get16(const uint8_t * p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static uint32_t get32(const uint8_t * p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+static void put16(uint8_t * p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static void put32(uint8_t * p, uint32_t v) { put16(p, (uint16_t)v); put16(p + 2, (uint16_t)(v >> 16)); }
+
+static bool is_eoc(uint32_t cluster) { return cluster >= 0x0FFFFFF8; }
+
+static uint32_t cluster_sector(const struct volume * vol, uint32_t cluster)
+{
+	return vol->dataStart + ((cluster - 2) * vol->sectorsPerCluster);
+}
+
+static uint32_t cluster_bytes(void)
+{
+	return (uint32_t)s_vol.sectorsPerCluster * SECTOR_SIZE;
+}
+
+/*
+ * fat_name, card_name
+ * "D261019.CSV" to and from the directory entry's "D261019 CSV"
+ */
+static bool fat_name(const char * name, char * entry)
+{
+	const char * dot = strchr(name, '.');
+	size_t base = dot ? (size_t)(dot - name) : strlen(name);
+	size_t ext = dot ? strlen(dot + 1) : 0;
+
+	if ((base == 0) || (base > 8) || (ext > 3)) { return false; }
+
+	memset(entry, ' ', 11);
+	memcpy(entry, name, base);
+	if (dot) { memcpy(entry + 8, dot + 1, ext); }
+	return true;
+}
+
+static void card_name(const uint8_t * entry, char * name)
+{
+	uint8_t length = 0;
+
+	for (uint8_t i = 0; (i < 8) && (entry[i] != ' '); i++) { name[length++] = (char)entry[i]; }
+	if (entry[8] != ' ')
+	{
+		name[length++] = '.';
+		for (uint8_t i = 8; (i < 11) && (entry[i] != ' '); i++) { name[length++] = (char)entry[i]; }
+	}
+	name[length] = '\0';
+}
+
+/*
+ * read_volume
+ * The volume's layout, from the MBR's first partition or a volume with no MBR
+ */
+static bool read_volume(struct volume * vol, bool (*read_sector)(uint32_t, uint8_t *))
+{
+	uint8_t sector[SECTOR_SIZE];
+	const uint8_t * partition = &sector[MBR_PARTITION];
+
+	if (!read_sector(0, sector) || (sector[510] != 0x55) || (sector[511] != 0xAA)) { return false; }
+
+	vol->start = 0;
+	if ((partition[4] == 0x0B) || (partition[4] == 0x0C))
+	{
+		vol->start = get32(&partition[8]);
+		if (!read_sector(vol->start, sector)) { return false; }
+	}
+
+	uint32_t total = get16(&sector[BPB_TOTAL_SECTORS_16]) ? get16(&sector[BPB_TOTAL_SECTORS_16]) : get32(&sector[BPB_TOTAL_SECTORS_32]);
+
+	vol->sectorsPerCluster = sector[BPB_SECTORS_PER_CLUSTER];
+	vol->fatCount = sector[BPB_FAT_COUNT];
+	vol->fatStart = vol->start + get16(&sector[BPB_RESERVED_SECTORS]);
+	vol->fatSize = get32(&sector[BPB_FAT_SIZE_32]);
+	vol->dataStart = vol->fatStart + (vol->fatCount * vol->fatSize);
+	vol->rootCluster = get32(&sector[BPB_ROOT_CLUSTER]);
+
+	// FAT32 only: no FAT16 size, no fixed root directory
+	if ((get16(&sector[BPB_BYTES_PER_SECTOR]) != SECTOR_SIZE) || (vol->sectorsPerCluster == 0) ||
+		(vol->sectorsPerCluster & (vol->sectorsPerCluster - 1)) || (vol->fatCount == 0) ||
+		get16(&sector[BPB_FAT_SIZE_16]) || get16(&sector[BPB_ROOT_ENTRIES]) || (vol->fatSize == 0) ||
+		(vol->start + total < vol->dataStart))
+	{
+		return false;
+	}
+
+	vol->clusterCount = (vol->start + total - vol->dataStart) / vol->sectorsPerCluster;
+	return vol->clusterCount >= MIN_FAT32_CLUSTERS;
+}
+
+/*
+ * cache_sync, cache_fetch
+ * The one sector cache. cache_fetch returns it holding the sector, or NULL
+ * if the sector it held couldn't be written back or the new one read.
+ */
+static bool cache_sync(void)
+{
+	if (!s_cacheDirty) { return true; }
+
+	if (!HAL_CardWriteSector(s_cacheSector, s_cache, s_cacheKind)) { return false; }
+	if (s_cacheMirror)
+	{
+		if (!HAL_CardWriteSector(s_cacheMirror, s_cache, s_cacheKind)) { return false; }
+		s_cacheMirror = 0;
+	}
+	s_cacheDirty = false;
+	return true;
+}
+
+static void cache_invalidate(void)
+{
+	s_cacheSector = CACHE_NONE;
+	s_cacheDirty = false;
+	s_cacheMirror = 0;
+}
+
+static uint8_t * cache_fetch(uint32_t sector, uint8_t kind, uint8_t option)
+{
+	if (s_cacheSector != sector)
+	{
+		if (!cache_sync()) { return NULL; }
+
+		if (option == CACHE_RESERVE)
+		{
+			memset(s_cache, 0, sizeof(s_cache));
+		}
+		else if (!HAL_CardReadSector(sector, s_cache))
+		{
+			cache_invalidate();
+			return NULL;
+		}
+		s_cacheSector = sector;
+		s_cacheMirror = 0;
+	}
+
+	s_cacheKind = kind;
+	if (option != CACHE_READ) { s_cacheDirty = true; }
+	return s_cache;
+}
+
+/*
+ * fat_get, fat_put
+ * A cluster's entry in the FAT
+ */
+static bool fat_get(uint32_t cluster, uint32_t * value)
+{
+	uint8_t * sector;
+
+	if ((cluster < 2) || (cluster > s_vol.clusterCount + 1)) { return false; }
+
+	sector = cache_fetch(s_vol.fatStart + (cluster / FAT_ENTRIES_PER_SECTOR), HAL_CARD_FAT, CACHE_READ);
+	if (!sector) { return false; }
+
+	*value = get32(&sector[(cluster % FAT_ENTRIES_PER_SECTOR) * 4]) & CLUSTER_MASK;
+	return true;
+}
+
+static bool fat_put(uint32_t cluster, uint32_t value)
+{
+	uint32_t fat_sector = s_vol.fatStart + (cluster / FAT_ENTRIES_PER_SECTOR);
+	uint8_t * sector;
+
+	if ((cluster < 2) || (cluster > s_vol.clusterCount + 1)) { return false; }
+
+	sector = cache_fetch(fat_sector, HAL_CARD_FAT, CACHE_WRITE);
+	if (!sector) { return false; }
+
+	put32(&sector[(cluster % FAT_ENTRIES_PER_SECTOR) * 4], value);
+	if (s_vol.fatCount > 1) { s_cacheMirror = fat_sector + s_vol.fatSize; }
+	return true;
+}
+
+/*
+ * alloc_cluster
+ * Finds a free cluster, marks it the end of a chain and links it after
+ * current (if not 0)
+ */
+static bool alloc_cluster(uint32_t current, uint32_t * cluster)
+{
+	uint32_t candidate = s_allocSearch;
+	uint32_t value;
+
+	for (uint32_t n = 0; n < s_vol.clusterCount; n++)
+	{
+		if (++candidate > s_vol.clusterCount + 1) { candidate = 2; }
+		if (!fat_get(candidate, &value)) { return false; }
+		if (value != CLUSTER_FREE) { continue; }
+
+		if (!fat_put(candidate, CLUSTER_EOC)) { return false; }
+		if (current && !fat_put(current, candidate)) { return false; }
+
+		s_allocSearch = candidate;
+		*cluster = candidate;
+		return true;
+	}
+	return false;  // Card full
+}
+
+static bool free_chain(uint32_t cluster)
+{
+	uint32_t next;
+
+	do
+	{
+		if (!fat_get(cluster, &next) || !fat_put(cluster, CLUSTER_FREE)) { return false; }
+		if (cluster <= s_allocSearch) { s_allocSearch = cluster - 1; }
+		cluster = next;
+	} while (!is_eoc(next));
+
+	return true;
+}
+
+/*
+ * dir_seek, dir_next
+ * Walks the root directory. dir_next returns the next entry in the cache,
+ * or NULL at the end of the directory's clusters.
+ */
+static void dir_seek(struct dir_cursor * cursor, uint32_t index)
+{
+	uint32_t entries_per_cluster = (uint32_t)s_vol.sectorsPerCluster * ENTRIES_PER_SECTOR;
+
+	cursor->index = 0;
+	cursor->cluster = s_vol.rootCluster;
+
+	while (index > cursor->index + entries_per_cluster)
+	{
+		if (!fat_get(cursor->cluster, &cursor->cluster) || is_eoc(cursor->cluster)) { return; }
+		cursor->index += entries_per_cluster;
+	}
+	cursor->index = index;
+}
+
+static uint8_t * dir_next(struct dir_cursor * cursor, uint8_t option, uint32_t * sector_number)
+{
+	uint32_t entries_per_cluster = (uint32_t)s_vol.sectorsPerCluster * ENTRIES_PER_SECTOR;
+	uint32_t in_cluster = cursor->index % entries_per_cluster;
+	uint8_t * sector;
+
+	if ((cursor->index > 0) && (in_cluster == 0))
+	{
+		uint32_t next;
+		if (!fat_get(cursor->cluster, &next) || is_eoc(next)) { return NULL; }
+		cursor->cluster = next;
+	}
+
+	*sector_number = cluster_sector(&s_vol, cursor->cluster) + (in_cluster / ENTRIES_PER_SECTOR);
+	sector = cache_fetch(*sector_number, HAL_CARD_DIRECTORY, option);
+	if (!sector) { return NULL; }
+
+	return &sector[(cursor->index++ % ENTRIES_PER_SECTOR) * ENTRY_SIZE];
+}
+
+/*
+ * find_entry
+ * Looks for a name in the root directory. Returns true if it's there, with
+ * where its entry is. If not, slot is the first free entry (or the end of
+ * the directory's clusters, with the last of them in cursor).
+ */
+static bool find_entry(const char * entry_name, struct dir_cursor * cursor, uint32_t * sector, uint8_t * index, bool * slot_found)
+{
+	struct dir_cursor slot;
+	uint32_t slot_sector = 0;
+	uint8_t * entry;
+
+	*slot_found = false;
+	dir_seek(cursor, 0);
+
+	while ((entry = dir_next(cursor, CACHE_READ, sector)) != NULL)
+	{
+		uint32_t entry_index = cursor->index - 1;
+
+		if ((entry[0] == 0) || (entry[0] == NAME_DELETED))
+		{
+			if (!*slot_found)
+			{
+				*slot_found = true;
+				slot = *cursor;
+				slot.index = entry_index;
+				slot_sector = *sector;
+			}
+			if (entry[0] == 0) { break; }
+			continue;
+		}
+
+		if (!(entry[DIR_ATTRIBUTES] & ATTR_VOLUME_ID) && (memcmp(entry, entry_name, 11) == 0))
+		{
+			*index = (uint8_t)(entry_index % ENTRIES_PER_SECTOR);
+			return true;
+		}
+	}
+
+	if (*slot_found)
+	{
+		*cursor = slot;
+		*sector = slot_sector;
+		*index = (uint8_t)(slot.index % ENTRIES_PER_SECTOR);
+	}
+	return false;
+}
+
+static bool open_entry(struct fat_file * file, uint32_t sector, uint8_t index, uint8_t oflag)
+{
+	uint8_t * entry = cache_fetch(sector, HAL_CARD_DIRECTORY, CACHE_READ);
+
+	if (!entry) { return false; }
+	entry += index * ENTRY_SIZE;
+
+	if (entry[DIR_ATTRIBUTES] & ATTR_DIRECTORY) { return false; }
+	if ((oflag & O_WRITE) && (entry[DIR_ATTRIBUTES] & ATTR_READ_ONLY)) { return false; }
+
+	memset(file, 0, sizeof(*file));
+	file->firstCluster = ((uint32_t)get16(&entry[DIR_CLUSTER_HIGH]) << 16) | get16(&entry[DIR_CLUSTER_LOW]);
+	file->fileSize = get32(&entry[DIR_FILE_SIZE]);
+	file->dirSector = sector;
+	file->dirIndex = index;
+	file->flags = oflag;
+	file->open = true;
+
+	if ((oflag & O_TRUNC) && (oflag & O_WRITE) && file->firstCluster)
+	{
+		if (!free_chain(file->firstCluster)) { file->open = false; return false; }
+		file->firstCluster = 0;
+		file->fileSize = 0;
+		file->dirDirty = true;
+		if (!FAT_Sync(file)) { file->open = false; return false; }
+	}
+	return true;
+}
+
+/*
+ * add_dir_cluster
+ * Adds a zeroed cluster to the root directory, after last
+ */
+static bool add_dir_cluster(uint32_t last, uint32_t * first_sector)
+{
+	uint32_t cluster;
+
+	if (!alloc_cluster(last, &cluster)) { return false; }
+
+	*first_sector = cluster_sector(&s_vol, cluster);
+	for (uint8_t i = 0; i < s_vol.sectorsPerCluster; i++)
+	{
+		if (!cache_fetch(*first_sector + i, HAL_CARD_DIRECTORY, CACHE_RESERVE) || !cache_sync()) { return false; }
+	}
+	return true;
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * FAT_Format
+ * Makes a FAT32 volume on a blank image, in one partition. The partition
+ * and the data area start on an erase block (align sectors), as the SD
+ * formatter lays a card out.
+ */
+bool FAT_Format(uint32_t sectors, uint8_t sectors_per_cluster, uint32_t align)
+{
+	uint8_t sector[SECTOR_SIZE];
+	uint32_t start = (align > 1) ? align : 63;
+	uint32_t reserved = 32;
+	uint32_t volume_sectors, fat_size, clusters;
+
+	if ((sectors_per_cluster == 0) || (sectors_per_cluster & (sectors_per_cluster - 1)) || (sectors <= start)) { return false; }
+
+	volume_sectors = sectors - start;
+	fat_size = ((((volume_sectors - reserved) / sectors_per_cluster) + 2) * 4 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	if (align > 1)
+	{
+		reserved += (align - ((start + reserved + (2 * fat_size)) % align)) % align;
+	}
+	if (volume_sectors <= reserved + (2 * fat_size)) { return false; }
+
+	clusters = (volume_sectors - reserved - (2 * fat_size)) / sectors_per_cluster;
+	if (clusters < MIN_FAT32_CLUSTERS) { return false; }
+
+	// MBR, one FAT32 (LBA) partition
+	memset(sector, 0, sizeof(sector));
+	sector[MBR_PARTITION + 4] = 0x0C;
+	put32(&sector[MBR_PARTITION + 8], start);
+	put32(&sector[MBR_PARTITION + 12], volume_sectors);
+	sector[510] = 0x55;
+	sector[511] = 0xAA;
+	if (!HAL_CardPokeSector(0, sector)) { return false; }
+
+	// Boot sector, and its backup at 6
+	memset(sector, 0, sizeof(sector));
+	memcpy(sector, "\xEB\x58\x90" "WINDLOGR", 11);
+	put16(&sector[BPB_BYTES_PER_SECTOR], SECTOR_SIZE);
+	sector[BPB_SECTORS_PER_CLUSTER] = sectors_per_cluster;
+	put16(&sector[BPB_RESERVED_SECTORS], (uint16_t)reserved);
+	sector[BPB_FAT_COUNT] = 2;
+	sector[21] = 0xF8;  // Media
+	put16(&sector[24], 63);  // Sectors per track
+	put16(&sector[26], 255);  // Heads
+	put32(&sector[BPB_HIDDEN_SECTORS], start);
+	put32(&sector[BPB_TOTAL_SECTORS_32], volume_sectors);
+	put32(&sector[BPB_FAT_SIZE_32], fat_size);
+	put32(&sector[BPB_ROOT_CLUSTER], 2);
+	put16(&sector[48], 1);  // FSInfo
+	put16(&sector[50], 6);  // Backup boot sector
+	sector[64] = 0x80;  // Drive
+	sector[66] = 0x29;  // Extended boot signature
+	put32(&sector[67], 0x57494E44);  // Volume ID
+	memcpy(&sector[71], "NO NAME    FAT32   ", 19);
+	sector[510] = 0x55;
+	sector[511] = 0xAA;
+	if (!HAL_CardPokeSector(start, sector) || !HAL_CardPokeSector(start + 6, sector)) { return false; }
+
+	// FSInfo, with the counts unknown
+	memset(sector, 0, sizeof(sector));
+	put32(&sector[0], 0x41615252);
+	put32(&sector[484], 0x61417272);
+	put32(&sector[488], 0xFFFFFFFF);
+	put32(&sector[492], 0xFFFFFFFF);
+	sector[510] = 0x55;
+	sector[511] = 0xAA;
+	if (!HAL_CardPokeSector(start + 1, sector) || !HAL_CardPokeSector(start + 7, sector)) { return false; }
+
+	// Both FATs: the reserved entries and the root directory's one cluster.
+	// The rest of the image is already zero.
+	memset(sector, 0, sizeof(sector));
+	put32(&sector[0], 0x0FFFFFF8);
+	put32(&sector[4], 0x0FFFFFFF);
+	put32(&sector[8], CLUSTER_EOC);
+	return HAL_CardPokeSector(start + reserved, sector) && HAL_CardPokeSector(start + reserved + fat_size, sector);
+}
+
+/*
+ * FAT_Mount
+ * SdFat's begin(): reads the MBR and boot sector. Anything in the cache is lost.
+ */
+bool FAT_Mount(void)
+{
+	cache_invalidate();
+	s_mounted = read_volume(&s_vol, HAL_CardReadSector);
+	s_allocSearch = 1;
+	return s_mounted;
+}
+
+/*
+ * FAT_Open
+ * Opens a file in the root directory, creating it for O_CREAT (with created set)
+ */
+bool FAT_Open(struct fat_file * file, const char * name, uint8_t oflag, bool * created)
+{
+	char entry_name[11];
+	struct dir_cursor cursor;
+	uint32_t sector;
+	uint8_t index = 0;
+	bool slot_found;
+
+	*created = false;
+	if (!s_mounted || !fat_name(name, entry_name)) { return false; }
+
+	if (find_entry(entry_name, &cursor, &sector, &index, &slot_found))
+	{
+		if ((oflag & O_CREAT) && (oflag & O_EXCL)) { return false; }
+		if (!open_entry(file, sector, index, oflag)) { return false; }
+	}
+	else
+	{
+		uint8_t * entry;
+
+		if (!(oflag & O_CREAT) || !(oflag & O_WRITE)) { return false; }
+
+		if (!slot_found)
+		{
+			// At the end of the directory's last cluster (not a read that failed part way)
+			if (cursor.index % ((uint32_t)s_vol.sectorsPerCluster * ENTRIES_PER_SECTOR)) { return false; }
+			if (!add_dir_cluster(cursor.cluster, &sector)) { return false; }
+			index = 0;
+		}
+
+		entry = cache_fetch(sector, HAL_CARD_DIRECTORY, CACHE_WRITE);
+		if (!entry) { return false; }
+		entry += index * ENTRY_SIZE;
+
+		memset(entry, 0, ENTRY_SIZE);
+		memcpy(entry, entry_name, 11);
+		entry[DIR_ATTRIBUTES] = ATTR_ARCHIVE;
+		put16(&entry[DIR_CREATE_DATE], FAT_DEFAULT_DATE);
+		put16(&entry[DIR_ACCESS_DATE], FAT_DEFAULT_DATE);
+		put16(&entry[DIR_MODIFY_DATE], FAT_DEFAULT_DATE);
+		if (!cache_sync()) { return false; }
+
+		memset(file, 0, sizeof(*file));
+		file->dirSector = sector;
+		file->dirIndex = index;
+		file->flags = oflag;
+		file->open = true;
+		*created = true;
+	}
+
+	if ((oflag & O_AT_END) && !FAT_SeekSet(file, file->fileSize))
+	{
+		file->open = false;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * FAT_OpenNext
+ * Opens the next file in the root directory from index, with its name.
+ * index is moved on past it.
+ */
+bool FAT_OpenNext(struct fat_file * file, uint16_t * index, uint8_t oflag, char * name)
+{
+	struct dir_cursor cursor;
+	uint32_t sector;
+	uint8_t * entry;
+
+	if (!s_mounted) { return false; }
+
+	dir_seek(&cursor, *index);
+	while (((entry = dir_next(&cursor, CACHE_READ, &sector)) != NULL) && (entry[0] != 0))
+	{
+		uint32_t entry_index = cursor.index - 1;
+
+		if ((entry[0] == NAME_DELETED) || (entry[0] == '.') || (entry[DIR_ATTRIBUTES] & (ATTR_VOLUME_ID | ATTR_DIRECTORY)))
+		{
+			continue;
+		}
+
+		card_name(entry, name);
+		*index = (uint16_t)cursor.index;
+		return open_entry(file, sector, (uint8_t)(entry_index % ENTRIES_PER_SECTOR), oflag);
+	}
+	return false;
+}
+
+/*
+ * FAT_Sync, FAT_Close
+ * Writes the directory entry if the file has grown, and the cache
+ */
+bool FAT_Sync(struct fat_file * file)
+{
+	if (!s_mounted || !file->open) { return false; }
+
+	if (file->dirDirty)
+	{
+		uint8_t * entry = cache_fetch(file->dirSector, HAL_CARD_DIRECTORY, CACHE_WRITE);
+		if (!entry) { return false; }
+		entry += file->dirIndex * ENTRY_SIZE;
+
+		if (entry[0] == NAME_DELETED) { return false; }
+
+		put32(&entry[DIR_FILE_SIZE], file->fileSize);
+		put16(&entry[DIR_CLUSTER_LOW], (uint16_t)file->firstCluster);
+		put16(&entry[DIR_CLUSTER_HIGH], (uint16_t)(file->firstCluster >> 16));
+		file->dirDirty = false;
+	}
+	return cache_sync();
+}
+
+bool FAT_Close(struct fat_file * file)
+{
+	bool synced = FAT_Sync(file);
+	file->open = false;
+	return synced;
+}
+
+int FAT_Read(struct fat_file * file, void * buffer, size_t count)
+{
+	uint8_t * dst = (uint8_t *)buffer;
+	size_t left;
+
+	if (!s_mounted || !file->open || !(file->flags & O_READ)) { return -1; }
+
+	if (count > file->fileSize - file->curPosition) { count = file->fileSize - file->curPosition; }
+	left = count;
+
+	while (left)
+	{
+		uint32_t offset = file->curPosition % SECTOR_SIZE;
+		uint32_t sector_of_cluster = (file->curPosition / SECTOR_SIZE) % s_vol.sectorsPerCluster;
+		size_t n = SECTOR_SIZE - offset;
+
+		if ((offset == 0) && (sector_of_cluster == 0))
+		{
+			if (file->curPosition == 0)
+			{
+				file->curCluster = file->firstCluster;
+			}
+			else if (!fat_get(file->curCluster, &file->curCluster))
+			{
+				return -1;
+			}
+		}
+
+		uint32_t sector = cluster_sector(&s_vol, file->curCluster) + sector_of_cluster;
+		if (n > left) { n = left; }
+
+		if ((n == SECTOR_SIZE) && (sector != s_cacheSector))
+		{
+			if (!HAL_CardReadSector(sector, dst)) { return -1; }
+		}
+		else
+		{
+			uint8_t * cached = cache_fetch(sector, HAL_CARD_DATA, CACHE_READ);
+			if (!cached) { return -1; }
+			memcpy(dst, cached + offset, n);
+		}
+
+		dst += n;
+		file->curPosition += (uint32_t)n;
+		left -= n;
+	}
+	return (int)count;
+}
+
+/*
+ * FAT_Write
+ * Returns the number of bytes written, which is short if the card failed
+ */
+size_t FAT_Write(struct fat_file * file, const uint8_t * buffer, size_t count)
+{
+	size_t left = count;
+
+	if (!s_mounted || !file->open || !(file->flags & O_WRITE)) { return 0; }
+
+	if ((file->flags & O_APPEND) && (file->curPosition != file->fileSize))
+	{
+		if (!FAT_SeekSet(file, file->fileSize)) { return 0; }
+	}
+
+	while (left)
+	{
+		uint32_t offset = file->curPosition % SECTOR_SIZE;
+		uint32_t sector_of_cluster = (file->curPosition / SECTOR_SIZE) % s_vol.sectorsPerCluster;
+		size_t n = SECTOR_SIZE - offset;
+
+		uint32_t cluster = file->curCluster;
+
+		if ((offset == 0) && (sector_of_cluster == 0))
+		{
+			// Into the next cluster, adding one at the end of the file. The file
+			// only moves into it once written, so a failed write can be retried.
+			if (cluster)
+			{
+				if (!fat_get(cluster, &cluster)) { break; }
+				if (is_eoc(cluster))
+				{
+					if (!alloc_cluster(file->curCluster, &cluster)) { break; }
+				}
+			}
+			else if (file->firstCluster == 0)
+			{
+				if (!alloc_cluster(0, &file->firstCluster)) { break; }
+				cluster = file->firstCluster;
+				file->dirDirty = true;
+			}
+			else
+			{
+				cluster = file->firstCluster;
+			}
+		}
+
+		uint32_t sector = cluster_sector(&s_vol, cluster) + sector_of_cluster;
+		if (n > left) { n = left; }
+
+		if (n == SECTOR_SIZE)
+		{
+			if (s_cacheSector == sector) { cache_invalidate(); }
+			if (!HAL_CardWriteSector(sector, buffer, HAL_CARD_DATA)) { break; }
+		}
+		else
+		{
+			// A new sector past the end of the file needn't be read
+			uint8_t option = ((offset == 0) && (file->curPosition >= file->fileSize)) ? CACHE_RESERVE : CACHE_WRITE;
+			uint8_t * cached = cache_fetch(sector, HAL_CARD_DATA, option);
+			if (!cached) { break; }
+
+			memcpy(cached + offset, buffer, n);
+			if ((offset + n == SECTOR_SIZE) && !cache_sync()) { break; }
+		}
+
+		file->curCluster = cluster;
+		buffer += n;
+		file->curPosition += (uint32_t)n;
+		left -= n;
+	}
+
+	if (file->curPosition > file->fileSize)
+	{
+		file->fileSize = file->curPosition;
+		file->dirDirty = true;
+	}
+
+	if ((file->flags & O_SYNC) && !FAT_Sync(file)) { return 0; }
+	return count - left;
+}
+
+bool FAT_SeekSet(struct fat_file * file, uint32_t position)
+{
+	uint32_t shift_bytes = cluster_bytes();
+	uint32_t clusters;
+
+	if (!s_mounted || !file->open || (position > file->fileSize)) { return false; }
+
+	if (position == 0)
+	{
+		file->curCluster = 0;
+		file->curPosition = 0;
+		return true;
+	}
+
+	// Walk on from the current cluster if the new position is at or after it
+	clusters = (position - 1) / shift_bytes;
+	if ((file->curPosition == 0) || (clusters < ((file->curPosition - 1) / shift_bytes)))
+	{
+		file->curCluster = file->firstCluster;
+	}
+	else
+	{
+		clusters -= (file->curPosition - 1) / shift_bytes;
+	}
+
+	while (clusters--)
+	{
+		if (!fat_get(file->curCluster, &file->curCluster)) { return false; }
+	}
+	file->curPosition = position;
+	return true;
+}
+
+bool FAT_Exists(const char * name)
+{
+	char entry_name[11];
+	struct dir_cursor cursor;
+	uint32_t sector;
+	uint8_t index;
+	bool slot_found;
+
+	return s_mounted && fat_name(name, entry_name) && find_entry(entry_name, &cursor, &sector, &index, &slot_found);
+}
+
+bool FAT_Remove(const char * name)
+{
+	char entry_name[11];
+	struct dir_cursor cursor;
+	struct fat_file file;
+	uint32_t sector;
+	uint8_t index;
+	bool slot_found;
+	uint8_t * entry;
+
+	if (!s_mounted || !fat_name(name, entry_name) || !find_entry(entry_name, &cursor, &sector, &index, &slot_found)) { return false; }
+	if (!open_entry(&file, sector, index, O_WRITE)) { return false; }
+
+	if (file.firstCluster && !free_chain(file.firstCluster)) { return false; }
+
+	entry = cache_fetch(sector, HAL_CARD_DIRECTORY, CACHE_WRITE);
+	if (!entry) { return false; }
+	entry[index * ENTRY_SIZE] = NAME_DELETED;
+	return cache_sync();
+}
+
+/*
+ * FAT_VisitFiles
+ * Each file in the root directory as it is on the card, read around the
+ * cache and without the card counting it
+ */
+bool FAT_VisitFiles(hal_card_visitor visit, void * param)
+{
+	struct volume vol;
+	uint8_t sector[SECTOR_SIZE];
+	uint8_t fat[SECTOR_SIZE];
+	uint32_t cluster;
+
+	if (!read_volume(&vol, HAL_CardPeekSector)) { return false; }
+
+	// Next in a chain, from the first FAT
+	auto next_cluster = [&](uint32_t current) -> uint32_t {
+		if (!HAL_CardPeekSector(vol.fatStart + (current / FAT_ENTRIES_PER_SECTOR), fat)) { return CLUSTER_EOC; }
+		return get32(&fat[(current % FAT_ENTRIES_PER_SECTOR) * 4]) & CLUSTER_MASK;
+	};
+
+	for (cluster = vol.rootCluster; (cluster >= 2) && !is_eoc(cluster); cluster = next_cluster(cluster))
+	{
+		for (uint8_t s = 0; s < vol.sectorsPerCluster; s++)
+		{
+			if (!HAL_CardPeekSector(cluster_sector(&vol, cluster) + s, sector)) { return false; }
+
+			for (uint8_t e = 0; e < ENTRIES_PER_SECTOR; e++)
+			{
+				const uint8_t * entry = &sector[e * ENTRY_SIZE];
+				char name[13];
+
+				if (entry[0] == 0) { return true; }
+				if ((entry[0] == NAME_DELETED) || (entry[0] == '.') || (entry[DIR_ATTRIBUTES] & (ATTR_VOLUME_ID | ATTR_DIRECTORY)))
+				{
+					continue;
+				}
+
+				uint32_t size = get32(&entry[DIR_FILE_SIZE]);
+				uint32_t data_cluster = ((uint32_t)get16(&entry[DIR_CLUSTER_HIGH]) << 16) | get16(&entry[DIR_CLUSTER_LOW]);
+				std::vector<uint8_t> data(size);
+
+				for (uint32_t done = 0; done < size; data_cluster = next_cluster(data_cluster))
+				{
+					if ((data_cluster < 2) || is_eoc(data_cluster)) { return false; }
+
+					for (uint8_t d = 0; (d < vol.sectorsPerCluster) && (done < size); d++)
+					{
+						uint8_t data_sector[SECTOR_SIZE];
+						uint32_t n = (size - done < SECTOR_SIZE) ? (size - done) : SECTOR_SIZE;
+
+						if (!HAL_CardPeekSector(cluster_sector(&vol, data_cluster) + d, data_sector)) { return false; }
+						memcpy(&data[done], data_sector, n);
+						done += n;
+					}
+				}
+
+				card_name(entry, name);
+				visit(name, data.data(), size, param);
+			}
+		}
+	}
+	return true;
+}
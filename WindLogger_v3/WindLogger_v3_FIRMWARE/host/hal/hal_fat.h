@@ -0,0 +1,44 @@
+#ifndef _HAL_FAT_H_
+#define _HAL_FAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hal.h"
+
+/*
+ * Defines and typedefs
+ */
+
+// An open file on the card image, kept in each SdBaseFile
+struct fat_file
+{
+	bool open;
+	uint8_t flags;			// O_READ, O_WRITE ...
+	bool dirDirty;			// Size or first cluster changed since the directory entry was written
+	uint8_t dirIndex;		// Entry in the directory sector
+	uint32_t dirSector;		// Sector holding the directory entry
+	uint32_t firstCluster;	// 0 while the file is empty
+	uint32_t curCluster;
+	uint32_t curPosition;
+	uint32_t fileSize;
+};
+
+// Public Functions
+
+bool FAT_Format(uint32_t sectors, uint8_t sectors_per_cluster, uint32_t align);
+bool FAT_Mount(void);
+
+bool FAT_Open(struct fat_file * file, const char * name, uint8_t oflag, bool * created);
+bool FAT_OpenNext(struct fat_file * file, uint16_t * index, uint8_t oflag, char * name);
+bool FAT_Sync(struct fat_file * file);
+bool FAT_Close(struct fat_file * file);
+int FAT_Read(struct fat_file * file, void * buffer, size_t count);
+size_t FAT_Write(struct fat_file * file, const uint8_t * buffer, size_t count);
+bool FAT_SeekSet(struct fat_file * file, uint32_t position);
+bool FAT_Exists(const char * name);
+bool FAT_Remove(const char * name);
+
+bool FAT_VisitFiles(hal_card_visitor visit, void * param);
+
+#endif
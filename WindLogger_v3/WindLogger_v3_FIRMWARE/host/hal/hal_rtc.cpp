@@ -0,0 +1,220 @@
+/*
+ * hal_rtc.cpp
+ *
+ * The PCF8563 RTC for the host build, through the Rtc_Pcf8563 and Wire libraries
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Rtc_Pcf8563.h>
+
+#include "hal.h"
+
+/*
+ * The RTC's time is a count of seconds from 2000-01-01 00:00:00, moved on by
+ * HAL_RtcTick() from the world's 1Hz CLKOUT (see world.cpp), so the time the
+ * firmware reads is always the one its tick interrupts imply.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define RTC_I2C_ADDRESS 0x51
+#define RTC_SECONDS_REGISTER 0x02
+
+#define SECONDS_PER_DAY 86400UL
+
+/*
+ * Private Variables
+ */
+
+static uint32_t s_seconds = 0;
+
+TwoWire Wire;
+
+/*
+ * Private Functions
+ */
+
+static uint8_t bcd_to_dec(uint8_t value)
+{
+	return ((value >> 4) * 10) + (value & 0x0F);
+}
+
+/*
+ * days_from_civil, civil_from_days
+ * Days from 2000-01-01 to a date, and back (proleptic Gregorian)
+ */
+static uint32_t days_from_civil(uint16_t year, uint8_t month, uint8_t day)
+{
+	year -= (month <= 2) ? 1 : 0;
+	uint32_t era = year / 400;
+	uint32_t year_of_era = year - (era * 400);
+	uint32_t day_of_year = (153 * (month + ((month > 2) ? -3 : 9)) + 2) / 5 + day - 1;
+	uint32_t day_of_era = (year_of_era * 365) + (year_of_era / 4) - (year_of_era / 100) + day_of_year;
+	return (era * 146097) + day_of_era - 730425;  // 730425 days from 0000-03-01 to 2000-01-01
+}
+
+static void civil_from_days(uint32_t days, uint16_t * year, uint8_t * month, uint8_t * day)
+{
+	uint32_t z = days + 730425;
+	uint32_t era = z / 146097;
+	uint32_t day_of_era = z - (era * 146097);
+	uint32_t year_of_era = (day_of_era - (day_of_era / 1460) + (day_of_era / 36524) - (day_of_era / 146096)) / 365;
+	uint32_t day_of_year = day_of_era - ((365 * year_of_era) + (year_of_era / 4) - (year_of_era / 100));
+	uint32_t mp = ((5 * day_of_year) + 2) / 153;
+
+	*day = (uint8_t)(day_of_year - ((153 * mp) + 2) / 5 + 1);
+	*month = (uint8_t)((mp < 10) ? (mp + 3) : (mp - 9));
+	*year = (uint16_t)((year_of_era + (era * 400)) + ((*month <= 2) ? 1 : 0));
+}
+
+static void set_rtc(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second)
+{
+	s_seconds = (days_from_civil(year, month, day) * SECONDS_PER_DAY) + (hour * 3600UL) + (minute * 60UL) + second;
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * HAL_RtcSet, HAL_RtcSeconds, HAL_RtcTick
+ * The RTC's time as seconds from 2000-01-01 00:00:00
+ */
+void HAL_RtcSet(uint32_t seconds)
+{
+	s_seconds = seconds;
+}
+
+uint32_t HAL_RtcSeconds(void)
+{
+	return s_seconds;
+}
+
+void HAL_RtcTick(void)
+{
+	s_seconds++;
+}
+
+/*
+ * TwoWire
+ * A write to the RTC from its seconds register on sets the time
+ * (as RTC_Setup does). Everything else on the bus is ignored.
+ */
+void TwoWire::beginTransmission(uint8_t address)
+{
+	m_address = address;
+	m_length = 0;
+}
+
+size_t TwoWire::write(uint8_t value)
+{
+	if (m_length >= sizeof(m_buffer)) { return 0; }
+
+	m_buffer[m_length++] = value;
+	return 1;
+}
+
+uint8_t TwoWire::endTransmission(void)
+{
+	if ((m_address != RTC_I2C_ADDRESS) || (m_length < 2)) { return 0; }
+
+	// m_buffer[0] is the first register written, the rest are the values
+	uint8_t first = m_buffer[0];
+	uint8_t registers[16];
+	bool written[16] = {false};
+
+	for (uint8_t i = 1; (i < m_length) && ((first + i - 1) < 16); i++)
+	{
+		registers[first + i - 1] = m_buffer[i];
+		written[first + i - 1] = true;
+	}
+
+	if (written[RTC_SECONDS_REGISTER] && written[RTC_SECONDS_REGISTER + 6])
+	{
+		set_rtc(
+			2000 + bcd_to_dec(registers[0x08]),
+			bcd_to_dec(registers[0x07] & 0x1F),
+			bcd_to_dec(registers[0x05] & 0x3F),
+			bcd_to_dec(registers[0x04] & 0x3F),
+			bcd_to_dec(registers[0x03] & 0x7F),
+			bcd_to_dec(registers[0x02] & 0x7F));
+	}
+	return 0;
+}
+
+/*
+ * Rtc_Pcf8563
+ */
+void Rtc_Pcf8563::getDate(void)
+{
+	uint16_t year;
+	uint32_t days = s_seconds / SECONDS_PER_DAY;
+
+	civil_from_days(days, &year, &m_month, &m_day);
+	m_year = (byte)(year % 100);
+	m_weekday = (byte)((days + 6) % 7);  // 2000-01-01 was a Saturday
+}
+
+void Rtc_Pcf8563::getTime(void)
+{
+	uint32_t time_of_day = s_seconds % SECONDS_PER_DAY;
+
+	m_hour = (byte)(time_of_day / 3600);
+	m_minute = (byte)((time_of_day / 60) % 60);
+	m_second = (byte)(time_of_day % 60);
+}
+
+void Rtc_Pcf8563::setDate(byte day, byte weekday, byte month, byte century, byte year)
+{
+	(void)weekday;
+	(void)century;
+
+	getTime();
+	set_rtc(2000 + year, month, day, m_hour, m_minute, m_second);
+}
+
+void Rtc_Pcf8563::setTime(byte hour, byte minute, byte second)
+{
+	uint32_t days = s_seconds / SECONDS_PER_DAY;
+	s_seconds = (days * SECONDS_PER_DAY) + (hour * 3600UL) + (minute * 60UL) + second;
+}
+
+char * Rtc_Pcf8563::formatTime(byte style)
+{
+	getTime();
+
+	if (style == RTCC_TIME_HM)
+	{
+		sprintf(m_strOut, "%02u:%02u", m_hour, m_minute);
+	}
+	else
+	{
+		sprintf(m_strOut, "%02u:%02u:%02u", m_hour, m_minute, m_second);
+	}
+	return m_strOut;
+}
+
+char * Rtc_Pcf8563::formatDate(byte style)
+{
+	getDate();
+
+	switch (style)
+	{
+		case RTCC_DATE_ASIA:
+			sprintf(m_strDate, "20%02u-%02u-%02u", m_year, m_month, m_day);
+			break;
+		case RTCC_DATE_US:
+			sprintf(m_strDate, "%02u/%02u/20%02u", m_month, m_day, m_year);
+			break;
+		default:
+			sprintf(m_strDate, "%02u-%02u-20%02u", m_day, m_month, m_year);
+			break;
+	}
+	return m_strDate;
+}
@@ -0,0 +1,394 @@
+/*
+ * hal_sd.cpp
+ *
+ * The SdFat library for the host build, on a directory standing in for the
+ * card, or a card image (hal_fat.cpp)
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <SdFat.h>
+
+#include "hal.h"
+#include "hal_fat.h"
+#include "sim.h"
+
+/*
+ * Names are kept in upper case, as SdFat's 8.3 names are on the card, so the
+ * firmware sees the same names and lookups ignore case in the same way.
+ *
+ * Each begin() is a new mount. Files opened before the card came out stay
+ * unusable after it goes back in, as they would be on the logger.
+ *
+ * With a card image every call goes to the FAT volume instead of a host
+ * file, and how long each one kept the firmware waiting on the card is
+ * timed for the report.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define NAME_LENGTH 12  // 8.3
+
+// Times an SdFat call, for the longest wait on the card
+class card_operation
+{
+public:
+	card_operation(const char * name) : m_name(name), m_start(SIM_Now()) {}
+	~card_operation() { HAL_CardTimeOperation(m_name, SIM_Now() - m_start); }
+
+private:
+	const char * m_name;
+	sim_time m_start;
+};
+
+/*
+ * Private Variables
+ */
+
+static char s_cardDirectory[PATH_MAX] = ".";
+static bool s_cardPresent = true;
+static uint32_t s_mount = 0;  // 0 while not mounted
+static uint32_t s_mounts = 0;
+
+static SdBaseFile s_root;
+
+/*
+ * Private Functions
+ */
+
+/*
+ * card_name, host_path
+ * A path on the card (only the root directory) as its 8.3 name and the host file
+ */
+static bool card_name(const char * path, char * name)
+{
+	uint8_t length = 0;
+
+	if (*path == '/') { path++; }
+
+	for (; *path; path++)
+	{
+		if ((*path == '/') || (length == NAME_LENGTH)) { return false; }
+		name[length++] = (char)toupper((unsigned char)*path);
+	}
+	name[length] = '\0';
+	return length > 0;
+}
+
+static std::string host_path(const char * name)
+{
+	return std::string(s_cardDirectory) + "/" + name;
+}
+
+static bool card_usable(void)
+{
+	return s_cardPresent && s_mount;
+}
+
+static bool host_file_exists(const char * name)
+{
+	struct stat info;
+	return (stat(host_path(name).c_str(), &info) == 0) && S_ISREG(info.st_mode);
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * HAL_SetCardDirectory
+ * Where the card's files are, made if it doesn't exist
+ */
+bool HAL_SetCardDirectory(const char * path)
+{
+	if ((mkdir(path, 0777) != 0) && (errno != EEXIST)) { return false; }
+
+	strncpy(s_cardDirectory, path, sizeof(s_cardDirectory) - 1);
+	return true;
+}
+
+/*
+ * HAL_SetCardPresent, HAL_CardPresent
+ * Takes the card out or puts it back (the card detect pin is the world's, see world.cpp)
+ */
+void HAL_SetCardPresent(bool present)
+{
+	s_cardPresent = present;
+	if (!present) { s_mount = 0; }
+}
+
+bool HAL_CardPresent(void)
+{
+	return s_cardPresent;
+}
+
+/*
+ * SdFat
+ */
+bool SdFat::begin(uint8_t cs_pin, uint8_t spi_speed)
+{
+	(void)cs_pin;
+	(void)spi_speed;
+
+	card_operation timed("begin");
+
+	if (!s_cardPresent) { return false; }
+	if (HAL_CardImageInUse() && !FAT_Mount()) { return false; }
+
+	s_mount = ++s_mounts;
+	s_root.close();
+	s_root.m_isRoot = true;
+	s_root.m_mount = s_mount;
+	s_root.m_next = 0;
+	return true;
+}
+
+bool SdFat::exists(const char * path)
+{
+	card_operation timed("exists");
+	char name[NAME_LENGTH + 1];
+
+	if (!card_usable() || !card_name(path, name)) { return false; }
+	return HAL_CardImageInUse() ? FAT_Exists(name) : host_file_exists(name);
+}
+
+bool SdFat::remove(const char * path)
+{
+	card_operation timed("remove");
+	char name[NAME_LENGTH + 1];
+
+	if (!card_usable() || !card_name(path, name)) { return false; }
+	return HAL_CardImageInUse() ? FAT_Remove(name) : (unlink(host_path(name).c_str()) == 0);
+}
+
+/*
+ * SdBaseFile
+ */
+SdBaseFile * SdBaseFile::cwd(void)
+{
+	return card_usable() ? &s_root : NULL;
+}
+
+bool SdBaseFile::usable(void) const
+{
+	return card_usable() && (m_mount == s_mount);
+}
+
+bool SdBaseFile::open(const char * path, uint8_t oflag)
+{
+	card_operation timed("open");
+	char name[NAME_LENGTH + 1];
+
+	if (isOpen() || !card_usable() || !card_name(path, name)) { return false; }
+
+	if (HAL_CardImageInUse())
+	{
+		bool created;
+		if (!FAT_Open(&m_fat, name, oflag, &created)) { return false; }
+		if (created) { HAL_CountCardFile(); }
+
+		strcpy(m_name, name);
+		m_flags = oflag;
+		m_mount = s_mount;
+		return true;
+	}
+
+	bool exists = host_file_exists(name);
+	const char * mode = "rb";
+
+	if (exists && (oflag & O_CREAT) && (oflag & O_EXCL)) { return false; }
+	if (!exists && !(oflag & O_CREAT)) { return false; }
+
+	if (oflag & O_WRITE)
+	{
+		mode = (!exists || (oflag & O_TRUNC)) ? "w+b" : "r+b";
+	}
+
+	m_file = fopen(host_path(name).c_str(), mode);
+	if (!m_file) { return false; }
+
+	if (!exists) { HAL_CountCardFile(); }
+	if (oflag & O_AT_END) { fseek(m_file, 0, SEEK_END); }
+
+	strcpy(m_name, name);
+	m_flags = oflag;
+	m_mount = s_mount;
+	return true;
+}
+
+/*
+ * openNext
+ * Opens the next file in the directory, in name order
+ */
+bool SdBaseFile::openNext(SdBaseFile * dir, uint8_t oflag)
+{
+	std::vector<std::string> names;
+	DIR * host_dir;
+	struct dirent * entry;
+
+	if (!dir || !dir->isDir() || !dir->usable() || isOpen()) { return false; }
+
+	if (HAL_CardImageInUse())
+	{
+		card_operation timed("openNext");
+
+		if (!FAT_OpenNext(&m_fat, &dir->m_next, oflag, m_name)) { return false; }
+		m_flags = oflag;
+		m_mount = s_mount;
+		return true;
+	}
+
+	host_dir = opendir(s_cardDirectory);
+	if (!host_dir) { return false; }
+
+	while ((entry = readdir(host_dir)) != NULL)
+	{
+		char name[NAME_LENGTH + 1];
+		if (card_name(entry->d_name, name) && (strcmp(name, entry->d_name) == 0) && host_file_exists(name))
+		{
+			names.push_back(name);
+		}
+	}
+	closedir(host_dir);
+	std::sort(names.begin(), names.end());
+
+	while (dir->m_next < names.size())
+	{
+		if (open(names[dir->m_next++].c_str(), oflag)) { return true; }
+	}
+	return false;
+}
+
+bool SdBaseFile::close(void)
+{
+	bool closed = true;
+
+	if (m_fat.open)
+	{
+		card_operation timed("close");
+		closed = usable() && FAT_Close(&m_fat);
+		m_fat.open = false;
+	}
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = NULL;
+	}
+	m_isRoot = false;
+	m_name[0] = '\0';
+	return closed;
+}
+
+bool SdBaseFile::sync(void)
+{
+	if (m_fat.open)
+	{
+		card_operation timed("sync");
+		return usable() && FAT_Sync(&m_fat);
+	}
+	return usable() && m_file && (fflush(m_file) == 0);
+}
+
+int SdBaseFile::read(void)
+{
+	uint8_t b;
+	return (read(&b, 1) == 1) ? b : -1;
+}
+
+int SdBaseFile::read(void * buffer, size_t count)
+{
+	if (m_fat.open)
+	{
+		card_operation timed("read");
+		return usable() ? FAT_Read(&m_fat, buffer, count) : -1;
+	}
+	if (!m_file || !usable() || !(m_flags & O_READ)) { return -1; }
+
+	fflush(m_file);  // Between a write and a read
+	return (int)fread(buffer, 1, count, m_file);
+}
+
+size_t SdBaseFile::write(uint8_t b)
+{
+	return write(&b, 1);
+}
+
+size_t SdBaseFile::write(const uint8_t * buffer, size_t size)
+{
+	size_t written;
+
+	if (m_fat.open)
+	{
+		card_operation timed("write");
+		written = usable() ? FAT_Write(&m_fat, buffer, size) : 0;
+		HAL_CountCardWrite(written);
+		return written;
+	}
+	if (!m_file || !usable() || !(m_flags & O_WRITE)) { return 0; }
+
+	if (m_flags & O_APPEND) { fseek(m_file, 0, SEEK_END); }
+
+	written = fwrite(buffer, 1, size, m_file);
+	HAL_CountCardWrite(written);
+	return written;
+}
+
+bool SdBaseFile::seekSet(uint32_t position)
+{
+	if (m_fat.open)
+	{
+		card_operation timed("seekSet");
+		return usable() && FAT_SeekSet(&m_fat, position);
+	}
+	if (!m_file || !usable() || (position > fileSize())) { return false; }
+
+	return fseek(m_file, position, SEEK_SET) == 0;
+}
+
+uint32_t SdBaseFile::curPosition(void) const
+{
+	if (m_fat.open) { return m_fat.curPosition; }
+	return m_file ? (uint32_t)ftell(m_file) : 0;
+}
+
+uint32_t SdBaseFile::fileSize(void) const
+{
+	if (m_fat.open) { return m_fat.fileSize; }
+	if (!m_file) { return 0; }
+
+	long position = ftell(m_file);
+	fseek(m_file, 0, SEEK_END);
+	long size = ftell(m_file);
+	fseek(m_file, position, SEEK_SET);
+	return (uint32_t)size;
+}
+
+void SdBaseFile::rewind(void)
+{
+	if (m_isRoot) { m_next = 0; }
+	if (m_fat.open) { seekSet(0); }
+	if (m_file) { fseek(m_file, 0, SEEK_SET); }
+}
+
+bool SdBaseFile::getName(char * name, size_t size)
+{
+	if (!isOpen() || (strlen(m_name) >= size)) { return false; }
+
+	strcpy(name, m_name);
+	return true;
+}
@@ -0,0 +1,19 @@
+#ifndef _UTIL_ATOMIC_H_
+#define _UTIL_ATOMIC_H_
+
+/*
+ * ATOMIC_BLOCK for the host build. Interrupts only run while the firmware
+ * waits (see sim.cpp), never in the middle of a block, so it just runs the block once.
+ */
+
+#include <stdint.h>
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define NONATOMIC_RESTORESTATE
+#define NONATOMIC_FORCEOFF
+
+#define ATOMIC_BLOCK(type) for (uint8_t hal_atomic_once = 1; hal_atomic_once; hal_atomic_once = 0)
+#define NONATOMIC_BLOCK(type) ATOMIC_BLOCK(type)
+
+#endif
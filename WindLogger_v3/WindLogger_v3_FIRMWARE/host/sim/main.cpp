@@ -0,0 +1,498 @@
+/*
+ * main.cpp
+ *
+ * Runs the Wind Data logger firmware on the host, in simulated time
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <getopt.h>
+
+#include <string>
+#include <vector>
+
+#include "hal.h"
+#include "sim.h"
+#include "world.h"
+#include "script.h"
+#include "stack.h"
+
+/*
+ * The sketch's setup() and loop() are run as the Arduino core would,
+ * until the simulated time is up, on a stack of their own (stack.cpp).
+ * Then the report says where the time went, what the logger wrote and
+ * how deep its stack went.
+ */
+
+void setup(void);
+void loop(void);
+
+/*
+ * Defines and Typedefs
+ */
+
+#define Y2K_UNIX_SECONDS 946684800L  // The RTC counts from 2000-01-01
+
+#define COMMAND_START (2 * SIM_SECOND)  // After the calibrate switch is seen
+#define COMMAND_SPACING (SIM_SECOND)
+
+#define FIRMWARE_STACK_SIZE (1024 * 1024)
+
+struct card_totals
+{
+	uint32_t files;
+	uint32_t dataFiles;
+	uint32_t records;
+	uint64_t bytes;
+};
+
+/*
+ * Private Variables
+ */
+
+static sim_time s_end;
+
+static const char s_usage[] =
+	"usage: windlogger_sim [options]\n"
+	"  --days N             simulated days to run (30)\n"
+	"  --start TIME         RTC time at the start, YYYY-MM-DDTHH:MM:SS (2026-10-19T00:00:00)\n"
+	"  --card DIR           directory standing in for the SD card (sim_card)\n"
+	"  --eeprom FILE        keep the EEPROM in this file between runs\n"
+	"  --serial FILE        write the serial output here (- for stdout)\n"
+	"  --script FILE        changes to make during the run (see script.cpp)\n"
+	"  --command TEXT       a serial command to send in calibrate mode at the start, e.g. S60E\n"
+	"  --wind M/S           mean wind speed (6)\n"
+	"  --battery VOLTS      battery voltage at night (12.4)\n"
+	"  --irradiance W/M2    irradiance at noon (800)\n"
+	"  --temperature C      mean temperature (10)\n"
+	"  --ext-volts VOLTS    external voltage (24)\n"
+	"  --ext-amps AMPS      external current (5)\n"
+	"  --a2 irradiance|volts  the sensor on A2 (irradiance)\n"
+	"  --seed N             weather seed (1)\n"
+	"  --card-image FILE    a FAT32 card image instead of the card directory, made if it doesn't exist\n"
+	"  --card-size MB       size of a new image (4096)\n"
+	"  --card-cluster KB    cluster size of a new image (32)\n"
+	"  --card-erase-block KB  the card's flash erase block (128)\n"
+	"  --card-open-blocks N   erase blocks the card writes into at once (2)\n"
+	"  --card-latency R,W,E   microseconds to read a sector, write one, and erase a block (100,250,20000)\n"
+	"  --card-fail-ppm N    sector writes that fail, per million (0)\n"
+	"  --card-endurance N   erase cycles an erase block lasts (3000)\n"
+	"  --card-extract DIR   copy the files on the card image to DIR at the end\n";
+
+/*
+ * Private Functions
+ */
+
+static bool parse_start(const char * text, uint32_t * start)
+{
+	struct tm fields;
+
+	memset(&fields, 0, sizeof(fields));
+	if (sscanf(text, "%d-%d-%dT%d:%d:%d", &fields.tm_year, &fields.tm_mon, &fields.tm_mday,
+		&fields.tm_hour, &fields.tm_min, &fields.tm_sec) != 6) { return false; }
+
+	fields.tm_year -= 1900;
+	fields.tm_mon -= 1;
+
+	time_t seconds = timegm(&fields);
+	if (seconds < Y2K_UNIX_SECONDS) { return false; }
+
+	*start = (uint32_t)(seconds - Y2K_UNIX_SECONDS);
+	return true;
+}
+
+/*
+ * total_file, total_card
+ * Counts the files on the card, and the records in the data files
+ * (D*.CSV, every line but the column headers)
+ */
+static void total_file(const char * name, const uint8_t * data, uint32_t size, void * param)
+{
+	struct card_totals * totals = (struct card_totals *)param;
+	bool data_file = (name[0] == 'D') && strstr(name, ".CSV");
+	bool line_start = true;
+
+	totals->files++;
+	if (data_file) { totals->dataFiles++; }
+	totals->bytes += size;
+
+	for (uint32_t i = 0; i < size; i++)
+	{
+		if (line_start && data_file && (data[i] != 'R'))
+		{
+			totals->records++;
+		}
+		line_start = (data[i] == '\n');
+	}
+}
+
+static void total_card(const char * directory, struct card_totals * totals)
+{
+	DIR * dir;
+	struct dirent * entry;
+
+	memset(totals, 0, sizeof(*totals));
+	if (HAL_CardImageInUse())
+	{
+		HAL_CardVisitFiles(total_file, totals);
+		return;
+	}
+
+	dir = opendir(directory);
+	if (!dir) { return; }
+
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (entry->d_name[0] == '.') { continue; }
+
+		std::string path = std::string(directory) + "/" + entry->d_name;
+		FILE * file = fopen(path.c_str(), "rb");
+		if (!file) { continue; }
+
+		std::vector<uint8_t> data;
+		int c;
+		while ((c = fgetc(file)) != EOF) { data.push_back((uint8_t)c); }
+		fclose(file);
+
+		total_file(entry->d_name, data.data(), (uint32_t)data.size(), totals);
+	}
+	closedir(dir);
+}
+
+/*
+ * extract_file
+ * Copies a file from the card image into the directory in param
+ */
+static void extract_file(const char * name, const uint8_t * data, uint32_t size, void * param)
+{
+	std::string path = std::string((const char *)param) + "/" + name;
+	FILE * file = fopen(path.c_str(), "wb");
+
+	if (!file || (fwrite(data, 1, size, file) != size))
+	{
+		fprintf(stderr, "%s: can't write the file from the card\n", path.c_str());
+	}
+	if (file) { fclose(file); }
+}
+
+/*
+ * parse_latency
+ * "R,W,E" microseconds for a sector read, a sector write and an erase
+ */
+static bool parse_latency(const char * text, struct hal_card_config * card)
+{
+	unsigned read_us, write_us, erase_us;
+
+	if (sscanf(text, "%u,%u,%u", &read_us, &write_us, &erase_us) != 3) { return false; }
+
+	card->readUs = read_us;
+	card->writeUs = write_us;
+	card->eraseUs = erase_us;
+	return true;
+}
+
+static double years(double erase_cycles, double erases_per_day)
+{
+	return erase_cycles / erases_per_day / 365.25;
+}
+
+/*
+ * report_card_image
+ * What the card image's sectors and flash went through, per record,
+ * and how long the card would last at that rate
+ */
+static void report_card_image(const struct hal_card_config * config, const struct hal_stats * stats, const struct card_totals * totals)
+{
+	static const char * const s_kindNames[HAL_CARD_KIND_COUNT] = {"data", "directory", "FAT", "system"};
+	struct hal_card_stats card;
+	double days = (double)SIM_Now() / (86400.0 * SIM_SECOND);
+
+	HAL_GetCardStats(&card);
+
+	fprintf(stderr, "Card image (%luMB, %uKB erase blocks, %u open, %u/%u/%uus read/write/erase)\n",
+		(unsigned long)((uint64_t)card.sectors * 512 / (1024 * 1024)), (unsigned)config->eraseBlockKB, config->openBlocks,
+		(unsigned)config->readUs, (unsigned)config->writeUs, (unsigned)config->eraseUs);
+	fprintf(stderr, "  %-18s %10llu\n", "sectors read", (unsigned long long)card.sectorsRead);
+	fprintf(stderr, "  %-18s %10llu (", "sectors written", (unsigned long long)card.sectorsWritten);
+	for (uint8_t kind = 0; kind < HAL_CARD_KIND_COUNT; kind++)
+	{
+		fprintf(stderr, "%s%llu %s", kind ? ", " : "", (unsigned long long)card.sectorsWrittenAs[kind], s_kindNames[kind]);
+	}
+	fprintf(stderr, ")\n");
+	fprintf(stderr, "  %-18s %10lu (sector %lu written %lu times)\n", "distinct sectors", (unsigned long)card.distinctSectors,
+		(unsigned long)card.mostWritten, (unsigned long)card.mostWrites);
+	fprintf(stderr, "  %-18s %10llu (most erased block %lu times)\n", "erases", (unsigned long long)card.erases, (unsigned long)card.mostErases);
+	fprintf(stderr, "  %-18s %10lu\n", "write failures", (unsigned long)card.writeFailures);
+	fprintf(stderr, "  %-18s %14.3fs (longest call %.1fms, %s)\n", "waiting on card", (double)card.busyTime / SIM_SECOND,
+		(double)card.longestOperation / SIM_MILLISECOND, card.longestOperationName ? card.longestOperationName : "none");
+
+	if (totals->records)
+	{
+		fprintf(stderr, "Card per record\n");
+		fprintf(stderr, "  %-18s %14.1f\n", "bytes written", (double)stats->cardBytesWritten / totals->records);
+		fprintf(stderr, "  %-18s %14.3f (", "sectors written", (double)card.sectorsWritten / totals->records);
+		for (uint8_t kind = 0; kind < HAL_CARD_KIND_COUNT; kind++)
+		{
+			fprintf(stderr, "%s%.3f %s", kind ? ", " : "", (double)card.sectorsWrittenAs[kind] / totals->records, s_kindNames[kind]);
+		}
+		fprintf(stderr, ")\n");
+		fprintf(stderr, "  %-18s %14.1f\n", "write amplification",
+			stats->cardBytesWritten ? (512.0 * card.sectorsWritten / stats->cardBytesWritten) : 0.0);
+		fprintf(stderr, "  %-18s %14.3f\n", "erases", (double)card.erases / totals->records);
+	}
+
+	if ((days > 0.0) && card.erases)
+	{
+		fprintf(stderr, "Card life (%u erase cycles)\n", (unsigned)config->endurance);
+		fprintf(stderr, "  %-18s %14.1f years\n", "wear levelled",
+			years((double)card.eraseBlocks * config->endurance, card.erases / days));
+		fprintf(stderr, "  %-18s %14.1f years\n", "without levelling",
+			years(config->endurance, card.mostErases / days));
+	}
+}
+
+/*
+ * run_firmware
+ * The Arduino core's main(), on the firmware's stack
+ */
+static void run_firmware(void)
+{
+	setup();
+	while ((SIM_Now() < s_end) && !SCRIPT_Stopped())
+	{
+		loop();
+		STACK_Check();
+	}
+}
+
+static void print_time(const char * name, sim_time time, sim_time total)
+{
+	fprintf(stderr, "  %-18s %14.3fs %7.3f%%\n", name, (double)time / SIM_SECOND, total ? (100.0 * time / total) : 0.0);
+}
+
+static void report(const char * card, const struct hal_card_config * card_config, clock_t host_clocks)
+{
+	struct hal_stats stats;
+	struct card_totals totals;
+	sim_time total = SIM_Now();
+
+	HAL_GetStats(&stats);
+	total_card(card, &totals);
+
+	fprintf(stderr, "Simulated %.1f days in %.2fs\n", (double)total / (86400.0 * SIM_SECOND), (double)host_clocks / CLOCKS_PER_SEC);
+
+	fprintf(stderr, "CPU time\n");
+	for (uint8_t state = 0; state < SIM_STATE_COUNT; state++)
+	{
+		print_time(SIM_StateName(state), SIM_TimeIn(state), total);
+	}
+
+	fprintf(stderr, "Interrupts\n");
+	for (uint8_t src = 0; src < SIM_SRC_COUNT; src++)
+	{
+		fprintf(stderr, "  %-18s %10lu\n", SIM_SourceName(src), (unsigned long)SIM_Interrupts(src));
+	}
+	fprintf(stderr, "  %-18s %10lu, %lu\n", "anemometer pulses", (unsigned long)WORLD_Pulses(0), (unsigned long)WORLD_Pulses(1));
+
+	fprintf(stderr, "Card\n");
+	fprintf(stderr, "  %-18s %10lu (%lu data files)\n", "files", (unsigned long)totals.files, (unsigned long)totals.dataFiles);
+	fprintf(stderr, "  %-18s %10lu\n", "files created", (unsigned long)stats.cardFilesCreated);
+	fprintf(stderr, "  %-18s %10lu\n", "records", (unsigned long)totals.records);
+	fprintf(stderr, "  %-18s %10lu (%llu on the card)\n", "bytes written", (unsigned long)stats.cardBytesWritten, (unsigned long long)totals.bytes);
+
+	fprintf(stderr, "Serial\n");
+	fprintf(stderr, "  %-18s %10lu\n", "bytes sent", (unsigned long)stats.serialBytesOut);
+	fprintf(stderr, "  %-18s %10lu (%lu lost)\n", "bytes received", (unsigned long)stats.serialBytesIn, (unsigned long)stats.serialBytesLost);
+
+	fprintf(stderr, "EEPROM\n");
+	fprintf(stderr, "  %-18s %10lu\n", "bytes written", (unsigned long)stats.eepromBytesWritten);
+	fprintf(stderr, "  %-18s %10lu (address %u)\n", "most writes", (unsigned long)stats.eepromMostWrites, stats.eepromMostWritten);
+
+	if (HAL_CardImageInUse()) { report_card_image(card_config, &stats, &totals); }
+
+	sim_time deepest_at = STACK_DeepestAt() / SIM_SECOND;
+	fprintf(stderr, "Stack\n");
+	fprintf(stderr, "  %-18s %10lu bytes, host (day %lu %02lu:%02lu:%02lu)\n", "deepest", (unsigned long)STACK_Deepest(),
+		(unsigned long)(deepest_at / 86400), (unsigned long)((deepest_at / 3600) % 24),
+		(unsigned long)((deepest_at / 60) % 60), (unsigned long)(deepest_at % 60));
+
+	if (totals.records)
+	{
+		fprintf(stderr, "Per record\n");
+		for (uint8_t state = 0; state < SIM_STATE_POWER_DOWN; state++)
+		{
+			fprintf(stderr, "  %-18s %14.3fms\n", SIM_StateName(state), (double)SIM_TimeIn(state) / SIM_MILLISECOND / totals.records);
+		}
+	}
+}
+
+/*
+ * Public Functions
+ */
+
+int main(int argc, char ** argv)
+{
+	static const struct option s_options[] = {
+		{"days", required_argument, NULL, 'd'},
+		{"start", required_argument, NULL, 't'},
+		{"card", required_argument, NULL, 'c'},
+		{"eeprom", required_argument, NULL, 'e'},
+		{"serial", required_argument, NULL, 'o'},
+		{"script", required_argument, NULL, 's'},
+		{"command", required_argument, NULL, 'k'},
+		{"wind", required_argument, NULL, 'w'},
+		{"battery", required_argument, NULL, 'b'},
+		{"irradiance", required_argument, NULL, 'i'},
+		{"temperature", required_argument, NULL, 'T'},
+		{"ext-volts", required_argument, NULL, 'V'},
+		{"ext-amps", required_argument, NULL, 'A'},
+		{"a2", required_argument, NULL, '2'},
+		{"seed", required_argument, NULL, 'r'},
+		{"card-image", required_argument, NULL, 'I'},
+		{"card-size", required_argument, NULL, 'Z'},
+		{"card-cluster", required_argument, NULL, 'C'},
+		{"card-erase-block", required_argument, NULL, 'E'},
+		{"card-open-blocks", required_argument, NULL, 'O'},
+		{"card-latency", required_argument, NULL, 'L'},
+		{"card-fail-ppm", required_argument, NULL, 'F'},
+		{"card-endurance", required_argument, NULL, 'N'},
+		{"card-extract", required_argument, NULL, 'X'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	struct world_config world = {1, 0, 6.0f, 12.4f, 800.0f, 10.0f, 24.0f, 5.0f, true};
+	struct hal_card_config card_config = {NULL, 4096, 32, 128, 2, 100, 250, 20000, 0, 3000, 1};
+	double days = 30.0;
+	const char * card = "sim_card";
+	const char * eeprom = NULL;
+	const char * serial = NULL;
+	const char * script = NULL;
+	const char * extract = NULL;
+	unsigned commands = 0;
+	FILE * serial_out = NULL;
+	int option;
+
+	parse_start("2026-10-19T00:00:00", &world.start);
+
+	while ((option = getopt_long(argc, argv, "", s_options, NULL)) != -1)
+	{
+		switch (option)
+		{
+			case 'd': days = atof(optarg); break;
+			case 'c': card = optarg; break;
+			case 'e': eeprom = optarg; break;
+			case 'o': serial = optarg; break;
+			case 's': script = optarg; break;
+			case 'w': world.windMean = atof(optarg); break;
+			case 'b': world.batteryVolts = atof(optarg); break;
+			case 'i': world.irradiancePeak = atof(optarg); break;
+			case 'T': world.temperatureMean = atof(optarg); break;
+			case 'V': world.externalVolts = atof(optarg); break;
+			case 'A': world.externalAmps = atof(optarg); break;
+			case 'r': world.seed = strtoul(optarg, NULL, 0); break;
+			case 'I': card_config.image = optarg; break;
+			case 'Z': card_config.sizeMB = strtoul(optarg, NULL, 0); break;
+			case 'C': card_config.clusterKB = (uint8_t)strtoul(optarg, NULL, 0); break;
+			case 'E': card_config.eraseBlockKB = strtoul(optarg, NULL, 0); break;
+			case 'O': card_config.openBlocks = (uint8_t)strtoul(optarg, NULL, 0); break;
+			case 'F': card_config.failPpm = strtoul(optarg, NULL, 0); break;
+			case 'N': card_config.endurance = strtoul(optarg, NULL, 0); break;
+			case 'X': extract = optarg; break;
+			case 'L':
+				if (!parse_latency(optarg, &card_config))
+				{
+					fprintf(stderr, "--card-latency is READ,WRITE,ERASE in microseconds\n");
+					return 1;
+				}
+				break;
+			case 't':
+				if (!parse_start(optarg, &world.start))
+				{
+					fprintf(stderr, "--start %s: expected YYYY-MM-DDTHH:MM:SS from 2000 on\n", optarg);
+					return 1;
+				}
+				break;
+			case '2':
+				if (strcmp(optarg, "irradiance") && strcmp(optarg, "volts"))
+				{
+					fprintf(stderr, "--a2 is irradiance or volts\n");
+					return 1;
+				}
+				world.a2IsIrradiance = (strcmp(optarg, "irradiance") == 0);
+				break;
+			case 'k':
+				// Each command a second apart, with the calibrate switch on around them
+				SCRIPT_Add(COMMAND_START + (commands++ * COMMAND_SPACING), (std::string("send ") + optarg).c_str());
+				break;
+			default:
+				fputs(s_usage, stderr);
+				return (option == 'h') ? 0 : 1;
+		}
+	}
+
+	if (commands)
+	{
+		SCRIPT_Add(0, "calibrate on");
+		SCRIPT_Add(COMMAND_START + (commands * COMMAND_SPACING) + SIM_SECOND, "calibrate off");
+	}
+
+	if (script && !SCRIPT_Load(script)) { return 1; }
+
+	if (serial)
+	{
+		serial_out = (strcmp(serial, "-") == 0) ? stdout : fopen(serial, "wb");
+		if (!serial_out)
+		{
+			fprintf(stderr, "%s: can't open the serial output\n", serial);
+			return 1;
+		}
+	}
+
+	HAL_Init();
+	card_config.seed = world.seed;
+	if (card_config.image && !HAL_CardOpenImage(&card_config))
+	{
+		fprintf(stderr, "%s: can't open or make the card image (FAT32 needs 65525 clusters or more)\n", card_config.image);
+		return 1;
+	}
+	if (!card_config.image && !HAL_SetCardDirectory(card))
+	{
+		fprintf(stderr, "%s: can't make the card directory\n", card);
+		return 1;
+	}
+	if (eeprom) { HAL_EepromLoad(eeprom); }
+	HAL_SetSerialOutput(serial_out);
+
+	WORLD_Setup(&world);
+	SCRIPT_Start();
+
+	clock_t host_start = clock();
+	s_end = (sim_time)(days * 86400.0 * SIM_SECOND);
+
+	if (!STACK_Run(run_firmware, FIRMWARE_STACK_SIZE))
+	{
+		fprintf(stderr, "can't make the firmware's stack\n");
+		return 1;
+	}
+
+	clock_t host_clocks = clock() - host_start;
+
+	if (eeprom && !HAL_EepromSave(eeprom))
+	{
+		fprintf(stderr, "%s: can't save the EEPROM\n", eeprom);
+	}
+	if (serial_out && (serial_out != stdout)) { fclose(serial_out); }
+
+	report(card, &card_config, host_clocks);
+	if (extract && HAL_CardImageInUse()) { HAL_CardVisitFiles(extract_file, (void *)extract); }
+	HAL_CardCloseImage();
+	return 0;
+}
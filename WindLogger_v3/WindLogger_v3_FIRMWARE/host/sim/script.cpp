@@ -0,0 +1,287 @@
+/*
+ * script.cpp
+ *
+ * Scripted changes to the simulated logger's world
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "hal.h"
+#include "sim.h"
+#include "world.h"
+#include "script.h"
+
+/*
+ * A script has one change per line, at a time from the start of the run:
+ *
+ *   <time> <action> [argument]
+ *
+ * The time is in seconds, or with suffixes of s, m, h and d (e.g. 90m, 2.5d, 1h30m).
+ * Blank lines and lines starting with # are ignored. The actions are:
+ *
+ *   calibrate on|off   Sets the calibrate switch
+ *   send TEXT          Sends the rest of the line to the serial port, a byte at a time
+ *   card out|in        Takes the SD card out or puts it back
+ *   card fail N        The card image's next N sector writes fail
+ *   card pull N        The card comes out during the card image's Nth sector write from now
+ *   wind M/S           Changes the mean wind speed
+ *   battery VOLTS      Changes the battery voltage
+ *   stop               Ends the run
+ *
+ * Changes at the same time are made in the order they are listed.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+struct script_entry
+{
+	sim_time when;
+	std::string action;
+	std::string argument;
+};
+
+/*
+ * Private Variables
+ */
+
+static std::vector<struct script_entry> s_entries;
+static size_t s_next = 0;
+static bool s_stopped = false;
+
+/*
+ * Private Functions
+ */
+
+static bool parse_time(const char * text, sim_time * when)
+{
+	double seconds = 0.0;
+
+	// Any number of parts, e.g. 1d6h or 90
+	do
+	{
+		char * end;
+		double value = strtod(text, &end);
+		double scale = 1.0;
+
+		if ((end == text) || (value < 0.0)) { return false; }
+
+		switch (*end)
+		{
+			case 'd': scale = 86400.0; end++; break;
+			case 'h': scale = 3600.0; end++; break;
+			case 'm': scale = 60.0; end++; break;
+			case 's': end++; break;
+			default: break;
+		}
+		seconds += value * scale;
+		text = end;
+	} while (*text);
+
+	*when = (sim_time)((seconds * SIM_SECOND) + 0.5);
+	return true;
+}
+
+static bool is_on(const std::string & argument, const char * on, const char * off, bool * result)
+{
+	if (argument == on) { *result = true; return true; }
+	if (argument == off) { *result = false; return true; }
+	return false;
+}
+
+/*
+ * card_failure
+ * "fail N" or "pull N". Returns true for a pull.
+ */
+static bool card_failure(const std::string & argument, uint32_t * writes)
+{
+	bool pull = argument.compare(0, 5, "pull ") == 0;
+	*writes = (uint32_t)strtoul(argument.c_str() + 5, NULL, 10);
+	return pull;
+}
+
+static bool is_card_failure(const std::string & argument)
+{
+	char * end;
+
+	if ((argument.compare(0, 5, "fail ") != 0) && (argument.compare(0, 5, "pull ") != 0)) { return false; }
+	return (strtoul(argument.c_str() + 5, &end, 10) > 0) && (*end == '\0');
+}
+
+/*
+ * run_entry
+ * Makes one change. Returns true if it ran a pin interrupt.
+ */
+static bool run_entry(const struct script_entry & entry)
+{
+	bool on = false;
+
+	if (entry.action == "calibrate" && is_on(entry.argument, "on", "off", &on))
+	{
+		return WORLD_SetCalibrate(on);
+	}
+	if (entry.action == "card" && is_on(entry.argument, "in", "out", &on))
+	{
+		return WORLD_SetCardPresent(on);
+	}
+	if (entry.action == "card")
+	{
+		uint32_t writes;
+		bool pull = card_failure(entry.argument, &writes);
+		if (pull) { HAL_CardPull(writes); } else { HAL_CardFail(writes); }
+		return false;
+	}
+	if (entry.action == "send")
+	{
+		HAL_SerialReceive(entry.argument.c_str());
+		return false;
+	}
+	if (entry.action == "wind")
+	{
+		WORLD_SetWindMean(strtof(entry.argument.c_str(), NULL));
+		return false;
+	}
+	if (entry.action == "battery")
+	{
+		WORLD_SetBatteryVolts(strtof(entry.argument.c_str(), NULL));
+		return false;
+	}
+	s_stopped = true;  // "stop"
+	return false;
+}
+
+/*
+ * script_due
+ * Makes the changes due now and schedules the next
+ */
+static bool script_due(void)
+{
+	bool interrupted = false;
+
+	while ((s_next < s_entries.size()) && (s_entries[s_next].when <= SIM_Now()))
+	{
+		interrupted |= run_entry(s_entries[s_next++]);
+	}
+
+	if (s_next < s_entries.size())
+	{
+		SIM_Schedule(SIM_SRC_SCRIPT, s_entries[s_next].when);
+	}
+	return interrupted;
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * SCRIPT_Add
+ * Adds one change, e.g. SCRIPT_Add(2 * SIM_SECOND, "send S60E").
+ * Returns false if it isn't a change the script knows.
+ */
+bool SCRIPT_Add(sim_time when, const char * action)
+{
+	struct script_entry entry;
+	const char * space = strchr(action, ' ');
+
+	entry.when = when;
+	entry.action = space ? std::string(action, space - action) : std::string(action);
+	entry.argument = space ? std::string(space + 1) : std::string();
+
+	bool on;
+
+	if (entry.action == "calibrate")
+	{
+		if (!is_on(entry.argument, "on", "off", &on)) { return false; }
+	}
+	else if (entry.action == "card")
+	{
+		if (!is_on(entry.argument, "in", "out", &on) && !is_card_failure(entry.argument)) { return false; }
+	}
+	else if ((entry.action == "wind") || (entry.action == "battery"))
+	{
+		if (entry.argument.empty()) { return false; }
+	}
+	else if ((entry.action != "send") && (entry.action != "stop"))
+	{
+		return false;
+	}
+
+	s_entries.push_back(entry);
+	return true;
+}
+
+/*
+ * SCRIPT_Load
+ * Adds the changes in a script file
+ */
+bool SCRIPT_Load(const char * path)
+{
+	char line[256];
+	unsigned line_number = 0;
+	FILE * file = fopen(path, "r");
+
+	if (!file)
+	{
+		fprintf(stderr, "%s: can't open the script\n", path);
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), file))
+	{
+		char * time = line;
+		sim_time when;
+
+		line_number++;
+		line[strcspn(line, "\r\n")] = '\0';
+		while (*time == ' ' || *time == '\t') { time++; }
+		if ((*time == '\0') || (*time == '#')) { continue; }
+
+		char * action = time + strcspn(time, " \t");
+		if (*action) { *action++ = '\0'; }
+		while (*action == ' ' || *action == '\t') { action++; }
+
+		if (!parse_time(time, &when) || !SCRIPT_Add(when, action))
+		{
+			fprintf(stderr, "%s:%u: can't make sense of this line\n", path, line_number);
+			fclose(file);
+			return false;
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+/*
+ * SCRIPT_Start
+ * Puts the changes in time order and schedules the first
+ */
+void SCRIPT_Start(void)
+{
+	std::stable_sort(s_entries.begin(), s_entries.end(),
+		[](const struct script_entry & a, const struct script_entry & b) { return a.when < b.when; });
+
+	SIM_SetHandler(SIM_SRC_SCRIPT, script_due);
+	s_next = 0;
+	if (!s_entries.empty())
+	{
+		SIM_Schedule(SIM_SRC_SCRIPT, s_entries[0].when);
+	}
+}
+
+bool SCRIPT_Stopped(void)
+{
+	return s_stopped;
+}
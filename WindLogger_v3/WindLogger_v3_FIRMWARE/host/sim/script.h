@@ -0,0 +1,11 @@
+#ifndef _SCRIPT_H_
+#define _SCRIPT_H_
+
+// Public Functions
+
+bool SCRIPT_Load(const char * path);
+bool SCRIPT_Add(sim_time when, const char * action);
+void SCRIPT_Start(void);
+bool SCRIPT_Stopped(void);
+
+#endif
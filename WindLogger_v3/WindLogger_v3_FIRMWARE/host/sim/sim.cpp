@@ -0,0 +1,250 @@
+/*
+ * sim.cpp
+ *
+ * Discrete event scheduler for the host build of the Wind Data logger
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <avr/sleep.h>
+
+#include "sim.h"
+
+/*
+ * The firmware runs in zero simulated time. Time only moves on when it
+ * waits: in sleep_cpu(), delay(), or a busy-wait such as Serial.flush().
+ * Each source (the RTC clock, anemometer pulses, the ADC ...) has the time it
+ * is next due. A wait jumps straight to the earliest due source that runs in
+ * the CPU's current state and calls its handler, which reschedules it.
+ *
+ * A sleep ends at the first handler that ran an interrupt, as on the AVR.
+ * Sources whose clock is stopped in a sleep mode (the ADC in power-down,
+ * the USART and Timer2 in anything but idle) are held until the CPU wakes.
+ *
+ * Nothing here reads the host clock, so a run is the same every time.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define SOURCE_BIT(source) (1U << (source))
+
+#define ALWAYS_RUNNING (SOURCE_BIT(SIM_SRC_RTC) | SOURCE_BIT(SIM_SRC_ANEMOMETER1) | SOURCE_BIT(SIM_SRC_ANEMOMETER2) | \
+	SOURCE_BIT(SIM_SRC_WATCHDOG) | SOURCE_BIT(SIM_SRC_USART_RX) | SOURCE_BIT(SIM_SRC_SCRIPT))
+
+/*
+ * Private Variables
+ */
+
+// The sources running in each state, in sim_state order
+static const uint16_t s_running[SIM_STATE_COUNT] = {
+	ALWAYS_RUNNING | SOURCE_BIT(SIM_SRC_TIMER2) | SOURCE_BIT(SIM_SRC_ADC) | SOURCE_BIT(SIM_SRC_USART_TX),
+	ALWAYS_RUNNING | SOURCE_BIT(SIM_SRC_TIMER2) | SOURCE_BIT(SIM_SRC_ADC) | SOURCE_BIT(SIM_SRC_USART_TX),
+	ALWAYS_RUNNING | SOURCE_BIT(SIM_SRC_ADC),
+	ALWAYS_RUNNING
+};
+
+static const char * const s_sourceNames[SIM_SRC_COUNT] = {
+	"RTC", "anemometer 1", "anemometer 2", "watchdog", "timer2", "ADC", "serial TX", "serial RX", "script"
+};
+
+static const char * const s_stateNames[SIM_STATE_COUNT] = {
+	"awake (waiting)", "idle sleep", "ADC sleep", "power-down"
+};
+
+static sim_time s_now = 0;
+static uint8_t s_state = SIM_STATE_AWAKE;
+static sim_time s_due[SIM_SRC_COUNT] = {
+	SIM_NEVER, SIM_NEVER, SIM_NEVER, SIM_NEVER, SIM_NEVER, SIM_NEVER, SIM_NEVER, SIM_NEVER, SIM_NEVER
+};
+static sim_handler s_handlers[SIM_SRC_COUNT];
+
+static sim_time s_timeIn[SIM_STATE_COUNT];
+static uint32_t s_interrupts[SIM_SRC_COUNT];
+
+/*
+ * Private Functions
+ */
+
+/*
+ * next_source
+ * Returns the earliest due source that runs in the state, or SIM_SRC_COUNT if none
+ */
+static uint8_t next_source(uint8_t state)
+{
+	uint8_t next = SIM_SRC_COUNT;
+	sim_time due = SIM_NEVER;
+
+	for (uint8_t src = 0; src < SIM_SRC_COUNT; src++)
+	{
+		if ((s_running[state] & SOURCE_BIT(src)) && (s_due[src] < due))
+		{
+			due = s_due[src];
+			next = src;
+		}
+	}
+	return next;
+}
+
+/*
+ * advance
+ * Moves time on to a source in the state and runs it.
+ * Returns true if it ran an interrupt.
+ */
+static bool advance(uint8_t state, uint8_t src)
+{
+	sim_time due = s_due[src];
+
+	if (due > s_now)
+	{
+		s_timeIn[state] += due - s_now;
+		s_now = due;
+	}
+
+	s_due[src] = SIM_NEVER;
+	s_state = state;
+	bool interrupted = s_handlers[src] ? s_handlers[src]() : false;
+	s_state = SIM_STATE_AWAKE;
+
+	if (interrupted) { s_interrupts[src]++; }
+	return interrupted;
+}
+
+static uint8_t state_for_sleep_mode(uint8_t sleep_mode)
+{
+	switch (sleep_mode)
+	{
+		case SLEEP_MODE_IDLE: return SIM_STATE_IDLE;
+		case SLEEP_MODE_ADC: return SIM_STATE_ADC;
+		default: return SIM_STATE_POWER_DOWN;
+	}
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * SIM_SetHandler, SIM_Schedule, SIM_Cancel, SIM_Due
+ * Each source has one handler and is due at most once.
+ * Scheduling it again replaces the time it was due.
+ */
+void SIM_SetHandler(uint8_t source, sim_handler handler)
+{
+	s_handlers[source] = handler;
+}
+
+void SIM_Schedule(uint8_t source, sim_time when)
+{
+	s_due[source] = (when < s_now) ? s_now : when;
+}
+
+void SIM_Cancel(uint8_t source)
+{
+	s_due[source] = SIM_NEVER;
+}
+
+sim_time SIM_Due(uint8_t source)
+{
+	return s_due[source];
+}
+
+/*
+ * SIM_Now, SIM_State
+ * The simulated time, and the state the CPU is in while a handler runs
+ */
+sim_time SIM_Now(void)
+{
+	return s_now;
+}
+
+uint8_t SIM_State(void)
+{
+	return s_state;
+}
+
+/*
+ * SIM_Sleep
+ * sleep_cpu(): waits in the sleep mode until an interrupt has run
+ */
+void SIM_Sleep(uint8_t sleep_mode)
+{
+	uint8_t state = state_for_sleep_mode(sleep_mode);
+
+	for (;;)
+	{
+		uint8_t src = next_source(state);
+		if (src == SIM_SRC_COUNT)
+		{
+			fprintf(stderr, "sim: nothing can wake the CPU from %s at %.6fs\n", s_stateNames[state], s_now / 1e6);
+			exit(2);
+		}
+		if (advance(state, src)) { return; }
+	}
+}
+
+/*
+ * SIM_Wait
+ * delay(): stays awake for the duration, taking any interrupts due in it
+ */
+void SIM_Wait(sim_time duration)
+{
+	sim_time end = s_now + duration;
+	uint8_t src;
+
+	while (((src = next_source(SIM_STATE_AWAKE)) != SIM_SRC_COUNT) && (s_due[src] <= end))
+	{
+		advance(SIM_STATE_AWAKE, src);
+	}
+
+	s_timeIn[SIM_STATE_AWAKE] += end - s_now;
+	s_now = end;
+}
+
+/*
+ * SIM_WaitFor
+ * A busy-wait loop: stays awake taking interrupts until done() is true
+ */
+void SIM_WaitFor(bool (*done)(void))
+{
+	while (!done())
+	{
+		uint8_t src = next_source(SIM_STATE_AWAKE);
+		if (src == SIM_SRC_COUNT)
+		{
+			fprintf(stderr, "sim: busy-wait can never finish at %.6fs\n", s_now / 1e6);
+			exit(2);
+		}
+		advance(SIM_STATE_AWAKE, src);
+	}
+}
+
+/*
+ * SIM_TimeIn, SIM_Interrupts
+ * Time spent in each state, and the interrupts each source ran
+ */
+sim_time SIM_TimeIn(uint8_t state)
+{
+	return s_timeIn[state];
+}
+
+uint32_t SIM_Interrupts(uint8_t source)
+{
+	return s_interrupts[source];
+}
+
+const char * SIM_SourceName(uint8_t source)
+{
+	return s_sourceNames[source];
+}
+
+const char * SIM_StateName(uint8_t state)
+{
+	return s_stateNames[state];
+}
@@ -0,0 +1,62 @@
+#ifndef _SIM_H_
+#define _SIM_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// Simulated time, in microseconds from the start of the run
+typedef uint64_t sim_time;
+
+#define SIM_NEVER UINT64_MAX
+#define SIM_MILLISECOND 1000ULL
+#define SIM_SECOND 1000000ULL
+
+// Everything that can happen while the CPU waits, in the order simultaneous ones are taken
+enum sim_source
+{
+	SIM_SRC_RTC = 0,		// RTC CLKOUT (1Hz) on D2
+	SIM_SRC_ANEMOMETER1,	// Pulses on D3
+	SIM_SRC_ANEMOMETER2,	// Pulses on D5
+	SIM_SRC_WATCHDOG,		// Watchdog interrupt (LED patterns)
+	SIM_SRC_TIMER2,			// Timer2 compare (telemetry)
+	SIM_SRC_ADC,			// ADC conversion complete
+	SIM_SRC_USART_TX,		// A byte has left the USART
+	SIM_SRC_USART_RX,		// A byte has arrived on RX
+	SIM_SRC_SCRIPT,			// A scripted change to the world (card swap, calibrate switch ...)
+	SIM_SRC_COUNT
+};
+
+// What the CPU is doing, for the time report
+enum sim_state
+{
+	SIM_STATE_AWAKE = 0,	// Busy-waiting: delay(), Serial.flush(), EEPROM writes
+	SIM_STATE_IDLE,			// SLEEP_MODE_IDLE
+	SIM_STATE_ADC,			// SLEEP_MODE_ADC (noise reduction)
+	SIM_STATE_POWER_DOWN,	// SLEEP_MODE_PWR_DOWN (and the other deep modes)
+	SIM_STATE_COUNT
+};
+
+// Called when a source is due. Returns true if an interrupt ran (which wakes the CPU).
+typedef bool (*sim_handler)(void);
+
+// Public Functions
+
+void SIM_SetHandler(uint8_t source, sim_handler handler);
+void SIM_Schedule(uint8_t source, sim_time when);
+void SIM_Cancel(uint8_t source);
+sim_time SIM_Due(uint8_t source);
+
+sim_time SIM_Now(void);
+uint8_t SIM_State(void);
+
+void SIM_Sleep(uint8_t sleep_mode);
+void SIM_Wait(sim_time duration);
+void SIM_WaitFor(bool (*done)(void));
+
+sim_time SIM_TimeIn(uint8_t state);
+uint32_t SIM_Interrupts(uint8_t source);
+const char * SIM_SourceName(uint8_t source);
+const char * SIM_StateName(uint8_t state);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * stack.cpp
+ *
+ * Runs the firmware on a stack of its own, painted, to find how deep it goes
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "sim.h"
+#include "stack.h"
+
+/*
+ * The stack is filled with a pattern before the firmware starts, as the
+ * AVR's would be from the end of .bss. The deepest the firmware has been
+ * is where the pattern is first found unbroken, from the bottom up.
+ * Interrupts are simulated inside the firmware's own calls (SIM_Wait),
+ * so they nest on the stack as they do on the 328P.
+ *
+ * This is the host's stack: 64-bit pointers, 32-bit ints and 16 byte
+ * alignment make its frames two to three times the AVR's. The figure is
+ * for comparing runs and finding when the firmware goes deepest, not the
+ * headroom left on the logger (the "H" command, with RAM_MONITOR).
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define PAINT 0xC5
+#define UNBROKEN 1024  // Bytes of pattern taken as never reached (a buffer on the stack may be part filled)
+
+/*
+ * Private Variables
+ */
+
+static ucontext_t s_simulator;
+static ucontext_t s_firmware;
+static uint8_t * s_stack = NULL;
+static size_t s_size = 0;
+static size_t s_deepest = 0;
+static sim_time s_deepestAt = 0;
+static void (*s_run)(void) = NULL;
+
+/*
+ * Private Functions
+ */
+
+static void run_firmware(void)
+{
+	s_run();
+	// Returning goes back to the simulator (uc_link)
+}
+
+/*
+ * Public Functions
+ */
+
+/*
+ * STACK_Run
+ * Calls firmware() on a painted stack of size bytes. Returns when it does.
+ */
+bool STACK_Run(void (*firmware)(void), size_t size)
+{
+	s_stack = (uint8_t *)malloc(size);
+	if (!s_stack) { return false; }
+
+	s_size = size;
+	memset(s_stack, PAINT, size);
+
+	if (getcontext(&s_firmware) != 0) { return false; }
+	s_firmware.uc_stack.ss_sp = s_stack;
+	s_firmware.uc_stack.ss_size = size;
+	s_firmware.uc_link = &s_simulator;
+	s_run = firmware;
+	makecontext(&s_firmware, run_firmware, 0);
+
+	if (swapcontext(&s_simulator, &s_firmware) != 0) { return false; }
+
+	STACK_Check();
+	free(s_stack);
+	s_stack = NULL;
+	return true;
+}
+
+/*
+ * STACK_Check
+ * Looks for a new deepest point, below the last one. Called between
+ * loop()s, so the time is the loop that went deepest.
+ */
+void STACK_Check(void)
+{
+	static uint8_t s_paint[UNBROKEN];
+	size_t low = s_size - s_deepest;  // The stack grows down, from s_stack + s_size
+
+	if (!s_stack) { return; }
+	if (s_paint[0] != PAINT) { memset(s_paint, PAINT, sizeof(s_paint)); }
+
+	// Down a window at a time, to the lowest byte written in each, until one is all paint
+	while (low > 0)
+	{
+		size_t window = (low < UNBROKEN) ? low : UNBROKEN;
+		size_t i = low - window;
+
+		if (memcmp(&s_stack[i], s_paint, window) == 0) { break; }
+		while (s_stack[i] == PAINT) { i++; }
+		low = i;
+	}
+
+	if (s_size - low > s_deepest)
+	{
+		s_deepest = s_size - low;
+		s_deepestAt = SIM_Now();
+	}
+}
+
+size_t STACK_Deepest(void)
+{
+	return s_deepest;
+}
+
+sim_time STACK_DeepestAt(void)
+{
+	return s_deepestAt;
+}
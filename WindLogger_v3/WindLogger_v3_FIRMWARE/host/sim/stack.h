@@ -0,0 +1,11 @@
+#ifndef _STACK_H_
+#define _STACK_H_
+
+// Public Functions
+
+bool STACK_Run(void (*firmware)(void), size_t size);
+void STACK_Check(void);
+size_t STACK_Deepest(void);
+sim_time STACK_DeepestAt(void);
+
+#endif
@@ -0,0 +1,295 @@
+/*
+ * world.cpp
+ *
+ * The world around the simulated logger: its sensors, the RTC clock output,
+ * the calibrate switch and the card detect switch
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <math.h>
+
+#include <Arduino.h>
+
+#include "hal.h"
+#include "sim.h"
+#include "world.h"
+
+/*
+ * The weather is value noise: random values at fixed times, from a hash
+ * of the seed and the time, eased between. The same seed always gives the
+ * same weather, however the firmware behaves, so two runs of different
+ * firmware see exactly the same wind.
+ *
+ * The sensors are the defaults the firmware's conversions assume:
+ *  - NRG #40C anemometers, speed = 0.765 x Hz + 0.35 m/s
+ *  - The vane at the bottom of its divider (see WIND_ReadingToDirection)
+ *  - Battery through a 5.7:1 divider, external volts through 100k/10k
+ *  - External current on a 10mV/A hall sensor centred on 1.65V
+ *  - Irradiance at 3000W/m^2 full scale
+ *  - A GT 10K thermistor (B 4126) over 10k
+ * all read against the 3.3V reference.
+ */
+
+/*
+ * Defines and Typedefs
+ */
+
+#define RTC_CLOCK_PIN 2
+#define ANEMOMETER1_PIN 3
+#define ANEMOMETER2_PIN 5
+#define CALIBRATE_PIN 6
+#define CARD_DETECT_PIN 9
+
+#define ADC_REFERENCE 3.3f
+#define ADC_FULL_SCALE 1023.0f
+
+#define ANEMOMETER_SLOPE 0.765f
+#define ANEMOMETER_OFFSET 0.35f
+#define ANEMOMETER2_FACTOR 0.92f  // The lower anemometer sees less wind
+
+#define SECONDS_PER_DAY 86400UL
+
+/*
+ * Private Variables
+ */
+
+static struct world_config s_config;
+static uint32_t s_pulses[2];
+static bool s_turning[2];
+
+// Vane readings for N, NE ... NW
+static const uint16_t s_vaneReadings[8] = {238, 562, 930, 839, 736, 394, 79, 137};
+
+/*
+ * Private Functions
+ */
+
+/*
+ * hash, noise
+ * Value noise in [-1, 1] for a stream (wind, gusts, cloud ...) at a time in seconds,
+ * with random values every period seconds
+ */
+static uint32_t hash(uint32_t a, uint32_t b)
+{
+	uint32_t h = (a * 0x9E3779B1U) ^ (b + 0x7F4A7C15U + (s_config.seed << 6) + (s_config.seed >> 2));
+	h ^= h >> 16;
+	h *= 0x85EBCA6BU;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35U;
+	h ^= h >> 16;
+	return h;
+}
+
+static float knot(uint32_t stream, uint32_t index)
+{
+	return (hash(stream, index) / 2147483647.5f) - 1.0f;
+}
+
+static float noise(uint32_t stream, double seconds, double period)
+{
+	double position = seconds / period;
+	uint32_t index = (uint32_t)position;
+	float t = (float)(position - index);
+	float eased = t * t * (3.0f - (2.0f * t));
+
+	return knot(stream, index) + ((knot(stream, index + 1) - knot(stream, index)) * eased);
+}
+
+static double now_seconds(void)
+{
+	return (double)SIM_Now() / SIM_SECOND;
+}
+
+// Hours into the day, from the world's clock (the RTC can be set to anything)
+static float hour_of_day(double seconds)
+{
+	return (float)fmod(s_config.start + seconds, (double)SECONDS_PER_DAY) / 3600.0f;
+}
+
+// 0 at night, up to 1 at noon
+static float daylight(double seconds)
+{
+	float hour = hour_of_day(seconds);
+	return ((hour > 6.0f) && (hour < 18.0f)) ? sinf((float)M_PI * (hour - 6.0f) / 12.0f) : 0.0f;
+}
+
+static float wind_speed(double seconds)
+{
+	// Windier in the afternoon, with weather over hours and gusts over seconds
+	float diurnal = 1.0f + (0.25f * sinf((float)M_PI * (hour_of_day(seconds) - 9.0f) / 12.0f));
+	float weather = 1.0f + (0.4f * noise(1, seconds, 3600.0));
+	float gusts = 1.0f + (0.25f * noise(2, seconds, 4.0));
+	float speed = s_config.windMean * diurnal * weather * gusts;
+
+	return (speed > 0.0f) ? speed : 0.0f;
+}
+
+static uint16_t reading(float pin_volts, uint32_t stream)
+{
+	// +/-1 count of noise
+	float code = (pin_volts / ADC_REFERENCE * ADC_FULL_SCALE) + (float)((int)(hash(stream, (uint32_t)SIM_Now()) % 3) - 1);
+
+	if (code < 0.0f) { return 0; }
+	if (code > ADC_FULL_SCALE) { return (uint16_t)ADC_FULL_SCALE; }
+	return (uint16_t)(code + 0.5f);
+}
+
+static float irradiance_volts(double seconds)
+{
+	float cloud = 0.8f + (0.2f * noise(3, seconds, 600.0));
+	return s_config.irradiancePeak * daylight(seconds) * cloud / 3000.0f * ADC_REFERENCE;
+}
+
+static float thermistor_volts(double seconds)
+{
+	float hour = hour_of_day(seconds);
+	float celsius = s_config.temperatureMean + (5.0f * sinf((float)M_PI * (hour - 9.0f) / 12.0f)) + noise(4, seconds, 1800.0);
+	float kelvin = celsius + 273.15f;
+	float resistance = 10000.0f * expf(4126.0f * ((1.0f / kelvin) - (1.0f / 298.15f)));
+
+	return ADC_REFERENCE * 10000.0f / (resistance + 10000.0f);
+}
+
+/*
+ * analog_reading
+ * The reading on an ADC channel (ADMUX 0-7) now
+ */
+static uint16_t analog_reading(uint8_t channel)
+{
+	double seconds = now_seconds();
+
+	switch (channel)
+	{
+		case 0:  // A0: vane
+		{
+			float heading = 225.0f + (120.0f * noise(5, seconds, 7200.0)) + (20.0f * noise(6, seconds, 10.0));
+			int sector = (int)floorf((heading + 22.5f) / 45.0f);
+			return s_vaneReadings[((sector % 8) + 8) % 8] + (hash(7, (uint32_t)SIM_Now()) % 3) - 1;
+		}
+		case 1:  // A1: battery, charging in the day
+			return reading((s_config.batteryVolts + (0.6f * daylight(seconds))) / 5.7f, 8);
+		case 2:  // A2: irradiance or external volts
+			if (s_config.a2IsIrradiance) { return reading(irradiance_volts(seconds), 9); }
+			return reading(s_config.externalVolts * (1.0f + 0.05f * noise(10, seconds, 60.0)) / 11.0f, 9);
+		case 3:  // A3: external current
+			return reading(1.65f + (0.01f * s_config.externalAmps * (1.0f + 0.2f * noise(11, seconds, 30.0))), 12);
+		case 6:  // A6: thermistor
+			return reading(thermistor_volts(seconds), 13);
+		default:
+			return 0;
+	}
+}
+
+/*
+ * rtc_clock
+ * The RTC's 1Hz CLKOUT, rising as each second starts
+ */
+static bool rtc_clock(void)
+{
+	bool interrupted;
+
+	SIM_Schedule(SIM_SRC_RTC, SIM_Now() + SIM_SECOND);
+
+	HAL_RtcTick();
+	interrupted = HAL_DrivePin(RTC_CLOCK_PIN, HIGH);
+	HAL_DrivePin(RTC_CLOCK_PIN, LOW);
+	return interrupted;
+}
+
+/*
+ * anemometer_due
+ * While the anemometer turns each due time is a pulse (a falling edge),
+ * and the next is when the wind now would turn it again.
+ * Below the offset it stands still, and is looked at again in a second.
+ */
+static bool anemometer_due(uint8_t anemometer)
+{
+	static const uint8_t s_pins[2] = {ANEMOMETER1_PIN, ANEMOMETER2_PIN};
+	static const uint8_t s_sources[2] = {SIM_SRC_ANEMOMETER1, SIM_SRC_ANEMOMETER2};
+	static const float s_factors[2] = {1.0f, ANEMOMETER2_FACTOR};
+
+	bool interrupted = false;
+
+	if (s_turning[anemometer])
+	{
+		s_pulses[anemometer]++;
+		interrupted = HAL_DrivePin(s_pins[anemometer], LOW);
+		HAL_DrivePin(s_pins[anemometer], HIGH);
+	}
+
+	float hz = ((wind_speed(now_seconds()) * s_factors[anemometer]) - ANEMOMETER_OFFSET) / ANEMOMETER_SLOPE;
+
+	s_turning[anemometer] = (hz > 0.1f);
+	SIM_Schedule(s_sources[anemometer], SIM_Now() + (s_turning[anemometer] ? (sim_time)(SIM_SECOND / hz) : SIM_SECOND));
+	return interrupted;
+}
+
+static bool anemometer1_due(void) { return anemometer_due(0); }
+
+// The card image pulled part way through a write (HAL_CardPull)
+static void card_pulled(void) { WORLD_SetCardPresent(false); }
+static bool anemometer2_due(void) { return anemometer_due(1); }
+
+/*
+ * Public Functions
+ */
+
+/*
+ * WORLD_Setup
+ * Starts the world: the RTC set to the start time and running, the
+ * anemometers turning, the calibrate switch off and the card in
+ */
+void WORLD_Setup(const struct world_config * config)
+{
+	s_config = *config;
+
+	HAL_SetAnalogSource(analog_reading);
+	HAL_RtcSet(config->start);
+
+	HAL_DrivePin(CALIBRATE_PIN, LOW);
+	WORLD_SetCardPresent(true);
+	HAL_SetCardPullHandler(card_pulled);
+
+	SIM_SetHandler(SIM_SRC_RTC, rtc_clock);
+	SIM_SetHandler(SIM_SRC_ANEMOMETER1, anemometer1_due);
+	SIM_SetHandler(SIM_SRC_ANEMOMETER2, anemometer2_due);
+
+	// The first tick is a second in, the anemometers start out of step
+	SIM_Schedule(SIM_SRC_RTC, SIM_SECOND);
+	SIM_Schedule(SIM_SRC_ANEMOMETER1, 0);
+	SIM_Schedule(SIM_SRC_ANEMOMETER2, 37 * SIM_MILLISECOND);
+}
+
+void WORLD_SetWindMean(float mean)
+{
+	s_config.windMean = mean;
+}
+
+void WORLD_SetBatteryVolts(float volts)
+{
+	s_config.batteryVolts = volts;
+}
+
+/*
+ * WORLD_SetCalibrate, WORLD_SetCardPresent
+ * The calibrate switch (D6, high for calibrate) and the card (D9 low while it is in).
+ * Return true if the change ran a pin interrupt.
+ */
+bool WORLD_SetCalibrate(bool calibrate)
+{
+	return HAL_DrivePin(CALIBRATE_PIN, calibrate ? HIGH : LOW);
+}
+
+bool WORLD_SetCardPresent(bool present)
+{
+	HAL_SetCardPresent(present);
+	return HAL_DrivePin(CARD_DETECT_PIN, present ? LOW : HIGH);
+}
+
+uint32_t WORLD_Pulses(uint8_t anemometer)
+{
+	return s_pulses[anemometer];
+}
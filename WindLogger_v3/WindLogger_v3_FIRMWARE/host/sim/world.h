@@ -0,0 +1,34 @@
+#ifndef _WORLD_H_
+#define _WORLD_H_
+
+/*
+ * Defines and typedefs
+ */
+
+// What the logger is measuring. Means and peaks, the world varies them over the day.
+struct world_config
+{
+	uint32_t seed;
+	uint32_t start;  // RTC time at the start, in seconds from 2000-01-01
+
+	float windMean;  // m/s
+	float batteryVolts;
+	float irradiancePeak;  // W/m^2 at noon
+	float temperatureMean;  // degrees C
+	float externalVolts;
+	float externalAmps;
+	bool a2IsIrradiance;  // A2 has the irradiance sensor (else the external voltage divider)
+};
+
+// Public Functions
+
+void WORLD_Setup(const struct world_config * config);
+
+void WORLD_SetWindMean(float mean);
+void WORLD_SetBatteryVolts(float volts);
+bool WORLD_SetCalibrate(bool calibrate);
+bool WORLD_SetCardPresent(bool present);
+
+uint32_t WORLD_Pulses(uint8_t anemometer);
+
+#endif
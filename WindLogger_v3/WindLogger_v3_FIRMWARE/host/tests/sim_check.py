@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+"""
+sim_check.py
+
+Checks for the host build (run by ctest): each one starts the firmware on
+the simulator for a few seconds, with serial commands and optionally an
+EEPROM image, and looks for lines in its serial output. A few (RUNS) need
+more than one run of the simulator, and are functions of their own.
+
+  python3 sim_check.py --sim host/build/windlogger_sim CHECK
+  python3 sim_check.py --sim host/build/windlogger_sim --list
+
+The exit status is 1 if an expected line is missing or out of order.
+"""
+
+import argparse
+import glob
+import os
+import subprocess
+import sys
+import tempfile
+
+EEPROM_SIZE = 1024
+LOC_CURRENT_OFFSET = 4  # The original firmware's per-value locations (eeprom_storage.cpp)
+LOC_CURRENT_GAIN = 10
+EEPROM_RING_START = 128  # The checkpoint ring (eeprom_storage.h)
+RUN_DAYS = "0.0001"  # about 9 seconds, long enough for the commands
+
+
+def eeprom_image(words):
+    """An erased EEPROM with {location: value} written as the original firmware did (high byte first)"""
+    image = bytearray(b"\xff" * EEPROM_SIZE)
+    for location, value in words.items():
+        image[location] = (value >> 8) & 0xFF
+        image[location + 1] = value & 0xFF
+    return bytes(image)
+
+
+# name: (commands, {EEPROM location: word} or None, lines expected in this order)
+CHECKS = {
+    # A command that ends where its index should be is answered at once,
+    # so the next command on the line is still read
+    "index_ended": (["PEU?E"], None, ["ERR index", "U=1", "OK"]),
+    "index_invalid": (["P9E", "U?E"], None, ["ERR index", "U=1", "OK"]),
+    # The original firmware's 10-bit current offset, taken over at the 13-bit scale
+    "old_current_offset": (["O?E"], {LOC_CURRENT_OFFSET: 512}, ["EEPROM: old settings", "O=4096", "OK"]),
+    # Only the original firmware's locations are read: words past them (here where the anemometer
+    # slope would be) are left alone, and the slope keeps its default
+    "old_layout_only": (["I?E", "C1?E"], {LOC_CURRENT_GAIN: 250, 35: 1000},
+                        ["EEPROM: old settings", "I=250", "OK", "C1=765", "OK"]),
+    # A command with the wrong CRC is refused whole, the right one (CRC-8 of "S60" is 8E) is taken
+    "bad_crc": (["S60*00E", "S?E", "S60*8EE", "S?E"], None, ["ERR crc", "S=600", "OK", "Sample Time:60", "OK", "S=60"]),
+    # Days past the end of the month, and 29 February only in leap years
+    "date_checked": (["D310226E", "D290225E", "D290224E", "D310126E"], None,
+                     ["ERR value", "ERR value", "29-02-2024", "OK", "31-01-2026", "OK"]),
+    # With a record every second, commands still reach the logger while it waits for the last scan
+    "commands_at_period_end": (["S1E", "U?E", "U?E"], None, ["Sample Time:1", "OK", "U=1", "OK", "U=1", "OK"]),
+    # A flat battery puts the logger in survival at the end of the 2s period: hourly, whatever S was set to
+    "sample_time_in_use": (["S2E", "U?E", "U?E", "S?E"], None, ["Sample Time:2", "OK", "S=3600", "OK"]),
+}
+
+# Simulator options for the checks that need them
+OPTIONS = {
+    "sample_time_in_use": ["--battery", "3.0"],
+}
+
+
+def run(sim, commands, eeprom, work, options=()):
+    """eeprom is {location: word} for a new image, True to carry on with the last run's, or None"""
+    args = [sim, "--days", RUN_DAYS, "--card", os.path.join(work, "card"), "--serial", "-"] + list(options)
+    if eeprom is not None:
+        path = os.path.join(work, "eeprom.bin")
+        if eeprom is not True:
+            with open(path, "wb") as f:
+                f.write(eeprom_image(eeprom))
+        args += ["--eeprom", path]
+    for command in commands:
+        args += ["--command", command]
+    result = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, cwd=work, check=True)
+    return [line.strip() for line in result.stdout.decode("ascii", "replace").splitlines()]
+
+
+def find_lines(name, lines, expected):
+    position = 0
+    for want in expected:
+        try:
+            position = lines.index(want, position) + 1
+        except ValueError:
+            print("%s: \"%s\" missing (expected %s)" % (name, want, expected))
+            print("serial output:\n  " + "\n  ".join(lines))
+            return False
+    return True
+
+
+def torn_checkpoint(sim, work):
+    """A checkpoint cut short before its CRC was written is passed over for the one before it"""
+    path = os.path.join(work, "eeprom.bin")
+
+    if not find_lines("first boot", run(sim, [], {}, work), ["Boot 1"]):
+        return False
+    with open(path, "rb") as f:
+        before = f.read()
+    if not find_lines("second boot", run(sim, [], True, work), ["Boot 2"]):
+        return False
+    with open(path, "rb") as f:
+        after = bytearray(f.read())
+
+    # The second boot's checkpoint is the only write to the ring. The CRC is written last, at the end
+    # of the slot, so the last byte it changed is the CRC's: put that back as if the power went then.
+    # (A write cut short any earlier leaves the old sequence, which is passed over without the CRC.)
+    changed = [i for i in range(EEPROM_RING_START, EEPROM_SIZE) if before[i] != after[i]]
+    if not changed:
+        print("torn_checkpoint: the second boot wrote no checkpoint")
+        return False
+    after[changed[-1]] = before[changed[-1]]
+    with open(path, "wb") as f:
+        f.write(after)
+
+    # Counted on from the first boot's checkpoint, then the ring carries on
+    return (find_lines("after the torn write", run(sim, [], True, work), ["Boot 2"])
+            and find_lines("the boot after", run(sim, [], True, work), ["Boot 3"]))
+
+
+# Field masks for fields_match_header (fields.h): the default, each field alone, none, and all
+# that can go together (irradiance and the external volts share a pin, energy needs volts and amps)
+FIELD_MASKS = [11, 0, 1, 2, 4, 8, 16, 32, 53, 119]
+
+
+def fields_match_header(sim, work):
+    """Every record has as many columns as its file's header, whichever fields are logged"""
+    for mask in FIELD_MASKS:
+        card = os.path.join(work, "card")
+        for path in glob.glob(os.path.join(card, "*.CSV")):
+            os.remove(path)
+        if not find_lines("F%d" % mask, run(sim, ["S1E", "F%dE" % mask, "F?E"], None, work), ["F=%d" % mask]):
+            return False
+
+        records = 0
+        for path in sorted(glob.glob(os.path.join(card, "D*.CSV"))):
+            with open(path) as f:
+                rows = [line.rstrip("\r\n") for line in f]
+            columns = rows[0].count(",")
+            for row in rows[1:]:
+                # Event rows ("Ref, Date, Time, Power CONSERVE 3520mV") are text of their own
+                fields = row.split(",")
+                if (len(fields) == 4) and (" " in fields[3]):
+                    continue
+                records += 1
+                if row.count(",") != columns:
+                    print("fields_match_header: F%d: %s has %d columns, its header %d:\n  %s\n  %s"
+                          % (mask, os.path.basename(path), row.count(",") + 1, columns + 1, rows[0], row))
+                    return False
+        if records == 0:
+            print("fields_match_header: F%d: no records written" % mask)
+            return False
+    return True
+
+
+# name: function(sim, work directory) returning True if it passed
+RUNS = {
+    "torn_checkpoint": torn_checkpoint,
+    "fields_match_header": fields_match_header,
+}
+
+
+def check(sim, name):
+    with tempfile.TemporaryDirectory() as work:
+        if name in RUNS:
+            passed = RUNS[name](sim, work)
+        else:
+            commands, eeprom, expected = CHECKS[name]
+            passed = find_lines(name, run(sim, commands, eeprom, work, OPTIONS.get(name, ())), expected)
+
+    if passed:
+        print("%s: ok" % name)
+    return passed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sim", required=True, help="the windlogger_sim executable")
+    parser.add_argument("--list", action="store_true", help="print the checks' names")
+    parser.add_argument("checks", nargs="*", help="checks to run (all of them)")
+    args = parser.parse_args()
+
+    if args.list:
+        print("\n".join(list(CHECKS) + list(RUNS)))
+        return 0
+
+    unknown = [name for name in args.checks if (name not in CHECKS) and (name not in RUNS)]
+    if unknown:
+        parser.error("unknown check: %s" % ", ".join(unknown))
+
+    results = [check(os.path.abspath(args.sim), name) for name in (args.checks or (list(CHECKS) + list(RUNS)))]
+    return 0 if all(results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
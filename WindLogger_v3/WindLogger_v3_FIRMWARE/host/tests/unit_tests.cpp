@@ -0,0 +1,302 @@
+/*
+ * unit_tests.cpp
+ *
+ * Checks of single firmware modules for the host build (run by ctest).
+ * The modules are called directly, without setup() and loop(), so each
+ * check only depends on the module it is about.
+ *
+ *   host/build/unit_tests TEST
+ *   host/build/unit_tests --list
+ *
+ * Matt Little/James Fowkes
+ * October 2026
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+
+#include "hal.h"
+
+#include "app.h"
+#include "events.h"
+#include "utility.h"
+#include "stats.h"
+#include "rtc.h"
+#include "analog.h"
+#include "energy.h"
+#include "pipeline.h"
+#include "wind.h"
+
+/*
+ * Defines and Typedefs
+ */
+
+// Fails the test it is in, saying where
+#define EXPECT(condition) do { if (!(condition)) { \
+	fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #condition); return false; } } while (0)
+
+struct unit_test
+{
+	const char * name;
+	bool (*run)(void);
+};
+
+/*
+ * Private Functions
+ */
+
+/*
+ * event_queue_full
+ * A full queue refuses the next event and counts it, and keeps the ones it has in order
+ */
+static bool event_queue_full(void)
+{
+	EVENT evt;
+
+	// One slot is always left empty
+	for (uint8_t i = 0; i < (EVENT_QUEUE_SIZE - 1); i++)
+	{
+		EXPECT(EVT_Post((EVENT)(EVT_TICK + (i % 2))));
+	}
+	EXPECT(EVT_GetDroppedCount() == 0);
+
+	EXPECT(!EVT_Post(EVT_CARD_CHANGE));
+	EXPECT(!EVT_PostFromMain(EVT_CARD_CHANGE));
+	EXPECT(EVT_GetDroppedCount() == 2);
+
+	// Taking one makes room for one more
+	EXPECT(EVT_Get(&evt) && (evt == EVT_TICK));
+	EXPECT(EVT_Post(EVT_SERIAL_RX));
+	EXPECT(!EVT_Post(EVT_SERIAL_RX));
+	EXPECT(EVT_GetDroppedCount() == 3);
+
+	for (uint8_t i = 1; i < (EVENT_QUEUE_SIZE - 1); i++)
+	{
+		EXPECT(EVT_Get(&evt) && (evt == (EVENT)(EVT_TICK + (i % 2))));
+	}
+	EXPECT(EVT_Get(&evt) && (evt == EVT_SERIAL_RX));
+	EXPECT(!EVT_Pending() && !EVT_Get(&evt));
+
+	// The count stops at 255 rather than wrapping to look like nothing was lost
+	for (uint16_t i = 0; i < 300; i++)
+	{
+		(void)EVT_Post(EVT_TICK);
+	}
+	EXPECT(EVT_GetDroppedCount() == 255);
+	return true;
+}
+
+/*
+ * pulse_count_wraps
+ * A count past 65535 is carried by the interrupt itself, latched with the period,
+ * and the next period starts again from nothing
+ */
+static void pulses(uint8_t pin, long count)
+{
+	for (long i = 0; i < count; i++)
+	{
+		HAL_DrivePin(pin, LOW);
+		HAL_DrivePin(pin, HIGH);
+	}
+}
+
+static bool pulse_count_wraps(void)
+{
+	long counts[2];
+
+	WIND_SetupWindPulseInterrupts();
+
+	pulses(ANEMOMETER1, 140000L);
+	pulses(ANEMOMETER2, 12L);
+	EXPECT(WIND_GetLivePulseCount(0) == 140000L);
+	EXPECT(WIND_GetLivePulseCount(1) == 12L);
+
+	WIND_LatchPulseCounts();
+	EXPECT(WIND_GetLivePulseCount(0) == 0);
+
+	// Pulses in the next period before the record is made aren't counted in it
+	pulses(ANEMOMETER1, 70000L);
+	WIND_StoreWindPulseCounts(counts);
+	EXPECT(counts[0] == 140000L);
+	EXPECT(counts[1] == 12L);
+	EXPECT(WIND_GetLivePulseCount(0) == 70000L);
+
+	WIND_LatchPulseCounts();
+	WIND_StoreWindPulseCounts(counts);
+	EXPECT(counts[0] == 70000L);
+	EXPECT(counts[1] == 0);
+	return true;
+}
+
+/*
+ * record_queue_drops_oldest
+ * A record made with the queue full pushes out the oldest one, not itself
+ */
+static bool record_queue_drops_oldest(void)
+{
+	// Each record is told apart by its ticks
+	for (uint16_t ticks = 1; ticks <= (RECORD_QUEUE_SIZE + 1); ticks++)
+	{
+		PIPE_SetPeriod(ticks);
+		EXPECT(PIPE_CompletePeriod() == (ticks <= RECORD_QUEUE_SIZE));
+		EXPECT(PIPE_NewestRecord()->ticks == ticks);
+	}
+	EXPECT(PIPE_RecordCount() == RECORD_QUEUE_SIZE);
+
+	for (uint16_t ticks = 2; ticks <= (RECORD_QUEUE_SIZE + 1); ticks++)
+	{
+		EXPECT(PIPE_PeekRecord()->ticks == ticks);
+		PIPE_ReleaseRecord();
+	}
+	EXPECT(PIPE_RecordCount() == 0);
+	EXPECT(PIPE_PeekRecord() == NULL);
+	return true;
+}
+
+/*
+ * scan_results_kept
+ * A finished scan's readings stay until they are collected: no scan or
+ * measurement is started over them
+ */
+static uint16_t mid_scale(uint8_t channel)
+{
+	(void)channel;
+	return 512;
+}
+
+static bool scan_results_kept(void)
+{
+	const uint8_t battery = ANALOG_CHANNEL_BIT(ANALOG_CH_BATTERY);
+	uint16_t reading = 0;
+
+	HAL_SetAnalogSource(mid_scale);
+	ANALOG_Setup();
+
+	EXPECT(ANALOG_StartScan(battery));
+	EXPECT(!ANALOG_StartScan(battery));
+	ANALOG_WaitForScan();
+	EXPECT(ANALOG_ResultsReady());
+
+	EXPECT(!ANALOG_StartScan(battery));
+	EXPECT(!ANALOG_Measure(ANALOG_CH_EXT_AMPS, 8, &reading));
+	EXPECT(reading == 0);
+	EXPECT(ANALOG_ResultsReady());
+	EXPECT(ANALOG_GetAverage(ANALOG_CH_BATTERY) == (512 << ANALOG_MAX_EXTRA_BITS));
+
+	ANALOG_ReleaseResults();
+	EXPECT(ANALOG_Measure(ANALOG_CH_EXT_AMPS, 8, &reading));
+	EXPECT(reading == (512 << ANALOG_MAX_EXTRA_BITS));
+	EXPECT(ANALOG_StartScan(battery));
+	return true;
+}
+
+/*
+ * stats_rounding_and_range
+ * Means round half away from zero either side of it, the whole int16_t range can be
+ * summarised, and the count stops at 65535
+ */
+static bool stats_rounding_and_range(void)
+{
+	ChannelStats stats;
+	FixedPointStats<int16_t> full;
+	struct stats_summary summary;
+
+	EXPECT(stats.mean() == 0);
+
+	stats.add(1); stats.add(2);
+	EXPECT(stats.mean() == 2);
+	stats.reset();
+	stats.add(-1); stats.add(-2);
+	EXPECT(stats.mean() == -2);
+	stats.reset();
+	stats.add(10); stats.add(10); stats.add(11);
+	EXPECT(stats.mean() == 10);
+	stats.reset();
+	stats.add(-10); stats.add(-11); stats.add(-11);
+	EXPECT(stats.mean() == -11);
+
+	// The sums are from the first value, so the extremes don't overflow
+	stats.reset();
+	stats.add(INT16_MAX); stats.add(INT16_MIN); stats.add(INT16_MIN);
+	stats.summarise(&summary);
+	EXPECT(summary.mean == -10923);
+	EXPECT(summary.min == INT16_MIN);
+	EXPECT(summary.max == INT16_MAX);
+	EXPECT(stats.total() == (long)INT16_MAX + (2L * INT16_MIN));
+
+	// A whole day of 1 second samples won't fit, the count stops rather than wraps
+	stats.reset();
+	stats.add(-30000);
+	for (long i = 1; i < 70000L; i++) { stats.add(30000); }
+	EXPECT(stats.count() == 0xFFFF);
+	EXPECT(stats.mean() == 29999);
+	EXPECT(stats.total() == -30000L + (65534L * 30000L));
+
+	// Population sd, with the sum of squares kept
+	const int16_t values[] = {2, 4, 4, 4, 5, 5, 7, 9};
+	for (uint8_t i = 0; i < 8; i++) { full.add(values[i] - 1000); }
+	EXPECT(full.mean() == -995);
+	EXPECT(full.sd() == 2);
+	full.reset();
+	full.add(0); full.add(1);
+	EXPECT(full.sd() == 1);
+	full.reset();
+	full.add(INT16_MIN); full.add(INT16_MAX);
+	EXPECT(full.sd() == INT16_MAX);
+
+	// Carried on from a summary, as after a checkpoint
+	stats.restore(10, 500, 0, 100, 900);
+	stats.add(511);
+	stats.summarise(&summary);
+	EXPECT(stats.count() == 11);
+	EXPECT(summary.mean == 501);
+	EXPECT((summary.min == 100) && (summary.max == 900));
+	return true;
+}
+
+static const struct unit_test s_tests[] = {
+	{"event_queue_full", event_queue_full},
+	{"pulse_count_wraps", pulse_count_wraps},
+	{"record_queue_drops_oldest", record_queue_drops_oldest},
+	{"scan_results_kept", scan_results_kept},
+	{"stats_rounding_and_range", stats_rounding_and_range},
+};
+
+#define TEST_COUNT (sizeof(s_tests) / sizeof(s_tests[0]))
+
+/*
+ * Public Functions
+ */
+
+int main(int argc, char ** argv)
+{
+	if ((argc == 2) && (strcmp(argv[1], "--list") == 0))
+	{
+		for (uint8_t i = 0; i < TEST_COUNT; i++) { printf("%s\n", s_tests[i].name); }
+		return 0;
+	}
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: unit_tests TEST | --list\n");
+		return 2;
+	}
+
+	for (uint8_t i = 0; i < TEST_COUNT; i++)
+	{
+		if (strcmp(argv[1], s_tests[i].name) == 0)
+		{
+			// Each test runs in a process of its own, so starts from reset
+			HAL_Init();
+			bool passed = s_tests[i].run();
+			printf("%s: %s\n", s_tests[i].name, passed ? "ok" : "FAILED");
+			return passed ? 0 : 1;
+		}
+	}
+
+	fprintf(stderr, "unknown test: %s\n", argv[1]);
+	return 2;
+}
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""
+bench_compare.py
+
+Compares two runs of the cycle benchmark (bench/), section by section,
+so a change that makes the firmware slower shows up before it ships.
+
+  python3 bench_compare.py baseline.json new.json
+  python3 bench_compare.py --threshold 2 baseline.json new.json
+
+A section's mean or max cycles, or the awake cycles per second, going up
+by more than the threshold (percent, 5 by default) is a regression, and
+the exit status is 1. It is 2 if there is no baseline yet.
+"""
+
+import argparse
+import json
+import sys
+
+
+def change(old, new):
+    """Percentage change, from old to new"""
+    if old == 0:
+        return 0.0 if new == 0 else float("inf")
+    return 100.0 * (new - old) / old
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline", help="bench.json from the run to compare against")
+    parser.add_argument("new", help="bench.json from the run being checked")
+    parser.add_argument("--threshold", type=float, default=5.0, help="percent slower that counts as a regression")
+    args = parser.parse_args()
+
+    try:
+        with open(args.baseline) as f:
+            old = json.load(f)
+    except FileNotFoundError:
+        print("no baseline at %s: make one with the bench_baseline target" % args.baseline)
+        return 2
+    with open(args.new) as f:
+        new = json.load(f)
+
+    if (old["hours"], old["wind"]) != (new["hours"], new["wind"]):
+        print("warning: runs differ (%sh at %sm/s against %sh at %sm/s)" %
+              (old["hours"], old["wind"], new["hours"], new["wind"]))
+
+    regressions = []
+    print("%-20s %10s %10s %8s %10s %10s %8s" % ("section", "mean", "was", "change", "max", "was", "change"))
+    for name, section in new["sections"].items():
+        before = old["sections"].get(name)
+        if not before:
+            print("%-20s %10.1f %10s %8s %10d" % (name, section["mean"], "-", "new", section["max"]))
+            continue
+        mean_change = change(before["mean"], section["mean"])
+        max_change = change(before["max"], section["max"])
+        print("%-20s %10.1f %10.1f %7.1f%% %10d %10d %7.1f%%" %
+              (name, section["mean"], before["mean"], mean_change, section["max"], before["max"], max_change))
+        if mean_change > args.threshold:
+            regressions.append("%s mean" % name)
+        if max_change > args.threshold:
+            regressions.append("%s max" % name)
+
+    awake_change = change(old["awake_cycles_per_second"], new["awake_cycles_per_second"])
+    print("%-20s %10.1f %10.1f %7.1f%%" %
+          ("awake cycles/s", new["awake_cycles_per_second"], old["awake_cycles_per_second"], awake_change))
+    if awake_change > args.threshold:
+        regressions.append("awake cycles per second")
+
+    if new.get("unmatched_markers"):
+        regressions.append("%d unmatched markers" % new["unmatched_markers"])
+
+    if regressions:
+        print("regressions: " + ", ".join(regressions))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""
+budget.py
+
+Checks that a firmware build fits the ATmega328P on the Uno: flash (less
+the bootloader) and RAM (less room for the stack), and shows which source
+files use the most of each.
+
+  python3 budget.py build/WindLogger_SMD_JF.ino.elf
+  python3 budget.py --build                  (compiles with arduino-cli first)
+  python3 budget.py --build --stack 600 --top 20
+
+--build runs:
+  arduino-cli compile -b arduino:avr:uno --output-dir <dir> ../WindLogger_SMD_JF
+so arduino-cli, the AVR core and the libraries in the README must be installed.
+The per-file breakdown comes from the debug information in the .elf
+(arduino-cli builds with -g). Needs avr-size and avr-nm on the path,
+which come with the AVR core.
+
+Returns 1 if the build does not fit.
+"""
+
+import argparse
+import collections
+import os
+import subprocess
+import sys
+
+FLASH_SIZE = 32768
+BOOTLOADER_SIZE = 512       # Optiboot
+RAM_SIZE = 2048
+STACK_RESERVE = 400         # Deepest call chain (333 bytes, a new file on a record write) plus a margin
+
+FLASH_SECTIONS = (".text", ".data")
+RAM_SECTIONS = (".data", ".bss", ".noinit")
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SKETCH = os.path.join(HERE, "..", "WindLogger_SMD_JF")
+
+
+def build(output_dir):
+    subprocess.check_call(["arduino-cli", "compile", "-b", "arduino:avr:uno", "--output-dir", output_dir, SKETCH])
+    return os.path.join(output_dir, "WindLogger_SMD_JF.ino.elf")
+
+
+def section_sizes(elf):
+    """Returns {section: size} from avr-size -A"""
+    sizes = {}
+    output = subprocess.check_output(["avr-size", "-A", elf], universal_newlines=True)
+    for line in output.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith(".") and parts[1].isdigit():
+            sizes[parts[0]] = int(parts[1])
+    return sizes
+
+
+def symbol_sizes(elf):
+    """Returns {file: [flash bytes, ram bytes]} from avr-nm -S -l"""
+    usage = collections.defaultdict(lambda: [0, 0])
+    output = subprocess.check_output(["avr-nm", "-S", "-C", "-l", "--size-sort", elf], universal_newlines=True)
+    for line in output.splitlines():
+        parts = line.split(None, 3)
+        if len(parts) < 4:
+            continue
+        size, kind, rest = int(parts[1], 16), parts[2].lower(), parts[3]
+        source = rest.rsplit("\t", 1)[1] if "\t" in rest else ""
+        source = os.path.basename(source.rsplit(":", 1)[0]) if source else "(libraries)"
+        if kind in "tw":
+            usage[source][0] += size
+        elif kind in "bd":
+            usage[source][1] += size
+            if kind == "d":
+                usage[source][0] += size  # Initial values are in flash too
+        elif kind in "rv":
+            usage[source][0] += size  # PROGMEM tables and strings
+    return usage
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", nargs="?", help="the built .elf (or use --build)")
+    parser.add_argument("--build", action="store_true", help="compile with arduino-cli first")
+    parser.add_argument("--output-dir", default=os.path.join(HERE, "..", "build"))
+    parser.add_argument("--stack", type=int, default=STACK_RESERVE, help="RAM to leave for the stack")
+    parser.add_argument("--top", type=int, default=12, help="source files to list")
+    args = parser.parse_args()
+
+    if args.build:
+        elf = build(args.output_dir)
+    elif args.elf:
+        elf = args.elf
+    else:
+        parser.error("give the .elf or --build")
+
+    sections = section_sizes(elf)
+    flash = sum(sections.get(s, 0) for s in FLASH_SECTIONS)
+    ram = sum(sections.get(s, 0) for s in RAM_SECTIONS)
+    flash_limit = FLASH_SIZE - BOOTLOADER_SIZE
+    ram_limit = RAM_SIZE - args.stack
+
+    flash_ok = flash <= flash_limit
+    ram_ok = ram <= ram_limit
+    print("flash %6d of %6d bytes (%5.1f%%) %s" % (flash, flash_limit, 100.0 * flash / flash_limit, "ok" if flash_ok else "OVER"))
+    print("RAM   %6d of %6d bytes (%5.1f%%) %s, %d left for the stack"
+          % (ram, ram_limit, 100.0 * ram / ram_limit, "ok" if ram_ok else "OVER", RAM_SIZE - ram))
+
+    if args.top:
+        usage = symbol_sizes(elf)
+        print()
+        print("%-28s %7s %6s" % ("source", "flash", "RAM"))
+        for source, (f, r) in sorted(usage.items(), key=lambda item: -item[1][0])[:args.top]:
+            print("%-28s %7d %6d" % (source, f, r))
+        print()
+        print("%-28s %7s %6s" % ("largest RAM users", "", "RAM"))
+        for source, (f, r) in sorted(usage.items(), key=lambda item: -item[1][1])[:args.top]:
+            if r:
+                print("%-28s %7s %6d" % (source, "", r))
+
+    return 0 if (flash_ok and ram_ok) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+"""
+checkpoint_sim.py
+
+Simulates the checkpoint ring (checkpoint.cpp) on a model of the ATmega328P's
+EEPROM and projects how long the cells last at a given checkpoint rate.
+
+Each checkpoint is written the way the firmware writes it: only bytes that
+change are written (eeprom_update_block), the slot first and its CRC last.
+The period in progress in each checkpoint
+is random bytes, as if every one of them had changed. Every cell's write count is kept. Some writes are cut short at a random byte
+to stand in for a brown-out, and after each one the ring is recovered as at
+boot and checked to give either the interrupted checkpoint or the one before.
+
+  python3 checkpoint_sim.py                          (every 600s, as CHECKPOINT_INTERVAL)
+  python3 checkpoint_sim.py --interval 60 --checkpoints 50000 --cut 20
+
+The projection is for the most written cell, against the datasheet's 100,000
+writes, compared with writing the same data to one fixed location.
+"""
+
+import argparse
+import binascii
+import random
+import struct
+import sys
+
+EEPROM_SIZE = 1024          # E2END + 1
+RING_START = 128            # EEPROM_RING_START
+ENDURANCE = 100000
+
+CHECKPOINT = struct.Struct("<HIihih")   # struct checkpoint
+CHANNELS = 5                            # PIPE_ANALOG_CHANNELS
+PERIOD = struct.Struct("<6BHH2i8H" + "ihihiH" + "H4h" * CHANNELS)  # struct period_checkpoint
+SEQUENCE = struct.Struct("<I")
+CRC = struct.Struct("<H")
+SLOT_SIZE = CHECKPOINT.size + PERIOD.size + SEQUENCE.size + CRC.size
+ERASED = 0xFFFFFFFF
+
+SECONDS_PER_YEAR = 365.25 * 24 * 3600
+
+
+class Eeprom:
+    def __init__(self, size):
+        self.data = bytearray([0xFF] * size)
+        self.writes = [0] * size
+
+    def update(self, address, data, cut=None):
+        """eeprom_update_block: writes changed bytes only. Stops after cut byte writes."""
+        for i, byte in enumerate(data):
+            if self.data[address + i] != byte:
+                if cut is not None:
+                    if cut == 0:
+                        return False
+                    cut -= 1
+                self.data[address + i] = byte
+                self.writes[address + i] += 1
+        return True
+
+
+class Ring:
+    """The same ring as checkpoint.cpp"""
+
+    def __init__(self, eeprom, start, end):
+        self.eeprom = eeprom
+        self.start = start
+        self.slots = (end - start) // SLOT_SIZE
+        self.next_sequence = 0
+        self.reads = 0
+
+    def address(self, index):
+        return self.start + index * SLOT_SIZE
+
+    def read_sequence(self, index):
+        self.reads += 1
+        a = self.address(index) + CHECKPOINT.size + PERIOD.size
+        return SEQUENCE.unpack_from(self.eeprom.data, a)[0]
+
+    def read_slot(self, index):
+        """Returns (sequence, checkpoint, period) or None if the slot isn't complete"""
+        raw = bytes(self.eeprom.data[self.address(index):self.address(index) + SLOT_SIZE])
+        body, (crc,) = raw[:-CRC.size], CRC.unpack(raw[-CRC.size:])
+        (sequence,) = SEQUENCE.unpack_from(body, CHECKPOINT.size + PERIOD.size)
+        if sequence == ERASED or sequence % self.slots != index or binascii.crc_hqx(body, 0) != crc:
+            return None
+        return sequence, CHECKPOINT.unpack_from(body), body[CHECKPOINT.size:CHECKPOINT.size + PERIOD.size]
+
+    def find_newest(self):
+        first = self.read_sequence(0)
+        low, high = 0, self.slots - 1
+        while low < high:
+            mid = (low + high + 1) // 2
+            if (self.read_sequence(mid) - first) & 0xFFFFFFFF == mid:
+                low = mid
+            else:
+                high = mid - 1
+        return low
+
+    def recover(self):
+        newest = self.find_newest()
+        for index in (newest, (newest - 1) % self.slots):
+            found = self.read_slot(index)
+            if found:
+                return found
+        found = [s for s in (self.read_slot(i) for i in range(self.slots)) if s]
+        return max(found) if found else None
+
+    def save(self, checkpoint, period, cut=None):
+        """Writes a checkpoint. cut = stop after that many byte writes (a brown-out)."""
+        sequence = self.next_sequence
+        self.next_sequence += 1
+        body = CHECKPOINT.pack(*checkpoint) + period + SEQUENCE.pack(sequence)
+        crc = CRC.pack(binascii.crc_hqx(body, 0))
+        address = self.address(sequence % self.slots)
+
+        if cut is not None:
+            changed = sum(1 for i, b in enumerate(body) if self.eeprom.data[address + i] != b)
+            if cut < changed:
+                return self.eeprom.update(address, body, cut)
+            cut -= changed
+        self.eeprom.update(address, body)
+        return self.eeprom.update(address + len(body), crc, cut)
+
+
+def simulate(args):
+    rng = random.Random(args.seed)
+    eeprom = Eeprom(EEPROM_SIZE)
+    ring = Ring(eeprom, args.ring_start, EEPROM_SIZE)
+
+    # boots, records, Wh, mWh, Ah, mAh
+    state = [1, 0, 0, 0, 0, 0]
+    records_per_checkpoint = max(1, args.interval // args.sample_time)
+    cuts = recovered_new = recovered_old = 0
+    worst_reads = 0
+
+    for n in range(args.checkpoints):
+        state[1] += records_per_checkpoint
+        milliwatt_hours = state[3] + rng.randrange(0, 400000)
+        state[2] += milliwatt_hours // 1000
+        state[3] = milliwatt_hours % 1000
+        milliamp_hours = state[5] + rng.randrange(0, 30000)
+        state[4] += milliamp_hours // 1000
+        state[5] = milliamp_hours % 1000
+        period = bytes(rng.randrange(256) for _ in range(PERIOD.size))
+        previous = ring.next_sequence - 1
+
+        if args.cut and rng.randrange(args.cut) == 0:
+            cuts += 1
+            ring.save(state, period, cut=rng.randrange(SLOT_SIZE))
+
+            # Reset: recover as at boot, count the boot
+            ring.reads = 0
+            found = ring.recover()
+            worst_reads = max(worst_reads, ring.reads)
+            if found is None or found[0] not in (previous, previous + 1):
+                print("FAILED to recover after checkpoint %d: got %s" % (n, found and found[0]))
+                return 1
+            if found[0] == previous + 1:
+                recovered_new += 1
+            else:
+                recovered_old += 1
+            ring.next_sequence = found[0] + 1
+            state = list(found[1])
+            state[0] += 1
+            period = found[2]
+            ring.save(state, period)
+        else:
+            ring.save(state, period)
+
+    ring.reads = 0
+    found = ring.recover()
+    worst_reads = max(worst_reads, ring.reads)
+    if found is None or found[0] != ring.next_sequence - 1 or list(found[1]) != state or found[2] != period:
+        print("FAILED: final recovery does not match the last checkpoint")
+        return 1
+
+    ring_writes = eeprom.writes[args.ring_start:]
+    worst = max(ring_writes)
+    total = ring.next_sequence
+    per_checkpoint = worst / total
+    bytes_per_checkpoint = sum(ring_writes) / total
+    ring_years = args.endurance / per_checkpoint * args.interval / SECONDS_PER_YEAR
+    fixed_years = args.endurance * args.interval / SECONDS_PER_YEAR
+
+    print("%d slots of %d bytes from address %d" % (ring.slots, SLOT_SIZE, args.ring_start))
+    print("%d checkpoints every %ds (%d interrupted: %d recovered the new one, %d the one before)"
+          % (total, args.interval, cuts, recovered_new, recovered_old))
+    print("recovery reads at most %d sequences" % worst_reads)
+    print("%.1f bytes written per checkpoint, most written cell %d times (%.4f per checkpoint)"
+          % (bytes_per_checkpoint, worst, per_checkpoint))
+    print("projected life: %.1f years (one fixed location: %.2f years)" % (ring_years, fixed_years))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--interval", type=int, default=600, help="seconds between checkpoints")
+    parser.add_argument("--sample-time", type=int, default=600, help="seconds per record")
+    parser.add_argument("--checkpoints", type=int, default=20000)
+    parser.add_argument("--cut", type=int, default=50, help="cut one write in N short (0 = never)")
+    parser.add_argument("--endurance", type=int, default=ENDURANCE, help="writes per cell")
+    parser.add_argument("--ring-start", type=int, default=RING_START)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+    return simulate(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""
+field_schema.py
+
+Makes the schema of the logger's data files from the firmware's own field
+list, so host tools don't keep a second copy of the columns that can drift.
+
+The field list (FIELD_LIST in fields.h), the READ_xxx switches in app.h and
+each module's xxx_HEADERS and xxx_COLUMNS are compiled with the host's C++
+compiler into a small program that prints them. The schema is exactly what
+the firmware built from the same sketch would write.
+
+  python3 field_schema.py                         (the schema as JSON)
+  python3 field_schema.py --mask 11               (the header line written after "F11E")
+  python3 field_schema.py --decode D261019.csv    (which fields a data file has)
+  python3 field_schema.py -D READ_TEMPERATURE=1   (for firmware built with a field app.h leaves out)
+
+Needs a C++ compiler (c++, or set CXX).
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SKETCH = os.path.join(HERE, "..", "WindLogger_SMD_JF")
+
+# Prints one line per field: ID, bit, built, requires mask, columns, headers
+PROGRAM = r"""
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+typedef uint8_t byte;	// What Arduino.h would give the firmware headers
+
+#include "app.h"
+#include "utility.h"
+#include "stats.h"
+#include "energy.h"
+#include "wind.h"
+#include "temperature.h"
+#include "irradiance.h"
+#include "external_volts_amps.h"
+#include "battery.h"
+#include "fields.h"
+
+#define PRINT_FIELD(id, channels, requires) \
+	printf("field\t%s\t%d\t%d\t%d\t%d\t%s\n", #id, FIELD_##id, READ_##id == 1, (int)(requires), id##_COLUMNS, id##_HEADERS);
+
+int main(void)
+{
+	printf("start\t%d\t%s\n", FIELDS_ROW_START_COLUMNS, FIELDS_ROW_START_HEADERS);
+	FIELD_LIST(PRINT_FIELD)
+	printf("end\t%d\t%s, \n", BATTERY_COLUMNS, BATTERY_HEADERS);
+	return 0;
+}
+"""
+
+
+def split_headers(headers):
+    """ "Wind 1, Wind 2, " -> ["Wind 1", "Wind 2"] """
+    return [h.strip() for h in headers.split(",")[:-1]]
+
+
+def build_schema(sketch, defines=()):
+    compiler = os.environ.get("CXX", "c++")
+    work = tempfile.mkdtemp()
+    try:
+        source = os.path.join(work, "field_schema.cpp")
+        program = os.path.join(work, "field_schema")
+        with open(source, "w") as f:
+            f.write(PROGRAM)
+        subprocess.check_call([compiler, "-std=c++11", "-I", sketch] + ["-D" + d for d in defines] + [source, "-o", program])
+        output = subprocess.check_output([program], universal_newlines=True)
+    finally:
+        shutil.rmtree(work)
+
+    schema = {"row_start": [], "fields": [], "row_end": []}
+    for line in output.splitlines():
+        parts = line.split("\t")
+        if parts[0] == "field":
+            _, name, bit, built, requires, columns, headers = parts
+            field = {
+                "id": name,
+                "bit": int(bit),
+                "built": built == "1",
+                "requires": [b for b in range(8) if int(requires) & (1 << b)],
+                "columns": split_headers(headers),
+            }
+            if len(field["columns"]) != int(columns):
+                sys.exit("%s: %d headers for %s columns" % (name, len(field["columns"]), columns))
+            schema["fields"].append(field)
+        else:
+            kind, columns, headers = parts
+            schema["row_start" if kind == "start" else "row_end"] = split_headers(headers)
+    return schema
+
+
+def header_line(schema, mask):
+    """The header line the logger writes for a field mask"""
+    columns = list(schema["row_start"])
+    for field in schema["fields"]:
+        if mask & (1 << field["bit"]):
+            columns += field["columns"]
+    columns += schema["row_end"]
+    return ", ".join(columns)
+
+
+def valid_masks(schema):
+    """The masks the logger accepts (without its pin check), most fields first"""
+    built = sum(1 << f["bit"] for f in schema["fields"] if f["built"])
+    for mask in range(built, -1, -1):
+        if mask & ~built:
+            continue
+        needs = [r for f in schema["fields"] if mask & (1 << f["bit"]) for r in f["requires"]]
+        if all(mask & (1 << r) for r in needs):
+            yield mask
+
+
+def decode(schema, path):
+    """Returns (mask, [(field id or None, column header)]) for a data file"""
+    with open(path, newline="") as f:
+        header = f.readline().rstrip("\r\n")
+    for mask in valid_masks(schema):
+        if header_line(schema, mask) == header:
+            columns = [(None, c) for c in schema["row_start"]]
+            for field in schema["fields"]:
+                if mask & (1 << field["bit"]):
+                    columns += [(field["id"], c) for c in field["columns"]]
+            columns += [(None, c) for c in schema["row_end"]]
+            return mask, columns
+    return None, None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sketch", default=SKETCH, help="the firmware sources (app.h decides what is built)")
+    parser.add_argument("--mask", type=int, help="print the header line for this field mask")
+    parser.add_argument("--decode", metavar="FILE", help="find the field mask a data file was written with")
+    parser.add_argument("-D", dest="defines", action="append", default=[], metavar="NAME=VALUE",
+                        help="a define the firmware was built with, e.g. READ_EXTERNAL_VOLTS=1")
+    args = parser.parse_args()
+
+    schema = build_schema(args.sketch, args.defines)
+
+    if args.mask is not None:
+        print(header_line(schema, args.mask))
+    elif args.decode:
+        mask, columns = decode(schema, args.decode)
+        if mask is None:
+            print("%s: header doesn't match any fields this firmware can write" % args.decode)
+            return 1
+        print("%s: written with fields %d (F%dE)" % (args.decode, mask, mask))
+        for n, (field, column) in enumerate(columns):
+            print("%3d  %-16s %s" % (n, field or "", column))
+    else:
+        print(json.dumps(schema, indent=2))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""
+live_view.py
+
+Shows the logger's live telemetry while commissioning anemometers and vanes.
+The logger must be in calibrate mode (D6 pulled low).
+
+Streaming is started with the "M" command and the binary frames (see
+telemetry.h) are decoded into pulse rates, wind speeds, the vane reading and
+direction and the raw analog channels. Streaming is stopped on Ctrl-C.
+
+  python3 live_view.py /dev/ttyUSB0              (10 frames per second)
+  python3 live_view.py /dev/ttyUSB0 --rate 2 --csv commissioning.csv
+
+Text the logger sends between frames (e.g. the record echo) is printed as it is.
+Needs pyserial.
+"""
+
+import argparse
+import struct
+import sys
+import time
+from collections import deque
+
+from logger_link import BAUD, REPLY_TIMEOUT, LoggerLink, CommandError, crc16, frame as frame_command
+
+FRAME_START = 0x02
+FRAME_LIVE = ord("T")
+FLAG_REPEATED = 0x80
+TIMER_HZ = 100
+
+# After FRAME_LIVE: sequence, time, pulses x2, vane, direction, adc x5, channels
+PAYLOAD = struct.Struct("<BHHHHB5HB")
+FRAME_LENGTH = 2 + PAYLOAD.size + 2
+
+DIRECTIONS = ["N", "NE", "E", "SE", "S", "SW", "W", "NW"]
+CHANNELS = ["Batt", "Volts", "Amps", "Irr", "Temp", "Vane"]  # analog_channel order
+
+
+class Frame:
+    def __init__(self, fields):
+        (self.sequence, self.time, pulses1, pulses2, self.vane, self.direction) = fields[:6]
+        self.pulses = (pulses1, pulses2)
+        self.adc = fields[6:11]
+        self.channels = fields[11] & ~FLAG_REPEATED
+        self.repeated = bool(fields[11] & FLAG_REPEATED)
+
+
+class Decoder:
+    """Splits the serial stream into telemetry frames and text lines"""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.bad_frames = 0
+
+    def feed(self, data):
+        """Yields Frame objects and text lines (str) found in data"""
+        self.buffer += data
+        while self.buffer:
+            start = self.buffer.find(bytes([FRAME_START]))
+            if start != 0:
+                text_end = len(self.buffer) if start < 0 else start
+                newline = self.buffer.find(b"\n", 0, text_end)
+                if newline < 0:
+                    if start < 0:
+                        return  # Wait for the rest of the line
+                    newline = start - 1
+                line = self.buffer[:newline + 1].decode("ascii", "replace").strip()
+                del self.buffer[:newline + 1]
+                if line and line.isprintable():
+                    yield line
+                continue
+
+            if len(self.buffer) < FRAME_LENGTH:
+                return
+            body = bytes(self.buffer[1:FRAME_LENGTH - 2])
+            (crc,) = struct.unpack("<H", self.buffer[FRAME_LENGTH - 2:FRAME_LENGTH])
+            if body[0] != FRAME_LIVE or crc != crc16(body):
+                # Not a frame (or a damaged one) - resync on the next start byte
+                self.bad_frames += 1
+                del self.buffer[:1]
+                continue
+            del self.buffer[:FRAME_LENGTH]
+            yield Frame(PAYLOAD.unpack(body[1:]))
+
+
+class Rates:
+    """Pulse rates over about the last second of frames. The counters wrap at 16 bits."""
+
+    def __init__(self, window=1.0):
+        self.window = window
+        self.history = deque()
+        self.elapsed = 0.0
+        self.last_time = None
+
+    def add(self, frame):
+        if self.last_time is not None:
+            self.elapsed += ((frame.time - self.last_time) & 0xFFFF) / TIMER_HZ
+        self.last_time = frame.time
+        self.history.append((self.elapsed, frame.pulses))
+        while len(self.history) > 2 and self.elapsed - self.history[1][0] >= self.window:
+            self.history.popleft()
+
+    def hz(self, counter):
+        (t0, p0), (t1, p1) = self.history[0], self.history[-1]
+        if t1 <= t0:
+            return 0.0
+        return ((p1[counter] - p0[counter]) & 0xFFFF) / (t1 - t0)
+
+
+def speed(hz, slope, offset):
+    """As WIND_PulsesToSpeed, in m/s"""
+    return (slope * hz + offset) / 1000.0 if hz > 0 else 0.0
+
+
+def query(link, command):
+    """Returns the values of a "?" query as {name: value}"""
+    values = {}
+    for line in link.command(command):
+        name, _, value = line.partition("=")
+        values[name] = value
+    return values
+
+
+def stop_streaming(port, decoder):
+    """Sends M0 and waits for its OK among any frames still arriving"""
+    port.write(frame_command("M0"))
+    deadline = time.monotonic() + REPLY_TIMEOUT
+    while time.monotonic() < deadline:
+        for item in decoder.feed(port.read(256)):
+            if item == "OK" or (isinstance(item, str) and item.startswith("ERR")):
+                return
+    # No reply: the logger may have left calibrate mode, which stops streaming anyway
+
+
+def show(frame, rates, slope, offset):
+    parts = ["%5.1fs #%03d" % (rates.elapsed, frame.sequence)]
+    for i in range(2):
+        hz = rates.hz(i)
+        parts.append("A%d %6.2fHz %5.2fm/s" % (i + 1, hz, speed(hz, slope, offset)))
+    if frame.channels & (1 << 5):
+        direction = DIRECTIONS[frame.direction] if frame.direction < 8 else "--"
+        parts.append("vane %4d %-2s" % (frame.vane, direction))
+    for ch in range(5):
+        if frame.channels & (1 << ch):
+            parts.append("%s %4d" % (CHANNELS[ch], frame.adc[ch]))
+    if frame.repeated:
+        parts.append("(ADC busy)")
+    return "  ".join(parts)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port")
+    parser.add_argument("--rate", type=int, default=10, help="frames per second (1 to 10)")
+    parser.add_argument("--csv", help="also log every frame to this file")
+    args = parser.parse_args()
+
+    import serial  # pyserial
+    port = serial.Serial(args.port, BAUD, timeout=0.1)
+    port.reset_input_buffer()
+    link = LoggerLink(port)
+
+    try:
+        calibration = query(link, "C?")
+        slope = int(calibration.get("C1", 765))
+        offset = int(calibration.get("C2", 350))
+        link.command("M%d" % args.rate)
+    except CommandError as e:
+        print(e, file=sys.stderr)
+        return 1
+
+    log = open(args.csv, "w") if args.csv else None
+    if log:
+        log.write("host time,sequence,time,pulses 1,pulses 2,vane,direction,%s,channels\n" % ",".join(CHANNELS[:5]))
+
+    decoder = Decoder()
+    rates = Rates()
+    interactive = sys.stdout.isatty()
+    try:
+        while True:
+            for item in decoder.feed(port.read(256)):
+                if isinstance(item, str):
+                    print(("\n" if interactive else "") + item)
+                    continue
+                rates.add(item)
+                line = show(item, rates, slope, offset)
+                print(("\r" + line + "\033[K") if interactive else line, end="" if interactive else "\n", flush=True)
+                if log:
+                    log.write("%.3f,%d,%d,%d,%d,%d,%d,%s,%d\n" % (
+                        time.time(), item.sequence, item.time, item.pulses[0], item.pulses[1],
+                        item.vane, item.direction, ",".join(str(a) for a in item.adc),
+                        item.channels | (FLAG_REPEATED if item.repeated else 0)))
+    except KeyboardInterrupt:
+        print()
+    finally:
+        stop_streaming(port, decoder)
+        if log:
+            log.close()
+        port.close()
+
+    if decoder.bad_frames:
+        print("%d damaged frames skipped" % decoder.bad_frames)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+logger_files.py
+
+Lists and downloads the data files on a logger's SD card over serial,
+without opening the enclosure. The logger must be in calibrate mode.
+
+  python3 logger_files.py /dev/ttyUSB0 list
+  python3 logger_files.py /dev/ttyUSB0 get 261019 [-o D261019.csv] [--offset N] [--length N]
+  python3 logger_files.py /dev/ttyUSB0 get 2610191    (D2610191.csv, after a change of fields)
+  python3 logger_files.py /dev/ttyUSB0 mirror ./unit07
+
+mirror keeps a local copy of every DYYMMDD.csv and DYYMMDDn.csv. Data files are only ever
+appended to, so each one is fetched from the end of the local copy and only
+new data crosses the link. An interrupted mirror picks up where it stopped.
+
+Needs pyserial.
+"""
+
+import argparse
+import os
+import re
+import sys
+import time
+
+from logger_link import BAUD, LoggerLink, CommandError
+
+DATA_FILE = re.compile(r"^D(\d{6,7})\.CSV$", re.IGNORECASE)
+
+
+def open_port(path):
+    import serial  # pyserial
+    port = serial.Serial(path, BAUD, timeout=0.2)
+    port.reset_input_buffer()
+    return port
+
+
+def cmd_list(link, args):
+    for name, size in sorted(link.list_files().items()):
+        print("%-12s %10d" % (name, size))
+
+
+def cmd_get(link, args):
+    output = args.output or "D%s.csv" % args.date
+    mode = "ab" if args.offset else "wb"
+    start = time.monotonic()
+    with open(output, mode) as f:
+        end = link.fetch(args.date, args.offset, args.length, f.write)
+    report(output, end - args.offset, time.monotonic() - start)
+
+
+def mirror(link, directory, log=print):
+    """Brings directory up to date with the logger. Returns the bytes fetched."""
+    os.makedirs(directory, exist_ok=True)
+    fetched = 0
+
+    for name, size in sorted(link.list_files().items()):
+        match = DATA_FILE.match(name)
+        if not match:
+            continue
+
+        local = os.path.join(directory, "D%s.csv" % match.group(1))
+        have = os.path.getsize(local) if os.path.exists(local) else 0
+
+        if have > size:
+            log("%s: local copy is longer than the logger's, skipped" % name)
+            continue
+        if have == size:
+            continue
+
+        start = time.monotonic()
+        with open(local, "ab") as f:
+            end = link.fetch(match.group(1), have, 0, f.write)
+        fetched += end - have
+        report(name, end - have, time.monotonic() - start, log)
+
+    return fetched
+
+
+def cmd_mirror(link, args):
+    fetched = mirror(link, args.directory)
+    print("%d bytes fetched" % fetched)
+
+
+def report(name, count, seconds, log=print):
+    rate = count / seconds if seconds > 0 else 0
+    log("%s: %d bytes in %.1fs (%.0f bytes/s)" % (name, count, seconds, rate))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    sub.add_parser("list")
+
+    get = sub.add_parser("get")
+    get.add_argument("date", help="YYMMDD, or YYMMDDn for DYYMMDDn.csv")
+    get.add_argument("-o", "--output")
+    get.add_argument("--offset", type=int, default=0, help="start here (appends to the output)")
+    get.add_argument("--length", type=int, default=0, help="bytes to fetch (0 = to the end)")
+
+    mirror_parser = sub.add_parser("mirror")
+    mirror_parser.add_argument("directory")
+
+    args = parser.parse_args()
+
+    with open_port(args.port) as port:
+        link = LoggerLink(port)
+        try:
+            {"list": cmd_list, "get": cmd_get, "mirror": cmd_mirror}[args.command](link, args)
+        except CommandError as e:
+            print(e, file=sys.stderr)
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
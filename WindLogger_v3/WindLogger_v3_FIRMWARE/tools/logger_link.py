@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+logger_link.py
+
+The host side of the logger's calibrate mode serial protocol, shared by the
+other tools:
+
+  - commands are framed with a CRC-8 and answered with "OK" or "ERR <reason>"
+    (see serial_handler.cpp)
+  - file transfers come back as blocks (see transfer.h):
+        0x02 'B' offset:u32 length:u16 data crc:u16    (little-endian)
+    with a CRC-16/XMODEM of everything after the 0x02.
+    A block of length 0 ends the transfer.
+
+The port can be a pyserial Serial or anything with read(n), write(bytes)
+and readline() that returns b"" on a timeout.
+"""
+
+import binascii
+import struct
+import time
+
+BAUD = 115200
+REPLY_TIMEOUT = 5.0
+
+FRAME_START = 0x02
+FRAME_BLOCK = ord("B")
+BLOCK_SIZE = 512
+WINDOW_SIZE = 8 * BLOCK_SIZE
+
+
+def crc8(data, crc=0):
+    """CRC-8, polynomial 0x07 (avr-libc _crc8_ccitt_update)"""
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def crc16(data):
+    """CRC-16/XMODEM (avr-libc _crc_xmodem_update from 0)"""
+    return binascii.crc_hqx(bytes(data), 0)
+
+
+def frame(command):
+    """The command with its CRC and end marker, e.g. S600 -> S600*33E"""
+    body = command.encode("ascii")
+    return body + b"*%02x" % crc8(body) + b"E"
+
+
+def block_frame(offset, data):
+    """Builds a transfer block as the logger sends it (for test fixtures)"""
+    body = bytes([FRAME_BLOCK]) + struct.pack("<IH", offset, len(data)) + bytes(data)
+    return bytes([FRAME_START]) + body + struct.pack("<H", crc16(body))
+
+
+class CommandError(Exception):
+    pass
+
+
+class LoggerLink:
+    def __init__(self, port, timeout=REPLY_TIMEOUT):
+        self.port = port
+        self.timeout = timeout
+
+    def command(self, command):
+        """Sends a command, returns the lines before "OK". Raises CommandError on ERR or no reply."""
+        self.port.write(frame(command))
+        lines = []
+        deadline = time.monotonic() + self.timeout
+        while time.monotonic() < deadline:
+            line = self.port.readline().decode("ascii", "replace").strip()
+            if not line:
+                continue
+            if line == "OK":
+                return lines
+            if line.startswith("ERR"):
+                raise CommandError("%s: %s" % (command, line))
+            lines.append(line)
+        raise CommandError("%s: no reply" % command)
+
+    def list_files(self):
+        """Returns {name: size} for the files on the card"""
+        files = {}
+        for line in self.command("L"):
+            name, _, size = line.rpartition(",")
+            if name and size.isdigit():
+                files[name] = int(size)
+        return files
+
+    def _read_exact(self, count, deadline):
+        data = b""
+        while len(data) < count:
+            if time.monotonic() > deadline:
+                raise CommandError("transfer timed out")
+            data += self.port.read(count - len(data))
+        return data
+
+    def read_blocks(self):
+        """
+        Yields (offset, data, good) for each block of a transfer, then returns at the end block.
+        Bytes outside frames (stray text) are skipped.
+        """
+        deadline = time.monotonic() + self.timeout
+        while True:
+            b = self._read_exact(1, deadline)
+            if b[0] != FRAME_START:
+                continue
+            body = self._read_exact(7, deadline)
+            if body[0] != FRAME_BLOCK:
+                continue
+            offset, length = struct.unpack("<IH", body[1:7])
+            if length > BLOCK_SIZE:
+                # Not a real header - keep looking
+                continue
+            data = self._read_exact(length, deadline)
+            (crc,) = struct.unpack("<H", self._read_exact(2, deadline))
+            good = crc == crc16(body + data)
+            deadline = time.monotonic() + self.timeout
+            if length == 0 and good:
+                return
+            yield offset, data, good
+
+    def fetch(self, digits, offset=0, length=0, sink=None):
+        """
+        Transfers a data file from offset, retrying from the first bad block.
+        digits are those of its name: "261019" for D261019.csv or "2610191"
+        for D2610191.csv (a YYMMDD int is also taken).
+        sink(data) is called with each good block, in order.
+        Returns the offset reached.
+
+        The file is asked for a window at a time: after a bad block the rest
+        of its window still has to arrive before it can be asked for again,
+        so the window bounds what an error costs.
+        """
+        if isinstance(digits, int):
+            digits = "%06d" % digits
+        end = offset + length if length else None
+        retries = 0
+        while True:
+            start = offset
+            window = WINDOW_SIZE if end is None else min(WINDOW_SIZE, end - offset)
+            self.command("G%s,%d,%d" % (digits, offset, window))
+
+            failed = False
+            for block_offset, data, good in self.read_blocks():
+                if failed:
+                    continue  # Drain to the end block, then ask again
+                if not good or block_offset != offset:
+                    failed = True
+                    continue
+                if sink:
+                    sink(data)
+                offset += len(data)
+
+            if not failed:
+                # A short window is the end of the file
+                if offset - start < window or offset == end:
+                    return offset
+                retries = 0
+                continue
+
+            # Only give up if the same block keeps failing
+            retries = retries + 1 if offset == start else 0
+            if retries > 10:
+                raise CommandError("too many bad blocks at offset %d" % offset)
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""
+provision.py
+
+Sends calibrate mode commands to a logger and checks each one is accepted.
+The logger must be in calibrate mode (D6 pulled low).
+
+Each command is sent with a CRC and the next is only sent once the
+logger has answered "OK" (or "ERR ..."), so the logger's serial receive
+buffer can never overflow however long a command takes.
+
+Commands are given as in the README, without the final E, e.g.
+
+  python3 provision.py /dev/ttyUSB0 R07 S600 P13600 "C1?"
+  python3 provision.py /dev/ttyUSB0 -f unit07.txt   (one command per line, # comments)
+
+Needs pyserial.
+"""
+
+import argparse
+import sys
+import time
+
+BAUD = 115200
+REPLY_TIMEOUT = 5.0
+
+
+def crc8(data, crc=0):
+    """CRC-8, polynomial 0x07 (avr-libc _crc8_ccitt_update)"""
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def frame(command):
+    """The command with its CRC and end marker, e.g. S600 -> S600*33E"""
+    body = command.encode("ascii")
+    return body + b"*%02x" % crc8(body) + b"E"
+
+
+def send(port, command):
+    """Sends one command. Returns (ok, reply lines)"""
+    port.write(frame(command))
+    lines = []
+    deadline = time.monotonic() + REPLY_TIMEOUT
+    while time.monotonic() < deadline:
+        line = port.readline().decode("ascii", "replace").strip()
+        if not line:
+            continue
+        if line == "OK":
+            return True, lines
+        if line.startswith("ERR"):
+            return False, lines + [line]
+        lines.append(line)
+    return False, lines + ["(no reply)"]
+
+
+def read_commands(args):
+    commands = list(args.commands)
+    if args.file:
+        with open(args.file) as f:
+            for line in f:
+                line = line.split("#", 1)[0].strip()
+                if line:
+                    commands.append(line)
+    return commands
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port")
+    parser.add_argument("commands", nargs="*")
+    parser.add_argument("-f", "--file", help="file of commands, one per line")
+    args = parser.parse_args()
+
+    import serial  # pyserial
+
+    commands = read_commands(args)
+    failed = 0
+
+    with serial.Serial(args.port, BAUD, timeout=0.2) as port:
+        port.reset_input_buffer()
+        for command in commands:
+            ok, lines = send(port, command)
+            # Skip the live data lines printed every second in calibrate mode
+            lines = [l for l in lines if "=" in l or l.startswith("ERR") or l.startswith("(")]
+            print("%-10s %s %s" % (command, "OK " if ok else "ERR", " ".join(lines)))
+            if not ok:
+                failed += 1
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+sd_wear.py
+
+Runs the host simulator (host/) on a fresh FAT32 card image for each sample
+time and power state, and tabulates what each record costs the card: sectors
+written (data, directory and FAT), write amplification, erase blocks erased,
+and how long the card would last.
+
+  python3 sd_wear.py
+  python3 sd_wear.py --days 7 --samples 10,60,600 --open-blocks 1,2,4
+  python3 sd_wear.py --sim host/build/windlogger_sim --erase-block 256 --endurance 10000
+
+Conserve is the battery held below the conserve threshold (power.cpp), so
+records are batched per card write. The flash model is the simulator's
+(hal_card.cpp): a sector written outside the card's open erase blocks, or
+behind one already written in its block, costs an erase.
+
+Build the simulator first (see the README).
+"""
+
+import argparse
+import itertools
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_SIM = os.path.join(HERE, "..", "host", "build", "windlogger_sim")
+
+POWER_STATES = {
+    "normal": "12.4",       # Battery volts, well above the conserve threshold
+    "conserve": "3.5",      # Below POWER_CONSERVE_ENTER, above survival
+}
+
+RECORDS = re.compile(r"^  records\s+(\d+)", re.MULTILINE)
+SECTORS = re.compile(r"^Card per record$.*?^  sectors written\s+([\d.]+) \(([\d.]+) data, ([\d.]+) directory, ([\d.]+) FAT", re.MULTILINE | re.DOTALL)
+AMPLIFICATION = re.compile(r"^  write amplification\s+([\d.]+)", re.MULTILINE)
+ERASES = re.compile(r"^Card per record$.*?^  erases\s+([\d.]+)", re.MULTILINE | re.DOTALL)
+LIFE = re.compile(r"^  wear levelled\s+([\d.]+) years\n  without levelling\s+([\d.]+) years", re.MULTILINE)
+LONGEST = re.compile(r"longest call ([\d.]+)ms")
+
+
+def run(args, sample, power, open_blocks):
+    """Runs one configuration, returning a row of the table"""
+    with tempfile.TemporaryDirectory() as work:
+        command = [args.sim, "--days", str(args.days), "--seed", str(args.seed),
+                   "--card-image", os.path.join(work, "card.img"),
+                   "--card-erase-block", str(args.erase_block),
+                   "--card-open-blocks", str(open_blocks),
+                   "--card-endurance", str(args.endurance),
+                   "--battery", POWER_STATES[power],
+                   "--command", "S%dE" % sample]
+        report = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                                universal_newlines=True, check=True).stderr
+
+    sectors = SECTORS.search(report)
+    life = LIFE.search(report)
+    if not (sectors and life):
+        raise RuntimeError("no card report from: %s\n%s" % (" ".join(command), report))
+
+    return {
+        "sample": sample,
+        "power": power,
+        "open": open_blocks,
+        "records": int(RECORDS.search(report).group(1)),
+        "sectors": [float(x) for x in sectors.groups()],
+        "amplification": float(AMPLIFICATION.search(report).group(1)),
+        "erases": float(ERASES.search(report).group(1)),
+        "longest": float(LONGEST.search(report).group(1)),
+        "life": [float(x) for x in life.groups()],
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sim", default=DEFAULT_SIM, help="the windlogger_sim to run")
+    parser.add_argument("--days", type=int, default=3, help="simulated days for each run")
+    parser.add_argument("--seed", type=int, default=1, help="weather seed")
+    parser.add_argument("--samples", default="10,60,600", help="sample times to try, in seconds")
+    parser.add_argument("--power", default="normal,conserve", help="power states to try")
+    parser.add_argument("--open-blocks", default="2", help="erase blocks the card writes into at once")
+    parser.add_argument("--erase-block", type=int, default=128, help="erase block, KB")
+    parser.add_argument("--endurance", type=int, default=3000, help="erase cycles an erase block lasts")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.sim):
+        sys.exit("%s not found: build the simulator first (cmake -S host -B host/build && cmake --build host/build)" % args.sim)
+
+    samples = [int(s) for s in args.samples.split(",")]
+    powers = args.power.split(",")
+    for power in powers:
+        if power not in POWER_STATES:
+            sys.exit("unknown power state %s (%s)" % (power, ", ".join(POWER_STATES)))
+    open_blocks = [int(n) for n in args.open_blocks.split(",")]
+
+    print("%d days each, %dKB erase blocks, %d erase cycles" % (args.days, args.erase_block, args.endurance))
+    print("%7s %-9s %4s %8s %8s %7s %7s %6s %7s %7s %8s %10s %10s" %
+          ("sample", "power", "open", "records", "sectors", "data", "dir", "FAT", "ampl.", "erases",
+           "longest", "levelled", "unlevelled"))
+    print("%7s %-9s %4s %8s %8s %7s %7s %6s %7s %7s %8s %10s %10s" %
+          ("s", "", "", "", "/record", "", "", "", "", "/record", "ms", "years", "years"))
+
+    for sample, power, blocks in itertools.product(samples, powers, open_blocks):
+        row = run(args, sample, power, blocks)
+        print("%7d %-9s %4d %8d %8.3f %7.3f %7.3f %6.3f %7.1f %7.3f %8.1f %10.1f %10.2f" %
+              ((row["sample"], row["power"], row["open"], row["records"]) + tuple(row["sectors"]) +
+               (row["amplification"], row["erases"], row["longest"]) + tuple(row["life"])))
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,343 @@
+#!/usr/bin/env python3
+"""
+soak.py
+
+Runs the firmware on the host simulator (host/) for a year, on one FAT32
+card image and one EEPROM, through what a deployment goes through: month,
+year and leap day rollovers, card swaps, the card pulled out part way
+through a write, serial sessions in calibrate mode (sample time changes,
+file listings and downloads, live streaming), a low battery and power
+losses. Then it reads every data file back and checks the timestamps.
+
+  python3 soak.py --sim host/build/windlogger_sim
+  python3 soak.py --sim host/build/windlogger_sim --days 60 --seed 3 --work /tmp/soak
+
+A power loss ends one run of the simulator and the next starts the firmware
+from reset, with the RTC moved on by the outage, the same EEPROM file and
+the same card image. Anything the firmware hadn't written to the card (the
+SdFat cache, records queued in conserve) is lost, as it would be.
+
+It reports the files created, bytes written, the card's write failures,
+the deepest the firmware's stack went (host bytes, see host/sim/stack.cpp)
+and the timestamp discontinuities in the data files: records out of
+order or repeated, records in the wrong day's file, and gaps between
+records other than the sample time that no power loss, card swap or
+sample time change explains. The exit status is 1 if there are any.
+
+The events come from --seed, so a run is repeatable. The work directory
+keeps the image, the EEPROM, each run's script, serial output and report,
+and the files read back from the card.
+"""
+
+import argparse
+import calendar
+import datetime
+import os
+import random
+import re
+import shutil
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_SIM = os.path.join(HERE, "..", "host", "build", "windlogger_sim")
+
+DAY = 86400
+DEFAULT_SAMPLE_TIME = 600       # sd.cpp, with a fresh EEPROM
+NORMAL_BATTERY = 12.4
+CONSERVE_BATTERY = 3.5          # Below POWER_CONSERVE_ENTER, above survival
+COMMAND_START = 2               # Seconds after the calibrate switch, as the simulator's --command
+COMMAND_SPACING = 30            # Long enough for a day's file to download
+TOLERANCE = 1                   # Seconds a gap can be off the sample time
+
+SAMPLE_TIMES = (60, 300, 600, 900)
+
+DATA_FILE = re.compile(r"^D(\d{2})(\d{2})(\d{2})\d?\.CSV$", re.IGNORECASE)
+RECORD = re.compile(r"^\d+,(\d{2})-(\d{2})-(\d{4}),(\d{2}):(\d{2}):(\d{2}),(.*)$")
+
+REPORT = {
+    "files_created": re.compile(r"^  files created\s+(\d+)", re.MULTILINE),
+    "bytes_written": re.compile(r"^  bytes written\s+(\d+) \(\d+ on the card\)", re.MULTILINE),
+    "write_failures": re.compile(r"^  write failures\s+(\d+)", re.MULTILINE),
+    "stack": re.compile(r"^  deepest\s+(\d+) bytes, host \(day (\d+) (\d+):(\d+):(\d+)\)", re.MULTILINE),
+}
+
+
+def unix(text):
+    return calendar.timegm(datetime.datetime.strptime(text, "%Y-%m-%dT%H:%M:%S").timetuple())
+
+
+def when(seconds):
+    return datetime.datetime.utcfromtimestamp(seconds).strftime("%Y-%m-%d %H:%M:%S")
+
+
+class Plan:
+    """What happens to the logger over the soak, in absolute (RTC) seconds"""
+
+    def __init__(self, start, days, rng):
+        self.start = start
+        self.end = start + days * DAY
+        self.outages = []       # (off, on)
+        self.cards = []         # (out, in, pull writes or 0 for a swap)
+        self.sessions = []      # (time, [commands])
+        self.batteries = []     # (low, back)
+
+        def every(low_days, high_days):
+            t = start + rng.uniform(low_days, high_days) * DAY
+            while t < self.end:
+                yield int(t)
+                t += rng.uniform(low_days, high_days) * DAY
+
+        for off in every(15, 45):
+            self.outages.append((off, off + rng.choice((60, 600, 3600, 6 * 3600, DAY, 3 * DAY))))
+
+        for out in every(7, 21):
+            self.cards.append((out, out + rng.randint(2, 120) * 60, 0))
+        for pull in every(30, 90):
+            self.cards.append((pull, pull + 6 * 3600, rng.randint(1, 8)))
+
+        for low in every(30, 60):
+            self.batteries.append((low, low + rng.randint(6, 72) * 3600))
+
+        sample_time = DEFAULT_SAMPLE_TIME
+        for t in every(5, 15):
+            commands = ["S?E", "LE", "F?E"]
+            day = datetime.datetime.utcfromtimestamp(t)
+            commands.append("G%sE" % day.strftime("%y%m%d"))
+            if rng.random() < 0.3:
+                commands += ["M5E", "M0E"]
+            if rng.random() < 0.3:
+                commands.append("BE")
+            if rng.random() < 0.5:
+                sample_time = rng.choice([s for s in SAMPLE_TIMES if s != sample_time])
+                commands.append("S%dE" % sample_time)
+            self.sessions.append((t, commands))
+
+        # Nothing happens while the power is off
+        self.sessions = [s for s in self.sessions if not self.powered_off(s[0], self.session_end(s))]
+        self.cards = [c for c in self.cards if not self.powered_off(c[0], c[0])]
+
+    @staticmethod
+    def session_end(session):
+        return session[0] + COMMAND_START + (len(session[1]) + 1) * COMMAND_SPACING
+
+    def powered_off(self, start, end):
+        return any((start < on) and (end >= off) for off, on in self.outages)
+
+    def segments(self):
+        """(start, end) of each run of the simulator, between power losses"""
+        t = self.start
+        for off, on in sorted(self.outages):
+            if off >= self.end:
+                break
+            yield (t, off)
+            t = on
+        if t < self.end:
+            yield (t, self.end)
+
+    def sample_changes(self):
+        """(time, sample time) of each S command"""
+        changes = []
+        for t, commands in self.sessions:
+            for n, command in enumerate(commands):
+                if re.match(r"^S\d+E$", command):
+                    changes.append((t + COMMAND_START + n * COMMAND_SPACING, int(command[1:-1])))
+        return changes
+
+    def script(self, start, end):
+        """The simulator's script for a run from start to end"""
+        lines = []
+
+        def add(t, action):
+            if start <= t < end:
+                lines.append((t - start, len(lines), action))
+
+        # The card and battery are as they were left
+        for out, back, pull in self.cards:
+            if out < start < back:
+                add(start, "card out")
+                add(back, "card in")
+            elif pull:
+                add(out, "card pull %d" % pull)
+                add(back, "card in")
+            else:
+                add(out, "card out")
+                add(back, "card in")
+        for low, back in self.batteries:
+            add(max(low, start) if low < start < back else low, "battery %.1f" % CONSERVE_BATTERY)
+            add(back, "battery %.1f" % NORMAL_BATTERY)
+        for session in self.sessions:
+            t, commands = session
+            add(t, "calibrate on")
+            for n, command in enumerate(commands):
+                add(t + COMMAND_START + n * COMMAND_SPACING, "send " + command)
+            add(self.session_end(session), "calibrate off")
+
+        return "".join("%d %s\n" % (t, action) for t, _, action in sorted(lines))
+
+    def disturbances(self, sample_times):
+        """Windows in which a gap other than the sample time is expected"""
+        longest = max(sample_times)
+        windows = [(off, on + longest, "power loss") for off, on in self.outages]
+        windows += [(out, back + longest, "card pulled" if pull else "card out") for out, back, pull in self.cards]
+        windows += [(t, t + longest, "sample time changed") for t, _ in self.sample_changes()]
+        return windows
+
+
+def run_segment(args, plan, number, start, end, last):
+    """Runs the simulator from start to end, returning its report's figures"""
+    base = os.path.join(args.work, "run%03d" % number)
+    with open(base + ".script", "w") as f:
+        f.write(plan.script(start, end))
+
+    command = [args.sim, "--days", "%.6f" % ((end - start) / DAY),
+               "--start", datetime.datetime.utcfromtimestamp(start).strftime("%Y-%m-%dT%H:%M:%S"),
+               "--seed", str(args.seed * 1000 + number),
+               "--card-image", os.path.join(args.work, "card.img"),
+               "--eeprom", os.path.join(args.work, "eeprom.bin"),
+               "--serial", base + ".serial",
+               "--script", base + ".script",
+               "--battery", "%.1f" % (CONSERVE_BATTERY if any(low <= start < back for low, back in plan.batteries)
+                                      else NORMAL_BATTERY)]
+    if last:
+        command += ["--card-extract", os.path.join(args.work, "card")]
+
+    result = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+    with open(base + ".report", "w") as f:
+        f.write(result.stderr)
+    if result.returncode != 0:
+        sys.exit("run %d failed (%d): %s\n%s" % (number, result.returncode, " ".join(command), result.stderr))
+
+    figures = {}
+    for name, pattern in REPORT.items():
+        match = pattern.search(result.stderr)
+        if not match:
+            sys.exit("run %d: no '%s' in the report\n%s" % (number, name, result.stderr))
+        figures[name] = [int(x) for x in match.groups()]
+
+    day, hours, minutes, seconds = figures["stack"][1:]
+    figures["stack"] = (figures["stack"][0], start + day * DAY + hours * 3600 + minutes * 60 + seconds)
+    return figures
+
+
+def read_records(directory):
+    """[(time, file name, date in the file name)] of every record, in file and line order"""
+    records = []
+    for name in sorted(os.listdir(directory)):
+        match = DATA_FILE.match(name)
+        if not match:
+            continue
+        yy, mm, dd = (int(x) for x in match.groups())
+        with open(os.path.join(directory, name), errors="replace") as f:
+            for line in f:
+                row = RECORD.match(line.strip())
+                if not row:
+                    continue    # Column headers
+                day, month, year, hour, minute, second, rest = row.groups()
+                if not rest[:1].isdigit():
+                    continue    # An event row, e.g. "Power CONSERVE 3520mV"
+                t = calendar.timegm((int(year), int(month), int(day), int(hour), int(minute), int(second)))
+                records.append((t, name, (2000 + yy, mm, dd)))
+    return records
+
+
+def check_records(records, plan):
+    """Returns {kind: [description]} of the discontinuities"""
+    changes = plan.sample_changes()
+    windows = plan.disturbances([DEFAULT_SAMPLE_TIME] + [s for _, s in changes])
+    found = {"out of order or repeated": [], "in the wrong file": [], "unexplained gaps": [], "explained gaps": []}
+
+    def sample_time_at(t):
+        sample_time = DEFAULT_SAMPLE_TIME
+        for change, value in changes:
+            if change <= t:
+                sample_time = value
+        return sample_time
+
+    for n, (t, name, file_date) in enumerate(records):
+        date = datetime.datetime.utcfromtimestamp(t)
+        if (date.year, date.month, date.day) != file_date:
+            found["in the wrong file"].append("%s in %s" % (when(t), name))
+        if n == 0:
+            continue
+
+        previous = records[n - 1][0]
+        gap = t - previous
+        expected = sample_time_at(previous)
+        if gap <= 0:
+            found["out of order or repeated"].append("%s after %s (%s)" % (when(t), when(previous), name))
+        elif abs(gap - expected) > TOLERANCE:
+            reasons = sorted(set(reason for start, end, reason in windows if start <= t and end >= previous))
+            entry = "%s to %s: %ds, sample time %ds" % (when(previous), when(t), gap, expected)
+            if reasons:
+                found["explained gaps"].append(entry + " (%s)" % ", ".join(reasons))
+            else:
+                found["unexplained gaps"].append(entry)
+    return found
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sim", default=DEFAULT_SIM, help="the windlogger_sim to run")
+    parser.add_argument("--days", type=int, default=365, help="simulated days")
+    parser.add_argument("--start", default="2027-06-01T00:00:00",
+                        help="RTC time at the start (the default takes in a year end and 29 February 2028)")
+    parser.add_argument("--seed", type=int, default=1, help="seed for the events and the weather")
+    parser.add_argument("--work", default="soak", help="directory for the image, EEPROM, scripts and reports")
+    parser.add_argument("--show", type=int, default=10, help="discontinuities of each kind to list")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.sim):
+        sys.exit("%s not found: build the simulator first (cmake -S host -B host/build && cmake --build host/build)" % args.sim)
+
+    if os.path.exists(args.work):
+        shutil.rmtree(args.work)
+    os.makedirs(os.path.join(args.work, "card"))
+
+    plan = Plan(unix(args.start), args.days, random.Random(args.seed))
+    segments = list(plan.segments())
+
+    totals = {"files_created": 0, "bytes_written": 0, "write_failures": 0}
+    deepest = (0, 0, 0)
+    for number, (start, end) in enumerate(segments):
+        print("run %d of %d: %s to %s" % (number + 1, len(segments), when(start), when(end)))
+        sys.stdout.flush()
+        figures = run_segment(args, plan, number, start, end, number == len(segments) - 1)
+        for name in totals:
+            totals[name] += figures[name][0]
+        if figures["stack"][0] > deepest[0]:
+            deepest = figures["stack"] + (number,)
+
+    records = read_records(os.path.join(args.work, "card"))
+    found = check_records(records, plan)
+    data_files = [n for n in os.listdir(os.path.join(args.work, "card")) if DATA_FILE.match(n)]
+    on_card = sum(os.path.getsize(os.path.join(args.work, "card", n)) for n in os.listdir(os.path.join(args.work, "card")))
+
+    print()
+    print("Soak: %d days from %s, seed %d" % (args.days, when(plan.start), args.seed))
+    print("  %-26s %10d" % ("power losses", len(segments) - 1))
+    print("  %-26s %10d" % ("card swaps", sum(1 for c in plan.cards if not c[2])))
+    print("  %-26s %10d" % ("card pulled in a write", sum(1 for c in plan.cards if c[2])))
+    print("  %-26s %10d" % ("serial sessions", len(plan.sessions)))
+    print("  %-26s %10d" % ("sample time changes", len(plan.sample_changes())))
+    print("  %-26s %10d" % ("low battery spells", len(plan.batteries)))
+    print("Card")
+    print("  %-26s %10d (%d data files)" % ("files", len(os.listdir(os.path.join(args.work, "card"))), len(data_files)))
+    print("  %-26s %10d" % ("files created", totals["files_created"]))
+    print("  %-26s %10d (%d on the card)" % ("bytes written", totals["bytes_written"], on_card))
+    print("  %-26s %10d" % ("records", len(records)))
+    print("  %-26s %10d" % ("write failures", totals["write_failures"]))
+    print("Stack")
+    print("  %-26s %10d bytes, host (%s, run %d)" % ("deepest", deepest[0], when(deepest[1]), deepest[2] + 1))
+    print("Timestamps")
+    for kind, entries in found.items():
+        print("  %-26s %10d" % (kind, len(entries)))
+        for entry in entries[:args.show]:
+            print("    " + entry)
+
+    failed = any(found[kind] for kind in ("out of order or repeated", "in the wrong file", "unexplained gaps"))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+thermistor_table.py
+
+Generates WindLogger_SMD_JF/thermistor_table.h: a PROGMEM table of
+temperature (hundredths of a degree C) against analog reading for each
+supported thermistor, so the firmware only has to interpolate.
+
+The model matches the old float code in temperature.cpp:
+  - thermistor is the pull-up, with a 10k balance resistor to ground
+  - B parameter equation: 1/T = 1/T0 + ln(R/R0)/B
+
+Readings are on the ANALOG_RESULT_BITS (13-bit) scale.
+
+Usage:
+  python3 thermistor_table.py            (writes the header)
+  python3 thermistor_table.py --check    (prints the worst interpolation error)
+"""
+
+import math
+import os
+import sys
+
+RESULT_BITS = 13            # Must match ANALOG_RESULT_BITS in analog.h
+TABLE_SHIFT = 6             # One entry every 64 readings
+FULL_SCALE = 1 << RESULT_BITS
+TABLE_SIZE = (FULL_SCALE >> TABLE_SHIFT) + 1
+
+R_BALANCE = 10000.0
+T_MIN = -55.0               # Clamp the ends of the curve (open/short circuit)
+T_MAX = 150.0
+
+# Same values as the old struct thermistor entries
+THERMISTORS = [
+    # (define, description, B, T0, R0)
+    ("THERMISTOR_EPICOS_K164", "Epicos K164 10K", 4300.0, 298.15, 10000.0),
+    ("THERMISTOR_GT_10K", "GT 10K", 4126.0, 298.15, 10000.0),
+    ("THERMISTOR_VISHAY_10K", "Vishay 10K", 4090.0, 298.15, 47000.0),
+]
+
+OUTPUT = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                      "..", "WindLogger_SMD_JF", "thermistor_table.h")
+
+
+def temperature(reading, b, t0, r0):
+    """Exact temperature in degrees C for a reading (clamped)"""
+    # Thermistor is the pull-up: cold (high R) reads low, hot (low R) reads high
+    if reading <= 0:
+        return T_MIN
+    if reading >= FULL_SCALE:
+        return T_MAX
+    r = (FULL_SCALE * R_BALANCE / reading) - R_BALANCE
+    t = 1.0 / (1.0 / t0 + math.log(r / r0) / b) - 273.15
+    return max(T_MIN, min(T_MAX, t))
+
+
+def table(b, t0, r0):
+    return [int(round(temperature(i << TABLE_SHIFT, b, t0, r0) * 100))
+            for i in range(TABLE_SIZE)]
+
+
+def interpolate(entries, reading):
+    """Same integer maths as temperature.cpp"""
+    index = reading >> TABLE_SHIFT
+    frac = reading & ((1 << TABLE_SHIFT) - 1)
+    low = entries[index]
+    high = entries[index + 1]
+    # C division truncates towards zero, Python's floors
+    step = (high - low) * frac
+    step = -((-step) >> TABLE_SHIFT) if step < 0 else step >> TABLE_SHIFT
+    return low + step
+
+
+def check():
+    for define, name, b, t0, r0 in THERMISTORS:
+        entries = table(b, t0, r0)
+        worst = 0.0
+        worst_t = 0.0
+        for reading in range(1, FULL_SCALE):
+            exact = temperature(reading, b, t0, r0)
+            if exact <= -40.0 or exact >= 85.0:
+                continue
+            error = abs(interpolate(entries, reading) / 100.0 - exact)
+            if error > worst:
+                worst, worst_t = error, exact
+        print("%-16s worst error %.3fC (at %.1fC) over -40C to 85C" % (name, worst, worst_t))
+
+
+def write_header():
+    lines = []
+    lines.append("#ifndef _THERMISTOR_TABLE_H_")
+    lines.append("#define _THERMISTOR_TABLE_H_")
+    lines.append("")
+    lines.append("/*")
+    lines.append(" * Generated by tools/thermistor_table.py - do not edit by hand.")
+    lines.append(" * Temperature in hundredths of a degree C, one entry every %d readings"
+                 % (1 << TABLE_SHIFT))
+    lines.append(" * (%d-bit scale), thermistor as the pull-up over a %dk balance resistor."
+                 % (RESULT_BITS, int(R_BALANCE / 1000)))
+    lines.append(" */")
+    lines.append("")
+    lines.append("#define THERMISTOR_TABLE_BITS %d" % RESULT_BITS)
+    lines.append("#define THERMISTOR_TABLE_SHIFT %d" % TABLE_SHIFT)
+    lines.append("#define THERMISTOR_TABLE_SIZE %d" % TABLE_SIZE)
+    lines.append("")
+    for n, (define, name, b, t0, r0) in enumerate(THERMISTORS):
+        lines.append("%s THERMISTOR_TYPE == %s  // %s: B=%g, R0=%g"
+                     % ("#if" if n == 0 else "#elif", define, name, b, r0))
+        lines.append("static const int16_t s_thermistorTable[THERMISTOR_TABLE_SIZE] PROGMEM = {")
+        entries = table(b, t0, r0)
+        for i in range(0, TABLE_SIZE, 8):
+            chunk = ", ".join("%d" % e for e in entries[i:i + 8])
+            comma = "," if i + 8 < TABLE_SIZE else ""
+            lines.append("\t" + chunk + comma)
+        lines.append("};")
+    lines.append("#else")
+    lines.append("#error \"Unknown THERMISTOR_TYPE\"")
+    lines.append("#endif")
+    lines.append("")
+    lines.append("#endif")
+    with open(OUTPUT, "w") as f:
+        f.write("\n".join(lines) + "\n")
+    print("Wrote " + os.path.normpath(OUTPUT))
+
+
+if __name__ == "__main__":
+    if "--check" in sys.argv:
+        check()
+    else:
+        write_header()
@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+"""
+trace_view.py
+
+Shows the logger's trace ring (firmware built with TRACE_ENABLED 1, see
+trace.h) as a timeline of the main loop's phases and the interrupts, and a
+histogram of how long each phase took.
+
+The ring is sent with the "X" command, with the logger in calibrate mode.
+Recording stops as calibrate mode is entered, so the first dump is of the
+logger as it was running, and starts again after each dump:
+
+  python3 trace_view.py /dev/ttyUSB0
+  python3 trace_view.py /dev/ttyUSB0 --dumps 10 --interval 5 --save trace.bin
+  python3 trace_view.py --file trace.bin                 (dumps saved before)
+  python3 trace_view.py --file serial.bin --no-timeline  (the simulator's --serial output)
+
+Times are Timer1 counts, which stop while the logger is in power-down or
+ADC noise reduction sleep, so the timeline is of the time it was awake (or
+in idle sleep, as in calibrate mode). The count wraps every 65536 ticks
+(262ms at 16MHz): a longer stretch between two entries shows as that much
+shorter. A phase whose start was overwritten before the dump is left out.
+
+The names come from the trace_id enum in trace.h. Needs pyserial for a port.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import time
+
+from logger_link import BAUD, REPLY_TIMEOUT, CommandError, crc16, frame as frame_command
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TRACE_H = os.path.join(HERE, "..", "WindLogger_SMD_JF", "trace.h")
+
+FRAME_START = 0x02
+FRAME_DUMP = ord("X")
+END_FLAG = 0x80
+HEADER = struct.Struct("<HBB")  # ticks per ms, lost, count
+ENTRY = struct.Struct("<BH")  # id, time
+
+BAR_WIDTH = 40
+
+
+def read_names(path=TRACE_H):
+    """{id: name} from the trace_id enum, e.g. {1: "loop", 0x20: "rtc"}"""
+    with open(path) as f:
+        text = f.read()
+    body = re.search(r"enum\s+trace_id\s*\{(.*?)\}", text, re.S).group(1)
+    names = {}
+    value = 0
+    for name, number in re.findall(r"^\s*TRACE_(\w+)\s*(?:=\s*(\w+))?\s*,?", body, re.M):
+        value = int(number, 0) if number else value + 1
+        names[value] = name.lower()
+    return names
+
+
+class Dump:
+    def __init__(self, ticks_per_ms, lost, entries):
+        self.ticks_per_ms = ticks_per_ms
+        self.lost = lost
+        self.entries = entries  # [(id, ticks)], oldest first
+
+    def times_us(self):
+        """Each entry's time from the first, in microseconds, the 16-bit count unwrapped"""
+        times = []
+        total = 0
+        for i, (_, ticks) in enumerate(self.entries):
+            if i:
+                total += (ticks - self.entries[i - 1][1]) & 0xFFFF
+            times.append(total * 1000.0 / self.ticks_per_ms)
+        return times
+
+
+def parse_frames(data):
+    """Returns (dumps, damaged) for the dump frames found in data; anything else is skipped"""
+    dumps = []
+    damaged = 0
+    start = 0
+    while True:
+        start = data.find(bytes([FRAME_START, FRAME_DUMP]), start)
+        if start < 0 or start + 2 + HEADER.size > len(data):
+            return dumps, damaged
+        ticks_per_ms, lost, count = HEADER.unpack_from(data, start + 2)
+        end = start + 2 + HEADER.size + count * ENTRY.size
+        if end + 2 > len(data):
+            return dumps, damaged
+        (crc,) = struct.unpack_from("<H", data, end)
+        if ticks_per_ms and crc == crc16(data[start + 1:end]):
+            entries = [ENTRY.unpack_from(data, start + 2 + HEADER.size + i * ENTRY.size) for i in range(count)]
+            dumps.append(Dump(ticks_per_ms, lost, entries))
+            start = end + 2
+        else:
+            damaged += 1
+            start += 1
+
+
+def request_dump(port, save=None):
+    """Sends X and returns the Dump that comes back before the OK"""
+    port.write(frame_command("X"))
+    data = b""
+    deadline = time.monotonic() + REPLY_TIMEOUT
+    while time.monotonic() < deadline:
+        data += port.read(256)
+        dumps, _ = parse_frames(data)
+        if dumps and b"OK" in data[data.rfind(bytes([FRAME_START, FRAME_DUMP])):]:
+            if save:
+                save.write(data)
+            return dumps[0]
+        err = data.find(b"ERR")
+        if err >= 0 and not dumps and b"\n" in data[err:]:
+            line = data[err:].split(b"\r")[0].decode("ascii", "replace")
+            if line == "ERR command":
+                raise CommandError("X: not built in (TRACE_ENABLED 0)")
+            raise CommandError("X: %s" % line)
+    raise CommandError("X: no reply")
+
+
+def phases(dump, names):
+    """
+    Yields (name, start_us, duration_us, depth) for each phase whose start and end are both in the dump,
+    and (name, time_us, None, depth) for each interrupt
+    """
+    times = dump.times_us()
+    stack = []  # [(id, start_us)]
+    for (entry_id, _), t in zip(dump.entries, times):
+        if entry_id & END_FLAG:
+            begin = entry_id & ~END_FLAG
+            for i in range(len(stack) - 1, -1, -1):
+                if stack[i][0] == begin:
+                    yield names.get(begin, "#%d" % begin), stack[i][1], t - stack[i][1], i
+                    del stack[i:]
+                    break
+        elif entry_id < 0x20:
+            stack.append((entry_id, t))
+        else:
+            yield names.get(entry_id, "#%d" % entry_id), t, None, len(stack)
+
+
+def show_timeline(dump, names):
+    times = dump.times_us()
+    depth = 0
+    print("%10s  %s" % ("ms", "(Timer1 time from the first entry)"))
+    for (entry_id, _), t in zip(dump.entries, times):
+        base = entry_id & ~END_FLAG
+        name = names.get(base, "#%d" % base)
+        if entry_id & END_FLAG:
+            depth = max(depth - 1, 0)
+            print("%10.3f  %s%s end" % (t / 1000.0, "  " * depth, name))
+        elif entry_id < 0x20:
+            print("%10.3f  %s%s" % (t / 1000.0, "  " * depth, name))
+            depth += 1
+        else:
+            print("%10.3f  %s* %s" % (t / 1000.0, "  " * depth, name))
+
+
+def bucket(us):
+    """Power of 2 bucket of a duration: 0 for under 8us, then 8-16us, 16-32us..."""
+    b = 0
+    while us >= (8 << b):
+        b += 1
+    return b
+
+
+def bucket_label(b):
+    if b == 0:
+        return "<8us"
+    low = 8 << (b - 1)
+    return ("%dus" % low) if low < 1000 else ("%.3gms" % (low / 1000.0))
+
+
+def show_histograms(durations, interrupts, timer_us):
+    for name in sorted(durations, key=lambda n: -max(durations[n])):
+        values = durations[name]
+        print("%s: %d, min %.0fus mean %.0fus max %.0fus" % (
+            name, len(values), min(values), sum(values) / len(values), max(values)))
+        counts = {}
+        for us in values:
+            counts[bucket(us)] = counts.get(bucket(us), 0) + 1
+        most = max(counts.values())
+        for b in range(min(counts), max(counts) + 1):
+            n = counts.get(b, 0)
+            print("  %8s %6d %s" % (bucket_label(b), n, "#" * ((n * BAR_WIDTH + most - 1) // most)))
+    if interrupts:
+        print("interrupts (in %.1fms of Timer1 time):" % (timer_us / 1000.0))
+        for name in sorted(interrupts, key=lambda n: -interrupts[n]):
+            print("  %-12s %6d" % (name, interrupts[name]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", nargs="?")
+    parser.add_argument("--file", help="read dumps from this file instead of a port")
+    parser.add_argument("--dumps", type=int, default=1, help="dumps to take from the port")
+    parser.add_argument("--interval", type=float, default=5.0, help="seconds between dumps")
+    parser.add_argument("--save", help="append what the port sends to this file, for --file")
+    parser.add_argument("--no-timeline", action="store_true", help="only the histograms")
+    args = parser.parse_args()
+
+    if bool(args.port) == bool(args.file):
+        parser.error("give a port or --file")
+
+    names = read_names()
+    damaged = 0
+    if args.file:
+        with open(args.file, "rb") as f:
+            dumps, damaged = parse_frames(f.read())
+    else:
+        import serial  # pyserial
+        dumps = []
+        save = open(args.save, "ab") if args.save else None
+        port = serial.Serial(args.port, BAUD, timeout=0.1)
+        port.reset_input_buffer()
+        try:
+            for i in range(args.dumps):
+                if i:
+                    time.sleep(args.interval)
+                dumps.append(request_dump(port, save))
+        except CommandError as e:
+            print(e, file=sys.stderr)
+            if not dumps:
+                return 1
+        finally:
+            port.close()
+            if save:
+                save.close()
+
+    if not dumps:
+        print("no trace dumps found", file=sys.stderr)
+        return 1
+
+    durations = {}
+    interrupts = {}
+    timer_us = 0.0
+    for n, dump in enumerate(dumps):
+        if not args.no_timeline:
+            print("Dump %d: %d entries, %s lost before them" % (
+                n + 1, len(dump.entries), "255+" if dump.lost == 255 else dump.lost))
+            show_timeline(dump, names)
+            print()
+        if dump.entries:
+            timer_us += dump.times_us()[-1]
+        for name, _, duration, _ in phases(dump, names):
+            if duration is None:
+                interrupts[name] = interrupts.get(name, 0) + 1
+            else:
+                durations.setdefault(name, []).append(duration)
+
+    print("%d dumps, %d entries" % (len(dumps), sum(len(d.entries) for d in dumps)))
+    show_histograms(durations, interrupts, timer_us)
+    if damaged:
+        print("%d damaged frames skipped" % damaged)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
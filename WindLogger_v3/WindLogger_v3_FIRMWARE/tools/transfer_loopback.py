@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+"""
+transfer_loopback.py
+
+Test fixture for the serial file transfer, with no logger attached.
+
+A pseudo-terminal pair stands in for the serial cable. One end is a stand-in
+logger that answers "L" and "G" the way transfer.cpp does, paced to the
+byte rate of a real UART. The other end runs the same mirror code as
+logger_files.py. It reports the sustained throughput against the line rate
+and checks that the mirrored files match byte for byte.
+
+  python3 transfer_loopback.py                    (3 files of 200kB at 115200 baud)
+  python3 transfer_loopback.py --files 5 --size 1000000 --corrupt 50
+  python3 transfer_loopback.py --baud 0           (unpaced - tests the host side alone)
+
+--corrupt N damages one block in N, to check the resume path.
+Runs on Linux and macOS. No pyserial needed.
+"""
+
+import argparse
+import os
+import random
+import select
+import shutil
+import sys
+import tempfile
+import threading
+import time
+import tty
+
+from logger_link import BLOCK_SIZE, LoggerLink, block_frame, crc8
+from logger_files import mirror
+
+
+class PtyPort:
+    """Just enough of a serial port over a file descriptor"""
+
+    def __init__(self, fd, timeout=0.2):
+        self.fd = fd
+        self.timeout = timeout
+        self.pending = b""
+
+    def write(self, data):
+        view = memoryview(data)
+        while view:
+            written = os.write(self.fd, view)
+            view = view[written:]
+
+    def _fill(self):
+        ready, _, _ = select.select([self.fd], [], [], self.timeout)
+        if not ready:
+            return False
+        try:
+            self.pending += os.read(self.fd, 4096)
+        except OSError:
+            return False
+        return True
+
+    def read(self, count):
+        if not self.pending:
+            self._fill()
+        data, self.pending = self.pending[:count], self.pending[count:]
+        return data
+
+    def readline(self):
+        while b"\n" not in self.pending:
+            if not self._fill():
+                line, self.pending = self.pending, b""
+                return line
+        line, _, self.pending = self.pending.partition(b"\n")
+        return line + b"\n"
+
+
+class FakeLogger(threading.Thread):
+    """Answers L and G commands from files in a directory, as the firmware does"""
+
+    def __init__(self, port, directory, baud, corrupt):
+        super().__init__(daemon=True)
+        self.port = port
+        self.directory = directory
+        self.bytes_per_second = baud / 10.0 if baud else 0   # 8N1
+        self.corrupt = corrupt
+        self.random = random.Random(1)
+        self.sent = 0
+        self.started = None
+        self.stop = False
+
+    def send(self, data):
+        # Pace to the UART: never ahead of the bytes the line could have carried
+        if self.bytes_per_second:
+            if self.started is None:
+                self.started = time.monotonic()
+            for i in range(0, len(data), 64):
+                piece = data[i:i + 64]
+                due = self.started + (self.sent + len(piece)) / self.bytes_per_second
+                delay = due - time.monotonic()
+                if delay > 0:
+                    time.sleep(delay)
+                elif delay < -0.05:
+                    self.started -= delay  # Idle time doesn't bank credit
+                self.port.write(piece)
+                self.sent += len(piece)
+        else:
+            self.port.write(data)
+            self.sent += len(data)
+
+    def reply(self, text):
+        self.send(text.encode("ascii") + b"\r\n")
+
+    def read_command(self):
+        """Returns the body of the next "<body>*<crc>E" command, or None on a CRC error"""
+        body = b""
+        while not self.stop:
+            c = self.port.read(1)
+            if not c:
+                continue
+            if c == b"*":
+                crc = b""
+                while len(crc) < 2:
+                    crc += self.port.read(1)
+                while self.port.read(1) != b"E":
+                    pass
+                return body.decode("ascii") if int(crc, 16) == crc8(body) else None
+            if c in b"\r\n ":
+                continue
+            body += c
+        return None
+
+    def run(self):
+        while not self.stop:
+            body = self.read_command()
+            if body is None:
+                if not self.stop:
+                    self.reply("ERR crc")
+                continue
+            if body == "L":
+                for name in sorted(os.listdir(self.directory)):
+                    self.reply("%s,%d" % (name.upper(), os.path.getsize(os.path.join(self.directory, name))))
+                self.reply("OK")
+            elif body.startswith("G"):
+                self.transfer(body[1:])
+            else:
+                self.reply("ERR command")
+
+    def transfer(self, args):
+        fields = args.split(",")
+        digits = fields[0]
+        offset, length = ([int(f) for f in fields[1:]] + [0, 0])[:2]
+        path = os.path.join(self.directory, "D%s.csv" % digits)
+        if not os.path.exists(path) or offset > os.path.getsize(path):
+            self.reply("ERR file")
+            return
+        with open(path, "rb") as f:
+            data = f.read()
+        end = len(data) if not length else min(len(data), offset + length)
+        self.reply("OK")
+
+        while offset < end:
+            block = data[offset:offset + BLOCK_SIZE] if offset + BLOCK_SIZE <= end else data[offset:end]
+            frame = bytearray(block_frame(offset, block))
+            if self.corrupt and self.random.randrange(self.corrupt) == 0:
+                frame[10] ^= 0x55
+            self.send(bytes(frame))
+            offset += len(block)
+        self.send(block_frame(offset, b""))
+
+
+def make_files(directory, count, size, seed=2):
+    rng = random.Random(seed)
+    for day in range(count):
+        lines = []
+        length = 0
+        while length < size:
+            line = "07,%02d-10-2026,%02d:%02d:00,%d,%d,%d,%.2f\r\n" % (
+                day + 1, (length // 3000) % 24, (length // 50) % 60,
+                rng.randrange(500), rng.randrange(500), rng.randrange(8), 3.5 + rng.random())
+            lines.append(line)
+            length += len(line)
+        with open(os.path.join(directory, "D2610%02d.csv" % (day + 1)), "w", newline="") as f:
+            f.write("".join(lines)[:size])
+
+    # The day's data carries on in DYYMMDD1.csv after a change of fields
+    with open(os.path.join(directory, "D2610%02d1.csv" % count), "w", newline="") as f:
+        f.write("Ref, Date, Time, Wind 1, Wind 2, Batt V\r\n" + "07,extra,file\r\n" * (size // 100))
+
+
+def append_files(directory, count):
+    for name in sorted(os.listdir(directory)):
+        with open(os.path.join(directory, name), "a", newline="") as f:
+            f.write("07,extra,row\r\n" * count)
+
+
+def compare(logger_dir, local_dir):
+    for name in sorted(os.listdir(logger_dir)):
+        with open(os.path.join(logger_dir, name), "rb") as a, open(os.path.join(local_dir, name), "rb") as b:
+            if a.read() != b.read():
+                return name
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--files", type=int, default=3)
+    parser.add_argument("--size", type=int, default=200000, help="bytes per file")
+    parser.add_argument("--baud", type=int, default=115200, help="0 = unpaced")
+    parser.add_argument("--corrupt", type=int, default=0, help="damage one block in N")
+    args = parser.parse_args()
+
+    work = tempfile.mkdtemp(prefix="xfer_")
+    logger_dir = os.path.join(work, "card")
+    local_dir = os.path.join(work, "mirror")
+    os.makedirs(logger_dir)
+    make_files(logger_dir, args.files, args.size)
+
+    master, slave = os.openpty()
+    tty.setraw(master)
+    tty.setraw(slave)
+
+    logger = FakeLogger(PtyPort(master), logger_dir, args.baud, args.corrupt)
+    logger.start()
+    link = LoggerLink(PtyPort(slave), timeout=10.0)
+
+    failed = False
+    try:
+        line_rate = args.baud / 10.0
+        for run, label in ((0, "full mirror"), (1, "incremental mirror")):
+            if run:
+                append_files(logger_dir, 100)
+            logger.sent = 0
+            logger.started = None
+            start = time.monotonic()
+            fetched = mirror(link, local_dir, log=lambda s: None)
+            seconds = time.monotonic() - start
+            rate = fetched / seconds if seconds else 0
+            print("%-19s %9d bytes  %6.2fs  %8.0f bytes/s" % (label, fetched, seconds, rate), end="")
+            if line_rate:
+                print("  %5.1f%% of the line rate (%d bytes on the line)" % (100.0 * rate / line_rate, logger.sent))
+            else:
+                print()
+
+            bad = compare(logger_dir, local_dir)
+            if bad:
+                print("MISMATCH in %s" % bad)
+                failed = True
+    finally:
+        logger.stop = True
+        os.close(master)
+        os.close(slave)
+        shutil.rmtree(work)
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())